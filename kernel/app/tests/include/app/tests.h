@@ -15,6 +15,7 @@ __BEGIN_CDECLS
 
 int thread_tests(void);
 int sleep_tests(void);
+int timer_tests(void);
 int port_tests(void);
 void printf_tests(void);
 void clock_tests(void);
@@ -30,6 +31,8 @@ int hash_tests(int argc, const cmd_args *argv);
 int vm_tests(int argc, const cmd_args *argv);
 int auto_call_tests(int argc, const cmd_args *argv);
 int sync_ipi_tests(int argc, const cmd_args *argv);
+int sched_bench(int argc, const cmd_args *argv);
+int tlb_bench(int argc, const cmd_args *argv);
 int arena_tests(int argc, const cmd_args *argv);
 int fifo_tests(int argc, const cmd_args *argv);
 int alloc_checker_tests(int argc, const cmd_args* argv);
@@ -18,10 +18,13 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/float_instructions.S \
     $(LOCAL_DIR)/mem_tests.c \
     $(LOCAL_DIR)/printf_tests.c \
+    $(LOCAL_DIR)/sched_bench.c \
     $(LOCAL_DIR)/sync_ipi_tests.c \
     $(LOCAL_DIR)/sleep_tests.c \
     $(LOCAL_DIR)/tests.c \
     $(LOCAL_DIR)/thread_tests.c \
+    $(LOCAL_DIR)/timer_tests.c \
+    $(LOCAL_DIR)/tlb_bench.cpp \
     $(LOCAL_DIR)/alloc_checker_tests.cpp \
 
 
@@ -0,0 +1,143 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <debug.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <app/tests.h>
+#include <arch/ops.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <platform.h>
+
+/* Scheduler stress benchmark.
+ *
+ * Runs pairs of threads that ping-pong through a pair of events, so every
+ * round trip is two wakeups and two context switches. The run is repeated
+ * with one pair per cpu for 1..N cpus to show how the scheduler scales with
+ * core count, and once more with the pairs unpinned to exercise wakeup
+ * placement and work stealing.
+ */
+
+#define SCHED_BENCH_RUNTIME 1000 /* ms */
+
+struct pingpong {
+    event_t ping;
+    event_t pong;
+    volatile bool done;
+    volatile ulong round_trips;
+    thread_t *threads[2];
+};
+
+static struct pingpong pairs[SMP_MAX_CPUS];
+
+static int pinger(void *arg)
+{
+    struct pingpong *pp = arg;
+
+    while (!pp->done) {
+        event_signal(&pp->pong, true);
+        event_wait(&pp->ping);
+        pp->round_trips++;
+    }
+
+    return 0;
+}
+
+static int ponger(void *arg)
+{
+    struct pingpong *pp = arg;
+
+    while (!pp->done) {
+        event_wait(&pp->pong);
+        event_signal(&pp->ping, true);
+    }
+
+    return 0;
+}
+
+static ulong run_pairs(uint num_pairs, bool pinned)
+{
+    for (uint i = 0; i < num_pairs; i++) {
+        struct pingpong *pp = &pairs[i];
+
+        event_init(&pp->ping, false, EVENT_FLAG_AUTOUNSIGNAL);
+        event_init(&pp->pong, false, EVENT_FLAG_AUTOUNSIGNAL);
+        pp->done = false;
+        pp->round_trips = 0;
+        pp->threads[0] = thread_create("sched bench ping", &pinger, pp, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        pp->threads[1] = thread_create("sched bench pong", &ponger, pp, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        if (pinned) {
+            thread_set_pinned_cpu(pp->threads[0], i);
+            thread_set_pinned_cpu(pp->threads[1], i);
+        }
+    }
+
+    for (uint i = 0; i < num_pairs; i++) {
+        thread_resume(pairs[i].threads[1]);
+        thread_resume(pairs[i].threads[0]);
+    }
+
+    thread_sleep(SCHED_BENCH_RUNTIME);
+
+    ulong round_trips = 0;
+    for (uint i = 0; i < num_pairs; i++) {
+        struct pingpong *pp = &pairs[i];
+
+        round_trips += pp->round_trips;
+
+        /* kick both sides so whichever one is blocked notices done */
+        pp->done = true;
+        event_signal(&pp->ping, false);
+        event_signal(&pp->pong, false);
+
+        thread_join(pp->threads[0], NULL, INFINITE_TIME);
+        thread_join(pp->threads[1], NULL, INFINITE_TIME);
+        event_destroy(&pp->ping);
+        event_destroy(&pp->pong);
+    }
+
+    return round_trips;
+}
+
+static void report(const char *label, uint num_cpus, ulong round_trips)
+{
+    uint64_t switches = (uint64_t)round_trips * 2 * 1000 / SCHED_BENCH_RUNTIME;
+
+    printf("%-9s %2u cpus: %10" PRIu64 " context switches/sec, %10" PRIu64 " per cpu\n",
+           label, num_cpus, switches, switches / num_cpus);
+}
+
+int sched_bench(int argc, const cmd_args *argv)
+{
+    uint num_cpus = 0;
+    mp_cpu_mask_t active = mp_get_active_mask();
+
+    /* pinned runs place pair i on cpu i, so only use a dense prefix of active cpus */
+    while (num_cpus < SMP_MAX_CPUS && (active & (1u << num_cpus)))
+        num_cpus++;
+
+    if (num_cpus == 0)
+        return ERR_BAD_STATE;
+
+    printf("scheduler benchmark: event ping-pong, %u ms per run\n", SCHED_BENCH_RUNTIME);
+
+    for (uint n = 1; n <= num_cpus; n++)
+        report("pinned", n, run_pairs(n, true));
+
+    report("unpinned", num_cpus, run_pairs(num_cpus, false));
+
+#if THREAD_STATS && WITH_SMP
+    ulong steals = 0;
+    for (uint i = 0; i < num_cpus; i++)
+        steals += thread_stats[i].steals;
+    printf("run queue steals since boot: %lu\n", steals);
+#endif
+
+    return NO_ERROR;
+}
@@ -23,10 +23,13 @@ STATIC_COMMAND("printf_tests", "test printf", (console_cmd)&printf_tests)
 STATIC_COMMAND("thread_tests", "test the scheduler", (console_cmd)&thread_tests)
 STATIC_COMMAND("clock_tests", "test clocks", (console_cmd)&clock_tests)
 STATIC_COMMAND("sleep_tests", "tests sleep", (console_cmd)&sleep_tests)
+STATIC_COMMAND("timer_tests", "test kernel timers", (console_cmd)&timer_tests)
 STATIC_COMMAND("bench", "miscellaneous benchmarks", (console_cmd)&benchmarks)
 STATIC_COMMAND("fibo", "threaded fibonacci", (console_cmd)&fibo)
 STATIC_COMMAND("spinner", "create a spinning thread", (console_cmd)&spinner)
 STATIC_COMMAND("sync_ipi_tests", "test synchronous IPIs", (console_cmd)&sync_ipi_tests)
+STATIC_COMMAND("sched_bench", "scheduler context switch benchmark", (console_cmd)&sched_bench)
+STATIC_COMMAND("tlb_bench", "large page vs 4K page random access benchmark", (console_cmd)&tlb_bench)
 STATIC_COMMAND_END(tests);
 
 #endif
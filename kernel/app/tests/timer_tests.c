@@ -0,0 +1,135 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <rand.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <platform.h>
+#include <app/tests.h>
+
+#define NUM_TIMERS 1000
+#define MAX_DELAY 3000 /* ms, long enough to spread over two wheel levels */
+#define MAX_SLACK 50 /* ms */
+
+/* how late past its window a timer may fire before it counts as an error */
+#define LATENESS 20 /* ms */
+
+struct test_timer {
+    timer_t timer;
+    lk_time_t earliest;
+    lk_time_t latest;
+    volatile lk_time_t fired;
+    volatile int fire_count;
+    bool canceled;
+};
+
+static enum handler_return timer_test_callback(struct timer *t, lk_time_t now, void *arg)
+{
+    struct test_timer *tt = arg;
+
+    tt->fired = current_time();
+    tt->fire_count++;
+    return INT_NO_RESCHEDULE;
+}
+
+// Arms a pile of one-shot timers with random delays and slack, cancels some
+// of them and checks that the rest fire exactly once, inside their window.
+static int timer_window_test(void)
+{
+    struct test_timer *timers = calloc(NUM_TIMERS, sizeof(*timers));
+    if (!timers)
+        return 1;
+
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        struct test_timer *tt = &timers[i];
+        lk_time_t delay = 1 + rand() % MAX_DELAY;
+        lk_time_t slack = (i % 2) ? rand() % MAX_SLACK : 0;
+
+        timer_initialize(&tt->timer);
+        tt->earliest = current_time() + delay;
+        timer_set_oneshot_etc(&tt->timer, delay, slack, timer_test_callback, tt);
+        tt->latest = current_time() + delay + slack + 1;
+    }
+
+    for (int i = 0; i < NUM_TIMERS; i += 3) {
+        timer_cancel(&timers[i].timer);
+        timers[i].canceled = timers[i].fire_count == 0;
+    }
+
+    thread_sleep(MAX_DELAY + MAX_SLACK + LATENESS + 10);
+
+    int errors = 0;
+    int fired = 0;
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        struct test_timer *tt = &timers[i];
+
+        if (tt->canceled) {
+            if (tt->fire_count != 0) {
+                printf("timer %d fired after being canceled\n", i);
+                errors++;
+            }
+            continue;
+        }
+
+        if (tt->fire_count != 1) {
+            printf("timer %d fired %d times\n", i, tt->fire_count);
+            errors++;
+            continue;
+        }
+        fired++;
+
+        if (TIME_LT(tt->fired, tt->earliest)) {
+            printf("timer %d fired at %u, %u ms early\n", i, tt->fired, tt->earliest - tt->fired);
+            errors++;
+        } else if (TIME_GT(tt->fired, tt->latest + LATENESS)) {
+            printf("timer %d fired at %u, %u ms late\n", i, tt->fired, tt->fired - tt->latest);
+            errors++;
+        }
+    }
+
+    printf("timer window test: %d timers fired, %d errors\n", fired, errors);
+
+    free(timers);
+    return errors;
+}
+
+// Checks that a periodic timer keeps firing, and stops once canceled.
+static int timer_periodic_test(void)
+{
+    struct test_timer tt = {};
+
+    timer_initialize(&tt.timer);
+    timer_set_periodic(&tt.timer, 10, timer_test_callback, &tt);
+    thread_sleep(205);
+    timer_cancel(&tt.timer);
+
+    int count = tt.fire_count;
+    thread_sleep(50);
+
+    int errors = 0;
+    if (count < 15 || count > 21) {
+        printf("periodic timer fired %d times in 205 ms\n", count);
+        errors++;
+    }
+    if (tt.fire_count != count) {
+        printf("periodic timer fired after being canceled\n");
+        errors++;
+    }
+    return errors;
+}
+
+int timer_tests(void)
+{
+    int errors = 0;
+
+    errors += timer_window_test();
+    errors += timer_periodic_test();
+
+    printf("timer tests %s\n", errors ? "failed" : "passed");
+    return errors;
+}
@@ -0,0 +1,118 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <app/tests.h>
+#include <kernel/vm.h>
+#include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_object.h>
+#include <platform.h>
+
+// TLB reach benchmark.
+//
+// Maps one physically contiguous vm object into the kernel aspace twice:
+// once large page aligned, so the mapping is built from large pages, and
+// once shifted by a page, which forces 4K page table entries. Random reads
+// across each mapping then show how much of the access time is spent
+// walking page tables.
+
+static const size_t kDefaultSizeMB = 1024;
+static const size_t kMinSizeMB = 16;
+static const uint kAccesses = 16 * 1024 * 1024;
+
+// 2MB with 4K pages
+static const uint8_t kLargePageShift = PAGE_SIZE_SHIFT + PAGE_SIZE_SHIFT - 3;
+
+static uint64_t random_reads(const void* ptr, size_t len, uint64_t* sum) {
+    const volatile uint64_t* buf = static_cast<const volatile uint64_t*>(ptr);
+    const size_t words = len / sizeof(uint64_t);
+
+    // xorshift, cheap enough not to hide the cost of the loads
+    uint64_t x = 0x2545f4914f6cdd1dULL;
+    uint64_t s = 0;
+
+    lk_bigtime_t t = current_time_hires();
+    for (uint i = 0; i < kAccesses; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        s += buf[x % words];
+    }
+    t = current_time_hires() - t;
+
+    *sum += s;
+    return t;
+}
+
+static status_t map_vmo(mxtl::RefPtr<VmObject> vmo, const char* name, uint64_t offset, size_t len,
+                        void** ptr) {
+    return VmAspace::kernel_aspace()->MapObject(mxtl::move(vmo), name, offset, len, ptr,
+                                                kLargePageShift, 0, VMM_FLAG_COMMIT,
+                                                ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE);
+}
+
+int tlb_bench(int argc, const cmd_args* argv) {
+    size_t size_mb = (argc > 1) ? argv[1].u : kDefaultSizeMB;
+
+    // find the largest contiguous run we can get, halving down from the
+    // requested size
+    mxtl::RefPtr<VmObject> vmo;
+    for (; size_mb >= kMinSizeMB; size_mb /= 2) {
+        vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, size_mb * 1024 * 1024);
+        if (!vmo)
+            return ERR_NO_MEMORY;
+        uint64_t committed;
+        if (vmo->CommitRangeContiguous(0, size_mb * 1024 * 1024, &committed, kLargePageShift) == NO_ERROR)
+            break;
+        vmo.reset();
+    }
+    if (!vmo) {
+        printf("could not allocate %zu MB of contiguous memory\n", kMinSizeMB);
+        return ERR_NO_MEMORY;
+    }
+
+    const size_t size = size_mb * 1024 * 1024;
+    void* large_ptr;
+    void* small_ptr;
+    status_t status = map_vmo(vmo, "tlb bench large", 0, size, &large_ptr);
+    if (status != NO_ERROR)
+        return status;
+
+    // starting the second mapping a page into the object misaligns it
+    // against the large page boundaries so only 4K pages can be used
+    status = map_vmo(vmo, "tlb bench small", PAGE_SIZE, size - PAGE_SIZE, &small_ptr);
+    if (status != NO_ERROR) {
+        VmAspace::kernel_aspace()->FreeRegion(reinterpret_cast<vaddr_t>(large_ptr));
+        return status;
+    }
+
+    // both mappings cover the same memory so the data cache behaves the same
+    const size_t len = size - (1UL << kLargePageShift);
+    uint64_t sum = 0;
+
+    printf("tlb benchmark: %u random reads over %zu MB\n", kAccesses, len / (1024 * 1024));
+
+    // warm up both mappings once so neither run pays for first touch
+    random_reads(large_ptr, len, &sum);
+    random_reads(small_ptr, len, &sum);
+
+    uint64_t large_time = random_reads(large_ptr, len, &sum);
+    uint64_t small_time = random_reads(small_ptr, len, &sum);
+
+    printf("large pages: %10" PRIu64 " usecs, %" PRIu64 " ns/access\n",
+           large_time / 1000, large_time / kAccesses);
+    printf("4K pages:    %10" PRIu64 " usecs, %" PRIu64 " ns/access\n",
+           small_time / 1000, small_time / kAccesses);
+    printf("(checksum %#" PRIx64 ")\n", sum);
+
+    VmAspace::kernel_aspace()->FreeRegion(reinterpret_cast<vaddr_t>(small_ptr));
+    VmAspace::kernel_aspace()->FreeRegion(reinterpret_cast<vaddr_t>(large_ptr));
+
+    return NO_ERROR;
+}
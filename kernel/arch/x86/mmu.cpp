@@ -531,9 +531,8 @@ static bool level_supports_ps(page_table_levels level) {
         case PD_L:
             return true;
 #if X86_PAGING_LEVELS > 2
-        // TODO(teisenbe): Technically need to feature detect this
         case PDP_L:
-            return true;
+            return x86_feature_test(X86_FEATURE_HUGE_PAGE);
 #if X86_PAGING_LEVELS > 3
         case PML4_L:
             return false;
@@ -18,11 +18,42 @@ __BEGIN_CDECLS;
 
 #define MUTEX_MAGIC (0x6D757478)  // 'mutx'
 
+/* Contention statistics shared by a group of mutexes, e.g. all instances of
+ * one lock member. Mutexes without a class are accounted to a catch-all
+ * "unclassified" class. Counters are updated under the thread lock.
+ */
+typedef struct mutex_class {
+    const char *name;
+    struct mutex_class *next;   /* list of classes that have been used */
+    bool registered;
+
+    uint64_t acquisitions;
+    uint64_t contended;         /* acquisitions that found the mutex held */
+    uint64_t spins;             /* contended acquisitions that spun */
+    uint64_t spin_successes;    /* ... and got the mutex without blocking */
+    uint64_t blocks;
+    lk_bigtime_t block_time;    /* total nsecs spent blocked */
+} mutex_class_t;
+
+#define MUTEX_CLASS_INITIAL_VALUE(n) \
+{ \
+    .name = (n), \
+    .next = NULL, \
+    .registered = false, \
+    .acquisitions = 0, \
+    .contended = 0, \
+    .spins = 0, \
+    .spin_successes = 0, \
+    .blocks = 0, \
+    .block_time = 0, \
+}
+
 typedef struct mutex {
     uint32_t magic;
     thread_t *holder;
     int count;
     wait_queue_t wait;
+    mutex_class_t *cls;
 } mutex_t;
 
 #define MUTEX_INITIAL_VALUE(m) \
@@ -31,11 +62,25 @@ typedef struct mutex {
     .holder = NULL, \
     .count = 0, \
     .wait = WAIT_QUEUE_INITIAL_VALUE((m).wait), \
+    .cls = NULL, \
+}
+
+#define MUTEX_INITIAL_VALUE_CLASS(m, c) \
+{ \
+    .magic = MUTEX_MAGIC, \
+    .holder = NULL, \
+    .count = 0, \
+    .wait = WAIT_QUEUE_INITIAL_VALUE((m).wait), \
+    .cls = (c), \
 }
 
 /* Rules for Mutexes:
  * - Mutexes are only safe to use from thread context.
  * - Mutexes are non-recursive.
+ *
+ * On SMP, a thread that finds the mutex held by a thread running on another
+ * cpu spins for a short while before blocking, since short critical sections
+ * are usually over before a block and wakeup would be.
 */
 
 void mutex_init(mutex_t *);
@@ -43,6 +88,9 @@ void mutex_destroy(mutex_t *);
 status_t mutex_acquire(mutex_t *);
 void mutex_release(mutex_t *);
 
+/* print the contention statistics of every mutex class, optionally clearing them */
+void mutex_class_dump_stats(bool reset);
+
 /* Internal functions for use by condvar implementation. */
 status_t mutex_acquire_internal(mutex_t *m);
 void mutex_release_internal(mutex_t *m, bool reschedule);
@@ -86,6 +86,7 @@ typedef struct thread {
 #if WITH_SMP
     int curr_cpu;
     int pinned_cpu; /* only run on pinned_cpu if >= 0 */
+    int last_cpu; /* cpu this thread last ran on, -1 if it never ran */
 #endif
 
     /* pointer to the kernel address space this thread is associated with */
@@ -148,11 +149,15 @@ typedef struct thread {
 #define thread_pinned_cpu(t) ((t)->pinned_cpu)
 #define thread_set_curr_cpu(t,c) ((t)->curr_cpu = (c))
 #define thread_set_pinned_cpu(t, c) ((t)->pinned_cpu = (c))
+#define thread_last_cpu(t) ((t)->last_cpu)
+#define thread_set_last_cpu(t,c) ((t)->last_cpu = (c))
 #else
 #define thread_curr_cpu(t) (0)
 #define thread_pinned_cpu(t) (-1)
 #define thread_set_curr_cpu(t,c) do {} while(0)
 #define thread_set_pinned_cpu(t, c) do {} while(0)
+#define thread_last_cpu(t) (0)
+#define thread_set_last_cpu(t,c) do {} while(0)
 #endif
 
 /* thread priority */
@@ -256,6 +261,7 @@ struct thread_stats {
 
 #if WITH_SMP
     ulong reschedule_ipis;
+    ulong steals; /* threads pulled from another cpu's run queue */
 #endif
 };
 
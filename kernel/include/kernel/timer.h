@@ -27,6 +27,11 @@ typedef struct timer {
 
     lk_time_t scheduled_time;
     lk_time_t periodic_time;
+    lk_time_t slack;
+
+    /* where the timer is filed in the per cpu timer wheel */
+    uint wheel_cpu;
+    uint wheel_slot;
 
     timer_callback callback;
     void *arg;
@@ -38,6 +43,9 @@ typedef struct timer {
     .node = LIST_INITIAL_CLEARED_VALUE, \
     .scheduled_time = 0, \
     .periodic_time = 0, \
+    .slack = 0, \
+    .wheel_cpu = 0, \
+    .wheel_slot = 0, \
     .callback = NULL, \
     .arg = NULL, \
 }
@@ -50,8 +58,10 @@ typedef struct timer {
 */
 void timer_initialize(timer_t *);
 void timer_set_oneshot(timer_t *, lk_time_t delay, timer_callback, void *arg);
+void timer_set_oneshot_etc(timer_t *, lk_time_t delay, lk_time_t slack, timer_callback, void *arg);
 void timer_set_periodic(timer_t *, lk_time_t period, timer_callback, void *arg);
 void timer_cancel(timer_t *);
+void timer_cancel_sync(timer_t *);
 
 void timer_transition_off_cpu(uint old_cpu);
 void timer_thaw_percpu(void);
@@ -72,12 +72,28 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // Moves the committed pages backing [offset, offset + len) into a new object
+    // of |len| bytes. This object loses them and reads zeros there afterwards.
+    // |region| must be the only mapping of this object.
+    virtual status_t TakePages(uint64_t offset, uint64_t len, const VmRegion* region,
+                               mxtl::RefPtr<VmObject>* taken_vmo) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // create a copy-on-write clone of a range of the object
+    virtual status_t CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) {
+        return ERR_NOT_SUPPORTED;
+    }
+
     virtual void Dump(bool page_dump = false) {}
 
 protected:
     // private constructor (use Create())
     VmObject();
 
+    // for objects protected by another object's |lock|
+    explicit VmObject(Mutex& lock);
+
     // private destructor, only called from refptr
     virtual ~VmObject();
     friend mxtl::default_delete<VmObject>;
@@ -111,6 +127,9 @@ protected:
         return NO_ERROR;
     }
 
+    // whether pages have to be copied out to clones before being written
+    virtual bool HasClonesLocked() const { return false; }
+
     Mutex& lock() { return lock_; }
 
     void AddRegionLocked(VmRegion* r);
@@ -121,12 +140,15 @@ protected:
     uint32_t magic_ = MAGIC;
 
     // members
-    mutable Mutex lock_;
+    // |lock_| is |local_lock_| unless the object shares another one's lock
+    mutable Mutex local_lock_;
+    Mutex& lock_;
     mxtl::DoublyLinkedList<VmRegion*> region_list_;
 };
 
 // the main VM object type, holding a list of pages
-class VmObjectPaged final : public VmObject {
+class VmObjectPaged final : public VmObject,
+                            public mxtl::DoublyLinkedListable<VmObjectPaged*> {
 public:
     static mxtl::RefPtr<VmObject> Create(uint32_t pmm_alloc_flags, uint64_t size);
 
@@ -152,17 +174,36 @@ public:
 
     status_t Lookup(uint64_t offset, uint64_t len, user_ptr<paddr_t>, size_t) override;
 
+    // The clone is a snapshot of this object at [offset, offset + size) that
+    // starts out sharing its pages. A page is copied into the clone the first
+    // time either side writes to it, and before this object decommits it or
+    // shrinks past it. Pages past the end of this object are the clone's own
+    // and start out zero.
+    status_t CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) override;
+
+    // The range must be page aligned and fully committed, this object may not
+    // be shared with clones or mapped anywhere but |region|, and its pages'
+    // physical addresses must never have been handed out.
+    status_t TakePages(uint64_t offset, uint64_t len, const VmRegion* region,
+                       mxtl::RefPtr<VmObject>* taken_vmo) override;
+
     void Dump(bool page_dump = false) override;
 
     vm_page_t* GetPageLocked(uint64_t offset) override;
     vm_page_t* FaultPageLocked(uint64_t offset, uint pf_flags) override;
+    bool HasClonesLocked() const override;
 
 private:
     // private constructor (use Create())
     explicit VmObjectPaged(uint32_t pmm_alloc_flags);
 
+    // constructor for clones (use CloneCOW())
+    VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObjectPaged> parent,
+                  uint64_t parent_offset);
+
     // private destructor, only called from refptr
     ~VmObjectPaged() override;
+    friend mxtl::default_delete<VmObjectPaged>;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmObjectPaged);
 
@@ -172,6 +213,18 @@ private:
     // internal page list routine
     void AddPageToArray(size_t index, vm_page_t* p);
 
+    // find the page backing offset in this object or the nearest ancestor that
+    // has one, without allocating
+    vm_page_t* FindPageLocked(uint64_t offset);
+
+    // unmap the page at offset from the clones that see it through this
+    // object, after this object got a page of its own there
+    void UnmapClonesLocked(uint64_t offset);
+
+    // give every clone that sees the page at offset through this object a
+    // copy of what it sees there, before this object changes or drops it
+    status_t CopyPageToClonesLocked(uint64_t offset);
+
     // internal read/write routine that takes a templated copy function to help share some code
     template <typename T>
     status_t ReadWriteInternal(uint64_t offset, size_t len, size_t* bytes_copied, bool write,
@@ -188,8 +241,23 @@ private:
     uint64_t size_ = 0;
     uint32_t pmm_alloc_flags_ = PMM_ALLOC_FLAG_ANY;
 
+    // set once something outside the object may rely on where its pages are:
+    // they were looked up, allocated contiguously, or are kernel pages from
+    // CreateFromROData(). Such pages are never moved to another object.
+    bool pages_pinned_ = false;
+
     // a tree of pages
     VmPageList page_list_;
+
+    // the object this one was cloned from, if any. A clone shares its
+    // parent's lock, so a whole tree of clones is protected by the lock of
+    // the object at its root.
+    mxtl::RefPtr<VmObjectPaged> parent_;
+    uint64_t parent_offset_ = 0;
+
+    // live clones of this object. While there are any, regions map pages
+    // read-only so that writes fault and copy the page out to them first.
+    mxtl::DoublyLinkedList<VmObjectPaged*> children_list_;
 };
 
 // VMO representing a physical range of memory
@@ -75,6 +75,17 @@ private:
     // unmap any pages that map the passed in vmo range. May not intersect with this range
     status_t UnmapVmoRangeLocked(uint64_t start, uint64_t size);
 
+    // map a physically contiguous run of |count| pages, skipping pages that
+    // are already mapped
+    void MapRunLocked(vaddr_t va, paddr_t pa, size_t count);
+
+    // map the large page sized block around |va| if all of it is resident and
+    // contiguous with |pa|, the page backing |va|
+    bool MapLargePageLocked(vaddr_t va, paddr_t pa);
+
+    // map the faulting page at |va| along with the resident pages around it
+    status_t FaultAroundLocked(vaddr_t va, uint pf_flags);
+
     // magic value
     static const uint32_t MAGIC = 0x564d5247; // VMRG
     uint32_t magic_ = MAGIC;
@@ -93,5 +104,15 @@ private:
     mxtl::RefPtr<VmObject> object_;
     uint64_t object_offset_ = 0;
 
+    // fault statistics, protected by the object's lock
+    uint64_t faults_ = 0;
+    uint64_t fault_around_mapped_ = 0;
+    uint64_t fault_ahead_committed_ = 0;
+    uint64_t large_pages_mapped_ = 0;
+
+    // region offset where the last fault-around window ended, used to spot
+    // sequential access
+    size_t fault_around_end_ = SIZE_MAX;
+
     char name_[32];
 };
@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include <kernel/mutex.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/mp.h>
@@ -33,6 +34,7 @@ static int cmd_thread(int argc, const cmd_args *argv);
 static int cmd_threadstats(int argc, const cmd_args *argv);
 static int cmd_threadload(int argc, const cmd_args *argv);
 static int cmd_kill(int argc, const cmd_args *argv);
+static int cmd_lockstats(int argc, const cmd_args *argv);
 
 STATIC_COMMAND_START
 #if LK_DEBUGLEVEL > 1
@@ -43,6 +45,7 @@ STATIC_COMMAND("threadstats", "thread level statistics", &cmd_threadstats)
 STATIC_COMMAND("threadload", "toggle thread load display", &cmd_threadload)
 #endif
 STATIC_COMMAND("kill", "kill a thread", &cmd_kill)
+STATIC_COMMAND("lockstats", "mutex contention statistics per lock class", &cmd_lockstats)
 STATIC_COMMAND_END(kernel);
 
 #if LK_DEBUGLEVEL > 1
@@ -85,6 +88,7 @@ static int cmd_threadstats(int argc, const cmd_args *argv)
         printf("\treschedules: %lu\n", thread_stats[i].reschedules);
 #if WITH_SMP
         printf("\treschedule_ipis: %lu\n", thread_stats[i].reschedule_ipis);
+        printf("\trun queue steals: %lu\n", thread_stats[i].steals);
 #endif
         printf("\tcontext_switches: %lu\n", thread_stats[i].context_switches);
         printf("\tpreempts: %lu\n", thread_stats[i].preempts);
@@ -186,4 +190,20 @@ static int cmd_kill(int argc, const cmd_args *argv)
     return 0;
 }
 
+static int cmd_lockstats(int argc, const cmd_args *argv)
+{
+    bool reset = false;
+    if (argc >= 2) {
+        if (strcmp(argv[1].str, "reset")) {
+            printf("usage: %s [reset]\n", argv[0].str);
+            return -1;
+        }
+        reset = true;
+    }
+
+    mutex_class_dump_stats(reset);
+
+    return 0;
+}
+
 #endif // WITH_LIB_CONSOLE
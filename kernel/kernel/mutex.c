@@ -19,7 +19,31 @@
 #include <debug.h>
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <kernel/thread.h>
+#include <platform.h>
+
+/* how long to spin on a mutex whose holder is running before blocking */
+#define MUTEX_SPIN_MAX_NSECS 10000
+
+static mutex_class_t unclassified_class = MUTEX_CLASS_INITIAL_VALUE("unclassified");
+
+/* classes that have seen at least one acquisition, protected by thread_lock */
+static mutex_class_t *mutex_classes;
+
+static mutex_class_t *mutex_get_class(mutex_t *m)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    mutex_class_t *cls = m->cls ? m->cls : &unclassified_class;
+    if (unlikely(!cls->registered)) {
+        cls->registered = true;
+        cls->next = mutex_classes;
+        mutex_classes = cls;
+    }
+    return cls;
+}
 
 /**
  * @brief  Initialize a mutex_t
@@ -56,8 +80,15 @@ void mutex_destroy(mutex_t *m)
 
 status_t mutex_acquire_internal(mutex_t *m)
 {
+    mutex_class_t *cls = mutex_get_class(m);
+    cls->acquisitions++;
+
     if (unlikely(++m->count > 1)) {
+        cls->contended++;
+        cls->blocks++;
+        lk_bigtime_t start = current_time_hires();
         status_t ret = wait_queue_block(&m->wait, INFINITE_TIME);
+        cls->block_time += current_time_hires() - start;
         if (unlikely(ret < NO_ERROR)) {
             /* if there was a general error, it may have been destroyed out from
              * underneath us, so just exit (which is really an invalid state anyway)
@@ -71,6 +102,61 @@ status_t mutex_acquire_internal(mutex_t *m)
     return NO_ERROR;
 }
 
+#if WITH_SMP
+/* is the mutex held, with nobody queued, by a thread running on another cpu? */
+static bool mutex_should_spin(mutex_t *m)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    /* with waiters queued, a release hands the mutex to one of them, so
+     * spinning can't win it
+     */
+    if (m->count != 1)
+        return false;
+
+    thread_t *holder = m->holder;
+    return holder && holder->state == THREAD_RUNNING &&
+           thread_curr_cpu(holder) != (int)arch_curr_cpu_num();
+}
+
+/* Spin while the holder keeps running, for up to MUTEX_SPIN_MAX_NSECS.
+ * Called and returns with thread_lock held, but drops it while spinning.
+ * Returns with the mutex free if spinning succeeded.
+ */
+static void mutex_spin(mutex_t *m, spin_lock_saved_state_t *state)
+{
+    mutex_class_t *cls = mutex_get_class(m);
+    cls->spins++;
+
+    lk_bigtime_t deadline = current_time_hires() + MUTEX_SPIN_MAX_NSECS;
+    for (;;) {
+        thread_t *holder = m->holder;
+        spin_unlock_irqrestore(&thread_lock, *state);
+
+        /* only look at the mutex itself until something changes; the holder
+         * may go away once it has released the mutex
+         */
+        uint iterations = 0;
+        while (*(volatile int *)&m->count != 0 &&
+               *(thread_t * volatile *)&m->holder == holder) {
+            arch_spinloop_pause();
+            if ((++iterations & 0x3f) == 0 && current_time_hires() >= deadline)
+                break;
+        }
+
+        spin_lock_irqsave(&thread_lock, *state);
+
+        if (m->count == 0) {
+            cls->spin_successes++;
+            return;
+        }
+        if (current_time_hires() >= deadline || !mutex_should_spin(m))
+            return;
+        /* the mutex changed hands to another running thread, keep going */
+    }
+}
+#endif
+
 /**
  * @brief  Acquire the mutex
  *
@@ -88,6 +174,13 @@ status_t mutex_acquire(mutex_t *m)
 #endif
 
     THREAD_LOCK(state);
+#if WITH_SMP
+    if (unlikely(m->count > 0) && mutex_should_spin(m)) {
+        mutex_spin(m, &state);
+        if (m->count == 0)
+            mutex_get_class(m)->contended++;
+    }
+#endif
     status_t ret = mutex_acquire_internal(m);
     THREAD_UNLOCK(state);
     return ret;
@@ -123,3 +216,34 @@ void mutex_release(mutex_t *m)
     THREAD_UNLOCK(state);
 }
 
+void mutex_class_dump_stats(bool reset)
+{
+    THREAD_LOCK(state);
+    /* classes are never unregistered and are only pushed on the front, so the
+     * list can be walked without the lock once we have its head
+     */
+    mutex_class_t *head = mutex_classes;
+    THREAD_UNLOCK(state);
+
+    printf("%-32s %12s %10s %10s %10s %10s %14s\n", "class", "acquisitions", "contended",
+           "spins", "spin wins", "blocks", "block usecs");
+    for (mutex_class_t *cls = head; cls; cls = cls->next) {
+        printf("%-32s %12" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+               " %14" PRIu64 "\n",
+               cls->name, cls->acquisitions, cls->contended, cls->spins, cls->spin_successes,
+               cls->blocks, cls->block_time / 1000);
+    }
+
+    if (reset) {
+        THREAD_LOCK(state2);
+        for (mutex_class_t *cls = head; cls; cls = cls->next) {
+            cls->acquisitions = 0;
+            cls->contended = 0;
+            cls->spins = 0;
+            cls->spin_successes = 0;
+            cls->blocks = 0;
+            cls->block_time = 0;
+        }
+        THREAD_UNLOCK(state2);
+    }
+}
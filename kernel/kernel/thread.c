@@ -51,12 +51,21 @@ static struct list_node thread_list;
 /* master thread spinlock */
 spin_lock_t thread_lock = SPIN_LOCK_INITIAL_VALUE;
 
-/* the run queue */
-static struct list_node run_queue[NUM_PRIORITIES];
-static uint32_t run_queue_bitmap;
+/* the run queues, one set per cpu, protected by thread_lock like the rest
+ * of the scheduler state. Splitting them keeps threads on the cpu whose
+ * cache they warmed; it does not take any contention off thread_lock. */
+struct run_queue {
+    struct list_node list[NUM_PRIORITIES];
+    uint32_t bitmap;
+} __CPU_ALIGN;
+
+static struct run_queue run_queue[SMP_MAX_CPUS];
+
+/* priority of the thread each cpu is running, -1 while it is idle */
+static int cpu_priority[SMP_MAX_CPUS];
 
 /* make sure the bitmap is large enough to cover our number of priorities */
-static_assert(NUM_PRIORITIES <= sizeof(run_queue_bitmap) * 8, "");
+static_assert(NUM_PRIORITIES <= sizeof(run_queue[0].bitmap) * 8, "");
 
 /* the idle thread(s) (statically allocated) */
 #if WITH_SMP
@@ -80,7 +89,89 @@ static timer_t preempt_timer[SMP_MAX_CPUS];
 #endif
 
 /* run queue manipulation */
-static void insert_in_run_queue_head(thread_t *t)
+static inline int run_queue_top_priority(uint32_t bitmap)
+{
+    if (bitmap == 0)
+        return -1;
+
+    return HIGHEST_PRIORITY - __builtin_clz(bitmap) - (sizeof(bitmap) * 8 - NUM_PRIORITIES);
+}
+
+/* pick the cpu whose run queue a newly ready thread goes on.
+ *
+ * Pinned threads always go to their cpu, and a thread being put back by its own
+ * cpu stays local. Otherwise prefer the cpu the thread last ran on if it is idle,
+ * since its cache is most likely still warm, then an idle cpu with nothing queued
+ * yet, so that a burst of wakeups spreads out instead of piling onto the one cpu
+ * that has not left its idle loop yet, then any idle cpu. With every cpu busy the
+ * thread goes to the one running the lowest priority work if that is below the
+ * thread's own priority, the caller's reschedule IPI then makes it preempt there.
+ * Only when nothing can be preempted does it queue behind its last cpu.
+ */
+static uint find_cpu_for_thread(thread_t *t)
+{
+#if WITH_SMP
+    uint local_cpu = arch_curr_cpu_num();
+
+    if (t->pinned_cpu >= 0)
+        return t->pinned_cpu;
+
+    if (t == get_current_thread())
+        return local_cpu;
+
+    mp_cpu_mask_t active = mp_get_active_mask();
+    mp_cpu_mask_t idle = mp_get_idle_mask() & active;
+    int last_cpu = t->last_cpu;
+
+    if (last_cpu >= 0 && (idle & (1u << last_cpu)) && run_queue[last_cpu].bitmap == 0)
+        return last_cpu;
+
+    for (mp_cpu_mask_t mask = idle; mask; mask &= mask - 1) {
+        uint cpu = __builtin_ctz(mask);
+        if (run_queue[cpu].bitmap == 0)
+            return cpu;
+    }
+
+    if (idle) {
+        if (last_cpu >= 0 && (idle & (1u << last_cpu)))
+            return last_cpu;
+        return __builtin_ctz(idle);
+    }
+
+    /* everyone is busy, find the cpu running the lowest priority, keeping
+     * the last cpu on a tie */
+    int best_cpu = (last_cpu >= 0 && (active & (1u << last_cpu))) ? last_cpu : (int)local_cpu;
+    int best_priority = cpu_priority[best_cpu];
+    for (mp_cpu_mask_t mask = active; mask; mask &= mask - 1) {
+        uint cpu = __builtin_ctz(mask);
+        if (cpu_priority[cpu] < best_priority) {
+            best_cpu = cpu;
+            best_priority = cpu_priority[cpu];
+        }
+    }
+    if (best_priority < t->priority)
+        return best_cpu;
+
+    if (last_cpu >= 0 && (active & (1u << last_cpu)))
+        return last_cpu;
+
+    return local_cpu;
+#else
+    return 0;
+#endif
+}
+
+static void run_queue_insert(struct run_queue *rq, thread_t *t, bool head)
+{
+    if (head)
+        list_add_head(&rq->list[t->priority], &t->queue_node);
+    else
+        list_add_tail(&rq->list[t->priority], &t->queue_node);
+    rq->bitmap |= (1u << t->priority);
+}
+
+/* returns the mask of the cpu the thread was queued on, for mp_reschedule() */
+static mp_cpu_mask_t insert_in_run_queue_head(thread_t *t)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -88,11 +179,13 @@ static void insert_in_run_queue_head(thread_t *t)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    list_add_head(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    uint cpu = find_cpu_for_thread(t);
+    run_queue_insert(&run_queue[cpu], t, true);
+
+    return 1u << cpu;
 }
 
-static void insert_in_run_queue_tail(thread_t *t)
+static mp_cpu_mask_t insert_in_run_queue_tail(thread_t *t)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -100,8 +193,41 @@ static void insert_in_run_queue_tail(thread_t *t)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    list_add_tail(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    uint cpu = find_cpu_for_thread(t);
+    run_queue_insert(&run_queue[cpu], t, false);
+
+    return 1u << cpu;
+}
+
+/* remove and return the highest priority thread in a run queue that is
+ * allowed to run on cpu and has a priority above min_priority, or NULL if
+ * there is none */
+static thread_t *run_queue_pop(struct run_queue *rq, uint cpu, int min_priority)
+{
+    thread_t *t;
+    uint32_t bitmap;
+    int priority;
+
+    bitmap = rq->bitmap;
+    if (min_priority >= 0)
+        bitmap &= ~((2u << min_priority) - 1);
+    while ((priority = run_queue_top_priority(bitmap)) >= 0) {
+        list_for_every_entry(&rq->list[priority], t, thread_t, queue_node) {
+#if WITH_SMP
+            if (t->pinned_cpu < 0 || t->pinned_cpu == (int)cpu)
+#endif
+            {
+                list_delete(&t->queue_node);
+                if (list_is_empty(&rq->list[priority]))
+                    rq->bitmap &= ~(1u << priority);
+
+                return t;
+            }
+        }
+        bitmap &= ~(1u << priority);
+    }
+
+    return NULL;
 }
 
 static void init_thread_struct(thread_t *t, const char *name)
@@ -109,6 +235,7 @@ static void init_thread_struct(thread_t *t, const char *name)
     memset(t, 0, sizeof(thread_t));
     t->magic = THREAD_MAGIC;
     thread_set_pinned_cpu(t, -1);
+    thread_set_last_cpu(t, -1);
     strlcpy(t->name, name, sizeof(t->name));
     wait_queue_init(&t->retcode_wait_queue);
 }
@@ -296,13 +423,11 @@ status_t thread_resume(thread_t *t)
     THREAD_LOCK(state);
     if (t->state == THREAD_SUSPENDED) {
         t->state = THREAD_READY;
-        insert_in_run_queue_head(t);
+        mp_reschedule(insert_in_run_queue_head(t), 0);
         if (!ints_disabled) /* HACK, don't resced into bootstrap thread before idle thread is set up */
             resched = true;
     }
 
-    mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
-
     THREAD_UNLOCK(state);
 
     if (resched)
@@ -528,7 +653,7 @@ void thread_kill(thread_t *t, bool block)
             if (t->interruptable) {
                 t->state = THREAD_READY;
                 t->blocked_status = ERR_INTERRUPTED;
-                insert_in_run_queue_head(t);
+                mp_reschedule(insert_in_run_queue_head(t), 0);
             }
             break;
         case THREAD_DEATH:
@@ -572,32 +697,45 @@ __NO_RETURN static int idle_thread_routine(void *arg)
         arch_idle();
 }
 
-static thread_t *get_top_thread(int cpu)
+/* pick the next thread to run on cpu.
+ *
+ * The local run queue is preferred, but a thread of strictly higher priority
+ * queued on another cpu is stolen instead so that priority order stays global.
+ * The other queues are scanned starting after this cpu so that cpus going idle
+ * at the same time do not all pick the same victim.
+ */
+static thread_t *get_top_thread(uint cpu)
 {
-    thread_t *newthread;
-    uint32_t local_run_queue_bitmap = run_queue_bitmap;
-
-    while (local_run_queue_bitmap) {
-        /* find the first (remaining) queue with a thread in it */
-        uint next_queue = HIGHEST_PRIORITY - __builtin_clz(local_run_queue_bitmap)
-                          - (sizeof(run_queue_bitmap) * 8 - NUM_PRIORITIES);
+    thread_t *t;
 
-        list_for_every_entry(&run_queue[next_queue], newthread, thread_t, queue_node) {
 #if WITH_SMP
-            if (newthread->pinned_cpu < 0 || newthread->pinned_cpu == cpu)
-#endif
-            {
-                list_delete(&newthread->queue_node);
-
-                if (list_is_empty(&run_queue[next_queue]))
-                    run_queue_bitmap &= ~(1<<next_queue);
-
-                return newthread;
-            }
+    int top_priority = run_queue_top_priority(run_queue[cpu].bitmap);
+    uint num_cpus = arch_max_num_cpus();
+    struct run_queue *victim = NULL;
+    for (uint i = 1; i < num_cpus; i++) {
+        struct run_queue *rq = &run_queue[(cpu + i) % num_cpus];
+        int priority = run_queue_top_priority(rq->bitmap);
+        if (priority > top_priority) {
+            top_priority = priority;
+            victim = rq;
         }
+    }
 
-        local_run_queue_bitmap &= ~(1<<next_queue);
+    /* the thread found may be pinned elsewhere, then fall back to the local
+     * queue */
+    if (victim) {
+        t = run_queue_pop(victim, cpu, run_queue_top_priority(run_queue[cpu].bitmap));
+        if (t) {
+            THREAD_STATS_INC(steals);
+            return t;
+        }
     }
+#endif
+
+    t = run_queue_pop(&run_queue[cpu], cpu, -1);
+    if (t)
+        return t;
+
     /* no threads to run, select the idle thread for this cpu */
     return idle_thread(cpu);
 }
@@ -649,6 +787,8 @@ static void thread_resched(void)
     /* mark the cpu ownership of the threads */
     thread_set_curr_cpu(oldthread, -1);
     thread_set_curr_cpu(newthread, cpu);
+    thread_set_last_cpu(newthread, cpu);
+    cpu_priority[cpu] = thread_is_idle(newthread) ? -1 : newthread->priority;
 
 #if WITH_SMP
     if (thread_is_idle(newthread)) {
@@ -858,8 +998,7 @@ static void thread_unblock(thread_t *t, bool resched)
     DEBUG_ASSERT(!thread_is_idle(t));
 
     t->state = THREAD_READY;
-    insert_in_run_queue_head(t);
-    mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+    mp_reschedule(insert_in_run_queue_head(t), 0);
     if (resched)
         thread_resched();
 }
@@ -895,7 +1034,7 @@ static enum handler_return thread_sleep_handler(timer_t *timer, lk_time_t now, v
 
     t->state = THREAD_READY;
     t->blocked_status = NO_ERROR;
-    insert_in_run_queue_head(t);
+    mp_reschedule(insert_in_run_queue_head(t), 0);
 
     spin_unlock(&thread_lock);
 
@@ -996,8 +1135,11 @@ void thread_init_early(void)
     DEBUG_ASSERT(arch_curr_cpu_num() == 0);
 
     /* initialize the run queues */
-    for (i=0; i < NUM_PRIORITIES; i++)
-        list_initialize(&run_queue[i]);
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        cpu_priority[cpu] = -1;
+        for (i=0; i < NUM_PRIORITIES; i++)
+            list_initialize(&run_queue[cpu].list[i]);
+    }
 
     /* initialize the thread list */
     list_initialize(&thread_list);
@@ -1389,8 +1531,7 @@ int wait_queue_wake_one(wait_queue_t *wait, bool reschedule, status_t wait_queue
             current_thread->state = THREAD_READY;
             insert_in_run_queue_head(current_thread);
         }
-        insert_in_run_queue_head(t);
-        mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+        mp_reschedule(insert_in_run_queue_head(t), 0);
         if (reschedule) {
             thread_resched();
         }
@@ -1437,6 +1578,7 @@ int wait_queue_wake_all(wait_queue_t *wait, bool reschedule, status_t wait_queue
     }
 
     /* pop all the threads off the wait queue into the run queue */
+    mp_cpu_mask_t cpus = 0;
     while ((t = list_remove_head_type(&wait->list, thread_t, queue_node))) {
         wait->count--;
         DEBUG_ASSERT(t->state == THREAD_BLOCKED);
@@ -1444,14 +1586,14 @@ int wait_queue_wake_all(wait_queue_t *wait, bool reschedule, status_t wait_queue
         t->blocked_status = wait_queue_error;
         t->blocking_wait_queue = NULL;
 
-        insert_in_run_queue_head(t);
+        cpus |= insert_in_run_queue_head(t);
         ret++;
     }
 
     DEBUG_ASSERT(wait->count == 0);
 
     if (ret > 0) {
-        mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+        mp_reschedule(cpus, 0);
         if (reschedule) {
             thread_resched();
         }
@@ -1512,8 +1654,7 @@ status_t thread_unblock_from_wait_queue(thread_t *t, status_t wait_queue_error)
     t->blocking_wait_queue = NULL;
     t->state = THREAD_READY;
     t->blocked_status = wait_queue_error;
-    insert_in_run_queue_head(t);
-    mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+    mp_reschedule(insert_in_run_queue_head(t), 0);
 
     return NO_ERROR;
 }
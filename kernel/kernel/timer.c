@@ -23,6 +23,7 @@
 #include <trace.h>
 #include <assert.h>
 #include <list.h>
+#include <arch/ops.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/spinlock.h>
@@ -31,10 +32,47 @@
 
 #define LOCAL_TRACE 0
 
+/* Each cpu keeps its pending timers in a hierarchical timing wheel.
+ *
+ * Level 0 has one slot per millisecond, and every level above it has slots
+ * TIMER_WHEEL_SLOTS times as wide as the one below. A timer is filed at the
+ * lowest level whose span covers its distance from the wheel clock, so
+ * inserting and canceling are O(1). When the wheel clock reaches a slot
+ * boundary of a higher level, the timers in the slot starting there are
+ * cascaded down and refiled against the new clock.
+ *
+ * A bitmap of occupied slots per level lets the tick handler skip straight
+ * to the next slot that needs attention instead of stepping the clock one
+ * millisecond at a time.
+ */
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1u << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_SHIFT(level) ((level) * TIMER_WHEEL_BITS)
+
+/* timers further out than this are parked in the last slot of the top level
+ * and refiled each time it cascades */
+#define TIMER_WHEEL_RANGE (1u << TIMER_WHEEL_SHIFT(TIMER_WHEEL_LEVELS))
+
 spin_lock_t timer_lock;
 
 struct timer_state {
-    struct list_node timer_queue;
+    /* every timer due before clk has been fired and every cascade at or
+     * before clk has been done; level 0 slot (clk & TIMER_WHEEL_MASK) holds
+     * the timers that are due now */
+    lk_time_t clk;
+    uint count;
+
+    /* when the hardware one-shot is due to fire, if armed */
+    bool armed;
+    lk_time_t armed_time;
+
+    /* timer whose callback this cpu is running, see timer_cancel_sync() */
+    timer_t *running;
+
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+    struct list_node wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
 } __CPU_ALIGN;
 
 static struct timer_state timers[SMP_MAX_CPUS];
@@ -49,30 +87,181 @@ void timer_initialize(timer_t *timer)
     *timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
 }
 
+static inline uint64_t rotate_right(uint64_t bits, uint shift)
+{
+    return shift ? (bits >> shift) | (bits << (64 - shift)) : bits;
+}
+
+/* Pick the time in [deadline, deadline + slack] with the most trailing zero
+ * bits, so timers with overlapping windows land on the same millisecond and
+ * are fired by the same hardware interrupt.
+ */
+static lk_time_t timer_coalesce(lk_time_t deadline, lk_time_t slack)
+{
+    lk_time_t latest = deadline + slack;
+
+    if (slack == 0 || latest < deadline)
+        return deadline;
+
+    /* keep the bits above the highest one that differs between the two
+     * ends of the window, set that one and clear everything below it */
+    lk_time_t mask = (1u << (31 - __builtin_clz(latest ^ deadline))) - 1;
+    return latest & ~mask;
+}
+
 static void insert_timer_in_queue(uint cpu, timer_t *timer)
 {
-    timer_t *entry;
+    struct timer_state *ts = &timers[cpu];
+    lk_time_t expires = timer->scheduled_time;
+    uint level = 0;
+    uint index;
 
     DEBUG_ASSERT(arch_ints_disabled());
 
     LTRACEF("timer %p, cpu %u, scheduled %u, periodic %u\n", timer, cpu, timer->scheduled_time, timer->periodic_time);
 
-    list_for_every_entry(&timers[cpu].timer_queue, entry, timer_t, node) {
-        if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-            list_add_before(&entry->node, &timer->node);
-            return;
+    /* an empty wheel may not have been advanced in a long time, bring it up
+     * to date so the new timer is filed against the current time */
+    if (ts->count == 0) {
+        lk_time_t now = current_time();
+        if (TIME_LT(ts->clk, now))
+            ts->clk = now;
+    }
+
+    if (TIME_LTE(expires, ts->clk)) {
+        /* already due, put it in the slot being processed */
+        index = ts->clk & TIMER_WHEEL_MASK;
+    } else {
+        lk_time_t delta = expires - ts->clk;
+        if (delta >= TIMER_WHEEL_RANGE) {
+            delta = TIMER_WHEEL_RANGE - 1;
+            expires = ts->clk + delta;
+        }
+        while (delta >= (TIMER_WHEEL_SLOTS << TIMER_WHEEL_SHIFT(level)))
+            level++;
+        index = (expires >> TIMER_WHEEL_SHIFT(level)) & TIMER_WHEEL_MASK;
+    }
+
+    timer->wheel_cpu = cpu;
+    timer->wheel_slot = level * TIMER_WHEEL_SLOTS + index;
+    list_add_tail(&ts->wheel[level][index], &timer->node);
+    ts->occupied[level] |= 1ull << index;
+    ts->count++;
+}
+
+static void remove_timer_from_queue(timer_t *timer)
+{
+    struct timer_state *ts = &timers[timer->wheel_cpu];
+    uint level = timer->wheel_slot / TIMER_WHEEL_SLOTS;
+    uint index = timer->wheel_slot % TIMER_WHEEL_SLOTS;
+
+    DEBUG_ASSERT(list_in_list(&timer->node));
+
+    list_delete(&timer->node);
+    if (list_is_empty(&ts->wheel[level][index]))
+        ts->occupied[level] &= ~(1ull << index);
+    ts->count--;
+}
+
+/* Find how far past the wheel clock the next slot that needs attention is,
+ * either a level 0 slot with timers in it or a higher level slot that has to
+ * be cascaded. Returns false if the wheel is empty.
+ */
+static bool wheel_next_event(const struct timer_state *ts, lk_time_t *delta)
+{
+    bool found = false;
+
+    for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint64_t occupied = ts->occupied[level];
+        if (occupied == 0)
+            continue;
+
+        uint shift = TIMER_WHEEL_SHIFT(level);
+        uint64_t rotated = rotate_right(occupied, (ts->clk >> shift) & TIMER_WHEEL_MASK);
+        uint slots;
+        if (level == 0 && (rotated & 1)) {
+            slots = 0;
+        } else if (rotated & ~1ull) {
+            slots = __builtin_ctzll(rotated & ~1ull);
+        } else {
+            /* the current slot of a higher level has already been cascaded,
+             * anything in it is a full turn of the wheel away */
+            slots = TIMER_WHEEL_SLOTS;
+        }
+
+        lk_time_t when = ((ts->clk >> shift) + slots) << shift;
+        if (!found || when - ts->clk < *delta) {
+            *delta = when - ts->clk;
+            found = true;
         }
     }
 
-    /* walked off the end of the list */
-    list_add_tail(&timers[cpu].timer_queue, &timer->node);
+    return found;
 }
 
-static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_callback callback, void *arg)
+/* refile the timers of every higher level slot that starts at the wheel clock */
+static void wheel_cascade(uint cpu)
+{
+    struct timer_state *ts = &timers[cpu];
+
+    for (uint level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        uint shift = TIMER_WHEEL_SHIFT(level);
+        if (ts->clk & ((1u << shift) - 1))
+            break;
+
+        uint index = (ts->clk >> shift) & TIMER_WHEEL_MASK;
+        if (!(ts->occupied[level] & (1ull << index)))
+            continue;
+
+        /* detach the slot first, parked timers may be refiled into it */
+        struct list_node pending = LIST_INITIAL_VALUE(pending);
+        timer_t *timer;
+        while ((timer = list_remove_head_type(&ts->wheel[level][index], timer_t, node)) != NULL)
+            list_add_tail(&pending, &timer->node);
+        ts->occupied[level] &= ~(1ull << index);
+
+        /* these are still counted, so the refiling never sees an empty
+         * wheel and moves the clock out from under us */
+        while ((timer = list_remove_head_type(&pending, timer_t, node)) != NULL) {
+            insert_timer_in_queue(cpu, timer);
+            ts->count--;
+        }
+    }
+}
+
+#if PLATFORM_HAS_DYNAMIC_TIMER
+static void timer_arm(struct timer_state *ts, lk_time_t when, lk_time_t now)
+{
+    lk_time_t delay = TIME_GT(when, now) ? when - now : 0;
+
+    ts->armed = true;
+    ts->armed_time = when;
+
+    LTRACEF("setting new timer for %u msecs\n", (uint)delay);
+    platform_set_oneshot_timer(timer_tick, NULL, delay);
+}
+
+/* program the hardware for the next event on the current cpu's wheel */
+static void timer_reprogram(struct timer_state *ts, lk_time_t now)
+{
+    lk_time_t delta;
+
+    if (wheel_next_event(ts, &delta)) {
+        timer_arm(ts, ts->clk + delta, now);
+    } else if (ts->armed) {
+        LTRACEF("clearing old hw timer, nothing in the queue\n");
+        ts->armed = false;
+        platform_stop_timer();
+    }
+}
+#endif
+
+static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, lk_time_t slack,
+                      timer_callback callback, void *arg)
 {
     lk_time_t now;
 
-    LTRACEF("timer %p, delay %u, period %u, callback %p, arg %p\n", timer, delay, period, callback, arg);
+    LTRACEF("timer %p, delay %u, period %u, slack %u, callback %p, arg %p\n", timer, delay, period, slack, callback, arg);
 
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
@@ -84,8 +273,9 @@ static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_c
     delay += 1;
 
     now = current_time();
-    timer->scheduled_time = now + delay;
+    timer->scheduled_time = timer_coalesce(now + delay, slack);
     timer->periodic_time = period;
+    timer->slack = slack;
     timer->callback = callback;
     timer->arg = arg;
 
@@ -98,11 +288,12 @@ static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_c
     insert_timer_in_queue(cpu, timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    if (list_peek_head_type(&timers[cpu].timer_queue, timer_t, node) == timer) {
-        /* we just modified the head of the timer queue */
-        LTRACEF("setting new timer for %u msecs\n", delay);
-        platform_set_oneshot_timer(timer_tick, NULL, delay);
-    }
+    /* only touch the hardware if this timer is due before the interrupt that
+     * is already programmed, timers coalesced onto the same millisecond share
+     * a single one-shot */
+    struct timer_state *ts = &timers[cpu];
+    if (!ts->armed || TIME_LT(timer->scheduled_time, ts->armed_time))
+        timer_arm(ts, timer->scheduled_time, now);
 #endif
 
     spin_unlock_irqrestore(&timer_lock, state);
@@ -126,7 +317,28 @@ void timer_set_oneshot(timer_t *timer, lk_time_t delay, timer_callback callback,
 {
     if (delay == 0)
         delay = 1;
-    timer_set(timer, delay, 0, callback, arg);
+    timer_set(timer, delay, 0, 0, callback, arg);
+}
+
+/**
+ * @brief  Set up a timer that executes once, within a window
+ *
+ * Like timer_set_oneshot(), but the callback may be delayed by up to
+ * @a slack ms past the requested time so that it can share a hardware
+ * interrupt with other timers that expire around the same time.
+ *
+ * @param  timer The timer to use
+ * @param  delay The delay, in ms, before the timer is executed
+ * @param  slack How much later, in ms, the timer may be executed
+ * @param  callback  The function to call when the timer expires
+ * @param  arg  The argument to pass to the callback
+ */
+void timer_set_oneshot_etc(timer_t *timer, lk_time_t delay, lk_time_t slack,
+                           timer_callback callback, void *arg)
+{
+    if (delay == 0)
+        delay = 1;
+    timer_set(timer, delay, 0, slack, callback, arg);
 }
 
 /**
@@ -147,7 +359,7 @@ void timer_set_periodic(timer_t *timer, lk_time_t period, timer_callback callbac
 {
     if (period == 0)
         period = 1;
-    timer_set(timer, period, period, callback, arg);
+    timer_set(timer, period, period, 0, callback, arg);
 }
 
 /**
@@ -160,14 +372,18 @@ void timer_cancel(timer_t *timer)
     spin_lock_saved_state_t state;
     spin_lock_irqsave(&timer_lock, state);
 
-#if PLATFORM_HAS_DYNAMIC_TIMER
-    uint cpu = arch_curr_cpu_num();
+    if (list_in_list(&timer->node)) {
+        remove_timer_from_queue(timer);
 
-    timer_t *oldhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+#if PLATFORM_HAS_DYNAMIC_TIMER
+        /* if the hardware was programmed for this timer, move it out to the
+         * next event, or stop it if this cpu has nothing left pending */
+        struct timer_state *ts = &timers[timer->wheel_cpu];
+        if (timer->wheel_cpu == arch_curr_cpu_num() && ts->armed &&
+            (ts->count == 0 || ts->armed_time == timer->scheduled_time))
+            timer_reprogram(ts, current_time());
 #endif
-
-    if (list_in_list(&timer->node))
-        list_delete(&timer->node);
+    }
 
     /* to keep it from being reinserted into the queue if called from
      * periodic timer callback.
@@ -176,27 +392,37 @@ void timer_cancel(timer_t *timer)
     timer->callback = NULL;
     timer->arg = NULL;
 
-#if PLATFORM_HAS_DYNAMIC_TIMER
-    /* see if we've just modified the head of the timer queue */
-    timer_t *newhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-    if (newhead == NULL) {
-        LTRACEF("clearing old hw timer, nothing in the queue\n");
-        platform_stop_timer();
-    } else if (newhead != oldhead) {
-        lk_time_t delay;
-        lk_time_t now = current_time();
+    spin_unlock_irqrestore(&timer_lock, state);
+}
 
-        if (TIME_LT(newhead->scheduled_time, now))
-            delay = 0;
-        else
-            delay = newhead->scheduled_time - now;
+/**
+ * @brief  Cancel a pending timer and wait for its callback to finish
+ *
+ * Like timer_cancel(), but if the callback is running on another cpu this
+ * waits for it to return, after which the timer may be freed. Must not be
+ * called while holding anything the callback acquires. Calling it from the
+ * timer's own callback does not wait.
+ */
+void timer_cancel_sync(timer_t *timer)
+{
+    timer_cancel(timer);
 
-        LTRACEF("setting new timer to %u\n", (uint) delay);
-        platform_set_oneshot_timer(timer_tick, NULL, delay);
-    }
-#endif
+    for (;;) {
+        bool running = false;
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&timer_lock, state);
+        uint cpu = arch_curr_cpu_num();
+        for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+            if (i != cpu && timers[i].running == timer)
+                running = true;
+        }
+        spin_unlock_irqrestore(&timer_lock, state);
 
-    spin_unlock_irqrestore(&timer_lock, state);
+        if (!running)
+            break;
+        arch_spinloop_pause();
+    }
 }
 
 /* called at interrupt time to process any pending timers */
@@ -210,24 +436,38 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
     THREAD_STATS_INC(timer_ints);
 
     uint cpu = arch_curr_cpu_num();
+    struct timer_state *ts = &timers[cpu];
 
     LTRACEF("cpu %u now %u, sp %p\n", cpu, now, __GET_FRAME());
 
     spin_lock(&timer_lock);
 
-    for (;;) {
+    /* the one-shot that got us here has fired */
+    ts->armed = false;
+
+    while (TIME_LTE(ts->clk, now)) {
         /* see if there's an event to process */
-        timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-        if (likely(timer == 0))
-            break;
+        timer = list_peek_head_type(&ts->wheel[0][ts->clk & TIMER_WHEEL_MASK], timer_t, node);
+        if (timer == NULL) {
+            /* move the wheel up to the next slot that needs attention, or
+             * straight to now if nothing does before then */
+            lk_time_t delta;
+            if (ts->clk == now || !wheel_next_event(ts, &delta) || delta > now - ts->clk) {
+                ts->clk = now;
+                break;
+            }
+            ts->clk += delta;
+            wheel_cascade(cpu);
+            continue;
+        }
+
         LTRACEF("next item on timer queue %p at %u now %u (%p, arg %p)\n", timer, timer->scheduled_time, now, timer->callback, timer->arg);
-        if (likely(TIME_LT(now, timer->scheduled_time)))
-            break;
 
         /* process it */
         LTRACEF("timer %p\n", timer);
         DEBUG_ASSERT(timer && timer->magic == TIMER_MAGIC);
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
+        ts->running = timer;
 
         /* we pulled it off the list, release the list lock to handle it */
         spin_unlock(&timer_lock);
@@ -245,29 +485,21 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
         DEBUG_ASSERT(arch_ints_disabled());
         /* it may have been requeued or periodic, grab the lock so we can safely inspect it */
         spin_lock(&timer_lock);
+        ts->running = NULL;
 
         /* if it was a periodic timer and it hasn't been requeued
          * by the callback put it back in the list
          */
         if (periodic && !list_in_list(&timer->node) && timer->periodic_time > 0) {
             LTRACEF("periodic timer, period %u\n", timer->periodic_time);
-            timer->scheduled_time = now + timer->periodic_time;
+            timer->scheduled_time = timer_coalesce(now + timer->periodic_time, timer->slack);
             insert_timer_in_queue(cpu, timer);
         }
     }
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
     /* reset the timer to the next event */
-    timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-    if (timer) {
-        /* has to be the case or it would have fired already */
-        DEBUG_ASSERT(TIME_GT(timer->scheduled_time, now));
-
-        lk_time_t delay = timer->scheduled_time - now;
-
-        LTRACEF("setting new timer for %u msecs for event %p\n", (uint)delay, timer);
-        platform_set_oneshot_timer(timer_tick, NULL, delay);
-    }
+    timer_reprogram(ts, now);
 
     /* we're done manipulating the timer queue */
     spin_unlock(&timer_lock);
@@ -289,29 +521,23 @@ void timer_transition_off_cpu(uint old_cpu)
     spin_lock_saved_state_t state;
     spin_lock_irqsave(&timer_lock, state);
     uint cpu = arch_curr_cpu_num();
+    struct timer_state *old_ts = &timers[old_cpu];
 
-    timer_t *old_head = list_peek_head_type(&timers[old_cpu].timer_queue, timer_t, node);
-
-    timer_t *entry = NULL, *tmp_entry = NULL;
     /* Move all timers from old_cpu to this cpu */
-    list_for_every_entry_safe(&timers[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
-        insert_timer_in_queue(cpu, entry);
+    for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        while (old_ts->occupied[level]) {
+            uint index = __builtin_ctzll(old_ts->occupied[level]);
+            timer_t *entry;
+            while ((entry = list_remove_head_type(&old_ts->wheel[level][index], timer_t, node)) != NULL)
+                insert_timer_in_queue(cpu, entry);
+            old_ts->occupied[level] &= ~(1ull << index);
+        }
     }
+    old_ts->count = 0;
+    old_ts->armed = false;
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    timer_t *new_head = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-    if (new_head != NULL && new_head != old_head) {
-        lk_time_t now = current_time();
-        lk_time_t delay = 0;
-        if (TIME_LT(now, new_head->scheduled_time)) {
-            delay = new_head->scheduled_time - now;
-        }
-
-        /* we just modified the head of the timer queue */
-        LTRACEF("setting new timer for %u msecs\n", delay);
-        platform_set_oneshot_timer(timer_tick, NULL, delay);
-    }
+    timer_reprogram(&timers[cpu], current_time());
 #endif
 
     spin_unlock_irqrestore(&timer_lock, state);
@@ -326,17 +552,10 @@ void timer_thaw_percpu(void)
     spin_lock(&timer_lock);
 
     uint cpu = arch_curr_cpu_num();
+    struct timer_state *ts = &timers[cpu];
 
-    timer_t *t = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-    if (t) {
-        lk_time_t now = current_time();
-        lk_time_t delay = 0;
-        if (TIME_LT(now, t->scheduled_time)) {
-            delay = t->scheduled_time - now;
-        }
-        LTRACEF("rescheduling timer for %u msecs\n", delay);
-        platform_set_oneshot_timer(timer_tick, NULL, delay);
-    }
+    ts->armed = false;
+    timer_reprogram(ts, current_time());
 
     spin_unlock(&timer_lock);
 #endif
@@ -346,7 +565,10 @@ void timer_init(void)
 {
     timer_lock = SPIN_LOCK_INITIAL_VALUE;
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&timers[i].timer_queue);
+        for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            for (uint index = 0; index < TIMER_WHEEL_SLOTS; index++)
+                list_initialize(&timers[i].wheel[level][index]);
+        }
     }
 #if !PLATFORM_HAS_DYNAMIC_TIMER
     /* register for a periodic timer tick */
@@ -6,14 +6,17 @@
 // https://opensource.org/licenses/MIT
 
 #include "vm_priv.h"
+#include <arch/ops.h>
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 #include <kernel/vm.h>
 #include <lib/console.h>
 #include <list.h>
+#include <lk/init.h>
 #include <new.h>
 #include <pow2.h>
 #include <stdlib.h>
@@ -28,7 +31,38 @@
 
 // the main arena list
 static mxtl::DoublyLinkedList<PmmArena*> arena_list;
-static Mutex arena_lock;
+static mutex_class_t arena_lock_class = MUTEX_CLASS_INITIAL_VALUE("pmm arena_lock");
+static Mutex arena_lock(&arena_lock_class);
+
+// Each cpu keeps a magazine of free pages in front of the arenas so that
+// single page allocations and frees, which is what demand faults do, do not
+// serialize on |arena_lock|. A magazine is only touched by its own cpu with
+// interrupts disabled and is refilled (or drained) half a magazine at a time.
+// Only PMM_ALLOC_FLAG_ANY allocations are served from the magazines. Pages
+// sitting in a magazine are marked VM_PAGE_STATE_CACHED so that the range
+// and contiguous allocators skip over them.
+static const size_t kPageMagazineSize = 64;
+static const size_t kPageMagazineBatch = kPageMagazineSize / 2;
+
+struct PageMagazine {
+    size_t count;
+    vm_page_t* pages[kPageMagazineSize];
+    // statistics, dumped by 'pmm cache'
+    uint64_t hits;
+    uint64_t refills;
+    uint64_t drains;
+} __CPU_ALIGN;
+
+static PageMagazine page_magazines[SMP_MAX_CPUS];
+
+// the magazines are only used once per cpu state is available
+static bool page_magazines_enabled;
+
+static void pmm_cache_init(uint level) {
+    page_magazines_enabled = true;
+}
+
+LK_INIT_HOOK(pmm_cache, &pmm_cache_init, LK_INIT_LEVEL_THREADING);
 
 paddr_t vm_page_to_paddr(const vm_page_t* page) {
     for (const auto& a : arena_list) {
@@ -78,7 +112,120 @@ done_add:
     return NO_ERROR;
 }
 
+// allocate up to |count| pages from the arenas, arena_lock must be held
+static size_t alloc_pages_locked(size_t count, uint alloc_flags, struct list_node* list) {
+    /* walk the arenas in order, allocating as many pages as we can from each */
+    size_t allocated = 0;
+    for (auto& a : arena_list) {
+        DEBUG_ASSERT(count > allocated);
+
+        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
+        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
+            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
+                continue;
+        }
+
+        // ask the arena to allocate some pages
+        allocated += a.AllocPages(count - allocated, list);
+        DEBUG_ASSERT(allocated <= count);
+        if (allocated == count)
+            break;
+    }
+
+    return allocated;
+}
+
+// return a list of pages to their arenas, arena_lock must be held
+static size_t free_pages_locked(struct list_node* list) {
+    size_t count = 0;
+    while (!list_is_empty(list)) {
+        vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
+
+        DEBUG_ASSERT(!page_is_free(page));
+
+        /* see which arena this page belongs to and add it */
+        for (auto& a : arena_list) {
+            if (a.FreePage(page) >= 0) {
+                count++;
+                break;
+            }
+        }
+    }
+
+    return count;
+}
+
+// move up to |count| pages from the current cpu's magazine to |list|
+static size_t alloc_cached_pages(size_t count, struct list_node* list) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    PageMagazine* mag = &page_magazines[arch_curr_cpu_num()];
+    size_t allocated = 0;
+    while (allocated < count && mag->count > 0) {
+        vm_page_t* page = mag->pages[--mag->count];
+        DEBUG_ASSERT(page->state == VM_PAGE_STATE_CACHED);
+        page->state = VM_PAGE_STATE_ALLOC;
+        list_add_tail(list, &page->free.node);
+        allocated++;
+    }
+    mag->hits += allocated;
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    return allocated;
+}
+
+// the current cpu's magazine is empty, grab a batch of pages from the arenas,
+// return one and stash the rest in the magazine
+static vm_page_t* refill_page_magazine() {
+    list_node batch = LIST_INITIAL_VALUE(batch);
+    {
+        AutoLock al(arena_lock);
+        if (alloc_pages_locked(kPageMagazineBatch, PMM_ALLOC_FLAG_ANY, &batch) == 0)
+            return nullptr;
+    }
+
+    vm_page_t* page = list_remove_head_type(&batch, vm_page_t, free.node);
+
+    // we might have migrated, anything that does not fit in the magazine of
+    // whatever cpu we are on now goes back to the arenas
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    PageMagazine* mag = &page_magazines[arch_curr_cpu_num()];
+    mag->refills++;
+    while (mag->count < kPageMagazineSize && !list_is_empty(&batch)) {
+        vm_page_t* p = list_remove_head_type(&batch, vm_page_t, free.node);
+        p->state = VM_PAGE_STATE_CACHED;
+        mag->pages[mag->count++] = p;
+    }
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (!list_is_empty(&batch)) {
+        AutoLock al(arena_lock);
+        free_pages_locked(&batch);
+    }
+
+    return page;
+}
+
 vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
+    if (page_magazines_enabled && alloc_flags == PMM_ALLOC_FLAG_ANY) {
+        list_node list = LIST_INITIAL_VALUE(list);
+        vm_page_t* page;
+        if (alloc_cached_pages(1, &list) == 1) {
+            page = list_remove_head_type(&list, vm_page_t, free.node);
+        } else {
+            page = refill_page_magazine();
+            if (!page) {
+                LTRACEF("failed to allocate page\n");
+                return nullptr;
+            }
+        }
+
+        if (pa)
+            *pa = vm_page_to_paddr(page);
+        return page;
+    }
+
     AutoLock al(arena_lock);
 
     /* walk the arenas in order until we find one with a free page */
@@ -108,27 +255,18 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
     if (count == 0)
         return 0;
 
-    AutoLock al(arena_lock);
-
-    /* walk the arenas in order, allocating as many pages as we can from each */
+    /* small requests are served from the per cpu cache first, large ones go
+     * straight to the arenas which hand out contiguous runs where possible */
     size_t allocated = 0;
-    for (auto& a : arena_list) {
-        DEBUG_ASSERT(count > allocated);
-
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
-        }
-
-        // ask the arena to allocate some pages
-        allocated += a.AllocPages(count - allocated, list);
-        DEBUG_ASSERT(allocated <= count);
+    if (page_magazines_enabled && alloc_flags == PMM_ALLOC_FLAG_ANY && count <= kPageMagazineBatch) {
+        allocated = alloc_cached_pages(count, list);
         if (allocated == count)
-            break;
+            return allocated;
     }
 
-    return allocated;
+    AutoLock al(arena_lock);
+
+    return allocated + alloc_pages_locked(count - allocated, alloc_flags, list);
 }
 
 size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
@@ -264,24 +402,52 @@ size_t pmm_free(struct list_node* list) {
 
     DEBUG_ASSERT(list);
 
-    AutoLock al(arena_lock);
+    size_t count = 0;
+    list_node drain = LIST_INITIAL_VALUE(drain);
+
+    if (page_magazines_enabled) {
+        /* stash as much as fits in the current cpu's magazine. if it fills
+         * up, push its older half out to the arenas once to make room */
+        spin_lock_saved_state_t state;
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        PageMagazine* mag = &page_magazines[arch_curr_cpu_num()];
+        bool drained = false;
+        while (!list_is_empty(list)) {
+            if (mag->count == kPageMagazineSize) {
+                if (drained)
+                    break;
+                for (size_t i = 0; i < kPageMagazineBatch; i++)
+                    list_add_tail(&drain, &mag->pages[i]->free.node);
+                mag->count -= kPageMagazineBatch;
+                memmove(&mag->pages[0], &mag->pages[kPageMagazineBatch],
+                        mag->count * sizeof(mag->pages[0]));
+                mag->drains++;
+                drained = true;
+            }
 
-    uint count = 0;
-    while (!list_is_empty(list)) {
-        vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
+            vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
 
-        DEBUG_ASSERT(!page_is_free(page));
+            DEBUG_ASSERT(!page_is_free(page));
+            DEBUG_ASSERT(page->state != VM_PAGE_STATE_CACHED);
 
-        /* see which arena this page belongs to and add it */
-        for (auto& a : arena_list) {
-            if (a.FreePage(page) >= 0) {
-                count++;
-                break;
-            }
+            page->state = VM_PAGE_STATE_CACHED;
+            mag->pages[mag->count++] = page;
+            count++;
+        }
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+        if (list_is_empty(list) && list_is_empty(&drain)) {
+            LTRACEF("returning count %zu\n", count);
+            return count;
         }
     }
 
-    LTRACEF("returning count %u\n", count);
+    AutoLock al(arena_lock);
+
+    free_pages_locked(&drain);
+    count += free_pages_locked(list);
+
+    LTRACEF("returning count %zu\n", count);
 
     return count;
 }
@@ -302,6 +468,7 @@ static int cmd_pmm(int argc, const cmd_args* argv) {
     usage:
         printf("usage:\n");
         printf("%s arenas\n", argv[0].str);
+        printf("%s cache\n", argv[0].str);
         printf("%s alloc <count>\n", argv[0].str);
         printf("%s alloc_range <address> <count>\n", argv[0].str);
         printf("%s alloc_kpages <count>\n", argv[0].str);
@@ -317,6 +484,12 @@ static int cmd_pmm(int argc, const cmd_args* argv) {
         for (auto& a : arena_list) {
             a.Dump(false);
         }
+    } else if (!strcmp(argv[1].str, "cache")) {
+        for (uint i = 0; i < arch_max_num_cpus(); i++) {
+            const PageMagazine& mag = page_magazines[i];
+            printf("cpu %u: %zu cached, hits %" PRIu64 " refills %" PRIu64 " drains %" PRIu64 "\n",
+                   i, mag.count, mag.hits, mag.refills, mag.drains);
+        }
     } else if (!strcmp(argv[1].str, "alloc")) {
         if (argc < 3)
             goto notenoughargs;
@@ -93,24 +93,39 @@ vm_page_t* PmmArena::AllocSpecific(paddr_t pa) {
 
 size_t PmmArena::AllocPages(size_t count, list_node* list) {
     size_t allocated = 0;
+    const size_t page_count = size() / PAGE_SIZE;
 
     while (allocated < count) {
         vm_page_t* page = list_remove_head_type(&free_list_, vm_page_t, free.node);
         if (!page)
             return allocated;
 
-        LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page_address_from_arena(page));
+        /* take the free pages physically following the head of the free list
+         * along with it, so bulk allocations come out as contiguous runs
+         * where possible.
+         */
+        size_t index = page - page_array_;
+        for (;;) {
+            LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page_address_from_arena(page));
 
-        DEBUG_ASSERT(free_count_ > 0);
+            DEBUG_ASSERT(free_count_ > 0);
+
+            free_count_--;
 
-        free_count_--;
+            DEBUG_ASSERT(page_is_free(page));
 
-        DEBUG_ASSERT(page_is_free(page));
+            page->state = VM_PAGE_STATE_ALLOC;
+            list_add_tail(list, &page->free.node);
 
-        page->state = VM_PAGE_STATE_ALLOC;
-        list_add_tail(list, &page->free.node);
+            allocated++;
 
-        allocated++;
+            if (allocated == count || ++index == page_count)
+                break;
+            page = &page_array_[index];
+            if (!page_is_free(page))
+                break;
+            list_delete(&page->free.node);
+        }
     }
 
     return allocated;
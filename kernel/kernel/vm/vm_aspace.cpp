@@ -459,7 +459,15 @@ status_t VmAspace::MapObject(mxtl::RefPtr<VmObject> vmo, const char* name, uint6
         // allocate a virtual slot for it
         RegionTree::iterator after;
         vaddr_t base = (vmm_flags & VMM_FLAG_VALLOC_BASE) ? vaddr : 0;
-        vaddr = AllocSpot(base, size, align_pow2, min_alloc_gap, arch_mmu_flags);
+        vaddr = (vaddr_t)-1;
+        if (size >= VM_LARGE_PAGE_SIZE && IS_ALIGNED(offset, VM_LARGE_PAGE_SIZE) &&
+            align_pow2 < VM_LARGE_PAGE_SHIFT) {
+            // prefer a large page aligned spot so contiguous memory behind
+            // the region can be mapped with large pages
+            vaddr = AllocSpot(base, size, VM_LARGE_PAGE_SHIFT, min_alloc_gap, arch_mmu_flags);
+        }
+        if (vaddr == (vaddr_t)-1)
+            vaddr = AllocSpot(base, size, align_pow2, min_alloc_gap, arch_mmu_flags);
         LTRACEF_LEVEL(2, "alloc_spot returns %#" PRIxPTR "\n", vaddr);
 
         if (vaddr == (vaddr_t)-1) {
@@ -37,6 +37,9 @@ void ZeroPage(vm_page_t* p) {
     ZeroPage(pa);
 }
 
+// source for reads of pages nothing has committed
+const uint8_t kZeroPage[PAGE_SIZE] = {};
+
 } // namespace
 
 VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags)
@@ -44,12 +47,25 @@ VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags)
     LTRACEF("%p\n", this);
 }
 
+VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObjectPaged> parent,
+                             uint64_t parent_offset)
+    : VmObject(parent->lock_), pmm_alloc_flags_(pmm_alloc_flags),
+      parent_(mxtl::move(parent)), parent_offset_(parent_offset) {
+    LTRACEF("%p\n", this);
+}
+
 VmObjectPaged::~VmObjectPaged() {
     DEBUG_ASSERT(magic_ == MAGIC);
     LTRACEF("%p\n", this);
 
     // free all of the pages attached to us
     page_list_.FreeAllPages();
+
+    DEBUG_ASSERT(children_list_.is_empty());
+    if (parent_) {
+        AutoLock a(lock_);
+        parent_->children_list_.erase(*this);
+    }
 }
 
 mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size) {
@@ -73,6 +89,94 @@ mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t
     return vmo;
 }
 
+status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    LTRACEF("vmo %p offset %#" PRIx64 " size %#" PRIx64 "\n", this, offset, size);
+
+    if (!IS_PAGE_ALIGNED(offset))
+        return ERR_INVALID_ARGS;
+
+    // there's a max size to keep indexes within range
+    if (size > MAX_SIZE)
+        return ERR_OUT_OF_RANGE;
+
+    AllocChecker ac;
+    auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(
+        pmm_alloc_flags_, mxtl::RefPtr<VmObjectPaged>(this), offset));
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    AutoLock a(lock_);
+    vmo->size_ = size;
+    children_list_.push_back(vmo.get());
+
+    // writable mappings of the cloned range have to fault again, so that
+    // writes through them copy the page out to the clone first
+    if (offset < size_) {
+        uint64_t len = ROUNDUP_PAGE_SIZE(MIN(size, size_ - offset));
+        if (len > 0) {
+            for (auto& r : region_list_)
+                r.UnmapVmoRangeLocked(offset, len);
+        }
+    }
+
+    *clone_vmo = mxtl::move(vmo);
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::TakePages(uint64_t offset, uint64_t len, const VmRegion* region,
+                                  mxtl::RefPtr<VmObject>* taken_vmo) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    LTRACEF("vmo %p offset %#" PRIx64 " len %#" PRIx64 "\n", this, offset, len);
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len) || len == 0)
+        return ERR_INVALID_ARGS;
+
+    AllocChecker ac;
+    auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags_));
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    vmo->size_ = len;
+
+    AutoLock a(lock_);
+
+    // pages seen through a parent aren't ours to give away, clones or other
+    // mappings may have ours mapped, and a device may be using them
+    if (parent_ || !children_list_.is_empty() || pages_pinned_)
+        return ERR_BAD_STATE;
+    if (region_list_.size_slow() != 1 || &region_list_.front() != region)
+        return ERR_BAD_STATE;
+
+    if (offset + len < offset || offset + len > size_)
+        return ERR_OUT_OF_RANGE;
+
+    // add every page to the new object before removing any from this one, so
+    // running out of memory for page list nodes leaves this object untouched
+    for (uint64_t o = 0; o < len; o += PAGE_SIZE) {
+        vm_page_t* p = page_list_.GetPage(offset + o);
+        status_t status = p ? vmo->page_list_.AddPage(p, o) : ERR_NOT_FOUND;
+        if (status != NO_ERROR) {
+            while (o > 0) {
+                o -= PAGE_SIZE;
+                vmo->page_list_.RemovePage(o);
+            }
+            return status;
+        }
+    }
+
+    // unmap the range everywhere before the pages change hands
+    for (auto& r : region_list_) {
+        r.UnmapVmoRangeLocked(offset, len);
+    }
+
+    for (uint64_t o = 0; o < len; o += PAGE_SIZE) {
+        page_list_.RemovePage(offset + o);
+    }
+
+    *taken_vmo = mxtl::move(vmo);
+    return NO_ERROR;
+}
+
 void VmObjectPaged::Dump(bool page_dump) {
     if (magic_ != MAGIC) {
         printf("VmObjectPaged at %p has bad magic\n", this);
@@ -86,6 +190,8 @@ void VmObjectPaged::Dump(bool page_dump) {
 
     printf("\t\tobject %p: ref %d size %#" PRIx64 ", %zu allocated pages\n", this, ref_count_debug(), size_,
            count);
+    if (parent_)
+        printf("\t\tclone of %p at offset %#" PRIx64 "\n", parent_.get(), parent_offset_);
 
     if (page_dump) {
         auto f = [](const auto p, uint64_t offset) {
@@ -154,6 +260,8 @@ mxtl::RefPtr<VmObject> VmObjectPaged::CreateFromROData(const void* data, size_t
             vmo2->AddPage(page, count * PAGE_SIZE);
         }
 
+        static_cast<VmObjectPaged*>(vmo.get())->pages_pinned_ = true;
+
         // TODO(mcgrathr): If the last reference to this VMO were released
         // so the VMO got destroyed, that would attempt to return these
         // pages to the system.  On arm and arm64, the kernel cannot
@@ -185,10 +293,21 @@ vm_page_t* VmObjectPaged::FaultPageLocked(uint64_t offset, uint pf_flags) {
     if (offset >= size_)
         return nullptr;
 
+    // clones keep seeing what they see now once the page gets written
+    if ((pf_flags & VMM_PF_FLAG_WRITE) && CopyPageToClonesLocked(ROUNDDOWN(offset, PAGE_SIZE)) != NO_ERROR)
+        return nullptr;
+
     vm_page_t* p = page_list_.GetPage(offset);
     if (p)
         return p;
 
+    // a clone shares its ancestors' pages until it writes to them
+    vm_page_t* src = parent_ ? parent_->FindPageLocked(parent_offset_ + offset) : nullptr;
+    if (src && !(pf_flags & VMM_PF_FLAG_WRITE)) {
+        LTRACEF("sharing page %p from ancestor\n", src);
+        return src;
+    }
+
     // allocate a page
     paddr_t pa;
     p = pmm_alloc_page(pmm_alloc_flags_, &pa);
@@ -197,8 +316,20 @@ vm_page_t* VmObjectPaged::FaultPageLocked(uint64_t offset, uint pf_flags) {
 
     p->state = VM_PAGE_STATE_OBJECT;
 
-    // TODO: remove once pmm returns zeroed pages
-    ZeroPage(pa);
+    if (src) {
+        // ancestors copy pages out to us before freeing them, under the
+        // lock the whole tree of clones shares, so src is still valid
+        memcpy(paddr_to_kvaddr(pa), paddr_to_kvaddr(vm_page_to_paddr(src)), PAGE_SIZE);
+
+        // regions may still have the shared page mapped read-only, and so
+        // may the regions of clones that read it through us
+        for (auto& r : region_list_)
+            r.UnmapVmoRangeLocked(ROUNDDOWN(offset, PAGE_SIZE), PAGE_SIZE);
+        UnmapClonesLocked(ROUNDDOWN(offset, PAGE_SIZE));
+    } else {
+        // TODO: remove once pmm returns zeroed pages
+        ZeroPage(pa);
+    }
 
     __UNUSED auto status = page_list_.AddPage(p, offset);
     DEBUG_ASSERT(status == NO_ERROR);
@@ -208,6 +339,89 @@ vm_page_t* VmObjectPaged::FaultPageLocked(uint64_t offset, uint pf_flags) {
     return p;
 }
 
+vm_page_t* VmObjectPaged::FindPageLocked(uint64_t offset) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (offset >= size_)
+        return nullptr;
+
+    vm_page_t* p = page_list_.GetPage(offset);
+    if (p || !parent_)
+        return p;
+
+    return parent_->FindPageLocked(parent_offset_ + offset);
+}
+
+void VmObjectPaged::UnmapClonesLocked(uint64_t offset) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    for (auto& child : children_list_) {
+        if (offset < child.parent_offset_ || offset - child.parent_offset_ >= child.size_)
+            continue;
+        uint64_t child_offset = offset - child.parent_offset_;
+
+        // a clone with a page of its own there never mapped ours
+        if (child.page_list_.GetPage(child_offset))
+            continue;
+
+        for (auto& r : child.region_list_)
+            r.UnmapVmoRangeLocked(child_offset, PAGE_SIZE);
+        child.UnmapClonesLocked(child_offset);
+    }
+}
+
+status_t VmObjectPaged::CopyPageToClonesLocked(uint64_t offset) {
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
+
+    if (children_list_.is_empty())
+        return NO_ERROR;
+
+    vm_page_t* src = FindPageLocked(offset);
+
+    for (auto& child : children_list_) {
+        if (offset < child.parent_offset_ || offset - child.parent_offset_ >= child.size_)
+            continue;
+        uint64_t child_offset = offset - child.parent_offset_;
+
+        // a clone with a page of its own there doesn't see ours
+        if (child.page_list_.GetPage(child_offset))
+            continue;
+
+        paddr_t pa;
+        vm_page_t* p = pmm_alloc_page(child.pmm_alloc_flags_, &pa);
+        if (!p)
+            return ERR_NO_MEMORY;
+
+        p->state = VM_PAGE_STATE_OBJECT;
+
+        if (src) {
+            memcpy(paddr_to_kvaddr(pa), paddr_to_kvaddr(vm_page_to_paddr(src)), PAGE_SIZE);
+        } else {
+            ZeroPage(pa);
+        }
+
+        auto status = child.page_list_.AddPage(p, child_offset);
+        if (status != NO_ERROR) {
+            pmm_free_page(p);
+            return status;
+        }
+
+        // the clone and the clones reading through it may have src mapped
+        for (auto& r : child.region_list_)
+            r.UnmapVmoRangeLocked(child_offset, PAGE_SIZE);
+        child.UnmapClonesLocked(child_offset);
+    }
+
+    return NO_ERROR;
+}
+
+bool VmObjectPaged::HasClonesLocked() const {
+    DEBUG_ASSERT(lock_.IsHeld());
+    return !children_list_.is_empty();
+}
+
 status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* committed) {
     DEBUG_ASSERT(magic_ == MAGIC);
     LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -229,6 +443,19 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     uint64_t end = ROUNDUP_PAGE_SIZE(offset + len);
     DEBUG_ASSERT(end > offset);
 
+    // a clone has to copy its ancestors' pages in one at a time
+    if (parent_) {
+        for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
+            if (page_list_.GetPage(o))
+                continue;
+            if (!FaultPageLocked(o, VMM_PF_FLAG_WRITE))
+                return ERR_NO_MEMORY;
+            if (committed)
+                *committed += PAGE_SIZE;
+        }
+        return NO_ERROR;
+    }
+
     // make a pass through the list, counting the number of pages we need to allocate
     size_t count = 0;
     for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
@@ -275,6 +502,8 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     // for now we only support committing as much as we were asked for
     DEBUG_ASSERT(!committed || *committed == count * PAGE_SIZE);
 
+    pages_pinned_ = true;
+
     return NO_ERROR;
 }
 
@@ -288,6 +517,10 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
 
     AutoLock a(lock_);
 
+    // clones can not be backed by contiguous memory
+    if (parent_)
+        return ERR_NOT_SUPPORTED;
+
     // trim the size
     if (!TrimRange(offset, len, size_))
         return ERR_OUT_OF_RANGE;
@@ -372,6 +605,15 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
     LTRACEF("start offset %#" PRIx64 ", end %#" PRIx64 ", page_aliged_len %#" PRIx64 "\n", start, end,
             page_aligned_len);
 
+    // clones keep the pages we're about to free, as they see them now
+    for (uint64_t o = start; o < end; o += PAGE_SIZE) {
+        if (!page_list_.GetPage(o))
+            continue;
+        auto status = CopyPageToClonesLocked(o);
+        if (status != NO_ERROR)
+            return status;
+    }
+
     // unmap all of the pages in this range on all the mapping regions
     for (auto& r : region_list_) {
         // unmap any pages the region may have mapped that intersect this range
@@ -409,6 +651,13 @@ status_t VmObjectPaged::Resize(uint64_t s) {
 
         // we're only worried about whole pages to be removed
         if (page_aligned_len > 0) {
+            // clones keep what they see through us in the removed range
+            for (uint64_t o = start; o < end; o += PAGE_SIZE) {
+                auto status = CopyPageToClonesLocked(o);
+                if (status != NO_ERROR)
+                    return status;
+            }
+
             // unmap all of the pages in this range on all the mapping regions
             for (auto& r : region_list_) {
                 // unmap any pages the region may have mapped that intersect this range
@@ -454,14 +703,20 @@ status_t VmObjectPaged::ReadWriteInternal(uint64_t offset, size_t len, size_t* b
         size_t page_offset = offset % PAGE_SIZE;
         size_t tocopy = MIN(PAGE_SIZE - page_offset, len);
 
-        // fault in the page
-        vm_page_t* p = FaultPageLocked(offset, write ? VMM_PF_FLAG_WRITE : 0);
-        if (!p)
+        // fault in the page for writes; reads of a page that neither this
+        // object nor an ancestor has committed see zeros without committing
+        // one, so reading a sparse object doesn't fill it in
+        vm_page_t* p = write ? FaultPageLocked(offset, VMM_PF_FLAG_WRITE) : FindPageLocked(offset);
+        uint8_t* page_ptr;
+        if (p) {
+            // compute the kernel mapping of this page
+            paddr_t pa = vm_page_to_paddr(p);
+            page_ptr = reinterpret_cast<uint8_t*>(paddr_to_kvaddr(pa));
+        } else if (!write) {
+            page_ptr = const_cast<uint8_t*>(kZeroPage);
+        } else {
             return ERR_NO_MEMORY;
-
-        // compute the kernel mapping of this page
-        paddr_t pa = vm_page_to_paddr(p);
-        uint8_t* page_ptr = reinterpret_cast<uint8_t*>(paddr_to_kvaddr(pa));
+        }
 
         // call the copy routine
         auto err = copyfunc(page_ptr + page_offset, dest_offset, tocopy);
@@ -568,6 +823,9 @@ status_t VmObjectPaged::Lookup(uint64_t offset, uint64_t len, user_ptr<paddr_t>
     if (unlikely(table_size > buffer_size))
         return ERR_BUFFER_TOO_SMALL;
 
+    // the caller may hand the addresses to a device
+    pages_pinned_ = true;
+
     size_t index = 0;
     for (uint64_t off = start_page_offset; off != end_page_offset; off += PAGE_SIZE, index++) {
         // grab a pointer to the page only if it's already present
@@ -112,7 +112,7 @@ vm_page* VmPageList::GetPage(uint64_t offset) {
     return pln->GetPage(index);
 }
 
-status_t VmPageList::FreePage(uint64_t offset) {
+vm_page* VmPageList::RemovePage(uint64_t offset) {
     uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
 
@@ -122,10 +122,9 @@ status_t VmPageList::FreePage(uint64_t offset) {
     // lookup the tree node that holds this page
     auto pln = list_.find(node_offset);
     if (!pln.IsValid()) {
-        return ERR_NOT_FOUND;
+        return nullptr;
     }
 
-    // free this page
     auto page = pln->RemovePage(index);
     if (page) {
         // if it was the last page in the node, remove the node from the tree
@@ -133,10 +132,19 @@ status_t VmPageList::FreePage(uint64_t offset) {
             LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
             list_.erase(*pln);
         }
+    }
 
-        pmm_free_page(page);
+    return page;
+}
+
+status_t VmPageList::FreePage(uint64_t offset) {
+    auto page = RemovePage(offset);
+    if (!page) {
+        return ERR_NOT_FOUND;
     }
 
+    pmm_free_page(page);
+
     return NO_ERROR;
 }
 
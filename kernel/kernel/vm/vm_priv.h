@@ -25,6 +25,11 @@ extern uintptr_t boot_alloc_end;
 void vmm_init_preheap(void);
 void vmm_init(void);
 
+// size of the block the architecture can map with a single entry one level
+// above the last page table (2MB with 4K pages)
+#define VM_LARGE_PAGE_SHIFT (PAGE_SIZE_SHIFT + PAGE_SIZE_SHIFT - 3)
+#define VM_LARGE_PAGE_SIZE (1UL << VM_LARGE_PAGE_SHIFT)
+
 // global vmm lock (for now)
 extern mutex_t vmm_lock;
 
@@ -10,9 +10,11 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
+#include <lk/init.h>
 #include <mxtl/auto_lock.h>
 #include <mxtl/type_support.h>
 #include <new.h>
@@ -22,6 +24,30 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+// On a fault, resident pages in the aligned window of this many pages around
+// the faulting address are mapped along with it. 0 or 1 disables fault-around.
+// Can be set with the vm.fault_around kernel command line option.
+static size_t fault_around_pages = 16;
+
+// When a fault lands right after the previous fault-around window the access
+// pattern is treated as sequential and the whole next window is committed.
+// Can be turned off with vm.fault_ahead=false.
+static bool fault_ahead = true;
+
+// A fault in a fully resident, physically contiguous and suitably aligned
+// large page sized block maps the whole block at once, letting the arch
+// layer use a single large page entry. Can be turned off with
+// vm.large_pages=false.
+static bool large_pages = true;
+
+static void vm_region_init(uint level) {
+    fault_around_pages = cmdline_get_uint32("vm.fault_around", static_cast<uint32_t>(fault_around_pages));
+    fault_ahead = cmdline_get_bool("vm.fault_ahead", fault_ahead);
+    large_pages = cmdline_get_bool("vm.large_pages", large_pages);
+}
+
+LK_INIT_HOOK(vm_region, &vm_region_init, LK_INIT_LEVEL_VM);
+
 VmRegion::VmRegion(VmAspace& aspace, vaddr_t base, size_t size, mxtl::RefPtr<VmObject> vmo, uint64_t offset,
                    uint arch_mmu_flags, const char* name)
     : base_(base), size_(size), arch_mmu_flags_(arch_mmu_flags), aspace_(&aspace), object_(mxtl::move(vmo)),
@@ -75,6 +101,9 @@ void VmRegion::Dump() const {
            " size %#zx mmu_flags %#x vmo %p offset %#" PRIx64 "\n",
            this, ref_count_debug(), name_, base_, base_ + size_ - 1, size_, arch_mmu_flags_, object_.get(),
            object_offset_);
+    printf("\t\tfaults %" PRIu64 " fault-around pages %" PRIu64 " fault-ahead pages %" PRIu64
+           " large pages %" PRIu64 "\n",
+           faults_, fault_around_mapped_, fault_ahead_committed_, large_pages_mapped_);
     object_->Dump();
 }
 
@@ -144,7 +173,8 @@ status_t VmRegion::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) {
 
     LTRACEF("going to unmap %#" PRIxPTR ", len %#" PRIx64 "\n", unmap_base.ValueOrDie(), len_new);
 
-    return arch_mmu_unmap(&aspace_->arch_aspace(), unmap_base.ValueOrDie(), static_cast<size_t>(len_new));
+    return arch_mmu_unmap(&aspace_->arch_aspace(), unmap_base.ValueOrDie(),
+                          static_cast<size_t>(len_new / PAGE_SIZE));
 }
 
 status_t VmRegion::MapRange(size_t offset, size_t len, bool commit) {
@@ -158,35 +188,67 @@ status_t VmRegion::MapRange(size_t offset, size_t len, bool commit) {
     // grab the lock for the vmo
     AutoLock al(object_->lock());
 
-    // iterate through the range, grabbing a page from the underlying object and mapping it in
-    size_t o;
-    for (o = offset; o < offset + len; o += PAGE_SIZE) {
-        uint64_t vmo_offset = object_offset_ + o;
-
-        status_t status;
-        paddr_t pa;
-        if (commit) {
-            status = object_->FaultPageLocked(vmo_offset, VMM_PF_FLAG_WRITE, &pa);
-        } else {
-            status = object_->GetPageLocked(vmo_offset, &pa);
+    // iterate through the range, grabbing pages from the underlying object and
+    // mapping each physically contiguous run with a single arch_mmu_map() call
+    // so the arch layer can use large pages where alignment allows
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_count = 0;
+    for (size_t o = offset; o <= offset + len; o += PAGE_SIZE) {
+        paddr_t pa = 0;
+        status_t status = ERR_NOT_FOUND;
+        if (o < offset + len) {
+            uint64_t vmo_offset = object_offset_ + o;
+            if (commit) {
+                status = object_->FaultPageLocked(vmo_offset, VMM_PF_FLAG_WRITE, &pa);
+            } else if (object_->HasClonesLocked()) {
+                // leave it to the fault handler to map the page read-only
+            } else {
+                status = object_->GetPageLocked(vmo_offset, &pa);
+            }
         }
-        if (status < 0) {
-            // no page to map, skip ahead
+
+        if (status >= 0 && run_count > 0 && pa == run_pa + run_count * PAGE_SIZE) {
+            run_count++;
             continue;
         }
 
-        vaddr_t va = base_ + o;
-        LTRACEF_LEVEL(2, "mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", pa, va);
+        if (run_count > 0)
+            MapRunLocked(run_va, run_pa, run_count);
 
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_);
-        if (ret < 0) {
-            TRACEF("error %d mapping page at va %#" PRIxPTR " pa %#" PRIxPTR "\n", ret, va, pa);
-        }
+        // start a new run, or skip ahead if there is no page to map
+        run_va = base_ + o;
+        run_pa = pa;
+        run_count = (status >= 0) ? 1 : 0;
     }
 
     return NO_ERROR;
 }
 
+void VmRegion::MapRunLocked(vaddr_t va, paddr_t pa, size_t count) {
+    DEBUG_ASSERT(object_->lock().IsHeld());
+    LTRACEF_LEVEL(2, "mapping %zu pages at pa %#" PRIxPTR " to va %#" PRIxPTR "\n", count, pa, va);
+
+    auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, count, arch_mmu_flags_);
+    if (ret >= 0)
+        return;
+
+    // part of the run is already mapped, fall back to mapping what is left a
+    // page at a time
+    for (size_t i = 0; i < count; i++) {
+        paddr_t mapped_pa;
+        uint mapped_flags;
+        vaddr_t page_va = va + i * PAGE_SIZE;
+        if (arch_mmu_query(&aspace_->arch_aspace(), page_va, &mapped_pa, &mapped_flags) >= 0)
+            continue;
+        ret = arch_mmu_map(&aspace_->arch_aspace(), page_va, pa + i * PAGE_SIZE, 1, arch_mmu_flags_);
+        if (ret < 0) {
+            TRACEF("error %d mapping page at va %#" PRIxPTR " pa %#" PRIxPTR "\n", ret, page_va,
+                   pa + i * PAGE_SIZE);
+        }
+    }
+}
+
 status_t VmRegion::PageFault(vaddr_t va, uint pf_flags) {
     DEBUG_ASSERT(magic_ == MAGIC);
     DEBUG_ASSERT(object_);
@@ -226,6 +288,8 @@ status_t VmRegion::PageFault(vaddr_t va, uint pf_flags) {
     // grab the lock for the vmo
     AutoLock al(object_->lock());
 
+    faults_++;
+
     // fault in or grab an existing page
     paddr_t new_pa;
     auto status = object_->FaultPageLocked(vmo_offset, pf_flags, &new_pa);
@@ -234,6 +298,24 @@ status_t VmRegion::PageFault(vaddr_t va, uint pf_flags) {
         return status;
     }
 
+    // a page the object shares with an ancestor (a copy-on-write clone that
+    // has not been written to yet) or with its own clones is mapped read-only
+    // so that the first write faults again and gets the page copied
+    uint mmu_flags = arch_mmu_flags_;
+    bool shared = false;
+    if (!(pf_flags & VMM_PF_FLAG_WRITE)) {
+        paddr_t owned_pa;
+        if (object_->HasClonesLocked() ||
+            object_->GetPageLocked(vmo_offset, &owned_pa) < 0 || owned_pa != new_pa) {
+            mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+            shared = true;
+        }
+    }
+
+    // neighbours are mapped with the region's permissions, which would let
+    // writes to them skip copying the page out to clones
+    bool single = shared || object_->HasClonesLocked();
+
     // see if something is mapped here now
     // this may happen if we are one of multiple threads racing on a single address
     uint page_flags;
@@ -243,28 +325,41 @@ status_t VmRegion::PageFault(vaddr_t va, uint pf_flags) {
         LTRACEF("queried va, page at pa %#" PRIxPTR ", flags %#x is already there\n", pa, page_flags);
         if (pa == new_pa) {
             // page was already mapped, are the permissions compatible?
-            if (page_flags == arch_mmu_flags_)
+            if (page_flags == mmu_flags)
                 return NO_ERROR;
 
             // same page, different permission
-            auto ret = arch_mmu_protect(&aspace_->arch_aspace(), va, 1, arch_mmu_flags_);
+            auto ret = arch_mmu_protect(&aspace_->arch_aspace(), va, 1, mmu_flags);
             if (ret < 0) {
                 TRACEF("failed to modify permissions on existing mapping\n");
                 return ERR_NO_MEMORY;
             }
         } else {
-            // some other page is mapped there already
-            // currently this is an error situation, since there's no way for this to have
-            // happened, but in the future this will be a path for copy-on-write.
-            // TODO: implement
-            printf("KERN: thread %s faulted on va %#" PRIxPTR ", different page was present, unhandled\n",
-                   get_current_thread()->name, va);
-            return ERR_NOT_SUPPORTED;
+            // a shared page is mapped and the object now has its own copy,
+            // replace the mapping
+            LTRACEF("replacing pa %#" PRIxPTR " with copy at pa %#" PRIxPTR "\n", pa, new_pa);
+            auto ret = arch_mmu_unmap(&aspace_->arch_aspace(), va, 1);
+            if (ret < 0) {
+                TRACEF("failed to unmap shared page\n");
+                return ERR_NO_MEMORY;
+            }
+            ret = arch_mmu_map(&aspace_->arch_aspace(), va, new_pa, 1, mmu_flags);
+            if (ret < 0) {
+                TRACEF("failed to map page\n");
+                return ERR_NO_MEMORY;
+            }
         }
+    } else if (large_pages && !single && MapLargePageLocked(va, new_pa)) {
+        // the whole large page block around va was resident and got mapped
+    } else if (fault_around_pages > 1 && !single) {
+        // nothing was mapped there before, map it along with its resident neighbours
+        auto ret = FaultAroundLocked(va, pf_flags);
+        if (ret < 0)
+            return ret;
     } else {
         // nothing was mapped there before, map it now
         LTRACEF("mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", new_pa, va);
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, new_pa, 1, arch_mmu_flags_);
+        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, new_pa, 1, mmu_flags);
         if (ret < 0) {
             TRACEF("failed to map page\n");
             return ERR_NO_MEMORY;
@@ -278,3 +373,118 @@ status_t VmRegion::PageFault(vaddr_t va, uint pf_flags) {
 #endif
     return NO_ERROR;
 }
+
+bool VmRegion::MapLargePageLocked(vaddr_t va, paddr_t pa) {
+    DEBUG_ASSERT(object_->lock().IsHeld());
+
+    // the block around va has to lie entirely within the region and map to a
+    // physical address with the same alignment
+    const vaddr_t block_va = ROUNDDOWN(va, VM_LARGE_PAGE_SIZE);
+    if (size_ < VM_LARGE_PAGE_SIZE || block_va < base_ || block_va - base_ > size_ - VM_LARGE_PAGE_SIZE)
+        return false;
+    if (pa < va - block_va)
+        return false;
+    const paddr_t block_pa = pa - (va - block_va);
+    if (!IS_ALIGNED(block_pa, VM_LARGE_PAGE_SIZE))
+        return false;
+
+    // every page in the block has to be resident, owned by the object and
+    // physically contiguous. Look at the last page first so a block that is
+    // still being filled in sequentially is rejected cheaply.
+    const uint64_t block_offset = object_offset_ + (block_va - base_);
+    const size_t last = VM_LARGE_PAGE_SIZE - PAGE_SIZE;
+    paddr_t page_pa;
+    if (object_->GetPageLocked(block_offset + last, &page_pa) < 0 || page_pa != block_pa + last)
+        return false;
+    for (size_t o = 0; o < last; o += PAGE_SIZE) {
+        if (object_->GetPageLocked(block_offset + o, &page_pa) < 0 || page_pa != block_pa + o)
+            return false;
+    }
+
+    // drop whatever small mappings already exist in the block and map it
+    // again in one go
+    const size_t count = VM_LARGE_PAGE_SIZE / PAGE_SIZE;
+    arch_mmu_unmap(&aspace_->arch_aspace(), block_va, count);
+    auto ret = arch_mmu_map(&aspace_->arch_aspace(), block_va, block_pa, count, arch_mmu_flags_);
+    if (ret < 0) {
+        TRACEF("failed to map large page at va %#" PRIxPTR "\n", block_va);
+        return false;
+    }
+    large_pages_mapped_++;
+
+#if ARCH_ARM64
+    if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
+        arch_sync_cache_range(block_va, VM_LARGE_PAGE_SIZE);
+#endif
+    return true;
+}
+
+status_t VmRegion::FaultAroundLocked(vaddr_t va, uint pf_flags) {
+    DEBUG_ASSERT(object_->lock().IsHeld());
+
+    // clip the aligned window around va to the region, working in region
+    // offsets so a region at the very top of the address space cannot wrap
+    const size_t window = fault_around_pages * PAGE_SIZE;
+    const size_t va_offset = va - base_;
+    const size_t start = va_offset - mxtl::min(va % window, va_offset);
+    const size_t end = mxtl::min(va_offset + (window - va % window), size_);
+
+    // a fault right where the last window ended looks sequential, so commit
+    // the whole of this window up front
+    if (fault_ahead && va_offset == fault_around_end_ && va_offset == start) {
+        for (size_t o = start; o < end; o += PAGE_SIZE) {
+            paddr_t pa;
+            if (object_->GetPageLocked(object_offset_ + o, &pa) >= 0)
+                continue;
+            if (object_->FaultPageLocked(object_offset_ + o, pf_flags, &pa) < 0)
+                break;
+            // a clone's read fault may only have found the page in an
+            // ancestor
+            if (object_->GetPageLocked(object_offset_ + o, &pa) >= 0)
+                fault_ahead_committed_++;
+        }
+    }
+    fault_around_end_ = end;
+
+    // walk the window, mapping physically contiguous runs of resident but
+    // unmapped pages with one arch_mmu_map() call each
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_count = 0;
+    for (size_t o = start; o <= end; o += PAGE_SIZE) {
+        paddr_t pa = 0;
+        bool mappable = false;
+        if (o < end && object_->GetPageLocked(object_offset_ + o, &pa) >= 0) {
+            paddr_t mapped_pa;
+            uint mapped_flags;
+            mappable = arch_mmu_query(&aspace_->arch_aspace(), base_ + o, &mapped_pa, &mapped_flags) < 0;
+        }
+
+        if (mappable && run_count > 0 && pa == run_pa + run_count * PAGE_SIZE) {
+            run_count++;
+            continue;
+        }
+
+        if (run_count > 0) {
+            LTRACEF("mapping %zu pages at pa %#" PRIxPTR " to va %#" PRIxPTR "\n", run_count, run_pa, run_va);
+            auto ret = arch_mmu_map(&aspace_->arch_aspace(), run_va, run_pa, run_count, arch_mmu_flags_);
+            if (ret < 0) {
+                TRACEF("failed to map pages\n");
+                return ERR_NO_MEMORY;
+            }
+            // the faulting page itself is not counted
+            bool has_va = va >= run_va && va - run_va < run_count * PAGE_SIZE;
+            fault_around_mapped_ += run_count - (has_va ? 1 : 0);
+#if ARCH_ARM64
+            if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
+                arch_sync_cache_range(run_va, run_count * PAGE_SIZE);
+#endif
+        }
+
+        run_va = base_ + o;
+        run_pa = pa;
+        run_count = mappable ? 1 : 0;
+    }
+
+    return NO_ERROR;
+}
@@ -7,12 +7,16 @@
 #include <app/tests.h>
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
 #include <kernel/vm/vm_region.h>
 #include <mxtl/array.h>
 #include <new.h>
+#include <platform.h>
 #include <unittest.h>
 
 static bool pmm_tests(void* context) {
@@ -393,6 +397,59 @@ static bool vmm_object_tests(void* context) {
         EXPECT_EQ(NO_ERROR, err, "unmapping object");
     }
 
+    unittest_printf("creating contiguous vm object, mapping it with large pages\n");
+    {
+        const uint arch_rw_flags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
+        static const uint8_t large_page_shift = PAGE_SIZE_SHIFT + PAGE_SIZE_SHIFT - 3;
+        static const size_t alloc_size = 2UL << large_page_shift;
+        auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+        REQUIRE_TRUE(vmo, "vmobject creation\n");
+
+        uint64_t committed;
+        auto ret = vmo->CommitRangeContiguous(0, alloc_size, &committed, large_page_shift);
+        EXPECT_EQ(NO_ERROR, ret, "committing vm object contig\n");
+
+        auto ka = VmAspace::kernel_aspace();
+        void* ptr;
+        ret = ka->MapObject(vmo, "test", 0, alloc_size, &ptr, large_page_shift, 0, VMM_FLAG_COMMIT,
+                            arch_rw_flags);
+        REQUIRE_EQ(NO_ERROR, ret, "mapping object");
+
+        if (!fill_and_test(ptr, alloc_size))
+            all_ok = false;
+
+        // every page maps to the matching offset of the contiguous run
+        vaddr_t va = reinterpret_cast<vaddr_t>(ptr);
+        paddr_t base_pa;
+        uint base_flags;
+        EXPECT_EQ(NO_ERROR, arch_mmu_query(&ka->arch_aspace(), va, &base_pa, &base_flags), "query\n");
+        EXPECT_TRUE(IS_ALIGNED(base_pa, 1UL << large_page_shift), "aligned allocation\n");
+        for (size_t o = 0; o < alloc_size; o += PAGE_SIZE * 31) {
+            paddr_t pa;
+            uint flags;
+            EXPECT_EQ(NO_ERROR, arch_mmu_query(&ka->arch_aspace(), va + o, &pa, &flags), "query\n");
+            EXPECT_EQ(base_pa + o, pa, "large page translation\n");
+        }
+
+        // changing the permissions of a single page splits the large page
+        // around it without disturbing its neighbours
+        vaddr_t ro_va = va + PAGE_SIZE * 7;
+        ret = arch_mmu_protect(&ka->arch_aspace(), ro_va, 1, ARCH_MMU_FLAG_PERM_READ);
+        EXPECT_EQ(NO_ERROR, ret, "protecting one page\n");
+        paddr_t pa;
+        uint flags;
+        EXPECT_EQ(NO_ERROR, arch_mmu_query(&ka->arch_aspace(), ro_va, &pa, &flags), "query\n");
+        EXPECT_EQ(base_pa + PAGE_SIZE * 7, pa, "split translation\n");
+        EXPECT_EQ(0u, flags & ARCH_MMU_FLAG_PERM_WRITE, "page made read only\n");
+        EXPECT_EQ(NO_ERROR, arch_mmu_query(&ka->arch_aspace(), ro_va + PAGE_SIZE, &pa, &flags),
+                  "query\n");
+        EXPECT_EQ(base_pa + PAGE_SIZE * 8, pa, "split neighbour translation\n");
+        EXPECT_NEQ(0u, flags & ARCH_MMU_FLAG_PERM_WRITE, "neighbour still writable\n");
+
+        auto err = ka->FreeRegion(va);
+        EXPECT_EQ(NO_ERROR, err, "unmapping object");
+    }
+
     unittest_printf("creating vm object, mapping it, demand paged\n");
     {
         const uint arch_rw_flags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
@@ -621,8 +678,84 @@ static bool vmm_object_tests(void* context) {
     END_TEST;
 }
 
+// Each thread maps its own demand paged object and touches every page of it,
+// so the faults and the page allocations behind them run in parallel.
+static const size_t kFaultBenchPages = 2048;
+
+struct fault_bench_thread_args {
+    uint8_t* ptr;
+    bool ok;
+};
+
+static int fault_bench_thread(void* arg) {
+    auto args = static_cast<fault_bench_thread_args*>(arg);
+
+    for (size_t i = 0; i < kFaultBenchPages; i++)
+        *reinterpret_cast<volatile size_t*>(args->ptr + i * PAGE_SIZE) = i;
+
+    args->ok = true;
+    for (size_t i = 0; i < kFaultBenchPages; i++) {
+        if (*reinterpret_cast<volatile size_t*>(args->ptr + i * PAGE_SIZE) != i)
+            args->ok = false;
+    }
+
+    return 0;
+}
+
+static bool vmm_parallel_fault_tests(void* context) {
+    BEGIN_TEST;
+    const uint arch_rw_flags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
+    auto ka = VmAspace::kernel_aspace();
+
+    uint num_cpus = 0;
+    mp_cpu_mask_t active = mp_get_active_mask();
+    while (num_cpus < SMP_MAX_CPUS && (active & (1u << num_cpus)))
+        num_cpus++;
+
+    for (uint n = 1; n <= num_cpus; n++) {
+        fault_bench_thread_args args[SMP_MAX_CPUS] = {};
+        thread_t* threads[SMP_MAX_CPUS];
+
+        for (uint i = 0; i < n; i++) {
+            auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, kFaultBenchPages * PAGE_SIZE);
+            REQUIRE_TRUE(vmo, "vmobject creation\n");
+
+            void* ptr;
+            auto ret = ka->MapObject(mxtl::move(vmo), "fault bench", 0, kFaultBenchPages * PAGE_SIZE,
+                                     &ptr, 0, 0, 0, arch_rw_flags);
+            REQUIRE_EQ(NO_ERROR, ret, "mapping object");
+            args[i].ptr = static_cast<uint8_t*>(ptr);
+
+            threads[i] = thread_create("fault bench", &fault_bench_thread, &args[i],
+                                       DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+            thread_set_pinned_cpu(threads[i], i);
+        }
+
+        lk_bigtime_t start = current_time_hires();
+        for (uint i = 0; i < n; i++)
+            thread_resume(threads[i]);
+        for (uint i = 0; i < n; i++)
+            thread_join(threads[i], NULL, INFINITE_TIME);
+        lk_bigtime_t elapsed = current_time_hires() - start;
+
+        for (uint i = 0; i < n; i++) {
+            EXPECT_TRUE(args[i].ok, "faulted pages hold their contents");
+            auto err = ka->FreeRegion(reinterpret_cast<vaddr_t>(args[i].ptr));
+            EXPECT_EQ(NO_ERROR, err, "unmapping object");
+        }
+
+        uint64_t faults = static_cast<uint64_t>(n) * kFaultBenchPages;
+        unittest_printf("%u cpus: %" PRIu64 " page faults in %" PRIu64 " usecs, %" PRIu64 " faults/sec\n",
+                        n, faults, static_cast<uint64_t>(elapsed),
+                        elapsed ? faults * 1000000 / elapsed : 0);
+    }
+
+    END_TEST;
+}
+
 UNITTEST_START_TESTCASE(vm_tests)
 UNITTEST("pmm tests", pmm_tests)
 UNITTEST("vmm tests", vmm_tests)
 UNITTEST("vm object based test", vmm_object_tests)
+UNITTEST("parallel page fault test", vmm_parallel_fault_tests)
 UNITTEST_END_TESTCASE(vm_tests, "vmtests", "Virtual memory tests", NULL, NULL);
@@ -12,18 +12,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <arch/ops.h>
 #include <kernel/thread.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <lib/cmpctmalloc.h>
 #include <lib/heap.h>
 #include <lib/page_alloc.h>
+#include <lk/init.h>
 
 // Malloc implementation tuned for space.
 //
 // Allocation strategy takes place with a global mutex.  Freelist entries are
 // kept in linked lists with 8 different sizes per binary order of magnitude
 // and the header size is two words with eager coalescing on free.
+//
+// Small allocations go through a per-cpu cache first, see "magazines" below.
 
 #if defined(DEBUG) || LK_DEBUGLEVEL > 2
 #define CMPCT_DEBUG
@@ -84,7 +88,41 @@ struct heap {
 // Heap static vars.
 static struct heap theheap;
 
+// Each cpu keeps a magazine of free blocks per small size class in front of
+// the heap so that the short lived small allocations that dominate kernel
+// object churn do not serialize on the heap lock.  Blocks in a magazine are
+// still allocated as far as the heap is concerned (they do not coalesce) and
+// a block is cached in the largest class its payload can hold.  A magazine is
+// only touched by its own cpu with interrupts disabled and is refilled (or
+// drained) half a magazine at a time under one acquisition of the heap lock.
+#define MAGAZINE_CLASSES 8
+#define MAGAZINE_SIZE 32
+#define MAGAZINE_BATCH (MAGAZINE_SIZE / 2)
+
+static const size_t magazine_class_sizes[MAGAZINE_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256,
+};
+
+struct magazine {
+    size_t count;
+    void *blocks[MAGAZINE_SIZE];
+    // statistics, dumped by 'heap info'
+    uint64_t alloc_hits;
+    uint64_t alloc_misses;
+    uint64_t free_hits;
+    uint64_t drains;
+} __CPU_ALIGN;
+
+static struct magazine magazines[SMP_MAX_CPUS][MAGAZINE_CLASSES];
+
+// Turned on once the cpus are up, and off while running the tests, which
+// depend on exact free list behaviour.
+static bool magazines_enabled;
+
 static ssize_t heap_grow(size_t len, free_t **bucket);
+static void cmpct_free_uncached(void *payload);
+static void drain_magazines(void);
+static int magazine_class_freeing(size_t payload);
 
 static void lock(void)
 {
@@ -124,6 +162,27 @@ void cmpct_dump(void)
         }
     }
     unlock();
+
+    dprintf(INFO, "\tper-cpu cache%s:\n", magazines_enabled ? "" : " (disabled)");
+    dprintf(INFO, "\t\t%6s %8s %12s %12s %8s %12s %10s\n",
+            "class", "cached", "alloc hits", "alloc misses", "hit %", "free hits", "drains");
+    for (int class = 0; class < MAGAZINE_CLASSES; class++) {
+        size_t cached = 0;
+        uint64_t alloc_hits = 0, alloc_misses = 0, free_hits = 0, drains = 0;
+        for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+            const struct magazine *mag = &magazines[cpu][class];
+            cached += mag->count;
+            alloc_hits += mag->alloc_hits;
+            alloc_misses += mag->alloc_misses;
+            free_hits += mag->free_hits;
+            drains += mag->drains;
+        }
+        uint64_t allocs = alloc_hits + alloc_misses;
+        dprintf(INFO, "\t\t%6zu %8zu %12" PRIu64 " %12" PRIu64 " %8" PRIu64 " %12" PRIu64
+                " %10" PRIu64 "\n",
+                magazine_class_sizes[class], cached, alloc_hits, alloc_misses,
+                allocs ? alloc_hits * 100 / allocs : 0, free_hits, drains);
+    }
 }
 
 // Operates in sizes that don't include the allocation header.
@@ -557,8 +616,121 @@ static void cmpct_test_return_to_os(void)
     ASSERT(remaining == theheap.remaining);
 }
 
+// Blocks currently cached in all of |cpu|'s magazines.
+static size_t cmpct_test_cached(uint cpu)
+{
+    size_t cached = 0;
+    for (int class = 0; class < MAGAZINE_CLASSES; class++)
+        cached += magazines[cpu][class].count;
+    return cached;
+}
+
+static void cmpct_test_magazines(void)
+{
+    // Stay on one cpu so that every alloc and free below hits the same
+    // magazines.
+    thread_t *t = get_current_thread();
+    int saved_pinned_cpu = thread_pinned_cpu(t);
+    THREAD_LOCK(state);
+    uint cpu = arch_curr_cpu_num();
+    thread_set_pinned_cpu(t, (int)cpu);
+    THREAD_UNLOCK(state);
+
+    bool saved_magazines_enabled = magazines_enabled;
+    magazines_enabled = true;
+    drain_magazines();
+    ASSERT(cmpct_test_cached(cpu) == 0);
+
+    void *ptr[MAGAZINE_SIZE * 2];
+
+    for (int class = 0; class < MAGAZINE_CLASSES; class++) {
+        // Blocks are cached by payload size, so a previous class may have
+        // left some in this one.
+        drain_magazines();
+        struct magazine *mag = &magazines[cpu][class];
+        size_t size = magazine_class_sizes[class];
+        uint64_t misses = mag->alloc_misses;
+        uint64_t hits = mag->alloc_hits;
+
+        // An empty magazine is refilled with a batch, one of which is
+        // returned, the next allocation is served from the magazine.
+        ptr[0] = cmpct_alloc(size);
+        ASSERT(ptr[0] != NULL);
+        ASSERT(mag->alloc_misses == misses + 1);
+        ASSERT(mag->count == MAGAZINE_BATCH - 1);
+        ptr[1] = cmpct_alloc(size);
+        ASSERT(ptr[1] != NULL && ptr[1] != ptr[0]);
+        ASSERT(mag->alloc_hits == hits + 1);
+        ASSERT(mag->count == MAGAZINE_BATCH - 2);
+
+        // Sizes in between classes are served by the next class up.
+        if (class > 0) {
+            void *p = cmpct_alloc(magazine_class_sizes[class - 1] + 1);
+            ASSERT(mag->alloc_hits == hits + 2);
+            cmpct_free(p);
+        }
+
+        // Frees go back to a magazine rather than to the heap.
+        size_t cached = cmpct_test_cached(cpu);
+        cmpct_free(ptr[1]);
+        cmpct_free(ptr[0]);
+        ASSERT(cmpct_test_cached(cpu) == cached + 2);
+    }
+
+    // Sizes past the last class bypass the magazines.
+    size_t cached = cmpct_test_cached(cpu);
+    ptr[0] = cmpct_alloc(magazine_class_sizes[MAGAZINE_CLASSES - 1] + 1);
+    ASSERT(ptr[0] != NULL);
+    cmpct_free(ptr[0]);
+    ASSERT(cmpct_test_cached(cpu) == cached);
+
+    // Allocating more than a magazine holds refills it several times,
+    // freeing it all again fills it and then flushes the older half each
+    // time it is full.
+    drain_magazines();
+    int class = MAGAZINE_CLASSES / 2;
+    struct magazine *mag = &magazines[cpu][class];
+    uint64_t misses = mag->alloc_misses;
+    uint64_t drains = mag->drains;
+    for (size_t i = 0; i < countof(ptr); i++) {
+        ptr[i] = cmpct_alloc(magazine_class_sizes[class]);
+        ASSERT(ptr[i] != NULL);
+    }
+    ASSERT(mag->alloc_misses == misses + countof(ptr) / MAGAZINE_BATCH);
+    ASSERT(mag->count == 0);
+    size_t to_class = 0;
+    for (size_t i = 0; i < countof(ptr); i++) {
+        header_t *header = (header_t *)ptr[i] - 1;
+        if (magazine_class_freeing(header->size - sizeof(header_t)) == class)
+            to_class++;
+        cmpct_free(ptr[i]);
+    }
+    // A block carved from the end of a free area can be a little bigger
+    // and cached in a larger class, but nearly all of them fit exactly.
+    ASSERT(to_class > MAGAZINE_SIZE);
+    ASSERT(mag->drains > drains);
+    ASSERT(mag->count > 0 && mag->count <= MAGAZINE_SIZE);
+    ASSERT(mag->count + (mag->drains - drains) * MAGAZINE_BATCH == to_class);
+
+    // Draining hands everything back to the heap.
+    drain_magazines();
+    ASSERT(cmpct_test_cached(cpu) == 0);
+
+    magazines_enabled = saved_magazines_enabled;
+
+    THREAD_LOCK(state2);
+    thread_set_pinned_cpu(t, saved_pinned_cpu);
+    THREAD_UNLOCK(state2);
+}
+
 void cmpct_test(void)
 {
+    // The tests check exact free list behaviour, so keep the magazines out
+    // of the way.
+    bool saved_magazines_enabled = magazines_enabled;
+    magazines_enabled = false;
+    drain_magazines();
+
     cmpct_test_buckets();
     cmpct_test_get_back_newly_freed();
     cmpct_test_return_to_os();
@@ -615,6 +787,10 @@ void cmpct_test(void)
     }
 
     cmpct_dump();
+
+    magazines_enabled = saved_magazines_enabled;
+
+    cmpct_test_magazines();
 }
 
 static void *large_alloc(size_t size)
@@ -647,6 +823,11 @@ static void *large_alloc(size_t size)
 
 void cmpct_trim(void)
 {
+    // Blocks cached on this cpu can't coalesce with their neighbours, give
+    // them back first.
+    if (magazines_enabled)
+        drain_magazines();
+
     // Look at free list entries that are at least as large as one page plus a
     // header. They might be at the start or the end of a block, so we can trim
     // them and free the page(s).
@@ -717,18 +898,14 @@ void cmpct_trim(void)
     unlock();
 }
 
-void *cmpct_alloc(size_t size)
+// Allocates from the free lists, the heap lock must be held.
+static void *alloc_locked(size_t size)
 {
-    if (size == 0u) return NULL;
-
-    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
-
     size_t rounded_up;
     int start_bucket = size_to_index_allocating(size, &rounded_up);
 
     rounded_up += sizeof(header_t);
 
-    lock();
     int bucket = find_nonempty_bucket(start_bucket);
     if (bucket == -1) {
         // Grow heap by at least 12% if we can.
@@ -737,7 +914,6 @@ void *cmpct_alloc(size_t size)
                                 MAX(HEAP_GROW_SIZE, rounded_up)));
         while (heap_grow(growby, NULL) < 0) {
             if (growby <= rounded_up) {
-                unlock();
                 return NULL;
             }
             growby = MAX(growby >> 1, rounded_up);
@@ -767,6 +943,93 @@ void *cmpct_alloc(size_t size)
     memset(result, ALLOC_FILL, size);
     memset(((char *)result) + size, PADDING_FILL, rounded_up - size - sizeof(header_t));
 #endif
+    return result;
+}
+
+static int magazine_class_allocating(size_t size)
+{
+    for (int i = 0; i < MAGAZINE_CLASSES; i++) {
+        if (size <= magazine_class_sizes[i])
+            return i;
+    }
+    return -1;
+}
+
+// The largest class a block with a |payload| byte payload can serve.
+static int magazine_class_freeing(size_t payload)
+{
+    if (payload < magazine_class_sizes[0] || payload > magazine_class_sizes[MAGAZINE_CLASSES - 1])
+        return -1;
+    int i = MAGAZINE_CLASSES - 1;
+    while (magazine_class_sizes[i] > payload)
+        i--;
+    return i;
+}
+
+// the current cpu's magazine for |class| is empty, allocate a batch of blocks
+// from the heap, return one and stash the rest in the magazine
+static void *refill_magazine(int class)
+{
+    void *batch[MAGAZINE_BATCH];
+    size_t count = 0;
+
+    lock();
+    while (count < MAGAZINE_BATCH) {
+        void *block = alloc_locked(magazine_class_sizes[class]);
+        if (!block)
+            break;
+        batch[count++] = block;
+    }
+    unlock();
+
+    if (count == 0)
+        return NULL;
+
+    // we might have migrated, anything that does not fit in the magazine of
+    // whatever cpu we are on now goes back to the heap
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    struct magazine *mag = &magazines[arch_curr_cpu_num()][class];
+    mag->alloc_misses++;
+    while (count > 1 && mag->count < MAGAZINE_SIZE)
+        mag->blocks[mag->count++] = batch[--count];
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    for (size_t i = 1; i < count; i++)
+        cmpct_free_uncached(batch[i]);
+
+    return batch[0];
+}
+
+void *cmpct_alloc(size_t size)
+{
+    if (size == 0u) return NULL;
+
+    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
+
+    int class = magazines_enabled ? magazine_class_allocating(size) : -1;
+    if (class >= 0) {
+        void *result = NULL;
+        spin_lock_saved_state_t state;
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        struct magazine *mag = &magazines[arch_curr_cpu_num()][class];
+        if (mag->count > 0) {
+            result = mag->blocks[--mag->count];
+            mag->alloc_hits++;
+        }
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+        if (!result)
+            result = refill_magazine(class);
+#ifdef CMPCT_DEBUG
+        if (result)
+            memset(result, ALLOC_FILL, size);
+#endif
+        return result;
+    }
+
+    lock();
+    void *result = alloc_locked(size);
     unlock();
     return result;
 }
@@ -800,13 +1063,12 @@ void *cmpct_memalign(size_t size, size_t alignment)
     return payload;
 }
 
-void cmpct_free(void *payload)
+// Returns a block to the free lists, the heap lock must be held.
+static void free_locked(void *payload)
 {
-    if (payload == NULL) return;
     header_t *header = (header_t *)payload - 1;
     DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
     size_t size = header->size;
-    lock();
     header_t *left = header->left;
     if (left != NULL && is_tagged_as_free(left)) {
         // Coalesce with left free object.
@@ -835,9 +1097,90 @@ void cmpct_free(void *payload)
             free_memory(header, left, size);
         }
     }
+}
+
+// Frees straight to the heap, bypassing the magazines.
+static void cmpct_free_uncached(void *payload)
+{
+    lock();
+    free_locked(payload);
     unlock();
 }
 
+void cmpct_free(void *payload)
+{
+    if (payload == NULL) return;
+    header_t *header = (header_t *)payload - 1;
+    DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
+
+    int class = magazines_enabled ? magazine_class_freeing(header->size - sizeof(header_t)) : -1;
+    if (class < 0) {
+        cmpct_free_uncached(payload);
+        return;
+    }
+
+#ifdef CMPCT_DEBUG
+    memset(payload, FREE_FILL, header->size - sizeof(header_t));
+#endif
+
+    // if the magazine is full, push its older half out to the heap to make
+    // room
+    void *drain[MAGAZINE_BATCH];
+    size_t drain_count = 0;
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    struct magazine *mag = &magazines[arch_curr_cpu_num()][class];
+    if (mag->count == MAGAZINE_SIZE) {
+        drain_count = MAGAZINE_BATCH;
+        memcpy(drain, &mag->blocks[0], sizeof(drain));
+        mag->count -= MAGAZINE_BATCH;
+        memmove(&mag->blocks[0], &mag->blocks[MAGAZINE_BATCH], mag->count * sizeof(mag->blocks[0]));
+        mag->drains++;
+    }
+    mag->blocks[mag->count++] = payload;
+    mag->free_hits++;
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (drain_count) {
+        lock();
+        for (size_t i = 0; i < drain_count; i++)
+            free_locked(drain[i]);
+        unlock();
+    }
+}
+
+// Returns everything in the current cpu's magazines to the heap.
+static void drain_magazines(void)
+{
+    for (int class = 0; class < MAGAZINE_CLASSES; class++) {
+        void *drain[MAGAZINE_SIZE];
+        size_t drain_count;
+
+        spin_lock_saved_state_t state;
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        struct magazine *mag = &magazines[arch_curr_cpu_num()][class];
+        drain_count = mag->count;
+        memcpy(drain, mag->blocks, drain_count * sizeof(drain[0]));
+        mag->count = 0;
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+        if (drain_count == 0)
+            continue;
+        lock();
+        for (size_t i = 0; i < drain_count; i++)
+            free_locked(drain[i]);
+        unlock();
+    }
+}
+
+static void cmpct_magazines_init(uint level)
+{
+    magazines_enabled = true;
+}
+
+LK_INIT_HOOK(cmpct_magazines, &cmpct_magazines_init, LK_INIT_LEVEL_THREADING);
+
 void *cmpct_realloc(void *payload, size_t size)
 {
     if (payload == NULL) return cmpct_alloc(size);
@@ -9,6 +9,7 @@
 #include <err.h>
 #include <new.h>
 #include <stddef.h>
+#include <string.h>
 
 #include <kernel/auto_lock.h>
 
@@ -17,6 +18,7 @@
 #include <magenta/message_packet.h>
 #include <magenta/port_dispatcher.h>
 #include <magenta/port_client.h>
+#include <magenta/process_dispatcher.h>
 
 namespace {
 
@@ -24,10 +26,16 @@ size_t other_side(size_t side) {
     return side ? 0u : 1u;
 }
 
+// Transaction ids handed out by Call() keep the high bit set so they can't collide with ids
+// that userspace picks for its own request/response matching.
+constexpr mx_txid_t kKernelTxidBit = 0x80000000u;
+
 }  // namespace
 
+static mutex_class_t channel_lock_class = MUTEX_CLASS_INITIAL_VALUE("Channel::lock_");
+
 Channel::Channel()
-    : dispatcher_alive_{true, true} {
+    : lock_(&channel_lock_class), dispatcher_alive_{true, true}, next_txid_(0u) {
     state_tracker_[0].set_initial_signals_state(MX_CHANNEL_WRITABLE);
     state_tracker_[1].set_initial_signals_state(MX_CHANNEL_WRITABLE);
 }
@@ -36,6 +44,8 @@ Channel::~Channel() {
     // No need to lock. We are single threaded and will not have new requests.
     DEBUG_ASSERT(messages_[0].is_empty());
     DEBUG_ASSERT(messages_[1].is_empty());
+    DEBUG_ASSERT(waiters_[0].is_empty());
+    DEBUG_ASSERT(waiters_[1].is_empty());
 }
 
 void Channel::OnDispatcherDestruction(size_t side) {
@@ -51,6 +61,13 @@ void Channel::OnDispatcherDestruction(size_t side) {
             state_tracker_[other].UpdateState(MX_CHANNEL_WRITABLE, MX_CHANNEL_PEER_CLOSED);
             if (iopc_[other])
                 iopc_[other]->Signal(MX_CHANNEL_PEER_CLOSED, &lock_);
+
+            // Nobody is left to answer pending calls.
+            while (!waiters_[other].is_empty()) {
+                CallWaiter* waiter = waiters_[other].pop_front();
+                waiter->status = ERR_REMOTE_CLOSED;
+                waiter->event.Signal();
+            }
         }
     }
 
@@ -61,7 +78,8 @@ status_t Channel::Read(size_t side,
                        uint32_t* msg_size,
                        uint32_t* msg_handle_count,
                        mxtl::unique_ptr<MessagePacket>* msg,
-                       bool may_discard) {
+                       bool may_discard,
+                       ProcessDispatcher* reader) {
     auto max_size = *msg_size;
     auto max_handle_count = *msg_handle_count;
     auto other = other_side(side);
@@ -80,6 +98,11 @@ status_t Channel::Read(size_t side,
         if (!may_discard)
             return ERR_BUFFER_TOO_SMALL;
         rv = ERR_BUFFER_TOO_SMALL;
+    } else if (*msg_handle_count > 0u) {
+        // Discarded messages close their handles, only delivered ones need room.
+        status_t status = reader->ReserveHandles(*msg_handle_count);
+        if (status != NO_ERROR)
+            return status;
     }
 
     *msg = messages_[side].pop_front();
@@ -103,13 +126,73 @@ status_t Channel::Write(size_t side, mxtl::unique_ptr<MessagePacket> msg) {
         return ERR_BAD_STATE;
     }
 
+    Deliver_NoLock(other, mxtl::move(msg));
+    return NO_ERROR;
+}
+
+status_t Channel::Call(size_t side, mxtl::unique_ptr<MessagePacket> msg, lk_time_t timeout,
+                       bool* write_failed, mxtl::unique_ptr<MessagePacket>* reply) {
+    DEBUG_ASSERT(msg->data_size() >= sizeof(mx_txid_t));
+
+    auto other = other_side(side);
+    CallWaiter waiter;
+
+    {
+        AutoLock lock(&lock_);
+        if (!dispatcher_alive_[other]) {
+            msg->set_owns_handles(false);
+            *write_failed = true;
+            return ERR_BAD_STATE;
+        }
+
+        waiter.txid = kKernelTxidBit | next_txid_++;
+        waiter.status = ERR_INTERNAL;
+        memcpy(msg->mutable_data(), &waiter.txid, sizeof(waiter.txid));
+        waiters_[side].push_back(&waiter);
+
+        Deliver_NoLock(other, mxtl::move(msg));
+    }
+    *write_failed = false;
+
+    status_t result = waiter.event.Wait(timeout);
+
+    AutoLock lock(&lock_);
+    if (waiter.InContainer()) {
+        // Nothing was delivered; we timed out or were interrupted.
+        waiters_[side].erase(waiter);
+        return result;
+    }
+
+    // A reply or a peer-closed notification raced with (or caused) our wakeup.
+    if (waiter.status == NO_ERROR)
+        *reply = mxtl::move(waiter.reply);
+    return waiter.status;
+}
+
+void Channel::Deliver_NoLock(size_t side, mxtl::unique_ptr<MessagePacket> msg) {
+    mx_txid_t txid = 0u;
+    if (!waiters_[side].is_empty() && msg->data_size() >= sizeof(mx_txid_t))
+        memcpy(&txid, msg->data(), sizeof(txid));
+
+    // Only ids that Call() handed out can match, everything else is an ordinary message.
+    if (txid & kKernelTxidBit) {
+        for (auto& waiter : waiters_[side]) {
+            if (waiter.txid == txid) {
+                waiters_[side].erase(waiter);
+                waiter.status = NO_ERROR;
+                waiter.reply = mxtl::move(msg);
+                waiter.event.Signal();
+                return;
+            }
+        }
+    }
+
     auto size = msg->data_size();
-    messages_[other].push_back(mxtl::move(msg));
+    messages_[side].push_back(mxtl::move(msg));
 
-    state_tracker_[other].UpdateState(0u, MX_CHANNEL_READABLE);
-    if (iopc_[other])
-        iopc_[other]->Signal(MX_CHANNEL_READABLE, size, &lock_);
-    return NO_ERROR;
+    state_tracker_[side].UpdateState(0u, MX_CHANNEL_READABLE);
+    if (iopc_[side])
+        iopc_[side]->Signal(MX_CHANNEL_READABLE, size, &lock_);
 }
 
 StateTracker* Channel::GetStateTracker(size_t side) {
@@ -69,9 +69,10 @@ StateTracker* ChannelDispatcher::get_state_tracker() {
 status_t ChannelDispatcher::Read(uint32_t* msg_size,
                                  uint32_t* msg_handle_count,
                                  mxtl::unique_ptr<MessagePacket>* msg,
-                                 bool may_discard) {
+                                 bool may_discard,
+                                 ProcessDispatcher* reader) {
     LTRACE_ENTRY;
-    return channel_->Read(side_, msg_size, msg_handle_count, msg, may_discard);
+    return channel_->Read(side_, msg_size, msg_handle_count, msg, may_discard, reader);
 }
 
 status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
@@ -79,6 +80,12 @@ status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
     return channel_->Write(side_, mxtl::move(msg));
 }
 
+status_t ChannelDispatcher::Call(mxtl::unique_ptr<MessagePacket> msg, lk_time_t timeout,
+                                 bool* write_failed, mxtl::unique_ptr<MessagePacket>* reply) {
+    LTRACE_ENTRY;
+    return channel_->Call(side_, mxtl::move(msg), timeout, write_failed, reply);
+}
+
 status_t ChannelDispatcher::set_port_client(mxtl::unique_ptr<PortClient> client) {
     LTRACE_ENTRY;
     return channel_->SetIOPort(side_, mxtl::move(client));
@@ -12,6 +12,8 @@
 #include <lib/console.h>
 
 #include <magenta/job_dispatcher.h>
+#include <magenta/magenta.h>
+#include <magenta/message_packet.h>
 #include <magenta/process_dispatcher.h>
 
 void DumpProcessListKeyMap() {
@@ -45,7 +47,7 @@ char StateChar(const ProcessDispatcher& pd) {
 }
 
 const char* ObjectTypeToString(mx_obj_type_t type) {
-    static_assert(MX_OBJ_TYPE_LAST == 18, "need to update switch below");
+    static_assert(MX_OBJ_TYPE_LAST == 19, "need to update switch below");
 
     switch (type) {
         case MX_OBJ_TYPE_PROCESS: return "process";
@@ -65,6 +67,7 @@ const char* ObjectTypeToString(mx_obj_type_t type) {
         case MX_OBJ_TYPE_RESOURCE: return "resource";
         case MX_OBJ_TYPE_EVENT_PAIR: return "event-pair";
         case MX_OBJ_TYPE_JOB: return "job";
+        case MX_OBJ_TYPE_TIMER: return "timer";
         default: return "???";
     }
 }
@@ -163,6 +166,29 @@ void DumpProcessHandles(mx_koid_t id) {
     printf("total: %u handles\n", total);
 }
 
+void DumpHandleCacheStats() {
+    HandleCacheStats stats;
+    GetHandleCacheStats(&stats);
+
+    printf("handle cache: %" PRIu64 " cached slots\n", stats.cached);
+    printf("  fast allocs : %" PRIu64 "\n", stats.hits);
+    printf("  refills     : %" PRIu64 "\n", stats.refills);
+    printf("  drains      : %" PRIu64 "\n", stats.drains);
+    printf("  contended   : %" PRIu64 "\n", stats.contended);
+}
+
+void DumpMessagePacketStats() {
+    MessagePacketStats stats;
+    MessagePacket::GetStats(&stats);
+
+    printf("message packets: %" PRIu64 " cached slots\n", stats.cached);
+    printf("  pool allocs : %" PRIu64 "\n", stats.pool_allocs);
+    printf("  cache allocs: %" PRIu64 "\n", stats.cache_allocs);
+    printf("  refills     : %" PRIu64 "\n", stats.refills);
+    printf("  drains      : %" PRIu64 "\n", stats.drains);
+    printf("  heap allocs : %" PRIu64 "\n", stats.heap_allocs);
+}
+
 void KillProcess(mx_koid_t id) {
     // search the process list and send a kill if found
     mxtl::RefPtr<ProcessDispatcher> proc_ref;
@@ -193,6 +219,8 @@ static int cmd_diagnostics(int argc, const cmd_args* argv) {
         printf("%s ps         : list processes\n", argv[0].str);
         printf("%s ht   <pid> : dump process handles\n", argv[0].str);
         printf("%s kill <pid> : kill process\n", argv[0].str);
+        printf("%s hc         : handle cache statistics\n", argv[0].str);
+        printf("%s mp         : message packet statistics\n", argv[0].str);
         return -1;
     }
 
@@ -210,6 +238,10 @@ static int cmd_diagnostics(int argc, const cmd_args* argv) {
         if (argc < 3)
             goto usage;
         KillProcess(argv[2].u);
+    } else if (strcmp(argv[1].str, "hc") == 0) {
+        DumpHandleCacheStats();
+    } else if (strcmp(argv[1].str, "mp") == 0) {
+        DumpMessagePacketStats();
     } else {
         printf("unrecognized subcommand\n");
         goto usage;
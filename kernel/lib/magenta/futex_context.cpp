@@ -15,6 +15,35 @@
 
 #define LOCAL_TRACE 0
 
+namespace {
+
+// Holds two mutexes, which may be the same one, taking them in address
+// order so that two threads locking the same pair can't deadlock.
+class AutoPairLock {
+public:
+    AutoPairLock(Mutex* a, Mutex* b)
+        : first_(a < b ? a : b), second_(a < b ? b : a) {
+        first_->Acquire();
+        if (second_ != first_)
+            second_->Acquire();
+    }
+
+    ~AutoPairLock() {
+        if (second_ != first_)
+            second_->Release();
+        first_->Release();
+    }
+
+    AutoPairLock(const AutoPairLock&) = delete;
+    AutoPairLock& operator=(const AutoPairLock&) = delete;
+
+private:
+    Mutex* first_;
+    Mutex* second_;
+};
+
+}  // namespace
+
 FutexContext::FutexContext() {
     LTRACE_ENTRY;
 }
@@ -23,10 +52,21 @@ FutexContext::~FutexContext() {
     LTRACE_ENTRY;
 }
 
+FutexContext::Bucket* FutexContext::GetBucket(uintptr_t futex_key) {
+    static_assert((kNumBuckets & (kNumBuckets - 1)) == 0, "kNumBuckets must be a power of 2");
+
+    // Futexes are at least 4 byte aligned and tend to be clustered (e.g. in arrays of mutexes),
+    // so mix the address before taking the top bits.
+    uint64_t hash = static_cast<uint64_t>(futex_key >> 2) * 0x9e3779b97f4a7c15ULL;
+    return &buckets_[hash >> (64 - __builtin_ctzll(kNumBuckets))];
+}
+
 status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t timeout) {
     LTRACE_ENTRY;
 
     uintptr_t futex_key = reinterpret_cast<uintptr_t>(value_ptr.get());
+    Bucket* bucket = GetBucket(futex_key);
+    Mutex* lock = &bucket->lock;
     FutexNode* node;
 
     // FutexWait() checks that the address value_ptr still contains
@@ -35,22 +75,22 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     // If a FutexWake() operation could occur between them, a userland mutex
     // operation built on top of futexes would have a race condition that
     // could miss wakeups.
-    lock_.Acquire();
+    lock->Acquire();
 
     UserThread* t = UserThread::GetCurrent();
     if (t->state() == UserThread::State::DYING || t->state() == UserThread::State::DEAD) {
-        lock_.Release();
+        lock->Release();
         return ERR_BAD_STATE;
     }
 
     int value;
     status_t result = value_ptr.copy_from_user(&value);
     if (result != NO_ERROR) {
-        lock_.Release();
+        lock->Release();
         return result;
     }
     if (value != current_value) {
-        lock_.Release();
+        lock->Release();
         return ERR_BAD_STATE;
     }
 
@@ -58,19 +98,18 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     node->set_hash_key(futex_key);
     node->SetAsSingletonList();
 
-    QueueNodesLocked(node);
+    QueueNodesLocked(bucket, node);
 
-    // Block current thread.  This releases lock_ and does not reacquire it.
-    result = node->BlockThread(&lock_, timeout);
+    // Block current thread.  This releases the bucket lock and does not reacquire it.
+    result = node->BlockThread(lock, timeout);
     if (result == NO_ERROR) {
         // All the work necessary for removing us from the hash table was done by FutexWake()
         return NO_ERROR;
     }
 
-    AutoLock lock(lock_);
     // If we got a timeout, we need to remove the thread's node from the
     // wait queue, since FutexWake() didn't do that.
-    if (UnqueueNodeLocked(node)) {
+    if (UnqueueNode(node)) {
         return ERR_TIMED_OUT;
     }
     // The current thread was not found on the wait queue.  This means
@@ -98,18 +137,19 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
 void FutexContext::WakeAll() {
     LTRACE_ENTRY;
 
-    AutoLock lock(lock_);
-    for(auto &entry : futex_table_) {
-        FutexNode::WakeThreads(&entry);
+    for (auto& bucket : buckets_) {
+        AutoLock lock(bucket.lock);
+        for(auto &entry : bucket.futex_table) {
+            FutexNode::WakeThreads(&entry);
+        }
+        bucket.futex_table.clear();
     }
-    futex_table_.clear();
 }
 
 void FutexContext::WakeKilledThread(FutexNode* node) {
     LTRACE_ENTRY;
 
-    AutoLock lock(lock_);
-    if (UnqueueNodeLocked(node))
+    if (UnqueueNode(node))
         node->WakeKilledThread();
 }
 
@@ -119,24 +159,28 @@ status_t FutexContext::FutexWake(user_ptr<int> value_ptr, uint32_t count) {
     if (count == 0) return NO_ERROR;
 
     uintptr_t futex_key = reinterpret_cast<uintptr_t>(value_ptr.get());
+    Bucket* bucket = GetBucket(futex_key);
 
     {
-        AutoLock lock(lock_);
+        AutoLock lock(bucket->lock);
 
-        FutexNode* node = futex_table_.erase(futex_key);
+        FutexNode* node = bucket->futex_table.erase(futex_key);
         if (!node) {
             // nothing blocked on this futex if we can't find it
             return NO_ERROR;
         }
         DEBUG_ASSERT(node->GetKey() == futex_key);
 
+        // Woken nodes keep their key until WakeThreads() has marked them
+        // as no longer queued, so that a racing timeout in UnqueueNode()
+        // waits on this bucket's lock rather than looking elsewhere.
         FutexNode* wake_head = node;
-        node = FutexNode::RemoveFromHead(node, count, futex_key, 0u);
+        node = FutexNode::RemoveFromHead(node, count, futex_key, futex_key);
         // node is now the new blocked thread list head
 
         if (node != nullptr) {
             DEBUG_ASSERT(node->GetKey() == futex_key);
-            futex_table_.insert(node);
+            bucket->futex_table.insert(node);
         }
 
         // Traversing this list of threads must be done while holding the
@@ -156,21 +200,27 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
     if ((requeue_ptr.get() == nullptr) && requeue_count)
         return ERR_INVALID_ARGS;
 
-    AutoLock lock(lock_);
+    uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
+    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
+    if (wake_key == requeue_key) return ERR_INVALID_ARGS;
+
+    // Both buckets must be held across the value check and the move so
+    // that the requeue is atomic with respect to waiters on either futex.
+    // Lock them in address order to avoid deadlocking against a requeue
+    // in the other direction.
+    Bucket* wake_bucket = GetBucket(wake_key);
+    Bucket* requeue_bucket = GetBucket(requeue_key);
+    AutoPairLock lock(&wake_bucket->lock, &requeue_bucket->lock);
 
     int value;
     status_t result = wake_ptr.copy_from_user(&value);
     if (result != NO_ERROR) return result;
     if (value != current_value) return ERR_BAD_STATE;
 
-    uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
-    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
-    if (wake_key == requeue_key) return ERR_INVALID_ARGS;
-
     // This must happen before RemoveFromHead() calls set_hash_key() on
-    // nodes below, because operations on futex_table_ look at the GetKey
+    // nodes below, because operations on futex_table look at the GetKey
     // field of the list head nodes for wake_key and requeue_key.
-    FutexNode* node = futex_table_.erase(wake_key);
+    FutexNode* node = wake_bucket->futex_table.erase(wake_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return NO_ERROR;
@@ -181,7 +231,7 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
         wake_head = nullptr;
     } else {
         wake_head = node;
-        node = FutexNode::RemoveFromHead(node, wake_count, wake_key, 0u);
+        node = FutexNode::RemoveFromHead(node, wake_count, wake_key, wake_key);
     }
 
     // node is now the head of wake_ptr futex after possibly removing some threads to wake
@@ -194,22 +244,22 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
 
             // now requeue our nodes to requeue_ptr mutex
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
-            QueueNodesLocked(requeue_head);
+            QueueNodesLocked(requeue_bucket, requeue_head);
         }
     }
 
     // add any remaining nodes back to wake_key futex
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == wake_key);
-        futex_table_.insert(node);
+        wake_bucket->futex_table.insert(node);
     }
 
     FutexNode::WakeThreads(wake_head);
     return NO_ERROR;
 }
 
-void FutexContext::QueueNodesLocked(FutexNode* head) {
-    DEBUG_ASSERT(lock_.IsHeld());
+void FutexContext::QueueNodesLocked(Bucket* bucket, FutexNode* head) {
+    DEBUG_ASSERT(bucket->lock.IsHeld());
 
     FutexNode::HashTable::iterator iter;
 
@@ -217,29 +267,38 @@ void FutexContext::QueueNodesLocked(FutexNode* head) {
     // succeeds, then the current thread is first to block on this futex and we
     // are finished.  If the insert fails, then there is already a thread
     // waiting on this futex.  Add ourselves to that thread's list.
-    if (!futex_table_.insert_or_find(head, &iter))
+    if (!bucket->futex_table.insert_or_find(head, &iter))
         iter->AppendList(head);
 }
 
 // This attempts to unqueue a thread (which may or may not be waiting on a
 // futex), given its FutexNode.  This returns whether the FutexNode was
 // found and removed from a futex wait queue.
-bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
-    DEBUG_ASSERT(lock_.IsHeld());
-
-    if (!node->IsInQueue())
-        return false;
-
+bool FutexContext::UnqueueNode(FutexNode* node) {
     // Note: When UnqueueNode() is called from FutexWait(), it might be
     // tempting to reuse the futex key that was passed to FutexWait().
     // However, that could be out of date if the thread was requeued by
     // FutexRequeue(), so we need to re-get the hash table key here.
-    uintptr_t futex_key = node->GetKey();
-
-    FutexNode* old_head = futex_table_.erase(futex_key);
-    DEBUG_ASSERT(old_head);
-    FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
-    if (new_head)
-        futex_table_.insert(new_head);
-    return true;
+    //
+    // A requeue changes the key while holding the lock of the bucket the
+    // node is leaving, so once we hold the lock for the bucket the key
+    // points at and the key still matches, it can't change under us.
+    for (;;) {
+        uintptr_t futex_key = node->GetKeyUnlocked();
+        Bucket* bucket = GetBucket(futex_key);
+        AutoLock lock(bucket->lock);
+
+        if (node->GetKey() != futex_key)
+            continue;
+
+        if (!node->IsInQueue())
+            return false;
+
+        FutexNode* old_head = bucket->futex_table.erase(futex_key);
+        DEBUG_ASSERT(old_head);
+        FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
+        if (new_head)
+            bucket->futex_table.insert(new_head);
+        return true;
+    }
 }
@@ -8,17 +8,19 @@
 
 #include <magenta/dispatcher.h>
 
-Handle::Handle(mxtl::RefPtr<Dispatcher> dispatcher, uint32_t rights)
+Handle::Handle(mxtl::RefPtr<Dispatcher> dispatcher, uint32_t rights, uint32_t base_value)
     : process_id_(0u),
       dispatcher_(mxtl::move(dispatcher)),
-      rights_(rights) {
+      rights_(rights),
+      base_value_(base_value) {
     dispatcher_->add_handle();
 }
 
-Handle::Handle(const Handle* rhs, mx_rights_t rights)
+Handle::Handle(const Handle* rhs, mx_rights_t rights, uint32_t base_value)
     : process_id_(rhs->process_id_),
       dispatcher_(rhs->dispatcher_),
-      rights_(rights) {
+      rights_(rights),
+      base_value_(base_value) {
     dispatcher_->add_handle();
 }
 
@@ -12,12 +12,14 @@
 
 #include <magenta/state_tracker.h>
 #include <magenta/syscalls/port.h>
+#include <magenta/wait_event.h>
 
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/ref_counted.h>
 
 class PortClient;
 class MessagePacket;
+class ProcessDispatcher;
 
 class Channel : public mxtl::RefCounted<Channel> {
 public:
@@ -30,22 +32,47 @@ public:
     // size and handle count, respectively. On NO_ERROR or ERR_BUFFER_TOO_SMALL, they specify the
     // actual size and handle count of the next message. The next message is returned in |*msg| on
     // NO_ERROR and also on ERR_BUFFER_TOO_SMALL when |may_discard| is set.
+    // Before a message is returned on NO_ERROR, room for its handles is reserved in |reader|'s
+    // handle quota (see ProcessDispatcher::ReserveHandles()); if they do not fit, the message
+    // stays queued and ERR_NO_RESOURCES is returned.
     status_t Read(size_t side,
                   uint32_t* msg_size,
                   uint32_t* msg_handle_count,
                   mxtl::unique_ptr<MessagePacket>* msg,
-                  bool may_discard);
+                  bool may_discard,
+                  ProcessDispatcher* reader);
     status_t Write(size_t side, mxtl::unique_ptr<MessagePacket> msg);
 
+    // Writes |msg| to the other side with a freshly generated transaction id in its first
+    // bytes, then waits up to |timeout| for the message carrying the same id to be written
+    // back. The reply is handed over directly in |*reply| and never shows up in the queue.
+    // |*write_failed| tells the caller whether it still owns the handles attached to |msg|.
+    status_t Call(size_t side, mxtl::unique_ptr<MessagePacket> msg, lk_time_t timeout,
+                  bool* write_failed, mxtl::unique_ptr<MessagePacket>* reply);
+
     StateTracker* GetStateTracker(size_t side);
     status_t SetIOPort(size_t side, mxtl::unique_ptr<PortClient> client);
 
 private:
     using MessageList = mxtl::DoublyLinkedList<mxtl::unique_ptr<MessagePacket>>;
 
+    // A thread blocked in Call() waiting for the reply with |txid|.
+    struct CallWaiter : public mxtl::DoublyLinkedListable<CallWaiter*> {
+        mx_txid_t txid;
+        status_t status;
+        mxtl::unique_ptr<MessagePacket> reply;
+        WaitEvent event;
+    };
+    using WaiterList = mxtl::DoublyLinkedList<CallWaiter*>;
+
+    // Queues |msg| for |side| or completes the Call() on |side| waiting for it.
+    void Deliver_NoLock(size_t side, mxtl::unique_ptr<MessagePacket> msg);
+
     Mutex lock_;
     bool dispatcher_alive_[2];
     MessageList messages_[2];
+    WaiterList waiters_[2];
+    mx_txid_t next_txid_;
     StateTracker state_tracker_[2];
     mxtl::unique_ptr<PortClient> iopc_[2];
 };
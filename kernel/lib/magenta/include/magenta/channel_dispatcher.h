@@ -38,8 +38,12 @@ public:
     status_t Read(uint32_t* msg_size,
                   uint32_t* msg_handle_count,
                   mxtl::unique_ptr<MessagePacket>* msg,
-                  bool may_disard);
+                  bool may_disard,
+                  ProcessDispatcher* reader);
     status_t Write(mxtl::unique_ptr<MessagePacket> msg);
+    // See Channel::Call() for details.
+    status_t Call(mxtl::unique_ptr<MessagePacket> msg, lk_time_t timeout,
+                  bool* write_failed, mxtl::unique_ptr<MessagePacket>* reply);
 
 private:
     ChannelDispatcher(uint32_t flags, size_t side, mxtl::RefPtr<Channel> channel);
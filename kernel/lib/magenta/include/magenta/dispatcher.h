@@ -44,6 +44,7 @@ DECLARE_DISPTAG(SocketDispatcher, MX_OBJ_TYPE_SOCKET)
 DECLARE_DISPTAG(ResourceDispatcher, MX_OBJ_TYPE_RESOURCE)
 DECLARE_DISPTAG(EventPairDispatcher, MX_OBJ_TYPE_EVENT_PAIR)
 DECLARE_DISPTAG(JobDispatcher, MX_OBJ_TYPE_JOB)
+DECLARE_DISPTAG(TimerDispatcher, MX_OBJ_TYPE_TIMER)
 
 #undef DECLARE_DISPTAG
 
@@ -23,6 +23,10 @@
 // When the thread at the head of the futex's blocked thread list is resumed,
 // The FutexNode for the new head of the blocked thread list is set as the hash table value
 // for the futex.
+// The table is split by address into kNumBuckets independently locked buckets so that
+// operations on unrelated futexes don't contend with each other. Operations on one futex only
+// take its bucket's lock; FutexRequeue takes the locks of both futexes' buckets, in bucket
+// order.
 class FutexContext {
 public:
     FutexContext();
@@ -56,14 +60,25 @@ private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head);
+    static constexpr size_t kNumBuckets = 16;
 
-    bool UnqueueNodeLocked(FutexNode* node);
+    struct Bucket {
+        // protects futex_table
+        Mutex lock;
 
-    // protects futex_table_
-    Mutex lock_;
+        // Hash table for the futexes in this bucket.
+        // Key is futex address, value is the FutexNode for the head of futex's blocked thread
+        // list.
+        FutexNode::HashTable futex_table;
+    };
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_;
+    Bucket* GetBucket(uintptr_t futex_key);
+
+    static void QueueNodesLocked(Bucket* bucket, FutexNode* head);
+
+    // Removes |node| from whichever futex it is waiting on, taking the bucket lock itself since
+    // a concurrent FutexRequeue() may move the node to another bucket.
+    bool UnqueueNode(FutexNode* node);
+
+    Bucket buckets_[kNumBuckets];
 };
@@ -46,9 +46,13 @@ public:
     static void WakeThreads(FutexNode* head);
 
     void set_hash_key(uintptr_t key) {
-        hash_key_ = key;
+        __atomic_store_n(&hash_key_, key, __ATOMIC_RELAXED);
     }
 
+    // Reads the key without holding the lock of the bucket the node is queued in. The result
+    // may be stale by the time it is used; callers must recheck it under the bucket lock.
+    uintptr_t GetKeyUnlocked() const { return __atomic_load_n(&hash_key_, __ATOMIC_RELAXED); }
+
     // Trait implementation for mxtl::HashTable
     uintptr_t GetKey() const { return hash_key_; }
     static size_t GetHash(uintptr_t key) { return (key >> 3); }
@@ -65,7 +69,7 @@ private:
     //  * Additionally, when this FutexNode is the head of a futex wait
     //    queue, this field is used by the HashTable (because it uses
     //    intrusive SinglyLinkedLists).
-    uintptr_t hash_key_;
+    uintptr_t hash_key_ = 0u;
 
     // Used for waking the thread corresponding to the FutexNode.
     wait_queue_t wait_queue_;
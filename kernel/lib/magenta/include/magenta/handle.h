@@ -17,8 +17,8 @@ class Dispatcher;
 
 class Handle final : public mxtl::DoublyLinkedListable<Handle*> {
 public:
-    Handle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights);
-    Handle(const Handle* rhs, mx_rights_t rights);
+    Handle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights, uint32_t base_value);
+    Handle(const Handle* rhs, mx_rights_t rights, uint32_t base_value);
 
     Handle(const Handle&) = delete;
     Handle& operator=(const Handle &) = delete;
@@ -39,8 +39,18 @@ public:
         return rights_;
     }
 
+    // The arena index and generation of this handle, see MapHandleToU32().
+    uint32_t base_value() const {
+        return base_value_;
+    }
+
+    void set_base_value(uint32_t base_value) {
+        base_value_ = base_value;
+    }
+
 private:
     mx_koid_t process_id_;
     mxtl::RefPtr<Dispatcher> dispatcher_;
     const mx_rights_t rights_;
+    uint32_t base_value_;
 };
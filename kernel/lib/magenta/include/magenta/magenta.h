@@ -8,6 +8,8 @@
 
 #include <stdint.h>
 
+#include <kernel/spinlock.h>
+
 #include <magenta/prctl.h>
 #include <magenta/types.h>
 
@@ -30,12 +32,44 @@ Handle* DupHandle(Handle* source, mx_rights_t rights);
 // Deletes a |handle| made by MakeHandle() or DupHandle().
 void DeleteHandle(Handle* handle);
 
-// Maps a handle created by MakeHandle() to the 0 to 2^32 range.
+// Counters for the per-cpu handle caches that sit in front of the
+// handle arena. |hits| are allocations served without taking the arena
+// lock, |refills| and |drains| are batch transfers to and from the arena
+// and |contended| counts how often the arena lock was found held.
+struct HandleCacheStats {
+    uint64_t cached;
+    uint64_t hits;
+    uint64_t refills;
+    uint64_t drains;
+    uint64_t contended;
+};
+
+void GetHandleCacheStats(HandleCacheStats* stats);
+
+// Returns the maximum number of handles a single process can own.
+uint32_t GetMaxHandlesPerProcess();
+
+// Maps a handle created by MakeHandle() to the 0 to 2^29 range. The value
+// encodes the handle's arena slot and the slot's generation.
 uint32_t MapHandleToU32(const Handle* handle);
 
-// Maps an integer obtained by MapHandleToU32() back to a Handle.
+// Maps an integer obtained by MapHandleToU32() back to a Handle. Returns
+// nullptr if the slot has since been reused.
 Handle* MapU32ToHandle(uint32_t value);
 
+// Gives |handle|, which must not be owned by any process, a new generation
+// so that the value it had in its previous owner no longer maps to it.
+// Called before a handle is given to a process.
+void RenewHandleValue(Handle* handle);
+
+// Finds the handle for an integer obtained by MapHandleToU32() without
+// holding the owning process' handle table lock. Returns nullptr if there is
+// no such handle. Otherwise the handle stays valid until EndHandleLookup():
+// DeleteHandle() waits for the lookups in progress on the handle's slot.
+// Runs with interrupts disabled; keep the critical section short.
+Handle* BeginHandleLookup(uint32_t value, spin_lock_saved_state_t* state);
+void EndHandleLookup(Handle* handle, spin_lock_saved_state_t state);
+
 // Set/get the system exception port.
 mx_status_t SetSystemExceptionPort(mxtl::RefPtr<ExceptionPort> eport);
 void ResetSystemExceptionPort();
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <magenta/types.h>
@@ -14,32 +15,58 @@
 
 class Handle;
 
+// Counters for message packet allocations. |pool_allocs| are packets
+// carved out of the packet pool, |cache_allocs| of which were served from a
+// per-cpu cache without taking a lock. |refills| and |drains| count the
+// batches moved between the caches and the pool. |heap_allocs| are packets
+// too large for the pool (or made while it was exhausted). Every packet is a
+// single allocation.
+struct MessagePacketStats {
+    uint64_t cached;
+    uint64_t pool_allocs;
+    uint64_t cache_allocs;
+    uint64_t refills;
+    uint64_t drains;
+    uint64_t heap_allocs;
+};
+
 class MessagePacket : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<MessagePacket>> {
 public:
-    // Creates a message packet.
+    // Messages with at most this much data and this many handles are
+    // carved out of fixed size pool slots, larger ones come from the heap.
+    static constexpr uint32_t kMaxPooledDataSize = 256u;
+    static constexpr uint32_t kMaxPooledHandles = 4u;
+
+    // Creates a message packet. The header, handle array and data are
+    // allocated together.
     static mx_status_t Create(uint32_t data_size, uint32_t num_handles,
                               mxtl::unique_ptr<MessagePacket>* msg);
 
+    static void GetStats(MessagePacketStats* stats);
+
     ~MessagePacket();
 
+    // Returns the packet memory to the pool or the heap.
+    static void operator delete(void* ptr);
+
     uint32_t data_size() const { return data_size_; }
     uint32_t num_handles() const { return num_handles_; }
 
     void set_owns_handles(bool own_handles) { owns_handles_ = own_handles; }
 
-    const void* data() const { return data_.get(); }
-    void* mutable_data() { return data_.get(); }
-    Handle* const* handles() const { return handles_.get(); }
-    Handle** mutable_handles() { return handles_.get(); }
+    const void* data() const { return data_; }
+    void* mutable_data() { return data_; }
+    Handle* const* handles() const { return handles_; }
+    Handle** mutable_handles() { return handles_; }
 
 private:
-    MessagePacket(uint32_t data_size, uint32_t num_handles);
+    MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles, uint8_t* data);
 
     bool owns_handles_;
     uint32_t data_size_;
     uint32_t num_handles_;
 
-    // TODO(vtl): Allocate these inline instead.
-    mxtl::unique_ptr<uint8_t[]> data_;
-    mxtl::unique_ptr<Handle*[]> handles_;
+    // Both point into the same allocation as the packet itself.
+    Handle** const handles_;
+    uint8_t* const data_;
 };
@@ -19,24 +19,27 @@
 #include <sys/types.h>
 
 
+class PortDispatcher;
+
 struct IOP_Packet : public mxtl::DoublyLinkedListable<IOP_Packet*> {
     friend struct IOP_PacketListTraits;
 
     static IOP_Packet* Alloc(mx_size_t size);
     static IOP_Packet* Make(const void* data, mx_size_t size);
-    static IOP_Packet* MakeFromUser(const void* data, mx_size_t size);
     static void Delete(IOP_Packet* packet);
 
     IOP_Packet(mx_size_t data_size)
-        : is_signal(false), data_size(data_size) {}
+        : is_signal(false), data_size(data_size), pool(nullptr) {}
 
     IOP_Packet(mx_size_t data_size, bool is_signal)
-        : is_signal(is_signal), data_size(data_size) {}
+        : is_signal(is_signal), data_size(data_size), pool(nullptr) {}
 
-    bool CopyToUser(void* data, mx_size_t* size);
+    mx_status_t CopyToUser(void* data, mx_size_t* size);
 
     bool is_signal;
     mx_size_t data_size;
+    // The port whose packet pool this came from, or null if it is on the heap.
+    PortDispatcher* pool;
 };
 
 struct IOP_Signal : public IOP_Packet {
@@ -49,10 +52,14 @@ struct IOP_Signal : public IOP_Packet {
 // Port job is to deliver packets to threads waiting in Wait(). There
 // are two types of packets:
 //
-// 1- Manually posted via Queue(), they are allocated in the
-//    heap by the caller and freed in the syscall layer at the bottom
-//    of mx_port_wait(). These Packets are of type IOP_Packet and only
-//    live in the |packets| list.
+// 1- Manually posted via Queue() or QueueFromUser(). Packets from
+//    userspace come from the port's own pool, at most kMaxQueuedPackets
+//    of them can be outstanding at once, after that QueueFromUser() fails
+//    with ERR_SHOULD_WAIT. Packets the kernel posts, such as exception
+//    reports, are allocated from the heap by the caller and are never
+//    refused for being over the limit. Both kinds are freed in the syscall
+//    layer at the bottom of mx_port_wait(). These Packets are of type
+//    IOP_Packet and only live in the |packets| list.
 //
 // 2- Posted by bound dispatchers via Signal(), they are allocated once
 //    during their first Signal() call and only freed when the IO port
@@ -71,6 +78,8 @@ struct IOP_Signal : public IOP_Packet {
 
 class PortDispatcher final : public Dispatcher {
 public:
+    static constexpr uint32_t kMaxQueuedPackets = 1024u;
+
     static status_t Create(uint32_t options,
                            mxtl::RefPtr<Dispatcher>* dispatcher,
                            mx_rights_t* rights);
@@ -80,18 +89,42 @@ public:
     void on_zero_handles() final;
 
     mx_status_t Queue(IOP_Packet* packet);
+    // Copies a packet in from userspace and queues it.
+    mx_status_t QueueFromUser(const void* data, mx_size_t size);
+    uint32_t GetQueuedCount();
+    // Reports how many of the port's pooled packets are in use and how many
+    // free ones it keeps for reuse.
+    void GetPoolUsage(uint32_t* used, uint32_t* cached);
+
+    // Returns a packet from this port's pool. Use IOP_Packet::Delete().
+    void FreePacket(IOP_Packet* packet);
     void* Signal(void* cookie, uint64_t key, mx_signals_t signal);
 
     mx_status_t Wait(mx_time_t timeout, IOP_Packet** packet);
 
+    // Dequeues up to |*count| packets of at most |max_size| bytes each in
+    // one go, blocking until at least one is available. |*count| is set to
+    // the number dequeued.
+    mx_status_t WaitMany(mx_time_t timeout, mx_size_t max_size,
+                         IOP_Packet** packets, uint32_t* count);
+
 private:
     PortDispatcher(uint32_t options);
     void FreePackets_NoLock();
+    IOP_Packet* Dequeue_NoLock();
+    IOP_Packet* AllocPacket_NoLock(mx_size_t size);
+    void FreePacket_NoLock(IOP_Packet* packet);
 
     const uint32_t options_;
 
     Mutex lock_;
     bool no_clients_;
+    // Number of queued packets that are not signal packets.
+    uint32_t queued_;
+    // Packets from |free_packets_| that have not been returned yet.
+    uint32_t pool_used_;
+    uint32_t pool_cached_;
+    mxtl::DoublyLinkedList<IOP_Packet*> free_packets_;
     mxtl::DoublyLinkedList<IOP_Packet*> packets_;
     mxtl::DoublyLinkedList<IOP_Packet*> at_zero_;
     event_t event_;
@@ -65,13 +65,28 @@ public:
     mx_handle_t MapHandleToValue(const Handle* handle) const;
 
     // Maps a handle value into a Handle as long we can verify that
-    // it belongs to this process.
+    // it belongs to this process. Callers must hold handle_table_lock().
     Handle* GetHandle_NoLock(mx_handle_t handle_value);
 
     // Adds |handle| to this process handle list. The handle->process_id() is
-    // set to this process id().
-    void AddHandle(HandleUniquePtr handle);
-    void AddHandle_NoLock(HandleUniquePtr handle);
+    // set to this process id(). Fails with ERR_NO_RESOURCES, destroying
+    // |handle|, if the process already owns GetMaxHandlesPerProcess() handles.
+    mx_status_t AddHandle(HandleUniquePtr handle) __WARN_UNUSED_RESULT;
+    mx_status_t AddHandle_NoLock(HandleUniquePtr handle) __WARN_UNUSED_RESULT;
+
+    // Reserves room for |count| handles in the handle quota so that a
+    // syscall producing several handles can check the quota once, before
+    // it has any side effects. Fails with ERR_NO_RESOURCES, reserving
+    // nothing, if they do not all fit. Each reserved slot must then be
+    // consumed by AddReservedHandle() or given back by UnreserveHandles().
+    // Does not take handle_table_lock(), so it can be called with other
+    // dispatchers' locks held.
+    mx_status_t ReserveHandles(uint32_t count) __WARN_UNUSED_RESULT;
+    void UnreserveHandles(uint32_t count);
+
+    // Adds |handle| to this process handle list using a slot obtained from
+    // ReserveHandles(). Cannot fail.
+    void AddReservedHandle(HandleUniquePtr handle);
 
     // Removes the Handle corresponding to |handle_value| from this process
     // handle list.
@@ -82,6 +97,7 @@ public:
     // back into this process.
     void UndoRemoveHandle_NoLock(mx_handle_t handle_value);
 
+    // Lock-free lookup of the dispatcher and rights behind |handle_value|.
     bool GetDispatcher(mx_handle_t handle_value, mxtl::RefPtr<Dispatcher>* dispatcher,
                        uint32_t* rights);
 
@@ -187,6 +203,9 @@ private:
     // Kill all threads
     void KillAllThreads();
 
+    // Links |handle| into the handle table without checking the quota.
+    void InsertHandle_NoLock(Handle* handle);
+
     // Add a process to the global process list.  Allocate a new process ID from
     // the global pool at the same time, and assign it to the process.
     static void AddProcess(ProcessDispatcher* process);
@@ -209,8 +228,11 @@ private:
     mxtl::RefPtr<JobDispatcher> job_;
 
     // our list of handles
-    mutable Mutex handle_table_lock_; // protects |handles_|.
+    mutable Mutex handle_table_lock_; // protects |handles_| and |handle_count_|.
     mxtl::DoublyLinkedList<Handle*> handles_;
+    uint32_t handle_count_ = 0u;
+    // |handle_count_| plus outstanding ReserveHandles() slots. Atomic.
+    int handle_quota_used_ = 0;
 
     StateTracker state_tracker_;
 
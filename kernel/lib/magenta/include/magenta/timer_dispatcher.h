@@ -0,0 +1,75 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stdint.h>
+
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/timer.h>
+#include <lib/dpc.h>
+
+#include <magenta/dispatcher.h>
+#include <magenta/state_tracker.h>
+#include <magenta/types.h>
+
+#include <mxtl/ref_ptr.h>
+#include <mxtl/unique_ptr.h>
+
+class PortClient;
+
+class TimerDispatcher final : public Dispatcher {
+public:
+    static status_t Create(uint32_t options, mxtl::RefPtr<Dispatcher>* dispatcher,
+                           mx_rights_t* rights);
+
+    ~TimerDispatcher() final;
+
+    // Dispatcher implementation.
+    mx_obj_type_t get_type() const final { return MX_OBJ_TYPE_TIMER; }
+    StateTracker* get_state_tracker() final { return &state_tracker_; }
+    void on_zero_handles() final;
+    status_t set_port_client(mxtl::unique_ptr<PortClient> client) final;
+
+    // Timer methods.
+    // Clears MX_TIMER_SIGNALED and asserts it again once the monotonic clock reaches
+    // |deadline|. The expiry may be delayed by up to |slack| to share a wakeup with other timers.
+    status_t Set(mx_time_t deadline, mx_time_t slack);
+    status_t Cancel();
+
+private:
+    explicit TimerDispatcher(uint32_t options);
+
+    // Called in interrupt context when |timer_| expires.
+    static enum handler_return TimerCallback(timer_t* timer, lk_time_t now, void* arg);
+    // Called from the dpc thread after |timer_| has expired.
+    static void TimerDpc(dpc_t* dpc);
+
+    void OnTimerFired();
+    void ArmTimer_NoLock(mx_time_t now);
+    void Signal_NoLock();
+    bool DpcQueued();
+
+    Mutex lock_;
+    mx_time_t deadline_ = 0u;
+    mx_time_t slack_ = 0u;
+    bool armed_ = false;
+
+    // Keeps the timer alive while |timer_| may fire or |dpc_| may run, so the interrupt and
+    // dpc paths never see a dispatcher that is being destroyed.
+    mxtl::RefPtr<TimerDispatcher> self_ref_;
+
+    timer_t timer_;
+
+    // Protects |dpc_queued_|, which is also touched from interrupt context.
+    spin_lock_t dpc_lock_ = SPIN_LOCK_INITIAL_VALUE;
+    bool dpc_queued_ = false;
+    dpc_t dpc_ = {};
+
+    StateTracker state_tracker_;
+    mxtl::unique_ptr<PortClient> iopc_;
+};
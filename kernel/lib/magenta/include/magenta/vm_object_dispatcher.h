@@ -31,6 +31,8 @@ public:
     mx_status_t SetSize(uint64_t);
     mx_status_t GetSize(uint64_t* size);
     mx_status_t RangeOp(uint32_t op, uint64_t offset, uint64_t size, user_ptr<void> buffer, size_t buffer_size, mx_rights_t);
+    mx_status_t Clone(uint32_t options, uint64_t offset, uint64_t size,
+                      mxtl::RefPtr<Dispatcher>* clone, mx_rights_t* rights);
 
     // XXX really belongs in process
     mx_status_t Map(mxtl::RefPtr<VmAspace> aspace, uint32_t vmo_rights, uint64_t offset, mx_size_t len,
@@ -58,7 +58,11 @@ public:
             }
         };
 
+        // |options| may include MX_WAITSET_EDGE_TRIGGERED, in which case the entry reports a
+        // result once each time one of |watched_signals| becomes asserted rather than for as long
+        // as one is asserted.
         static status_t Create(mx_signals_t watched_signals,
+                               uint32_t options,
                                uint64_t cookie,
                                mxtl::unique_ptr<Entry>* entry);
 
@@ -66,6 +70,7 @@ public:
 
         // Const, hence these don't care about locking:
         mx_signals_t watched_signals() const { return watched_signals_; }
+        bool edge_triggered() const { return edge_triggered_; }
 
         void Init_NoLock(WaitSetDispatcher* wait_set, Handle* handle);
         State GetState_NoLock() const;
@@ -83,7 +88,7 @@ public:
         uint64_t GetKey() const { return cookie_; }
 
     private:
-        Entry(mx_signals_t watched_signals, uint64_t cookie);
+        Entry(mx_signals_t watched_signals, bool edge_triggered, uint64_t cookie);
         Entry(const Entry&) = delete;
         Entry& operator=(const Entry&) = delete;
 
@@ -95,7 +100,14 @@ public:
         // (i.e., |is_triggered_| must be false; this will set it to true).
         bool Trigger_NoLock();
 
+        // Undoes Trigger_NoLock(). Level triggered entries untrigger when their signals are no
+        // longer asserted, edge triggered ones once their result has been reported.
+        void Untrigger_NoLock();
+
+        friend class WaitSetDispatcher;
+
         const mx_signals_t watched_signals_;
+        const bool edge_triggered_;
         const uint64_t cookie_;
 
         // The members below are all protected by the owning WaitSetDispatcher's mutex (once the
@@ -129,6 +141,11 @@ public:
     status_t RemoveEntry(uint64_t cookie);
 
     // Waits on the wait set. Note: This blocks.
+    //
+    // Only triggered entries are looked at, so the cost is proportional to the number of results
+    // rather than the number of entries. Reported level triggered entries are moved to the back
+    // of the triggered list so that busy entries can't starve the others; reported edge
+    // triggered entries are untriggered.
     status_t Wait(mx_time_t timeout,
                   uint32_t* num_results,
                   mx_waitset_result_t* results,
@@ -6,10 +6,16 @@
 
 #include <magenta/magenta.h>
 
+#include <string.h>
 #include <trace.h>
 
+#include <arch/ops.h>
+
 #include <kernel/auto_lock.h>
+#include <kernel/cmdline.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/vm.h>
 
 #include <lk/init.h>
 
@@ -32,15 +38,62 @@
 
 #define LOCAL_TRACE 0
 
-// This handle limit relects the fact that VMOs have an internal array
-// with entry per memory page. When we switch to a tree of ranges we can
-// up this limit.
-constexpr size_t kMaxHandleCount = 32 * 1024;
+// The handle arena only reserves kernel address space for this many
+// handles; the backing pages are committed as the arena grows, so the
+// limit costs about 56MB of kernel VA and nothing else until it is used.
+constexpr uint32_t kHandleIndexBits = 20u;
+constexpr size_t kMaxHandleCount = 1u << kHandleIndexBits;
+
+// Handle values carry 29 bits of MapHandleToU32() (see map_handle_to_value).
+// The bits above the arena index hold a per-slot generation so that a stale
+// handle value does not alias a newer handle that reuses the same slot, or
+// the same handle after it has moved to another process and back.
+constexpr uint32_t kHandleGenerationBits = 29u - kHandleIndexBits;
+constexpr uint32_t kHandleIndexMask = (1u << kHandleIndexBits) - 1u;
+constexpr uint16_t kMaxHandleGeneration = (1u << kHandleGenerationBits) - 1u;
+
+// Per arena slot state. |lookups| counts the lock-free
+// lookups of the slot in progress, see BeginHandleLookup(). |generation|
+// is the last generation handed out for the slot. The array is committed
+// up front since it is touched with interrupts disabled.
+struct HandleSlotInfo {
+    volatile int lookups;
+    uint16_t generation;
+};
+
+static HandleSlotInfo* handle_slots;
+
+// Default per-process handle quota, can be overriden with the
+// magenta.process.max_handles kernel command line option.
+constexpr uint32_t kDefaultMaxHandlesPerProcess = 64 * 1024;
+static uint32_t max_handles_per_process = kDefaultMaxHandlesPerProcess;
 
 // The handle arena and its mutex.
 mutex_t handle_mutex = MUTEX_INITIAL_VALUE(handle_mutex);
 mxtl::TypedArena<Handle> handle_arena;
 
+// Each cpu keeps a magazine of free handle slots in front of the arena so
+// that the common MakeHandle() / DeleteHandle() path does not take the
+// |handle_mutex|. A magazine is only touched by its own cpu with interrupts
+// disabled. When it runs empty (or full) half a magazine worth of slots is
+// moved from (or to) the arena under the mutex.
+constexpr size_t kHandleMagazineSize = 64u;
+constexpr size_t kHandleMagazineBatch = kHandleMagazineSize / 2u;
+
+struct HandleMagazine {
+    size_t count;
+    void* slots[kHandleMagazineSize];
+    // Statistics, see GetHandleCacheStats().
+    uint64_t hits;
+    uint64_t refills;
+    uint64_t drains;
+} __CPU_ALIGN;
+
+static HandleMagazine handle_magazines[SMP_MAX_CPUS];
+
+// Number of times the slow path found |handle_mutex| already held.
+static volatile int handle_mutex_contended;
+
 // The system exception port.
 static mxtl::RefPtr<ExceptionPort> system_exception_port;
 static mutex_t system_exception_mutex = MUTEX_INITIAL_VALUE(system_exception_mutex);
@@ -50,20 +103,170 @@ static mxtl::RefPtr<JobDispatcher> root_job;
 
 void magenta_init(uint level) {
     handle_arena.Init("handles", kMaxHandleCount);
+
+    void* slots = nullptr;
+    status_t st = vmm_alloc(vmm_get_kernel_aspace(), "handle_slots",
+                            kMaxHandleCount * sizeof(HandleSlotInfo), &slots,
+                            PAGE_SIZE_SHIFT, 0, VMM_FLAG_COMMIT,
+                            ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE);
+    if (st < 0)
+        panic("failed to allocate handle slot info\n");
+    handle_slots = reinterpret_cast<HandleSlotInfo*>(slots);
+    max_handles_per_process =
+        cmdline_get_uint32("magenta.process.max_handles", kDefaultMaxHandlesPerProcess);
     root_job = JobDispatcher::CreateRootJob();
 }
 
+static void AcquireHandleArenaLock() {
+    // Racy peek, only used to feed the contention counter.
+    if (handle_mutex.holder)
+        atomic_add(&handle_mutex_contended, 1);
+    mutex_acquire(&handle_mutex);
+}
+
+static void* AllocHandleSlot() {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    auto mag = &handle_magazines[arch_curr_cpu_num()];
+    if (mag->count > 0u) {
+        void* slot = mag->slots[--mag->count];
+        ++mag->hits;
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+        return slot;
+    }
+    ++mag->refills;
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    // The magazine is empty. Refill a batch from the arena.
+    void* batch[kHandleMagazineBatch];
+    size_t n = 0u;
+    AcquireHandleArenaLock();
+    while (n < kHandleMagazineBatch) {
+        void* slot = handle_arena.RawAlloc();
+        if (!slot)
+            break;
+        batch[n++] = slot;
+    }
+    mutex_release(&handle_mutex);
+
+    if (n == 0u)
+        return nullptr;
+    void* slot = batch[--n];
+
+    // We might have migrated, so stash the rest in whatever cpu we are on
+    // now. Anything that does not fit goes back to the arena.
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    mag = &handle_magazines[arch_curr_cpu_num()];
+    while ((n > 0u) && (mag->count < kHandleMagazineSize))
+        mag->slots[mag->count++] = batch[--n];
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (n > 0u) {
+        AcquireHandleArenaLock();
+        while (n > 0u)
+            handle_arena.RawFree(batch[--n]);
+        mutex_release(&handle_mutex);
+    }
+    return slot;
+}
+
+static void FreeHandleSlot(void* slot) {
+    void* batch[kHandleMagazineBatch];
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    auto mag = &handle_magazines[arch_curr_cpu_num()];
+    if (mag->count < kHandleMagazineSize) {
+        mag->slots[mag->count++] = slot;
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+        return;
+    }
+    // The magazine is full. Keep the hot half and drain the older half
+    // back to the arena.
+    mag->count -= kHandleMagazineBatch;
+    memcpy(batch, &mag->slots[mag->count], sizeof(batch));
+    mag->slots[mag->count++] = slot;
+    ++mag->drains;
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    AcquireHandleArenaLock();
+    for (auto s : batch)
+        handle_arena.RawFree(s);
+    mutex_release(&handle_mutex);
+}
+
+static uint32_t HandleSlotIndex(const void* addr) {
+    return static_cast<uint32_t>(reinterpret_cast<const Handle*>(addr) -
+                                 reinterpret_cast<const Handle*>(handle_arena.start()));
+}
+
+// Advances the generation of the slot at |addr| and returns the value that
+// MapHandleToU32() yields for the handle that lives there from now on.
+static uint32_t NextHandleBaseValue(const void* addr) {
+    uint32_t index = HandleSlotIndex(addr);
+    // Generations run from 1 so that a zeroed slot never matches.
+    uint16_t gen = static_cast<uint16_t>(
+        (handle_slots[index].generation % kMaxHandleGeneration) + 1u);
+    handle_slots[index].generation = gen;
+    return index | (static_cast<uint32_t>(gen) << kHandleIndexBits);
+}
+
 Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
-    AutoLock lock(&handle_mutex);
-    return handle_arena.New(mxtl::move(dispatcher), rights);
+    void* addr = AllocHandleSlot();
+    if (!addr)
+        return nullptr;
+    return new (addr) Handle(mxtl::move(dispatcher), rights, NextHandleBaseValue(addr));
 }
 
 Handle* DupHandle(Handle* source, mx_rights_t rights) {
-    AutoLock lock(&handle_mutex);
-    return handle_arena.New(source, rights);
+    void* addr = AllocHandleSlot();
+    if (!addr)
+        return nullptr;
+    return new (addr) Handle(source, rights, NextHandleBaseValue(addr));
+}
+
+void RenewHandleValue(Handle* handle) {
+    DEBUG_ASSERT(handle->process_id() == 0u);
+    handle->set_base_value(NextHandleBaseValue(handle));
+}
+
+Handle* BeginHandleLookup(uint32_t value, spin_lock_saved_state_t* state) {
+    uint32_t index = value & kHandleIndexMask;
+    auto handle = &reinterpret_cast<Handle*>(handle_arena.start())[index];
+    if (!handle_arena.in_range(handle))
+        return nullptr;
+
+    arch_interrupt_save(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    atomic_add(&handle_slots[index].lookups, 1);
+    if (handle->base_value() != value) {
+        atomic_add_release(&handle_slots[index].lookups, -1);
+        arch_interrupt_restore(*state, SPIN_LOCK_FLAG_INTERRUPTS);
+        return nullptr;
+    }
+    return handle;
+}
+
+void EndHandleLookup(Handle* handle, spin_lock_saved_state_t state) {
+    atomic_add_release(&handle_slots[HandleSlotIndex(handle)].lookups, -1);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Waits for the lookups of |handle|'s slot that could have observed it
+// before it was disowned. Lookups run with interrupts disabled and are a
+// handful of instructions long, and only lookups of this one slot are
+// waited for, so this is usually a single load.
+static void WaitForHandleLookups(const Handle* handle) {
+    smp_mb();
+    auto slot = &handle_slots[HandleSlotIndex(handle)];
+    while (atomic_load(&slot->lookups) != 0)
+        arch_spinloop_pause();
 }
 
 void DeleteHandle(Handle* handle) {
+    // Make sure no lock-free lookup can still be using |handle|.
+    handle->set_process_id(0u);
+    WaitForHandleLookups(handle);
+
     StateTracker* state_tracker = handle->dispatcher()->get_state_tracker();
     if (state_tracker) {
         state_tracker->Cancel(handle);
@@ -90,25 +293,40 @@ void DeleteHandle(Handle* handle) {
     // table lookup.
     memset(handle, 0, sizeof(Handle));
 
-    AutoLock lock(&handle_mutex);
-    handle_arena.RawFree(handle);
+    FreeHandleSlot(handle);
 }
 
+void GetHandleCacheStats(HandleCacheStats* stats) {
+    *stats = {};
+    for (const auto& mag : handle_magazines) {
+        stats->cached += mag.count;
+        stats->hits += mag.hits;
+        stats->refills += mag.refills;
+        stats->drains += mag.drains;
+    }
+    stats->contended = static_cast<uint64_t>(atomic_load(&handle_mutex_contended));
+}
+
+// Lock-free: the arena only ever grows and slots are zeroed until they are
+// handed out, so a racy lookup at worst fails the owner check.
 bool HandleInRange(void* addr) {
-    AutoLock lock(&handle_mutex);
     return handle_arena.in_range(addr);
 }
 
+uint32_t GetMaxHandlesPerProcess() {
+    return max_handles_per_process;
+}
+
 uint32_t MapHandleToU32(const Handle* handle) {
-    auto va = handle - reinterpret_cast<Handle*>(handle_arena.start());
-    return static_cast<uint32_t>(va);
+    return handle->base_value();
 }
 
 Handle* MapU32ToHandle(uint32_t value) {
-    auto va = &reinterpret_cast<Handle*>(handle_arena.start())[value];
+    auto va = &reinterpret_cast<Handle*>(handle_arena.start())[value & kHandleIndexMask];
     if (!HandleInRange(va))
         return nullptr;
-    return reinterpret_cast<Handle*>(va);
+    auto handle = reinterpret_cast<Handle*>(va);
+    return (handle->base_value() == value) ? handle : nullptr;
 }
 
 mx_status_t SetSystemExceptionPort(mxtl::RefPtr<ExceptionPort> eport) {
@@ -8,33 +8,166 @@
 
 #include <err.h>
 #include <new.h>
+#include <string.h>
+
+#include <arch/ops.h>
+
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+
+#include <lk/init.h>
 
 #include <magenta/magenta.h>
 
-// static
-mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
-                                  mxtl::unique_ptr<MessagePacket>* msg) {
-    AllocChecker ac;
+#include <mxtl/arena.h>
 
-    msg->reset(new (&ac) MessagePacket(data_size, num_handles));
-    if (!ac.check())
-        return ERR_NO_MEMORY;
+// A packet is laid out as the MessagePacket itself, followed by the handle
+// array and then the data, so that each message is a single allocation.
+static size_t PacketSize(uint32_t data_size, uint32_t num_handles) {
+    return sizeof(MessagePacket) + num_handles * sizeof(Handle*) + data_size;
+}
+
+// Small packets come from fixed size slots in |packet_arena|.
+constexpr size_t kPooledPacketSize =
+    sizeof(MessagePacket) + MessagePacket::kMaxPooledHandles * sizeof(Handle*) +
+    MessagePacket::kMaxPooledDataSize;
+constexpr size_t kMaxPooledPackets = 16 * 1024;
+
+static mutex_t packet_mutex = MUTEX_INITIAL_VALUE(packet_mutex);
+static mxtl::Arena packet_arena;
+
+// Each cpu keeps a magazine of free pool slots in front of the arena, in
+// the same way as the handle magazines. It is only touched by its own cpu
+// with interrupts disabled and is refilled (or drained) half a magazine at
+// a time under |packet_mutex|.
+constexpr size_t kPacketMagazineSize = 32u;
+constexpr size_t kPacketMagazineBatch = kPacketMagazineSize / 2u;
+
+struct PacketMagazine {
+    size_t count;
+    void* slots[kPacketMagazineSize];
+    // Statistics, see MessagePacket::GetStats().
+    uint64_t hits;
+    uint64_t refills;
+    uint64_t drains;
+    uint64_t heap_allocs;
+} __CPU_ALIGN;
+
+static PacketMagazine packet_magazines[SMP_MAX_CPUS];
+
+static void message_packet_init(uint level) {
+    packet_arena.Init("msg_packets", kPooledPacketSize, kMaxPooledPackets);
+}
+
+static void* AllocPooledPacket() {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    auto mag = &packet_magazines[arch_curr_cpu_num()];
+    if (mag->count > 0u) {
+        void* slot = mag->slots[--mag->count];
+        ++mag->hits;
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+        return slot;
+    }
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    void* batch[kPacketMagazineBatch];
+    size_t n = 0u;
+    mutex_acquire(&packet_mutex);
+    while (n < kPacketMagazineBatch) {
+        void* slot = packet_arena.Alloc();
+        if (!slot)
+            break;
+        batch[n++] = slot;
+    }
+    mutex_release(&packet_mutex);
+
+    if (n == 0u)
+        return nullptr;
+    void* slot = batch[--n];
+
+    // We might have migrated; anything that does not fit in the current
+    // cpu's magazine goes back to the arena.
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    mag = &packet_magazines[arch_curr_cpu_num()];
+    ++mag->refills;
+    while ((n > 0u) && (mag->count < kPacketMagazineSize))
+        mag->slots[mag->count++] = batch[--n];
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 
-    if (data_size > 0u) {
-        (*msg)->data_.reset(new (&ac) uint8_t[data_size]);
-        if (!ac.check())
-            return ERR_NO_MEMORY;
+    if (n > 0u) {
+        mutex_acquire(&packet_mutex);
+        while (n > 0u)
+            packet_arena.Free(batch[--n]);
+        mutex_release(&packet_mutex);
     }
+    return slot;
+}
+
+static void FreePooledPacket(void* slot) {
+    void* batch[kPacketMagazineBatch];
 
-    if (num_handles > 0u) {
-        (*msg)->handles_.reset(new (&ac) Handle*[num_handles]);
-        if (!ac.check())
-            return ERR_NO_MEMORY;
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    auto mag = &packet_magazines[arch_curr_cpu_num()];
+    if (mag->count < kPacketMagazineSize) {
+        mag->slots[mag->count++] = slot;
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+        return;
     }
+    mag->count -= kPacketMagazineBatch;
+    memcpy(batch, &mag->slots[mag->count], sizeof(batch));
+    mag->slots[mag->count++] = slot;
+    ++mag->drains;
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    mutex_acquire(&packet_mutex);
+    for (auto s : batch)
+        packet_arena.Free(s);
+    mutex_release(&packet_mutex);
+}
+
+static void* AllocHeapPacket(size_t size) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    ++packet_magazines[arch_curr_cpu_num()].heap_allocs;
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    AllocChecker ac;
+    auto mem = new (&ac) uint8_t[size];
+    return ac.check() ? mem : nullptr;
+}
+
+// static
+mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
+                                  mxtl::unique_ptr<MessagePacket>* msg) {
+    void* mem = nullptr;
+    if ((data_size <= kMaxPooledDataSize) && (num_handles <= kMaxPooledHandles))
+        mem = AllocPooledPacket();
+    if (!mem)
+        mem = AllocHeapPacket(PacketSize(data_size, num_handles));
+    if (!mem)
+        return ERR_NO_MEMORY;
 
+    auto handles = reinterpret_cast<Handle**>(static_cast<uint8_t*>(mem) + sizeof(MessagePacket));
+    auto data = reinterpret_cast<uint8_t*>(handles + num_handles);
+    msg->reset(new (mem) MessagePacket(data_size, num_handles, handles, data));
     return NO_ERROR;
 }
 
+// static
+void MessagePacket::GetStats(MessagePacketStats* stats) {
+    *stats = {};
+    for (const auto& mag : packet_magazines) {
+        stats->cached += mag.count;
+        stats->pool_allocs += mag.hits + mag.refills;
+        stats->cache_allocs += mag.hits;
+        stats->refills += mag.refills;
+        stats->drains += mag.drains;
+        stats->heap_allocs += mag.heap_allocs;
+    }
+}
+
 MessagePacket::~MessagePacket() {
     if (owns_handles_) {
         for (uint32_t i = 0; i < num_handles_; i++)
@@ -42,6 +175,19 @@ MessagePacket::~MessagePacket() {
     }
 }
 
-MessagePacket::MessagePacket(uint32_t data_size, uint32_t num_handles)
-    : owns_handles_(false), data_size_(data_size), num_handles_(num_handles) {
+// static
+void MessagePacket::operator delete(void* ptr) {
+    if (packet_arena.in_range(ptr)) {
+        FreePooledPacket(ptr);
+    } else {
+        delete[] static_cast<uint8_t*>(ptr);
+    }
 }
+
+MessagePacket::MessagePacket(uint32_t data_size, uint32_t num_handles,
+                             Handle** handles, uint8_t* data)
+    : owns_handles_(false), data_size_(data_size), num_handles_(num_handles),
+      handles_(handles), data_(data) {
+}
+
+LK_INIT_HOOK(message_packets, message_packet_init, LK_INIT_LEVEL_THREADING);
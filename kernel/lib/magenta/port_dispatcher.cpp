@@ -22,6 +22,14 @@
 constexpr mx_rights_t kDefaultIOPortRights =
     MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
 
+// Packets queued from userspace, which are at most MX_PORT_MAX_PKT_SIZE
+// bytes, come from fixed size slots owned by the port they are queued on.
+// Freed slots are kept for reuse, up to kMaxCachedPackets per port.
+constexpr size_t kPooledPacketSize = sizeof(IOP_Packet) + MX_PORT_MAX_PKT_SIZE;
+constexpr uint32_t kMaxCachedPackets = 64u;
+
+static mutex_class_t port_lock_class = MUTEX_CLASS_INITIAL_VALUE("PortDispatcher::lock_");
+
 IOP_Packet* IOP_Packet::Alloc(mx_size_t size) {
     AllocChecker ac;
     auto mem = new (&ac) char [sizeof(IOP_Packet) + size];
@@ -38,33 +46,25 @@ IOP_Packet* IOP_Packet::Make(const void* data, mx_size_t size) {
     return pk;
 }
 
-IOP_Packet* IOP_Packet::MakeFromUser(const void* data, mx_size_t size) {
-    auto pk = Alloc(size);
-    if (!pk)
-        return nullptr;
-
-    auto header = reinterpret_cast<mx_packet_header_t*>(
-        reinterpret_cast<char*>(pk) + sizeof(IOP_Packet));
-
-    auto status = magenta_copy_from_user(data, header, size);
-    header->type = MX_PORT_PKT_TYPE_USER;
-
-    return (status == NO_ERROR) ? pk : nullptr;
-}
-
 void IOP_Packet::Delete(IOP_Packet* packet) {
     if (!packet || packet->is_signal)
         return;
+    if (packet->pool) {
+        packet->pool->FreePacket(packet);
+        return;
+    }
     packet->~IOP_Packet();
     delete [] reinterpret_cast<char*>(packet);
 }
 
-bool IOP_Packet::CopyToUser(void* data, mx_size_t* size) {
+mx_status_t IOP_Packet::CopyToUser(void* data, mx_size_t* size) {
     if (*size < data_size)
         return ERR_BUFFER_TOO_SMALL;
     *size = data_size;
-    return copy_to_user_unsafe(
-        data, reinterpret_cast<char*>(this) + sizeof(IOP_Packet), data_size) == NO_ERROR;
+    if (copy_to_user_unsafe(
+        data, reinterpret_cast<char*>(this) + sizeof(IOP_Packet), data_size) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return NO_ERROR;
 }
 
 IOP_Signal::IOP_Signal(uint64_t key, mx_signals_t signal)
@@ -76,6 +76,9 @@ IOP_Signal::IOP_Signal(uint64_t key, mx_signals_t signal)
 mx_status_t PortDispatcher::Create(uint32_t options,
                                    mxtl::RefPtr<Dispatcher>* dispatcher,
                                    mx_rights_t* rights) {
+    if (options & ~MX_PORT_OPT_NO_YIELD)
+        return ERR_INVALID_ARGS;
+
     AllocChecker ac;
     auto disp = new (&ac) PortDispatcher(options);
     if (!ac.check())
@@ -88,20 +91,36 @@ mx_status_t PortDispatcher::Create(uint32_t options,
 
 PortDispatcher::PortDispatcher(uint32_t options)
     : options_(options),
-      no_clients_(false) {
+      lock_(&port_lock_class),
+      no_clients_(false),
+      queued_(0u),
+      pool_used_(0u),
+      pool_cached_(0u) {
     event_init(&event_, false, EVENT_FLAG_AUTOUNSIGNAL);
 }
 
 PortDispatcher::~PortDispatcher() {
     FreePackets_NoLock();
     DEBUG_ASSERT(packets_.is_empty());
+    // Pooled packets are only handed out to callers holding a reference.
+    DEBUG_ASSERT(pool_used_ == 0u);
+    IOP_Packet* pk;
+    while ((pk = free_packets_.pop_front()) != nullptr) {
+        pk->~IOP_Packet();
+        delete [] reinterpret_cast<char*>(pk);
+    }
     event_destroy(&event_);
 }
 
 void PortDispatcher::FreePackets_NoLock() {
-    while (!packets_.is_empty()) {
-        IOP_Packet::Delete(packets_.pop_front());
+    IOP_Packet* pk;
+    while ((pk = packets_.pop_front()) != nullptr) {
+        if (pk->pool)
+            FreePacket_NoLock(pk);
+        else
+            IOP_Packet::Delete(pk);
     }
+    queued_ = 0u;
     while (!at_zero_.is_empty()) {
         auto signal = at_zero_.pop_front();
         if (signal) {
@@ -126,6 +145,7 @@ mx_status_t PortDispatcher::Queue(IOP_Packet* packet) {
             status = ERR_UNAVAILABLE;
         } else {
             packets_.push_back(packet);
+            ++queued_;
             wake_count = event_signal_etc(&event_, false, status);
         }
     }
@@ -135,12 +155,79 @@ mx_status_t PortDispatcher::Queue(IOP_Packet* packet) {
         return status;
     }
 
-    if (wake_count)
+    if (wake_count && !(options_ & MX_PORT_OPT_NO_YIELD))
         thread_preempt(false);
 
     return NO_ERROR;
 }
 
+mx_status_t PortDispatcher::QueueFromUser(const void* data, mx_size_t size) {
+    DEBUG_ASSERT(size <= MX_PORT_MAX_PKT_SIZE);
+
+    IOP_Packet* pk;
+    {
+        AutoLock al(&lock_);
+        if (no_clients_)
+            return ERR_UNAVAILABLE;
+        if (pool_used_ >= kMaxQueuedPackets)
+            return ERR_SHOULD_WAIT;
+        pk = AllocPacket_NoLock(size);
+        if (!pk)
+            return ERR_NO_MEMORY;
+    }
+
+    auto header = reinterpret_cast<mx_packet_header_t*>(
+        reinterpret_cast<char*>(pk) + sizeof(IOP_Packet));
+
+    if (magenta_copy_from_user(data, header, size) != NO_ERROR) {
+        FreePacket(pk);
+        return ERR_INVALID_ARGS;
+    }
+    header->type = MX_PORT_PKT_TYPE_USER;
+
+    return Queue(pk);
+}
+
+IOP_Packet* PortDispatcher::AllocPacket_NoLock(mx_size_t size) {
+    IOP_Packet* pk = free_packets_.pop_front();
+    if (pk) {
+        pk->data_size = size;
+        --pool_cached_;
+    } else {
+        AllocChecker ac;
+        auto mem = new (&ac) char [kPooledPacketSize];
+        if (!ac.check())
+            return nullptr;
+        pk = new (mem) IOP_Packet(size);
+        pk->pool = this;
+    }
+    ++pool_used_;
+    return pk;
+}
+
+void PortDispatcher::FreePacket(IOP_Packet* packet) {
+    AutoLock al(&lock_);
+    FreePacket_NoLock(packet);
+}
+
+void PortDispatcher::FreePacket_NoLock(IOP_Packet* packet) {
+    DEBUG_ASSERT(packet->pool == this);
+    --pool_used_;
+    if (!no_clients_ && pool_cached_ < kMaxCachedPackets) {
+        free_packets_.push_front(packet);
+        ++pool_cached_;
+    } else {
+        packet->~IOP_Packet();
+        delete [] reinterpret_cast<char*>(packet);
+    }
+}
+
+void PortDispatcher::GetPoolUsage(uint32_t* used, uint32_t* cached) {
+    AutoLock al(&lock_);
+    *used = pool_used_;
+    *cached = pool_cached_;
+}
+
 void* PortDispatcher::Signal(void* cookie, uint64_t key, mx_signals_t signal) {
     IOP_Signal* node;
     int prev_count;
@@ -171,34 +258,81 @@ void* PortDispatcher::Signal(void* cookie, uint64_t key, mx_signals_t signal) {
         wake_count = event_signal_etc(&event_, false, NO_ERROR);
     }
 
-    if (wake_count)
+    if (wake_count && !(options_ & MX_PORT_OPT_NO_YIELD))
         thread_yield();
 
     return node;
 }
 
+uint32_t PortDispatcher::GetQueuedCount() {
+    AutoLock al(&lock_);
+    return queued_;
+}
+
+IOP_Packet* PortDispatcher::Dequeue_NoLock() {
+    auto pk = packets_.pop_front();
+    ASSERT(pk);
+
+    if (!pk->is_signal) {
+        --queued_;
+    } else {
+        auto signal = static_cast<IOP_Signal*>(pk);
+        auto prev = atomic_add(&signal->count, -1);
+        if (prev == 1)
+            at_zero_.push_back(signal);
+        else
+            packets_.push_back(signal);
+    }
+    return pk;
+}
+
 mx_status_t PortDispatcher::Wait(mx_time_t timeout, IOP_Packet** packet) {
     while (true) {
         {
             AutoLock al(&lock_);
             if (!packets_.is_empty()) {
-                auto pk = packets_.pop_front();
-                ASSERT(pk);
-
-                if (!pk->is_signal) {
-                    *packet = pk;
-                } else {
-                    auto signal = static_cast<IOP_Signal*>(pk);
-                    auto prev = atomic_add(&signal->count, -1);
-                    if (prev == 1)
-                        at_zero_.push_back(signal);
-                    else
-                        packets_.push_back(signal);
-                    *packet = signal;
-                }
+                *packet = Dequeue_NoLock();
                 return NO_ERROR;
             }
+        }
 
+        if (timeout == 0ull)
+            return ERR_TIMED_OUT;
+
+        lk_time_t t = mx_time_to_lk(timeout);
+        status_t st = event_wait_timeout(&event_, (t == 0u) ? 1u : t, true);
+        if (st != NO_ERROR)
+            return st;
+    }
+}
+
+mx_status_t PortDispatcher::WaitMany(mx_time_t timeout, mx_size_t max_size,
+                                     IOP_Packet** packets, uint32_t* count) {
+    DEBUG_ASSERT(*count > 0);
+
+    while (true) {
+        {
+            AutoLock al(&lock_);
+            if (!packets_.is_empty()) {
+                if (packets_.front().data_size > max_size)
+                    return ERR_BUFFER_TOO_SMALL;
+
+                // Take as many packets as fit, stopping at the first one
+                // that is too big so it stays at the head of the queue.
+                uint32_t n = 0;
+                while (n < *count && !packets_.is_empty() &&
+                       packets_.front().data_size <= max_size) {
+                    packets[n++] = Dequeue_NoLock();
+                }
+
+                // Other waiters were only woken for one packet, pass the
+                // wakeup on if some are left.
+                if (!packets_.is_empty())
+                    event_signal(&event_, false);
+
+                *count = n;
+                return NO_ERROR;
+            }
         }
 
         if (timeout == 0ull)
@@ -6,6 +6,7 @@
 
 #include <magenta/process_dispatcher.h>
 
+#include <arch/ops.h>
 #include <assert.h>
 #include <inttypes.h>
 #include <list.h>
@@ -51,9 +52,12 @@ mx_handle_t map_handle_to_value(const Handle* handle, mx_handle_t mixer) {
     return mixer ^ handle_id;
 }
 
+static uint32_t map_value_to_u32(mx_handle_t value, mx_handle_t mixer) {
+    return (value ^ mixer) >> 2;
+}
+
 Handle* map_value_to_handle(mx_handle_t value, mx_handle_t mixer) {
-    auto handle_id = (value ^ mixer) >> 2;
-    return MapU32ToHandle(handle_id);
+    return MapU32ToHandle(map_value_to_u32(value, mixer));
 }
 
 mx_status_t ProcessDispatcher::Create(mxtl::RefPtr<JobDispatcher> job,
@@ -290,6 +294,8 @@ void ProcessDispatcher::SetState(State s) {
             while ((handle = handles_.pop_front()) != nullptr) {
                 DeleteHandle(handle);
             }
+            atomic_add(&handle_quota_used_, -static_cast<int>(handle_count_));
+            handle_count_ = 0u;
         }
         LTRACEF_LEVEL(2, "done cleaning up handle table on proc %p\n", this);
 
@@ -322,14 +328,46 @@ Handle* ProcessDispatcher::GetHandle_NoLock(mx_handle_t handle_value) {
     return (handle->process_id() == get_koid()) ? handle : nullptr;
 }
 
-void ProcessDispatcher::AddHandle(HandleUniquePtr handle) {
+mx_status_t ProcessDispatcher::AddHandle(HandleUniquePtr handle) {
+    AutoLock lock(&handle_table_lock_);
+    return AddHandle_NoLock(mxtl::move(handle));
+}
+
+mx_status_t ProcessDispatcher::AddHandle_NoLock(HandleUniquePtr handle) {
+    mx_status_t status = ReserveHandles(1u);
+    if (status != NO_ERROR)
+        return status;
+    InsertHandle_NoLock(handle.release());
+    return NO_ERROR;
+}
+
+mx_status_t ProcessDispatcher::ReserveHandles(uint32_t count) {
+    // Lock-free so that it can be called with other dispatchers' locks
+    // held, which must never nest outside |handle_table_lock_|.
+    const int max = static_cast<int>(GetMaxHandlesPerProcess());
+    int used = atomic_load(&handle_quota_used_);
+    do {
+        if (count > static_cast<uint32_t>(max - used)) {
+            LTRACEF("process %" PRIu64 " is over its handle quota\n", get_koid());
+            return ERR_NO_RESOURCES;
+        }
+    } while (!atomic_cmpxchg(&handle_quota_used_, &used, used + static_cast<int>(count)));
+    return NO_ERROR;
+}
+
+void ProcessDispatcher::UnreserveHandles(uint32_t count) {
+    atomic_add(&handle_quota_used_, -static_cast<int>(count));
+}
+
+void ProcessDispatcher::AddReservedHandle(HandleUniquePtr handle) {
     AutoLock lock(&handle_table_lock_);
-    AddHandle_NoLock(mxtl::move(handle));
+    InsertHandle_NoLock(handle.release());
 }
 
-void ProcessDispatcher::AddHandle_NoLock(HandleUniquePtr handle) {
+void ProcessDispatcher::InsertHandle_NoLock(Handle* handle) {
     handle->set_process_id(get_koid());
-    handles_.push_front(handle.release());
+    handles_.push_front(handle);
+    ++handle_count_;
 }
 
 HandleUniquePtr ProcessDispatcher::RemoveHandle(mx_handle_t handle_value) {
@@ -342,26 +380,40 @@ HandleUniquePtr ProcessDispatcher::RemoveHandle_NoLock(mx_handle_t handle_value)
     if (!handle)
         return nullptr;
     handles_.erase(*handle);
+    --handle_count_;
+    atomic_add(&handle_quota_used_, -1);
     handle->set_process_id(0u);
 
     return HandleUniquePtr(handle);
 }
 
 void ProcessDispatcher::UndoRemoveHandle_NoLock(mx_handle_t handle_value) {
-    auto handle = map_value_to_handle(handle_value, handle_rand_);
-    AddHandle_NoLock(HandleUniquePtr(handle));
+    // Not subject to the handle quota, the handle was ours to begin with.
+    atomic_add(&handle_quota_used_, 1);
+    InsertHandle_NoLock(map_value_to_handle(handle_value, handle_rand_));
 }
 
 bool ProcessDispatcher::GetDispatcher(mx_handle_t handle_value,
                                       mxtl::RefPtr<Dispatcher>* dispatcher,
                                       uint32_t* rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandle_NoLock(handle_value);
+    // This is the hot path of almost every syscall so it does not take
+    // |handle_table_lock_|. The handle value is decoded straight to its
+    // arena slot and the slot generation and owner are checked; the
+    // handle cannot be destroyed until EndHandleLookup().
+    mxtl::RefPtr<Dispatcher> found;
+    spin_lock_saved_state_t state;
+    Handle* handle = BeginHandleLookup(map_value_to_u32(handle_value, handle_rand_), &state);
     if (!handle)
         return false;
+    if (handle->process_id() == get_koid()) {
+        *rights = handle->rights();
+        found = handle->dispatcher();
+    }
+    EndHandleLookup(handle, state);
 
-    *rights = handle->rights();
-    *dispatcher = handle->dispatcher();
+    if (!found)
+        return false;
+    *dispatcher = mxtl::move(found);
     return true;
 }
 
@@ -0,0 +1,203 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/timer_dispatcher.h>
+
+#include <err.h>
+#include <new.h>
+#include <platform.h>
+
+#include <kernel/auto_lock.h>
+
+#include <magenta/port_client.h>
+#include <magenta/state_tracker.h>
+
+#include <mxtl/algorithm.h>
+
+constexpr mx_rights_t kDefaultTimerRights =
+    MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
+
+// Kernel timers count milliseconds in 32 bits. Deadlines further out than this are reached
+// in several steps, the timer is simply re-armed when it fires early.
+constexpr uint64_t kMaxTimerDelayMs = 1u << 30;
+
+status_t TimerDispatcher::Create(uint32_t options, mxtl::RefPtr<Dispatcher>* dispatcher,
+                                 mx_rights_t* rights) {
+    if (options != 0u)
+        return ERR_INVALID_ARGS;
+
+    AllocChecker ac;
+    auto disp = new (&ac) TimerDispatcher(options);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    *rights = kDefaultTimerRights;
+    *dispatcher = mxtl::AdoptRef<Dispatcher>(disp);
+    return NO_ERROR;
+}
+
+TimerDispatcher::TimerDispatcher(uint32_t options)
+        : state_tracker_(0u) {
+    timer_initialize(&timer_);
+    dpc_.func = &TimerDispatcher::TimerDpc;
+    dpc_.arg = this;
+}
+
+TimerDispatcher::~TimerDispatcher() {
+    // |self_ref_| is held whenever the timer can fire, so by now it cannot.
+    DEBUG_ASSERT(!armed_);
+    DEBUG_ASSERT(!dpc_queued_);
+}
+
+void TimerDispatcher::on_zero_handles() {
+    // Nobody can observe the timer anymore; drop the reference an armed timer holds.
+    Cancel();
+}
+
+status_t TimerDispatcher::set_port_client(mxtl::unique_ptr<PortClient> client) {
+    if ((client->get_trigger_signals() & ~MX_TIMER_SIGNALED) != 0)
+        return ERR_INVALID_ARGS;
+
+    AutoLock lock(&lock_);
+    if (iopc_)
+        return ERR_BAD_STATE;
+
+    iopc_ = mxtl::move(client);
+
+    if (state_tracker_.GetSignalsState() & MX_TIMER_SIGNALED)
+        iopc_->Signal(MX_TIMER_SIGNALED, &lock_);
+
+    return NO_ERROR;
+}
+
+status_t TimerDispatcher::Set(mx_time_t deadline, mx_time_t slack) {
+    if (deadline == MX_TIME_INFINITE)
+        return Cancel();
+
+    mxtl::RefPtr<TimerDispatcher> ref;
+    {
+        AutoLock lock(&lock_);
+
+        timer_cancel_sync(&timer_);
+        state_tracker_.UpdateState(MX_TIMER_SIGNALED, 0u);
+
+        deadline_ = deadline;
+        slack_ = slack;
+
+        mx_time_t now = current_time_hires();
+        if (deadline_ <= now) {
+            armed_ = false;
+            Signal_NoLock();
+            if (!DpcQueued())
+                ref = mxtl::move(self_ref_);
+        } else {
+            armed_ = true;
+            if (!self_ref_)
+                self_ref_ = mxtl::WrapRefPtr(this);
+            ArmTimer_NoLock(now);
+        }
+    }
+
+    // |ref| may have been the last reference.
+    return NO_ERROR;
+}
+
+status_t TimerDispatcher::Cancel() {
+    mxtl::RefPtr<TimerDispatcher> ref;
+    {
+        AutoLock lock(&lock_);
+
+        armed_ = false;
+        timer_cancel_sync(&timer_);
+        state_tracker_.UpdateState(MX_TIMER_SIGNALED, 0u);
+
+        // A queued dpc still needs the object, it drops the reference when it runs.
+        if (!DpcQueued())
+            ref = mxtl::move(self_ref_);
+    }
+
+    return NO_ERROR;
+}
+
+void TimerDispatcher::ArmTimer_NoLock(mx_time_t now) {
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(deadline_ > now);
+
+    mx_time_t delay = deadline_ - now;
+    uint64_t delay_ms = delay / MX_MSEC(1) + ((delay % MX_MSEC(1)) ? 1u : 0u);
+    uint64_t slack_ms = slack_ / MX_MSEC(1);
+
+    timer_set_oneshot_etc(&timer_,
+                          static_cast<lk_time_t>(mxtl::min(delay_ms, kMaxTimerDelayMs)),
+                          static_cast<lk_time_t>(mxtl::min(slack_ms, kMaxTimerDelayMs)),
+                          &TimerDispatcher::TimerCallback, this);
+}
+
+void TimerDispatcher::Signal_NoLock() {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    state_tracker_.UpdateState(0u, MX_TIMER_SIGNALED);
+    if (iopc_)
+        iopc_->Signal(MX_TIMER_SIGNALED, &lock_);
+}
+
+bool TimerDispatcher::DpcQueued() {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&dpc_lock_, state);
+    bool queued = dpc_queued_;
+    spin_unlock_irqrestore(&dpc_lock_, state);
+    return queued;
+}
+
+enum handler_return TimerDispatcher::TimerCallback(timer_t* timer, lk_time_t now, void* arg) {
+    auto disp = static_cast<TimerDispatcher*>(arg);
+
+    // Signaling takes mutexes, so it has to happen on the dpc thread.
+    spin_lock(&disp->dpc_lock_);
+    if (!disp->dpc_queued_) {
+        disp->dpc_queued_ = true;
+        dpc_queue(&disp->dpc_, false);
+    }
+    spin_unlock(&disp->dpc_lock_);
+
+    return INT_RESCHEDULE;
+}
+
+void TimerDispatcher::TimerDpc(dpc_t* dpc) {
+    static_cast<TimerDispatcher*>(dpc->arg)->OnTimerFired();
+}
+
+void TimerDispatcher::OnTimerFired() {
+    mxtl::RefPtr<TimerDispatcher> ref;
+    {
+        AutoLock lock(&lock_);
+
+        // Only mark the dpc done once |lock_| is held, so Cancel() can't drop the last
+        // reference while this is waiting for the lock.
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&dpc_lock_, state);
+        dpc_queued_ = false;
+        spin_unlock_irqrestore(&dpc_lock_, state);
+
+        // The timer may have been canceled or set again after it fired, |armed_| and
+        // |deadline_| say what should happen now.
+        if (armed_) {
+            mx_time_t now = current_time_hires();
+            if (now < deadline_) {
+                timer_cancel_sync(&timer_);
+                ArmTimer_NoLock(now);
+            } else {
+                armed_ = false;
+                Signal_NoLock();
+            }
+        }
+
+        if (!armed_ && !DpcQueued())
+            ref = mxtl::move(self_ref_);
+    }
+
+    // |ref| may have been the last reference, |this| must not be touched past here.
+}
@@ -63,6 +63,21 @@ mx_status_t VmObjectDispatcher::GetSize(uint64_t* size) {
     return NO_ERROR;
 }
 
+mx_status_t VmObjectDispatcher::Clone(uint32_t options, uint64_t offset, uint64_t size,
+                                      mxtl::RefPtr<Dispatcher>* clone, mx_rights_t* rights) {
+    LTRACEF("options %#x offset %#" PRIx64 " size %#" PRIx64 "\n", options, offset, size);
+
+    if (options != MX_VMO_CLONE_COPY_ON_WRITE)
+        return ERR_INVALID_ARGS;
+
+    mxtl::RefPtr<VmObject> clone_vmo;
+    mx_status_t status = vmo_->CloneCOW(offset, size, &clone_vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    return Create(mxtl::move(clone_vmo), clone, rights);
+}
+
 mx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t size,
                                         user_ptr<void> buffer, size_t buffer_size, mx_rights_t rights) {
     LTRACEF("op %u offset %#" PRIx64 " size %#" PRIx64
@@ -26,10 +26,14 @@
 
 // static
 status_t WaitSetDispatcher::Entry::Create(mx_signals_t watched_signals,
+                                          uint32_t options,
                                           uint64_t cookie,
                                           mxtl::unique_ptr<Entry>* entry) {
+    if (options & ~MX_WAITSET_EDGE_TRIGGERED)
+        return ERR_INVALID_ARGS;
+
     AllocChecker ac;
-    Entry* e = new (&ac) Entry (watched_signals, cookie);
+    Entry* e = new (&ac) Entry (watched_signals, options & MX_WAITSET_EDGE_TRIGGERED, cookie);
     if (!ac.check())
         return ERR_NO_MEMORY;
 
@@ -87,8 +91,10 @@ mx_signals_t WaitSetDispatcher::Entry::GetSignalsState_NoLock() const {
     return signals_;
 }
 
-WaitSetDispatcher::Entry::Entry(mx_signals_t watched_signals, uint64_t cookie)
-    : StateObserver(), watched_signals_(watched_signals), cookie_(cookie) {}
+WaitSetDispatcher::Entry::Entry(mx_signals_t watched_signals, bool edge_triggered,
+                                uint64_t cookie)
+    : StateObserver(), watched_signals_(watched_signals), edge_triggered_(edge_triggered),
+      cookie_(cookie) {}
 
 bool WaitSetDispatcher::Entry::OnInitialize(mx_signals_t initial_state) {
     AutoLock lock(&wait_set_->mutex_);
@@ -112,27 +118,25 @@ bool WaitSetDispatcher::Entry::OnStateChange(mx_signals_t new_state) {
 
     DEBUG_ASSERT(state_ == State::ADDED);
 
+    mx_signals_t old_state = signals_;
     signals_= new_state;
 
+    if (edge_triggered_) {
+        // Only a watched signal going from deasserted to asserted counts. Once triggered, the
+        // entry stays that way until Wait() reports it.
+        if (is_triggered_ || !(watched_signals_ & new_state & ~old_state))
+            return false;
+        return Trigger_NoLock();
+    }
+
     if (watched_signals_ & signals_) {
         if (is_triggered_)
             return false;  // Already triggered.
         return Trigger_NoLock();
     }
 
-    if (is_triggered_) {
-        DEBUG_ASSERT(InTriggeredEntriesList_NoLock());
-        is_triggered_ = false;
-        wait_set_->triggered_entries_.erase(*this);
-
-        DEBUG_ASSERT(wait_set_->num_triggered_entries_ > 0u);
-        wait_set_->num_triggered_entries_--;
-
-        if ((wait_set_->num_triggered_entries_ == 0) &&
-            (!wait_set_->cancelled_)) {
-            event_unsignal(&wait_set_->event_);
-        }
-    }
+    if (is_triggered_)
+        Untrigger_NoLock();
     return false;
 }
 
@@ -181,6 +185,23 @@ bool WaitSetDispatcher::Entry::Trigger_NoLock() {
     return false;
 }
 
+void WaitSetDispatcher::Entry::Untrigger_NoLock() {
+    DEBUG_ASSERT(wait_set_->mutex_.IsHeld());
+
+    DEBUG_ASSERT(is_triggered_);
+    DEBUG_ASSERT(InTriggeredEntriesList_NoLock());
+    is_triggered_ = false;
+    wait_set_->triggered_entries_.erase(*this);
+
+    DEBUG_ASSERT(wait_set_->num_triggered_entries_ > 0u);
+    wait_set_->num_triggered_entries_--;
+
+    if ((wait_set_->num_triggered_entries_ == 0) &&
+        (!wait_set_->cancelled_)) {
+        event_unsignal(&wait_set_->event_);
+    }
+}
+
 // WaitSetDispatcher -------------------------------------------------------------------------------
 
 constexpr mx_rights_t kDefaultWaitSetRights = MX_RIGHT_READ | MX_RIGHT_WRITE;
@@ -333,23 +354,31 @@ status_t WaitSetDispatcher::Wait(mx_time_t timeout,
     if (num_triggered_entries_ < *num_results)
         *num_results = num_triggered_entries_;
 
-    auto it = triggered_entries_.cbegin();
-    for (uint32_t i = 0; i < *num_results; i++, ++it) {
-        DEBUG_ASSERT(it != triggered_entries_.cend());
+    *max_results = num_triggered_entries_;
+
+    for (uint32_t i = 0; i < *num_results; i++) {
+        DEBUG_ASSERT(!triggered_entries_.is_empty());
+        Entry* e = &triggered_entries_.front();
 
-        results[i].cookie = it->GetKey();
-        if (it->GetHandle_NoLock()) {
+        results[i].cookie = e->GetKey();
+        if (e->GetHandle_NoLock()) {
             // Not cancelled
             results[i].status = NO_ERROR;
-            results[i].observed = it->GetSignalsState_NoLock();
+            results[i].observed = e->GetSignalsState_NoLock();
         } else {
             // Cancelled.
             results[i].status = ERR_HANDLE_CLOSED;
             results[i].observed = 0;
         }
-    }
 
-    *max_results = num_triggered_entries_;
+        // A cancelled entry keeps being reported until it is removed, whatever its mode.
+        if (e->edge_triggered() && e->GetHandle_NoLock()) {
+            e->Untrigger_NoLock();
+        } else {
+            triggered_entries_.erase(*e);
+            triggered_entries_.push_back(e);
+        }
+    }
 
     return result;
 }
@@ -97,7 +97,7 @@ void* Arena::Alloc() {
     } else if (d_top_ < d_end_) {
         CommitMemoryAheadIfNeeded();
         auto slot = d_top_;
-        d_top_ += ob_size_;
+        __atomic_store_n(&d_top_, d_top_ + ob_size_, __ATOMIC_RELEASE);
         return slot;
     } else {
         return nullptr;
@@ -36,9 +36,11 @@ public:
     void Free(void* addr);
     size_t Trim();
 
+    // Safe to call without holding the lock that serializes Alloc() and
+    // Free() since the in-use range only ever grows.
     bool in_range(void* addr) const {
         return ((addr >= static_cast<void*>(d_start_)) &&
-                (addr < static_cast<void*>(d_top_)));
+                (addr < static_cast<void*>(__atomic_load_n(&d_top_, __ATOMIC_ACQUIRE))));
     }
 
     void* start() const { return d_start_; }
@@ -90,6 +92,10 @@ public:
         arena_.Free(obj);
     }
 
+    void* RawAlloc() {
+        return arena_.Alloc();
+    }
+
     void RawFree(void* mem) {
         arena_.Free(mem);
     }
@@ -9,6 +9,9 @@
 #include <trace.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_object.h>
+#include <kernel/vm/vm_region.h>
 
 #include <lib/ktrace.h>
 #include <lib/user_copy.h>
@@ -18,6 +21,7 @@
 #include <magenta/message_packet.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/user_copy.h>
+#include <magenta/vm_object_dispatcher.h>
 
 #include <magenta/syscalls/channel.h>
 
@@ -31,6 +35,7 @@
 
 constexpr uint32_t kMaxMessageSize = 65536u;
 constexpr uint32_t kMaxMessageHandles = 1024u;
+constexpr uint32_t kMaxMessageIovecs = 16u;
 
 constexpr size_t kChannelReadHandlesChunkCount = 16u;
 constexpr size_t kChannelWriteHandlesInlineCount = 8u;
@@ -59,105 +64,187 @@ mx_status_t sys_channel_create(uint32_t flags, user_ptr<mx_handle_t> out0, user_
         return ERR_NO_MEMORY;
 
     auto up = ProcessDispatcher::GetCurrent();
-    if (out0.copy_to_user(up->MapHandleToValue(h0.get())) != NO_ERROR)
-        return ERR_INVALID_ARGS;
-    if (out1.copy_to_user(up->MapHandleToValue(h1.get())) != NO_ERROR)
+    result = up->ReserveHandles(2u);
+    if (result != NO_ERROR)
+        return result;
+
+    if (out0.copy_to_user(up->MapHandleToValue(h0.get())) != NO_ERROR ||
+        out1.copy_to_user(up->MapHandleToValue(h1.get())) != NO_ERROR) {
+        up->UnreserveHandles(2u);
         return ERR_INVALID_ARGS;
+    }
 
-    up->AddHandle(mxtl::move(h0));
-    up->AddHandle(mxtl::move(h1));
+    up->AddReservedHandle(mxtl::move(h0));
+    up->AddReservedHandle(mxtl::move(h1));
 
     ktrace(TAG_CHANNEL_CREATE, (uint32_t)id0, (uint32_t)id1, flags, 0);
     return NO_ERROR;
 }
 
-mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t flags,
-                             user_ptr<void> _bytes,
-                             uint32_t num_bytes, user_ptr<uint32_t> _num_bytes,
-                             user_ptr<mx_handle_t> _handles,
-                             uint32_t num_handles, user_ptr<uint32_t> _num_handles) {
-    LTRACEF("handle %d bytes %p num_bytes %p handles %p num_handles %p",
-            handle_value, _bytes.get(), _num_bytes.get(), _handles.get(), _num_handles.get());
-
-    auto up = ProcessDispatcher::GetCurrent();
-
-    mxtl::RefPtr<ChannelDispatcher> channel;
-    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_READ);
-    if (result != NO_ERROR)
-        return result;
-
-    if (flags & ~MX_CHANNEL_READ_MASK)
-        return ERR_NOT_SUPPORTED;
-
-    mxtl::unique_ptr<MessagePacket> msg;
-    result = channel->Read(&num_bytes, &num_handles, &msg,
-                           flags & MX_CHANNEL_READ_MAY_DISCARD);
-    if (result != NO_ERROR && result != ERR_BUFFER_TOO_SMALL)
-        return result;
+// Copies the caller's iovec array in. |iovs| must have room for kMaxMessageIovecs entries.
+// The byte counts are summed into |total|, which can't overflow with this few entries.
+static mx_status_t iovecs_get_from_user(user_ptr<const mx_channel_iovec_t> _iovs, uint32_t num_iovs,
+                                        mx_channel_iovec_t* iovs, uint64_t* total) {
+    if (num_iovs > kMaxMessageIovecs)
+        return ERR_OUT_OF_RANGE;
+    if (num_iovs > 0u && !_iovs)
+        return ERR_INVALID_ARGS;
+    if (num_iovs > 0u && _iovs.copy_array_from_user(iovs, num_iovs) != NO_ERROR)
+        return ERR_INVALID_ARGS;
 
-    // On ERR_BUFFER_TOO_SMALL, Read() gives us the size of the next message (which remains
-    // unconsumed, unless |flags| has MX_CHANNEL_READ_MAY_DISCARD set).
-    if (_num_bytes) {
-        if (_num_bytes.copy_to_user(num_bytes) != NO_ERROR)
+    *total = 0u;
+    for (uint32_t ix = 0; ix != num_iovs; ++ix) {
+        if (iovs[ix].reserved != 0u)
             return ERR_INVALID_ARGS;
+        *total += iovs[ix].num_bytes;
     }
-    if (_num_handles) {
-        if (_num_handles.copy_to_user(num_handles) != NO_ERROR)
-            return ERR_INVALID_ARGS;
-    }
-    if (result == ERR_BUFFER_TOO_SMALL)
-        return result;
+    return NO_ERROR;
+}
 
-    if (num_bytes > 0u) {
-        if (_bytes.copy_array_to_user(msg->data(), num_bytes) != NO_ERROR)
+// Copies a message that was taken off a channel out to the caller, installing its handles
+// into |up|, which must already have reserved room for them with ReserveHandles(). The first
+// |num_bytes| of the message are scattered across |iovs|, which the caller has checked are
+// large enough. On failure the reservation is given back and nothing is installed; the
+// message keeps its handles and closes them.
+static mx_status_t msg_put_to_user(ProcessDispatcher* up, MessagePacket* msg,
+                                   const mx_channel_iovec_t* iovs, uint32_t num_iovs,
+                                   uint32_t num_bytes,
+                                   user_ptr<mx_handle_t> _handles, uint32_t num_handles) {
+    auto data = static_cast<const uint8_t*>(msg->data());
+    for (uint32_t ix = 0; ix != num_iovs && num_bytes > 0u; ++ix) {
+        uint32_t len = mxtl::min(iovs[ix].num_bytes, num_bytes);
+        if (len == 0u)
+            continue;
+        if (user_ptr<void>(iovs[ix].buffer).copy_array_to_user(data, len) != NO_ERROR) {
+            up->UnreserveHandles(num_handles);
             return ERR_INVALID_ARGS;
+        }
+        data += len;
+        num_bytes -= len;
     }
 
     if (num_handles > 0u) {
         Handle* const* handle_list = msg->handles();
-        msg->set_owns_handles(false);
 
-        // Copy the handle values out in chunks.
+        // Copy the handle values out in chunks. Each handle gets a fresh value so that
+        // the one it had in the sender does not work here.
         mx_handle_t hvs[kChannelReadHandlesChunkCount];
         size_t num_copied = 0;
         do {
             size_t this_chunk_size = mxtl::min(num_handles - num_copied,
                                                kChannelReadHandlesChunkCount);
-            for (size_t i = 0; i < this_chunk_size; i++)
+            for (size_t i = 0; i < this_chunk_size; i++) {
+                RenewHandleValue(handle_list[num_copied + i]);
                 hvs[i] = up->MapHandleToValue(handle_list[num_copied + i]);
-            _handles.element_offset(num_copied).copy_array_to_user(hvs, this_chunk_size);
+            }
+            if (_handles.element_offset(num_copied).copy_array_to_user(hvs, this_chunk_size)
+                != NO_ERROR) {
+                up->UnreserveHandles(num_handles);
+                return ERR_INVALID_ARGS;
+            }
             num_copied += this_chunk_size;
         } while (num_copied < num_handles);
 
+        msg->set_owns_handles(false);
         for (size_t idx = 0u; idx < num_handles; ++idx) {
             if (handle_list[idx]->dispatcher()->get_state_tracker())
                 handle_list[idx]->dispatcher()->get_state_tracker()->Cancel(handle_list[idx]);
-            HandleUniquePtr handle(handle_list[idx]);
-            up->AddHandle(mxtl::move(handle));
+            up->AddReservedHandle(HandleUniquePtr(handle_list[idx]));
         }
     }
 
+    return NO_ERROR;
+}
+
+static mx_status_t channel_read(mx_handle_t handle_value, uint32_t flags,
+                                const mx_channel_iovec_t* iovs, uint32_t num_iovs,
+                                uint32_t num_bytes, user_ptr<uint32_t> _num_bytes,
+                                user_ptr<mx_handle_t> _handles,
+                                uint32_t num_handles, user_ptr<uint32_t> _num_handles) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_READ);
+    if (result != NO_ERROR)
+        return result;
+
+    if (flags & ~MX_CHANNEL_READ_MASK)
+        return ERR_NOT_SUPPORTED;
+
+    mxtl::unique_ptr<MessagePacket> msg;
+    result = channel->Read(&num_bytes, &num_handles, &msg,
+                           flags & MX_CHANNEL_READ_MAY_DISCARD, up);
+    if (result != NO_ERROR && result != ERR_BUFFER_TOO_SMALL)
+        return result;
+
+    // On ERR_BUFFER_TOO_SMALL, Read() gives us the size of the next message (which remains
+    // unconsumed, unless |flags| has MX_CHANNEL_READ_MAY_DISCARD set). On NO_ERROR it has
+    // reserved quota for the message's handles.
+    if ((_num_bytes && _num_bytes.copy_to_user(num_bytes) != NO_ERROR) ||
+        (_num_handles && _num_handles.copy_to_user(num_handles) != NO_ERROR)) {
+        if (result == NO_ERROR)
+            up->UnreserveHandles(num_handles);
+        return ERR_INVALID_ARGS;
+    }
+    if (result == ERR_BUFFER_TOO_SMALL)
+        return result;
+
+    result = msg_put_to_user(up, msg.get(), iovs, num_iovs, num_bytes, _handles, num_handles);
+
     ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
     return result;
 }
 
-mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
-                              user_ptr<const void> _bytes, uint32_t num_bytes,
-                              user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
-    LTRACEF("handle %d bytes %p num_bytes %u handles %p num_handles %u flags 0x%x\n",
-            handle_value, _bytes.get(), num_bytes, _handles.get(), num_handles, flags);
+mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t flags,
+                             user_ptr<void> _bytes,
+                             uint32_t num_bytes, user_ptr<uint32_t> _num_bytes,
+                             user_ptr<mx_handle_t> _handles,
+                             uint32_t num_handles, user_ptr<uint32_t> _num_handles) {
+    LTRACEF("handle %d bytes %p num_bytes %p handles %p num_handles %p",
+            handle_value, _bytes.get(), _num_bytes.get(), _handles.get(), _num_handles.get());
 
-    auto up = ProcessDispatcher::GetCurrent();
+    mx_channel_iovec_t iov = {_bytes.get(), num_bytes, 0u};
+    return channel_read(handle_value, flags, &iov, 1u, num_bytes, _num_bytes,
+                        _handles, num_handles, _num_handles);
+}
 
-    mxtl::RefPtr<ChannelDispatcher> channel;
-    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_WRITE);
+mx_status_t sys_channel_readv(mx_handle_t handle_value, uint32_t flags,
+                              user_ptr<const mx_channel_iovec_t> _iovs, uint32_t num_iovs,
+                              user_ptr<uint32_t> _num_bytes,
+                              user_ptr<mx_handle_t> _handles,
+                              uint32_t num_handles, user_ptr<uint32_t> _num_handles) {
+    LTRACEF("handle %d iovs %p num_iovs %u handles %p num_handles %u\n",
+            handle_value, _iovs.get(), num_iovs, _handles.get(), num_handles);
+
+    mx_channel_iovec_t iovs[kMaxMessageIovecs];
+    uint64_t num_bytes;
+    mx_status_t result = iovecs_get_from_user(_iovs, num_iovs, iovs, &num_bytes);
     if (result != NO_ERROR)
         return result;
 
+    // Messages are far smaller than 4GB, so a larger total behaves like an unlimited buffer.
+    return channel_read(handle_value, flags, iovs, num_iovs,
+                        static_cast<uint32_t>(mxtl::min<uint64_t>(num_bytes, UINT32_MAX)),
+                        _num_bytes, _handles, num_handles, _num_handles);
+}
+
+// Builds a message from the caller's bytes and handles. The bytes are gathered from |iovs|,
+// which together hold |num_bytes|, straight into the packet. On success the handles have been
+// removed from |up| and belong to the message; |handles| must hold |num_handles| entries and
+// keeps their values so that a failed write can put them back. The packet has room for
+// |extra_handles| more handles after the caller's, which are left null.
+static mx_status_t msg_get_from_user(ProcessDispatcher* up, ChannelDispatcher* channel,
+                                     const mx_channel_iovec_t* iovs, uint32_t num_iovs,
+                                     uint64_t num_bytes,
+                                     user_ptr<const mx_handle_t> _handles, uint32_t num_handles,
+                                     uint32_t extra_handles,
+                                     mx_handle_t* handles, mxtl::unique_ptr<MessagePacket>* out) {
     bool is_reply_channel = channel->is_reply_channel();
 
-    if (num_bytes > 0u && !_bytes)
-        return ERR_INVALID_ARGS;
+    for (uint32_t ix = 0; ix != num_iovs; ++ix) {
+        if (iovs[ix].num_bytes > 0u && !iovs[ix].buffer)
+            return ERR_INVALID_ARGS;
+    }
     if (num_handles > 0u && !_handles)
         return ERR_INVALID_ARGS;
 
@@ -167,21 +254,25 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
         return ERR_OUT_OF_RANGE;
 
     mxtl::unique_ptr<MessagePacket> msg;
-    result = MessagePacket::Create(num_bytes, num_handles, &msg);
+    mx_status_t result = MessagePacket::Create(static_cast<uint32_t>(num_bytes),
+                                               num_handles + extra_handles, &msg);
     if (result != NO_ERROR)
         return result;
-
-    if (num_bytes > 0u) {
-        if (_bytes.copy_array_from_user(msg->mutable_data(), num_bytes) != NO_ERROR)
+    for (uint32_t ix = 0; ix != extra_handles; ++ix)
+        msg->mutable_handles()[num_handles + ix] = nullptr;
+
+    auto data = static_cast<uint8_t*>(msg->mutable_data());
+    for (uint32_t ix = 0; ix != num_iovs; ++ix) {
+        uint32_t len = iovs[ix].num_bytes;
+        if (len == 0u)
+            continue;
+        if (user_ptr<const void>(iovs[ix].buffer).copy_array_from_user(data, len) != NO_ERROR)
             return ERR_INVALID_ARGS;
+        data += len;
     }
 
-    AllocChecker ac;
-    mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac, num_handles);
-    if (!ac.check())
-        return ERR_NO_MEMORY;
     if (num_handles > 0u) {
-        if (_handles.copy_array_from_user(handles.get(), num_handles) != NO_ERROR)
+        if (_handles.copy_array_from_user(handles, num_handles) != NO_ERROR)
             return ERR_INVALID_ARGS;
 
         {
@@ -196,7 +287,7 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
                 if (!handle)
                     return up->BadHandle(handles[ix], ERR_BAD_HANDLE);
 
-                if (handle->dispatcher().get() == static_cast<Dispatcher*>(channel.get())) {
+                if (handle->dispatcher().get() == static_cast<Dispatcher*>(channel)) {
                     // Found itself, which is only allowed for
                     // MX_FLAG_REPLY_CHANNEL (aka Reply) channels.
                     if (!is_reply_channel) {
@@ -243,15 +334,304 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
             return ERR_BAD_STATE;
     }
 
+    *out = mxtl::move(msg);
+    return NO_ERROR;
+}
+
+// Turns |payload| into a read-only VMO handle. When the buffer is made of whole pages of a
+// writable mapping they are moved out of the caller's VMO; otherwise the bytes are copied into
+// a new VMO.
+static mx_status_t payload_to_vmo(ProcessDispatcher* up, const mx_channel_iovec_t& payload,
+                                  HandleUniquePtr* out) {
+    const vaddr_t va = reinterpret_cast<vaddr_t>(payload.buffer);
+    const size_t len = payload.num_bytes;
+
+    mxtl::RefPtr<VmObject> vmo;
+    if (len > 0u && IS_PAGE_ALIGNED(va) && IS_PAGE_ALIGNED(len)) {
+        auto region = up->aspace()->FindRegion(va);
+        if (region && (region->arch_mmu_flags() & ARCH_MMU_FLAG_PERM_WRITE) &&
+            len <= region->size() - (va - region->base())) {
+            // Any failure (uncommitted pages, clones, other mappings, pages a
+            // device may be using) just means the bytes get copied.
+            region->vmo()->TakePages(region->object_offset() + (va - region->base()), len,
+                                     region.get(), &vmo);
+        }
+    }
+
+    if (!vmo) {
+        vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, len);
+        if (!vmo)
+            return ERR_NO_MEMORY;
+        if (len > 0u) {
+            size_t written;
+            if (vmo->WriteUser(user_ptr<const void>(payload.buffer), 0, len, &written) != NO_ERROR ||
+                written != len)
+                return ERR_INVALID_ARGS;
+        }
+    }
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    mx_status_t result = VmObjectDispatcher::Create(mxtl::move(vmo), &dispatcher, &rights);
+    if (result != NO_ERROR)
+        return result;
+
+    HandleUniquePtr handle(MakeHandle(mxtl::move(dispatcher),
+                                      rights & ~(MX_RIGHT_WRITE | MX_RIGHT_EXECUTE)));
+    if (!handle)
+        return ERR_NO_MEMORY;
+
+    *out = mxtl::move(handle);
+    return NO_ERROR;
+}
+
+// Undoes msg_get_from_user() after the channel refused the message.
+static void msg_return_handles(ProcessDispatcher* up, const mx_handle_t* handles,
+                               uint32_t num_handles) {
+    AutoLock lock(up->handle_table_lock());
+    for (size_t ix = 0; ix != num_handles; ++ix) {
+        up->UndoRemoveHandle_NoLock(handles[ix]);
+    }
+}
+
+static mx_status_t channel_write(mx_handle_t handle_value, uint32_t flags,
+                                 const mx_channel_iovec_t* iovs, uint32_t num_iovs,
+                                 uint64_t num_bytes,
+                                 user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_WRITE);
+    if (result != NO_ERROR)
+        return result;
+
+    if (flags & ~MX_CHANNEL_WRITE_MASK)
+        return ERR_NOT_SUPPORTED;
+
+    // The last buffer becomes a VMO handle after the caller's handles.
+    const bool payload_vmo = flags & MX_CHANNEL_WRITE_PAYLOAD_VMO;
+    mx_channel_iovec_t payload = {};
+    if (payload_vmo) {
+        // A reply channel has to be the last handle of its messages.
+        if (num_iovs == 0u || channel->is_reply_channel())
+            return ERR_INVALID_ARGS;
+        payload = iovs[--num_iovs];
+        num_bytes -= payload.num_bytes;
+    }
+
+    if (num_handles > kMaxMessageHandles)
+        return ERR_OUT_OF_RANGE;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac, num_handles);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    mxtl::unique_ptr<MessagePacket> msg;
+    result = msg_get_from_user(up, channel.get(), iovs, num_iovs, num_bytes,
+                               _handles, num_handles, payload_vmo ? 1u : 0u, handles.get(), &msg);
+    if (result != NO_ERROR)
+        return result;
+
+    Handle* payload_handle = nullptr;
+    if (payload_vmo) {
+        HandleUniquePtr handle;
+        result = payload_to_vmo(up, payload, &handle);
+        if (result != NO_ERROR) {
+            msg->set_owns_handles(false);
+            msg_return_handles(up, handles.get(), num_handles);
+            return result;
+        }
+        payload_handle = handle.release();
+        msg->mutable_handles()[num_handles] = payload_handle;
+        // msg_get_from_user() only hands the message its handles when the
+        // caller passed some, but the payload handle is always the message's.
+        msg->set_owns_handles(true);
+    }
+
     result = channel->Write(mxtl::move(msg));
     if (result != NO_ERROR) {
         // Write failed, put back the handles into this process.
-        AutoLock lock(up->handle_table_lock());
-        for (size_t ix = 0; ix != num_handles; ++ix) {
-            up->UndoRemoveHandle_NoLock(handles[ix]);
-        }
+        msg_return_handles(up, handles.get(), num_handles);
+        if (payload_handle)
+            DeleteHandle(payload_handle);
     }
 
-    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
+    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), (uint32_t)num_bytes, num_handles, 0);
     return result;
 }
+
+mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
+                              user_ptr<const void> _bytes, uint32_t num_bytes,
+                              user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
+    LTRACEF("handle %d bytes %p num_bytes %u handles %p num_handles %u flags 0x%x\n",
+            handle_value, _bytes.get(), num_bytes, _handles.get(), num_handles, flags);
+
+    mx_channel_iovec_t iov = {const_cast<void*>(_bytes.get()), num_bytes, 0u};
+    return channel_write(handle_value, flags, &iov, 1u, num_bytes, _handles, num_handles);
+}
+
+mx_status_t sys_channel_writev(mx_handle_t handle_value, uint32_t flags,
+                               user_ptr<const mx_channel_iovec_t> _iovs, uint32_t num_iovs,
+                               user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
+    LTRACEF("handle %d iovs %p num_iovs %u handles %p num_handles %u flags 0x%x\n",
+            handle_value, _iovs.get(), num_iovs, _handles.get(), num_handles, flags);
+
+    mx_channel_iovec_t iovs[kMaxMessageIovecs];
+    uint64_t num_bytes;
+    mx_status_t result = iovecs_get_from_user(_iovs, num_iovs, iovs, &num_bytes);
+    if (result != NO_ERROR)
+        return result;
+
+    return channel_write(handle_value, flags, iovs, num_iovs, num_bytes, _handles, num_handles);
+}
+
+static mx_status_t channel_call(mx_handle_t handle_value, uint32_t flags, mx_time_t timeout,
+                                const mx_channel_iovec_t* wr_iovs, uint32_t wr_num_iovs,
+                                uint64_t wr_num_bytes,
+                                user_ptr<const mx_handle_t> _wr_handles, uint32_t wr_num_handles,
+                                const mx_channel_iovec_t* rd_iovs, uint32_t rd_num_iovs,
+                                uint32_t rd_num_bytes,
+                                user_ptr<mx_handle_t> _rd_handles, uint32_t rd_num_handles,
+                                user_ptr<uint32_t> _num_bytes, user_ptr<uint32_t> _num_handles,
+                                user_ptr<mx_status_t> _read_status) {
+    if (flags != 0u)
+        return ERR_NOT_SUPPORTED;
+
+    // The first bytes of the request carry the transaction id.
+    if (wr_num_bytes < sizeof(mx_txid_t))
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcher(handle_value, &channel,
+                                           MX_RIGHT_READ | MX_RIGHT_WRITE);
+    if (result != NO_ERROR)
+        return result;
+
+    // Replies come back on this same endpoint, so there is no reply channel to hand over.
+    if (channel->is_reply_channel())
+        return ERR_NOT_SUPPORTED;
+
+    if (wr_num_handles > kMaxMessageHandles)
+        return ERR_OUT_OF_RANGE;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(
+        &ac, wr_num_handles);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    mxtl::unique_ptr<MessagePacket> msg;
+    result = msg_get_from_user(up, channel.get(), wr_iovs, wr_num_iovs, wr_num_bytes,
+                               _wr_handles, wr_num_handles, 0u, handles.get(), &msg);
+    if (result != NO_ERROR)
+        return result;
+
+    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), (uint32_t)wr_num_bytes,
+           wr_num_handles, 0);
+
+    lk_time_t t = 0u;
+    if (timeout > 0ull) {
+        t = mx_time_to_lk(timeout);
+        if (t == 0)
+            t = 1u;
+    }
+
+    bool write_failed;
+    mxtl::unique_ptr<MessagePacket> reply;
+    result = channel->Call(mxtl::move(msg), t, &write_failed, &reply);
+    if (write_failed) {
+        msg_return_handles(up, handles.get(), wr_num_handles);
+        return result;
+    }
+
+    // From here on the request has been sent, so failures are reported through
+    // |_read_status| and the call returns ERR_CALL_FAILED.
+    if (result == NO_ERROR) {
+        uint32_t num_bytes = reply->data_size();
+        uint32_t num_handles = reply->num_handles();
+
+        if (num_bytes > rd_num_bytes || num_handles > rd_num_handles) {
+            // The reply is discarded, closing any handles it carried.
+            result = ERR_BUFFER_TOO_SMALL;
+        } else {
+            // Likewise when its handles do not fit in our quota.
+            result = up->ReserveHandles(num_handles);
+            if (result == NO_ERROR) {
+                result = msg_put_to_user(up, reply.get(), rd_iovs, rd_num_iovs, num_bytes,
+                                         _rd_handles, num_handles);
+            }
+        }
+
+        if (_num_bytes && _num_bytes.copy_to_user(num_bytes) != NO_ERROR)
+            result = ERR_INVALID_ARGS;
+        if (_num_handles && _num_handles.copy_to_user(num_handles) != NO_ERROR)
+            result = ERR_INVALID_ARGS;
+
+        ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
+    }
+
+    if (result == NO_ERROR)
+        return NO_ERROR;
+
+    if (_read_status)
+        _read_status.copy_to_user(result);
+    return ERR_CALL_FAILED;
+}
+
+mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t flags, mx_time_t timeout,
+                             user_ptr<const mx_channel_call_args_t> _args,
+                             user_ptr<uint32_t> _num_bytes, user_ptr<uint32_t> _num_handles,
+                             user_ptr<mx_status_t> _read_status) {
+    LTRACEF("handle %d flags 0x%x\n", handle_value, flags);
+
+    mx_channel_call_args_t args;
+    if (_args.copy_from_user(&args) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    mx_channel_iovec_t wr_iov = {const_cast<void*>(args.wr_bytes), args.wr_num_bytes, 0u};
+    mx_channel_iovec_t rd_iov = {args.rd_bytes, args.rd_num_bytes, 0u};
+    return channel_call(handle_value, flags, timeout,
+                        &wr_iov, 1u, args.wr_num_bytes,
+                        user_ptr<const mx_handle_t>(args.wr_handles), args.wr_num_handles,
+                        &rd_iov, 1u, args.rd_num_bytes,
+                        user_ptr<mx_handle_t>(args.rd_handles), args.rd_num_handles,
+                        _num_bytes, _num_handles, _read_status);
+}
+
+mx_status_t sys_channel_callv(mx_handle_t handle_value, uint32_t flags, mx_time_t timeout,
+                              user_ptr<const mx_channel_callv_args_t> _args,
+                              user_ptr<uint32_t> _num_bytes, user_ptr<uint32_t> _num_handles,
+                              user_ptr<mx_status_t> _read_status) {
+    LTRACEF("handle %d flags 0x%x\n", handle_value, flags);
+
+    mx_channel_callv_args_t args;
+    if (_args.copy_from_user(&args) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    mx_channel_iovec_t wr_iovs[kMaxMessageIovecs];
+    uint64_t wr_num_bytes;
+    mx_status_t result = iovecs_get_from_user(
+        user_ptr<const mx_channel_iovec_t>(args.wr_iovs), args.wr_num_iovs, wr_iovs,
+        &wr_num_bytes);
+    if (result != NO_ERROR)
+        return result;
+
+    mx_channel_iovec_t rd_iovs[kMaxMessageIovecs];
+    uint64_t rd_num_bytes;
+    result = iovecs_get_from_user(user_ptr<const mx_channel_iovec_t>(args.rd_iovs),
+                                  args.rd_num_iovs, rd_iovs, &rd_num_bytes);
+    if (result != NO_ERROR)
+        return result;
+
+    // As with readv, a read total past 4GB behaves like an unlimited buffer.
+    return channel_call(handle_value, flags, timeout,
+                        wr_iovs, args.wr_num_iovs, wr_num_bytes,
+                        user_ptr<const mx_handle_t>(args.wr_handles), args.wr_num_handles,
+                        rd_iovs, args.rd_num_iovs,
+                        static_cast<uint32_t>(mxtl::min<uint64_t>(rd_num_bytes, UINT32_MAX)),
+                        user_ptr<mx_handle_t>(args.rd_handles), args.rd_num_handles,
+                        _num_bytes, _num_handles, _read_status);
+}
@@ -71,14 +71,20 @@ mx_handle_t sys_datapipe_create(uint32_t options, mx_size_t element_size, mx_siz
         return ERR_NO_MEMORY;
 
     auto up = ProcessDispatcher::GetCurrent();
+    result = up->ReserveHandles(2u);
+    if (result != NO_ERROR)
+        return result;
+
     mx_handle_t hv_producer = up->MapHandleToValue(producer_handle.get());
     mx_handle_t hv_consumer = up->MapHandleToValue(consumer_handle.get());
 
-    if (_consumer_handle.copy_to_user(hv_consumer) != NO_ERROR)
+    if (_consumer_handle.copy_to_user(hv_consumer) != NO_ERROR) {
+        up->UnreserveHandles(2u);
         return ERR_INVALID_ARGS;
+    }
 
-    up->AddHandle(mxtl::move(producer_handle));
-    up->AddHandle(mxtl::move(consumer_handle));
+    up->AddReservedHandle(mxtl::move(producer_handle));
+    up->AddReservedHandle(mxtl::move(consumer_handle));
 
     return hv_producer;
 }
@@ -67,7 +67,8 @@ mx_handle_t sys_interrupt_create(mx_handle_t hrsrc, uint32_t vector, uint32_t fl
 
     auto up = ProcessDispatcher::GetCurrent();
     mx_handle_t hv = up->MapHandleToValue(handle.get());
-    up->AddHandle(mxtl::move(handle));
+    if (up->AddHandle(mxtl::move(handle)) != NO_ERROR)
+        return ERR_NO_RESOURCES;
     return hv;
 }
 
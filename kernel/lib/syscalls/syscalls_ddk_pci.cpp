@@ -260,7 +260,8 @@ mx_handle_t sys_pci_get_nth_device(mx_handle_t hrsrc, uint32_t index, mx_pcie_ge
                             &info, sizeof(*out_info)) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    up->AddHandle(mxtl::move(handle));
+    if (up->AddHandle(mxtl::move(handle)) != NO_ERROR)
+        return ERR_NO_RESOURCES;
     return handle_value;
 }
 
@@ -347,7 +348,8 @@ mx_handle_t sys_pci_map_mmio(mx_handle_t handle, uint32_t bar_num, mx_cache_poli
         return ERR_NO_MEMORY;
 
     mx_handle_t ret_val = up->MapHandleToValue(mmio_handle.get());
-    up->AddHandle(mxtl::move(mmio_handle));
+    if (up->AddHandle(mxtl::move(mmio_handle)) != NO_ERROR)
+        return ERR_NO_RESOURCES;
     return ret_val;
 }
 
@@ -405,7 +407,8 @@ mx_handle_t sys_pci_map_interrupt(mx_handle_t handle_value, int32_t which_irq) {
         return ERR_NO_MEMORY;
 
     mx_handle_t interrupt_handle = up->MapHandleToValue(handle.get());
-    up->AddHandle(mxtl::move(handle));
+    if (up->AddHandle(mxtl::move(handle)) != NO_ERROR)
+        return ERR_NO_RESOURCES;
     return interrupt_handle;
 }
 
@@ -436,7 +439,8 @@ mx_handle_t sys_pci_map_config(mx_handle_t handle) {
         return ERR_NO_MEMORY;
 
     mx_handle_t ret_val = up->MapHandleToValue(config_handle.get());
-    up->AddHandle(mxtl::move(config_handle));
+    if (up->AddHandle(mxtl::move(config_handle)) != NO_ERROR)
+        return ERR_NO_RESOURCES;
     return ret_val;
 }
 
@@ -130,7 +130,8 @@ mx_handle_t sys_debug_transfer_handle(mx_handle_t proc, mx_handle_t src_handle)
         return ERR_BAD_HANDLE;
 
     auto dest_hv = process->MapHandleToValue(handle.get());
-    process->AddHandle(mxtl::move(handle));
+    if (process->AddHandle(mxtl::move(handle)) != NO_ERROR)
+        return ERR_NO_RESOURCES;
     return dest_hv;
 }
 
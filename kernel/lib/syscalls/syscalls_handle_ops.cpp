@@ -56,7 +56,8 @@ mx_status_t sys_handle_duplicate(mx_handle_t handle_value, mx_rights_t rights,
 
         if (out.copy_to_user(up->MapHandleToValue(dest.get())) != NO_ERROR)
             return ERR_INVALID_ARGS;
-        up->AddHandle_NoLock(mxtl::move(dest));
+        if (up->AddHandle_NoLock(mxtl::move(dest)) != NO_ERROR)
+            return ERR_NO_RESOURCES;
     }
 
     return NO_ERROR;
@@ -89,13 +90,15 @@ mx_status_t sys_handle_replace(mx_handle_t handle_value, mx_rights_t rights,
 
         if (!dest) {
             // Unwind: put |source| back!
-            up->AddHandle_NoLock(mxtl::move(source));
+            source.release();
+            up->UndoRemoveHandle_NoLock(handle_value);
             return error;
         }
 
         if (out.copy_to_user(up->MapHandleToValue(dest.get())) != NO_ERROR)
             return ERR_INVALID_ARGS;
-        up->AddHandle_NoLock(mxtl::move(dest));
+        if (up->AddHandle_NoLock(mxtl::move(dest)) != NO_ERROR)
+            return ERR_NO_RESOURCES;
     }
 
     return NO_ERROR;
@@ -33,9 +33,11 @@
 #include <magenta/socket_dispatcher.h>
 #include <magenta/state_tracker.h>
 #include <magenta/syscalls/log.h>
+#include <magenta/timer_dispatcher.h>
 #include <magenta/user_copy.h>
 #include <magenta/wait_set_dispatcher.h>
 
+#include <mxtl/inline_array.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
@@ -46,6 +48,7 @@ constexpr mx_size_t kMaxCPRNGDraw = MX_CPRNG_DRAW_MAX_LEN;
 constexpr mx_size_t kMaxCPRNGSeed = MX_CPRNG_ADD_ENTROPY_MAX_LEN;
 
 constexpr uint32_t kMaxWaitSetWaitResults = 1024u;
+constexpr size_t kWaitSetWaitResultsInlineCount = 16u;
 
 mx_status_t sys_nanosleep(mx_time_t nanoseconds) {
     LTRACEF("nseconds %" PRIu64 "\n", nanoseconds);
@@ -87,8 +90,7 @@ mx_status_t sys_event_create(uint32_t options, user_ptr<mx_handle_t> out) {
     if (out.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    up->AddHandle(mxtl::move(handle));
-    return NO_ERROR;
+    return up->AddHandle(mxtl::move(handle));
 }
 
 mx_status_t sys_eventpair_create(uint32_t flags,
@@ -113,14 +115,18 @@ mx_status_t sys_eventpair_create(uint32_t flags,
         return ERR_NO_MEMORY;
 
     auto up = ProcessDispatcher::GetCurrent();
-    if (out0.copy_to_user(up->MapHandleToValue(h0.get())) != NO_ERROR)
-        return ERR_INVALID_ARGS;
+    result = up->ReserveHandles(2u);
+    if (result != NO_ERROR)
+        return result;
 
-    if (out1.copy_to_user(up->MapHandleToValue(h1.get())) != NO_ERROR)
+    if (out0.copy_to_user(up->MapHandleToValue(h0.get())) != NO_ERROR ||
+        out1.copy_to_user(up->MapHandleToValue(h1.get())) != NO_ERROR) {
+        up->UnreserveHandles(2u);
         return ERR_INVALID_ARGS;
+    }
 
-    up->AddHandle(mxtl::move(h0));
-    up->AddHandle(mxtl::move(h1));
+    up->AddReservedHandle(mxtl::move(h0));
+    up->AddReservedHandle(mxtl::move(h1));
 
     return NO_ERROR;
 }
@@ -140,6 +146,54 @@ mx_status_t sys_futex_requeue(user_ptr<mx_futex_t> wake_ptr, uint32_t wake_count
         wake_ptr, wake_count, current_value, requeue_ptr, requeue_count);
 }
 
+mx_status_t sys_timer_create(uint32_t options, user_ptr<mx_handle_t> out) {
+    LTRACEF("options 0x%x\n", options);
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+
+    status_t result = TimerDispatcher::Create(options, &dispatcher, &rights);
+    if (result != NO_ERROR)
+        return result;
+
+    HandleUniquePtr handle(MakeHandle(mxtl::move(dispatcher), rights));
+    if (!handle)
+        return ERR_NO_MEMORY;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    if (out.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    return up->AddHandle(mxtl::move(handle));
+}
+
+mx_status_t sys_timer_set(mx_handle_t handle, mx_time_t deadline, mx_time_t slack) {
+    LTRACEF("handle %d, deadline %" PRIu64 ", slack %" PRIu64 "\n", handle, deadline, slack);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<TimerDispatcher> timer;
+    mx_status_t status = up->GetDispatcher(handle, &timer, MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    return timer->Set(deadline, slack);
+}
+
+mx_status_t sys_timer_cancel(mx_handle_t handle) {
+    LTRACEF("handle %d\n", handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<TimerDispatcher> timer;
+    mx_status_t status = up->GetDispatcher(handle, &timer, MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    return timer->Cancel();
+}
+
 int sys_log_create(uint32_t flags) {
     LTRACEF("flags 0x%x\n", flags);
 
@@ -167,7 +221,8 @@ int sys_log_create(uint32_t flags) {
     auto up = ProcessDispatcher::GetCurrent();
 
     mx_handle_t hv = up->MapHandleToValue(handle.get());
-    up->AddHandle(mxtl::move(handle));
+    if (up->AddHandle(mxtl::move(handle)) != NO_ERROR)
+        return ERR_NO_RESOURCES;
 
     return hv;
 }
@@ -259,19 +314,18 @@ mx_status_t sys_waitset_create(uint32_t options, user_ptr<mx_handle_t> out) {
     auto up = ProcessDispatcher::GetCurrent();
     if (out.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
         return ERR_INVALID_ARGS;
-    up->AddHandle(mxtl::move(handle));
-
-    return NO_ERROR;
+    return up->AddHandle(mxtl::move(handle));
 }
 
 mx_status_t sys_waitset_add(mx_handle_t ws_handle_value,
                             uint64_t cookie,
                             mx_handle_t handle_value,
-                            mx_signals_t signals) {
+                            mx_signals_t signals,
+                            uint32_t options) {
     LTRACEF("wait set handle %d, handle %d\n", ws_handle_value, handle_value);
 
     mxtl::unique_ptr<WaitSetDispatcher::Entry> entry;
-    mx_status_t result = WaitSetDispatcher::Entry::Create(signals, cookie, &entry);
+    mx_status_t result = WaitSetDispatcher::Entry::Create(signals, options, cookie, &entry);
     if (result != NO_ERROR)
         return result;
 
@@ -324,19 +378,14 @@ mx_status_t sys_waitset_wait(mx_handle_t ws_handle,
     if (_count.copy_from_user(&count) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    //TODO: use inline array here
-    mxtl::unique_ptr<mx_waitset_result_t[]> results;
-    if (count > 0u) {
-        if (count > kMaxWaitSetWaitResults)
-            return ERR_OUT_OF_RANGE;
-
-        // TODO(vtl): It kind of sucks that we always have to allocate the indicated maximum size
-        // here (namely, |count|).
-        AllocChecker ac;
-        results.reset(new (&ac) mx_waitset_result_t[count]);
-        if (!ac.check())
-            return ERR_NO_MEMORY;
-    }
+    if (count > kMaxWaitSetWaitResults)
+        return ERR_OUT_OF_RANGE;
+
+    // Small waits (the common case for event loops) don't need to touch the heap.
+    AllocChecker ac;
+    mxtl::InlineArray<mx_waitset_result_t, kWaitSetWaitResultsInlineCount> results(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
 
     auto up = ProcessDispatcher::GetCurrent();
 
@@ -381,15 +430,18 @@ mx_status_t sys_socket_create(uint32_t flags, user_ptr<mx_handle_t> out0, user_p
         return ERR_NO_MEMORY;
 
     auto up = ProcessDispatcher::GetCurrent();
+    result = up->ReserveHandles(2u);
+    if (result != NO_ERROR)
+        return result;
 
-    if (out0.copy_to_user(up->MapHandleToValue(h0.get())) != NO_ERROR)
-        return ERR_INVALID_ARGS;
-
-    if (out1.copy_to_user(up->MapHandleToValue(h1.get())) != NO_ERROR)
+    if (out0.copy_to_user(up->MapHandleToValue(h0.get())) != NO_ERROR ||
+        out1.copy_to_user(up->MapHandleToValue(h1.get())) != NO_ERROR) {
+        up->UnreserveHandles(2u);
         return ERR_INVALID_ARGS;
+    }
 
-    up->AddHandle(mxtl::move(h0));
-    up->AddHandle(mxtl::move(h1));
+    up->AddReservedHandle(mxtl::move(h0));
+    up->AddReservedHandle(mxtl::move(h1));
 
     return NO_ERROR;
 }
@@ -10,9 +10,12 @@
 
 #include <kernel/auto_lock.h>
 
+#include <magenta/channel_dispatcher.h>
 #include <magenta/data_pipe_consumer_dispatcher.h>
 #include <magenta/data_pipe_producer_dispatcher.h>
 #include <magenta/magenta.h>
+#include <magenta/message_packet.h>
+#include <magenta/port_dispatcher.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/resource_dispatcher.h>
 #include <magenta/thread_dispatcher.h>
@@ -241,6 +244,92 @@ mx_status_t sys_object_get_info(mx_handle_t handle, uint32_t topic, uint16_t top
 
             return status;
         }
+        case MX_INFO_MESSAGE_PACKETS: {
+            // the counts are system wide, any readable channel will do
+            mxtl::RefPtr<ChannelDispatcher> channel;
+            auto error = up->GetDispatcher<ChannelDispatcher>(handle, &channel, MX_RIGHT_READ);
+            if (error < 0)
+                return error;
+
+            if (topic_size != 0 && topic_size != sizeof(mx_record_message_packets_t))
+                return ERR_INVALID_ARGS;
+
+            if (!_buffer)
+                return ERR_INVALID_ARGS;
+
+            if (buffer_size < sizeof(mx_info_header_t) + topic_size)
+                return ERR_BUFFER_TOO_SMALL;
+
+            mx_info_message_packets_t info = {};
+
+            info.hdr.topic = topic;
+            info.hdr.avail_topic_size = sizeof(info.rec);
+            info.hdr.topic_size = topic_size;
+            info.hdr.avail_count = 1;
+            info.hdr.count = 1;
+
+            mx_size_t tocopy;
+            if (topic_size == 0) {
+                tocopy = sizeof(info.hdr);
+            } else {
+                MessagePacketStats stats;
+                MessagePacket::GetStats(&stats);
+                info.rec.cached = stats.cached;
+                info.rec.pool_allocs = stats.pool_allocs;
+                info.rec.cache_allocs = stats.cache_allocs;
+                info.rec.refills = stats.refills;
+                info.rec.drains = stats.drains;
+                info.rec.heap_allocs = stats.heap_allocs;
+
+                tocopy = sizeof(info);
+            }
+
+            if (_buffer.copy_array_to_user(&info, tocopy) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            if (actual.copy_to_user(tocopy) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_INFO_PORT: {
+            mxtl::RefPtr<PortDispatcher> port;
+            auto error = up->GetDispatcher<PortDispatcher>(handle, &port, MX_RIGHT_READ);
+            if (error < 0)
+                return error;
+
+            if (topic_size != 0 && topic_size != sizeof(mx_record_port_t))
+                return ERR_INVALID_ARGS;
+
+            if (!_buffer)
+                return ERR_INVALID_ARGS;
+
+            if (buffer_size < sizeof(mx_info_header_t) + topic_size)
+                return ERR_BUFFER_TOO_SMALL;
+
+            mx_info_port_t info = {};
+
+            info.hdr.topic = topic;
+            info.hdr.avail_topic_size = sizeof(info.rec);
+            info.hdr.topic_size = topic_size;
+            info.hdr.avail_count = 1;
+            info.hdr.count = 1;
+
+            mx_size_t tocopy;
+            if (topic_size == 0) {
+                tocopy = sizeof(info.hdr);
+            } else {
+                info.rec.queued = port->GetQueuedCount();
+                info.rec.max_queued = PortDispatcher::kMaxQueuedPackets;
+                port->GetPoolUsage(&info.rec.pool_used, &info.rec.pool_cached);
+
+                tocopy = sizeof(info);
+            }
+
+            if (_buffer.copy_array_to_user(&info, tocopy) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            if (actual.copy_to_user(tocopy) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
         default:
             return ERR_NOT_FOUND;
     }
@@ -433,8 +522,7 @@ mx_status_t sys_object_get_child(mx_handle_t handle, uint64_t koid, mx_rights_t
 
         if (out.copy_to_user(up->MapHandleToValue(process_h.get())))
             return ERR_INVALID_ARGS;
-        up->AddHandle(mxtl::move(process_h));
-        return NO_ERROR;
+        return up->AddHandle(mxtl::move(process_h));
     }
 
     mxtl::RefPtr<Dispatcher> dispatcher;
@@ -462,8 +550,7 @@ mx_status_t sys_object_get_child(mx_handle_t handle, uint64_t koid, mx_rights_t
 
         if (out.copy_to_user(up->MapHandleToValue(thread_h.get())) != NO_ERROR)
             return ERR_INVALID_ARGS;
-        up->AddHandle(mxtl::move(thread_h));
-        return NO_ERROR;
+        return up->AddHandle(mxtl::move(thread_h));
     }
 
     auto resource = dispatcher->get_specific<ResourceDispatcher>();
@@ -480,8 +567,7 @@ mx_status_t sys_object_get_child(mx_handle_t handle, uint64_t koid, mx_rights_t
 
         if (out.copy_to_user(up->MapHandleToValue(child_h.get())) != NO_ERROR)
             return ERR_INVALID_ARGS;
-        up->AddHandle(mxtl::move(child_h));
-        return NO_ERROR;
+        return up->AddHandle(mxtl::move(child_h));
     }
 
     return ERR_WRONG_TYPE;
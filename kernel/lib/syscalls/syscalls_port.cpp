@@ -43,7 +43,8 @@ mx_status_t sys_port_create(uint32_t options, user_ptr<mx_handle_t> out) {
 
     if (out.copy_to_user(hv) != NO_ERROR)
         return ERR_INVALID_ARGS;
-    up->AddHandle(mxtl::move(handle));
+    if (up->AddHandle(mxtl::move(handle)) != NO_ERROR)
+        return ERR_NO_RESOURCES;
 
     ktrace(TAG_PORT_CREATE, koid, 0, 0, 0);
     return NO_ERROR;
@@ -65,13 +66,9 @@ mx_status_t sys_port_queue(mx_handle_t handle, user_ptr<const void> packet, mx_s
     if (status != NO_ERROR)
         return status;
 
-    auto iopk = IOP_Packet::MakeFromUser(packet.get(), size);
-    if (!iopk)
-        return ERR_NO_MEMORY;
-
     ktrace(TAG_PORT_QUEUE, (uint32_t)port->get_koid(), (uint32_t)size, 0, 0);
 
-    return port->Queue(iopk);
+    return port->QueueFromUser(packet.get(), size);
 }
 
 mx_status_t sys_port_wait(mx_handle_t handle, mx_time_t timeout,
@@ -97,10 +94,56 @@ mx_status_t sys_port_wait(mx_handle_t handle, mx_time_t timeout,
     if (status < 0)
         return status;
 
-    if (!iopk->CopyToUser(packet.get(), &size))
+    status = iopk->CopyToUser(packet.get(), &size);
+    IOP_Packet::Delete(iopk);
+    return status;
+}
+
+// Most packets a single port_wait_many() call will dequeue.
+constexpr uint32_t kMaxWaitManyPackets = 64u;
+
+mx_status_t sys_port_wait_many(mx_handle_t handle, mx_time_t timeout,
+                               user_ptr<void> packets, mx_size_t size,
+                               uint32_t count, user_ptr<uint32_t> actual) {
+    LTRACEF("handle %d count %u\n", handle, count);
+
+    if (!packets || !actual || count == 0u)
+        return ERR_INVALID_ARGS;
+    if (size < sizeof(mx_packet_header_t))
+        return ERR_INVALID_ARGS;
+    if (count > kMaxWaitManyPackets)
+        count = kMaxWaitManyPackets;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PortDispatcher> port;
+    mx_status_t status = up->GetDispatcher(handle, &port, MX_RIGHT_READ);
+    if (status != NO_ERROR)
+        return status;
+
+    ktrace(TAG_PORT_WAIT, (uint32_t)port->get_koid(), 0, 0, 0);
+
+    IOP_Packet* iopk[kMaxWaitManyPackets];
+    status = port->WaitMany(timeout, size, iopk, &count);
+
+    ktrace(TAG_PORT_WAIT_DONE, (uint32_t)port->get_koid(), status, 0, 0);
+    if (status < 0)
+        return status;
+
+    // Packet i goes in the i-th |size| byte slot of the user array.
+    auto dst = reinterpret_cast<char*>(packets.get());
+    for (uint32_t i = 0; i < count; i++) {
+        mx_size_t pk_size = size;
+        if (status == NO_ERROR)
+            status = iopk[i]->CopyToUser(dst + i * size, &pk_size);
+        IOP_Packet::Delete(iopk[i]);
+    }
+    if (status != NO_ERROR)
+        return status;
+
+    if (actual.copy_to_user(count) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    IOP_Packet::Delete(iopk);
     return NO_ERROR;
 }
 
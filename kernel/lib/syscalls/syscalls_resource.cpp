@@ -81,9 +81,7 @@ mx_status_t sys_resource_create(mx_handle_t handle, user_ptr<mx_rrec_t> records,
         return ERR_INVALID_ARGS;
     }
 
-    up->AddHandle(mxtl::move(child_h));
-
-    return NO_ERROR;
+    return up->AddHandle(mxtl::move(child_h));
 }
 
 // Given a resource handle and an index into its array of rsrc info records
@@ -114,9 +112,7 @@ mx_status_t sys_resource_get_handle(mx_handle_t handle, uint32_t index,
     if (out.copy_to_user(out_hv) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    up->AddHandle(mxtl::move(out_h));
-
-    return NO_ERROR;
+    return up->AddHandle(mxtl::move(out_h));
 }
 
 // Given a resource handle, perform an action that is specific to that
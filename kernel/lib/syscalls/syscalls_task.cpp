@@ -89,9 +89,7 @@ mx_status_t sys_thread_create(mx_handle_t process_handle,
 
     if (out.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
         return ERR_INVALID_ARGS;
-    up->AddHandle(mxtl::move(handle));
-
-    return NO_ERROR;
+    return up->AddHandle(mxtl::move(handle));
 }
 
 mx_status_t sys_thread_start(mx_handle_t thread_handle, uintptr_t entry,
@@ -223,9 +221,7 @@ mx_status_t sys_process_create(mx_handle_t job_handle,
     if (out.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    up->AddHandle(mxtl::move(handle));
-
-    return NO_ERROR;
+    return up->AddHandle(mxtl::move(handle));
 }
 
 // Note: This is used to start the main thread (as opposed to using
@@ -269,8 +265,10 @@ mx_status_t sys_process_start(mx_handle_t process_handle, mx_handle_t thread_han
     if (!arg_handle)
         return ERR_INVALID_ARGS;
 
+    RenewHandleValue(arg_handle.get());
     auto arg_nhv = process->MapHandleToValue(arg_handle.get());
-    process->AddHandle(mxtl::move(arg_handle));
+    if (process->AddHandle(mxtl::move(arg_handle)) != NO_ERROR)
+        return ERR_NO_RESOURCES;
 
     // TODO(cpu) if Start() fails we want to undo RemoveHandle().
 
@@ -345,6 +343,5 @@ mx_status_t sys_job_create(mx_handle_t parent_job, uint32_t flags, user_ptr<mx_h
     if (out.copy_to_user(up->MapHandleToValue(job_handle.get())) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    up->AddHandle(mxtl::move(job_handle));
-    return NO_ERROR;
+    return up->AddHandle(mxtl::move(job_handle));
 }
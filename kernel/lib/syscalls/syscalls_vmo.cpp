@@ -53,9 +53,7 @@ mx_status_t sys_vmo_create(uint64_t size, uint32_t options, user_ptr<mx_handle_t
     if (out.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    up->AddHandle(mxtl::move(handle));
-
-    return NO_ERROR;
+    return up->AddHandle(mxtl::move(handle));
 }
 
 mx_status_t sys_vmo_read(mx_handle_t handle, user_ptr<void> data,
@@ -159,6 +157,37 @@ mx_status_t sys_vmo_op_range(mx_handle_t handle, uint32_t op, uint64_t offset, u
     return vmo->RangeOp(op, offset, size, buffer, buffer_size, vmo_rights);
 }
 
+mx_status_t sys_vmo_clone(mx_handle_t handle, uint32_t options, uint64_t offset, uint64_t size,
+                          user_ptr<mx_handle_t> out) {
+    LTRACEF("handle %d options %#x offset %#" PRIx64 " size %#" PRIx64 "\n",
+            handle, options, offset, size);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // lookup the dispatcher from handle, the clone starts out with its contents
+    mxtl::RefPtr<VmObjectDispatcher> vmo;
+    mx_status_t status = up->GetDispatcher(handle, &vmo, MX_RIGHT_READ);
+    if (status != NO_ERROR)
+        return status;
+
+    // create the clone and a dispatcher for it
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    status = vmo->Clone(options, offset, size, &dispatcher, &rights);
+    if (status != NO_ERROR)
+        return status;
+
+    // create a handle and attach the dispatcher to it
+    HandleUniquePtr clone_handle(MakeHandle(mxtl::move(dispatcher), rights));
+    if (!clone_handle)
+        return ERR_NO_MEMORY;
+
+    if (out.copy_to_user(up->MapHandleToValue(clone_handle.get())) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    return up->AddHandle(mxtl::move(clone_handle));
+}
+
 mx_status_t sys_process_map_vm(mx_handle_t proc_handle, mx_handle_t vmo_handle,
                                uint64_t offset, mx_size_t len, user_ptr<uintptr_t> user_ptr,
                                uint32_t flags) {
@@ -152,7 +152,8 @@ static mx_handle_t make_bootstrap_channel(
         return status;
 
     mx_handle_t hv = process->MapHandleToValue(user_channel_handle.get());
-    process->AddHandle(mxtl::move(user_channel_handle));
+    if (process->AddHandle(mxtl::move(user_channel_handle)) != NO_ERROR)
+        return ERR_NO_RESOURCES;
 
     return hv;
 }
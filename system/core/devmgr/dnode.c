@@ -13,6 +13,52 @@
 #include <stdlib.h>
 #include <string.h>
 
+// FNV-1a
+static uint32_t dn_hash_name(const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    while (len-- > 0) {
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+static void dn_hash_insert(dnode_t* parent, dnode_t* child) {
+    dnode_t** bucket = &parent->hash_table[child->hash & (parent->hash_buckets - 1)];
+    child->hash_next = *bucket;
+    *bucket = child;
+}
+
+static void dn_hash_remove(dnode_t* parent, dnode_t* child) {
+    dnode_t** link = &parent->hash_table[child->hash & (parent->hash_buckets - 1)];
+    while (*link != NULL) {
+        if (*link == child) {
+            *link = child->hash_next;
+            child->hash_next = NULL;
+            return;
+        }
+        link = &(*link)->hash_next;
+    }
+}
+
+// Rebuild the hash index of a directory with the given (power of two)
+// number of buckets. On allocation failure the old index (if any) stays,
+// lookups still work, they just walk longer chains.
+static bool dn_hash_resize(dnode_t* parent, uint32_t buckets) {
+    dnode_t** table;
+    if ((table = calloc(buckets, sizeof(dnode_t*))) == NULL) {
+        return false;
+    }
+    free(parent->hash_table);
+    parent->hash_table = table;
+    parent->hash_buckets = buckets;
+
+    dnode_t* dn;
+    list_for_every_entry(&parent->children, dn, dnode_t, dn_entry) {
+        dn_hash_insert(parent, dn);
+    }
+    return true;
+}
+
 // create a new dnode and attach it to a vnode
 mx_status_t dn_create(dnode_t** out, const char* name, size_t len, vnode_t* vn) {
     mx_status_t status;
@@ -53,7 +99,14 @@ void dn_attach(dnode_t* dn, vnode_t* vn) {
 void dn_delete(dnode_t* dn) {
     // detach from parent
     if (dn->parent) {
+        if (dn->parent->vnode) {
+            vfs_dcache_remove(dn->parent->vnode, dn->name, DN_NAME_LEN(dn->flags));
+        }
+        if (dn->parent->hash_table) {
+            dn_hash_remove(dn->parent, dn);
+        }
         list_delete(&dn->dn_entry);
+        dn->parent->child_count--;
         dn->parent = NULL;
     }
 
@@ -65,6 +118,7 @@ void dn_delete(dnode_t* dn) {
         dn->vnode = NULL;
     }
 
+    free(dn->hash_table);
     free(dn);
 }
 
@@ -82,8 +136,37 @@ void dn_add_child(dnode_t* parent, dnode_t* child) {
         panic();
     }
 
+    if (parent->vnode) {
+        vfs_dcache_remove(parent->vnode, child->name, DN_NAME_LEN(child->flags));
+    }
+
     child->parent = parent;
+    child->hash = dn_hash_name(child->name, DN_NAME_LEN(child->flags));
     list_add_tail(&parent->children, &child->dn_entry);
+    parent->child_count++;
+
+    // keep about one child per bucket, resizing rehashes the new child too
+    if (parent->hash_table == NULL) {
+        if (parent->child_count >= DN_HASH_MIN_CHILDREN) {
+            dn_hash_resize(parent, DN_HASH_MIN_CHILDREN);
+        }
+    } else if ((parent->child_count <= parent->hash_buckets) ||
+               !dn_hash_resize(parent, parent->hash_buckets * 2)) {
+        dn_hash_insert(parent, child);
+    }
+}
+
+void dn_move_children(dnode_t* from, dnode_t* to) {
+    dnode_t* child;
+    while ((child = list_remove_head_type(&from->children, dnode_t, dn_entry)) != NULL) {
+        child->parent = NULL;
+        child->hash_next = NULL;
+        dn_add_child(to, child);
+    }
+    free(from->hash_table);
+    from->hash_table = NULL;
+    from->hash_buckets = 0;
+    from->child_count = 0;
 }
 
 mx_status_t dn_lookup(dnode_t* parent, dnode_t** out, const char* name, size_t len) {
@@ -96,6 +179,18 @@ mx_status_t dn_lookup(dnode_t* parent, dnode_t** out, const char* name, size_t l
         *out = parent->parent;
         return NO_ERROR;
     }
+    if (parent->hash_table) {
+        uint32_t hash = dn_hash_name(name, len);
+        for (dn = parent->hash_table[hash & (parent->hash_buckets - 1)];
+             dn != NULL; dn = dn->hash_next) {
+            if ((dn->hash == hash) && (DN_NAME_LEN(dn->flags) == len) &&
+                (memcmp(dn->name, name, len) == 0)) {
+                *out = dn;
+                return NO_ERROR;
+            }
+        }
+        return ERR_NOT_FOUND;
+    }
     list_for_every_entry(&parent->children, dn, dnode_t, dn_entry) {
         if (DN_NAME_LEN(dn->flags) != len) {
             continue;
@@ -19,13 +19,26 @@ typedef struct dnode dnode_t;
 #define DN_TYPE_SYMLINK 0x400
 #define DN_TYPE(flags) ((flags) & DN_TYPE_MASK)
 
+// directories with at least this many children get a hash index
+#define DN_HASH_MIN_CHILDREN 16
+
 struct dnode {
     dnode_t* parent;
     vnode_t* vnode;
-    list_node_t children;
+    list_node_t children; // in creation order, for readdir
     list_node_t dn_entry; // entry in parent's list
     list_node_t vn_entry; // entry in vnode's list
     uint32_t flags;
+
+    // hash index over children, for lookups in large directories
+    // grown as children are added, NULL while the directory is small
+    dnode_t** hash_table;
+    uint32_t hash_buckets;
+    uint32_t child_count;
+
+    uint32_t hash;        // hash of name
+    dnode_t* hash_next;   // chain in parent's hash table
+
     char name[];
 };
 
@@ -45,4 +58,7 @@ mx_status_t dn_lookup(dnode_t* dn, dnode_t** out, const char* name, size_t len);
 
 void dn_add_child(dnode_t* parent, dnode_t* child);
 
+// Move all children of one directory dnode to another
+void dn_move_children(dnode_t* from, dnode_t* to);
+
 mx_status_t dn_readdir(dnode_t* parent, void* cookie, void* data, size_t len);
@@ -66,7 +66,7 @@ static mx_status_t vnb_create(vnode_t* vn, vnode_t** out, const char* name, size
     return ERR_NOT_SUPPORTED;
 }
 
-mx_handle_t vfs_get_vmofile(vnode_t* vn, mx_off_t* off, mx_off_t* len) {
+static mx_handle_t vnb_get_vmofile(vnode_t* vn, mx_off_t* off, mx_off_t* len) {
     vnboot_t* vnb = vn->pdata;
     mx_handle_t vmo;
     mx_status_t status = mx_handle_duplicate(vnb->vmo, MX_RIGHT_READ | MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER, &vmo);
@@ -95,6 +95,10 @@ static vnode_ops_t vn_boot_ops = {
     .rename = memfs_rename_none,
 };
 
+static vnode_pops_t vn_boot_pops = {
+    .get_vmofile = vnb_get_vmofile,
+};
+
 static dnode_t bootfs_root_dn = {
     .name = "boot",
     .flags = 4,
@@ -129,6 +133,7 @@ static vnboot_t systemfs_root = {
     },
 };
 
+// called with parent's lock held exclusively
 static mx_status_t _vnb_create(vnboot_t* parent, vnboot_t** out,
                                const char* name, size_t namelen,
                                mx_handle_t vmo, mx_off_t off,
@@ -170,6 +175,7 @@ static mx_status_t _vnb_create(vnboot_t* parent, vnboot_t** out,
 
     if (vmo) {
         vnb->vn.flags |= V_FLAG_VMOFILE;
+        vnb->vn.pops = &vn_boot_pops;
     }
 
     // TODO: dups?
@@ -186,6 +192,8 @@ static mx_status_t _vnb_mkdir(vnboot_t* parent, vnboot_t** out, const char* name
         return ERR_NOT_DIR;
     }
 
+    mx_status_t r;
+    pthread_rwlock_wrlock(&parent->vn.lock);
     // existing directory of the same name?
     dnode_t* dn;
     if (dn_lookup(parent->vn.dnode, &dn, name, namelen) == NO_ERROR) {
@@ -193,14 +201,16 @@ static mx_status_t _vnb_mkdir(vnboot_t* parent, vnboot_t** out, const char* name
         if (dn->vnode->dnode != NULL) {
             // is a directory, success!
             *out = dn->vnode->pdata;
-            return NO_ERROR;
+            r = NO_ERROR;
         } else {
-            return ERR_NOT_DIR;
+            r = ERR_NOT_DIR;
         }
+    } else {
+        // create a new directory
+        r = _vnb_create(parent, out, name, namelen, 0, 0, NULL, 0);
     }
-
-    // create a new directory
-    return _vnb_create(parent, out, name, namelen, 0, 0, NULL, 0);
+    pthread_rwlock_unlock(&parent->vn.lock);
+    return r;
 }
 
 static mx_status_t _add_file(vnboot_t* vnb, const char* path, mx_handle_t vmo,
@@ -213,7 +223,11 @@ static mx_status_t _add_file(vnboot_t* vnb, const char* path, mx_handle_t vmo,
         if (nextpath == NULL) {
             if (path[0] == 0)
                 return ERR_INVALID_ARGS;
-            return _vnb_create(vnb, &vnb, path, strlen(path), vmo, off, data, len);
+            vnboot_t* file;
+            pthread_rwlock_wrlock(&vnb->vn.lock);
+            r = _vnb_create(vnb, &file, path, strlen(path), vmo, off, data, len);
+            pthread_rwlock_unlock(&vnb->vn.lock);
+            return r;
         } else {
             if (nextpath == path)
                 return ERR_INVALID_ARGS;
@@ -24,6 +24,9 @@
 
 #define MXDEBUG 0
 
+// serializes changes to devfs, taken before any vnode lock
+static mtx_t devfs_lock = MTX_INIT;
+
 static void vnd_release(vnode_t* vn) {
     xprintf("devfs: vn %p destroyed\n", vn);
     free(vn);
@@ -31,11 +34,13 @@ static void vnd_release(vnode_t* vn) {
 
 static mx_status_t vnd_getattr(vnode_t* vn, vnattr_t* attr) {
     memset(attr, 0, sizeof(vnattr_t));
+    pthread_rwlock_rdlock(&vn->lock);
     if ((vn->remote != 0) && list_is_empty(&vn->dnode->children)) {
         attr->mode = V_TYPE_CDEV | V_IRUSR | V_IWUSR;
     } else {
         attr->mode = V_TYPE_DIR | V_IRUSR;
     }
+    pthread_rwlock_unlock(&vn->lock);
     attr->size = 0;
     return NO_ERROR;
 }
@@ -83,10 +88,8 @@ vnode_t* devfs_get_root(void) {
     return &vnd_root;
 }
 
+// called with devfs_lock and parent's lock held
 static mx_status_t _devfs_add_node(vnode_t** out, vnode_t* parent, const char* name, mx_handle_t h) {
-    if ((parent == NULL) || (name == NULL)) {
-        return ERR_INVALID_ARGS;
-    }
     xprintf("devfs_add_node() p=%p name='%s'\n", parent, name);
     size_t len = strlen(name);
 
@@ -135,10 +138,8 @@ static mx_status_t _devfs_add_node(vnode_t** out, vnode_t* parent, const char* n
     return NO_ERROR;
 }
 
+// called with devfs_lock and parent's lock held
 static mx_status_t _devfs_add_link(vnode_t* parent, const char* name, vnode_t* target) {
-    if ((parent == NULL) || (target == NULL)) {
-        return ERR_INVALID_ARGS;
-    }
 
     xprintf("devfs_add_link() p=%p name='%s'\n", parent, name ? name : "###");
     mx_status_t r;
@@ -176,49 +177,74 @@ got_name:
 }
 
 mx_status_t devfs_add_node(vnode_t** out, vnode_t* parent, const char* name, mx_handle_t h) {
+    if ((parent == NULL) || (name == NULL)) {
+        return ERR_INVALID_ARGS;
+    }
     mx_status_t r;
-    mtx_lock(&vfs_lock);
+    mtx_lock(&devfs_lock);
+    pthread_rwlock_wrlock(&parent->lock);
     r = _devfs_add_node(out, parent, name, h);
-    mtx_unlock(&vfs_lock);
+    pthread_rwlock_unlock(&parent->lock);
+    mtx_unlock(&devfs_lock);
     return r;
 }
 
 mx_status_t devfs_add_link(vnode_t* parent, const char* name, vnode_t* target) {
+    if ((parent == NULL) || (target == NULL)) {
+        return ERR_INVALID_ARGS;
+    }
     mx_status_t r;
-    mtx_lock(&vfs_lock);
+    mtx_lock(&devfs_lock);
+    pthread_rwlock_wrlock(&parent->lock);
     r = _devfs_add_link(parent, name, target);
-    mtx_unlock(&vfs_lock);
+    pthread_rwlock_unlock(&parent->lock);
+    mtx_unlock(&devfs_lock);
     return r;
 }
 
+// called with devfs_lock held, which keeps dn->parent stable
+static void devfs_delete_dnode(dnode_t* dn) {
+    vnode_t* parent = dn->parent ? dn->parent->vnode : NULL;
+    if (parent) {
+        pthread_rwlock_wrlock(&parent->lock);
+    }
+    dn_delete(dn);
+    if (parent) {
+        pthread_rwlock_unlock(&parent->lock);
+    }
+}
+
 mx_status_t devfs_remove(vnode_t* vn) {
-    mtx_lock(&vfs_lock);
+    mtx_lock(&devfs_lock);
 
     // hold a reference to ourselves so the rug doesn't get pulled out from under us
     vn_acquire(vn);
 
     xprintf("devfs_remove(%p)\n", vn);
+
+    // detach the device and directory first, so that lookups
+    // in this vnode no longer see the dnode that is going away
+    pthread_rwlock_wrlock(&vn->lock);
+    vfs_dcache_remove(vn, NULL, 0);
+    dnode_t* dn = vn->dnode;
+    vn->dnode = NULL;
     vn->remote = 0;
+    pthread_rwlock_unlock(&vn->lock);
 
     // if this vnode is a directory, delete its dnode
-    if (vn->dnode) {
+    if (dn) {
         xprintf("devfs_remove(%p) delete dnode\n", vn);
-        dn_delete(vn->dnode);
-        vn->dnode = NULL;
+        devfs_delete_dnode(dn);
     }
 
     // delete all dnodes that point to this vnode
     // (effectively unlink() it from every directory it is in)
-    dnode_t* dn;
     while ((dn = list_peek_head_type(&vn->dn_list, dnode_t, vn_entry)) != NULL) {
-        if (vn->dnode == dn) {
-            vn->dnode = NULL;
-        }
-        dn_delete(dn);
+        devfs_delete_dnode(dn);
     }
 
     vn_release(vn);
-    mtx_unlock(&vfs_lock);
+    mtx_unlock(&devfs_lock);
 
     // with all dnodes destroyed, nothing should hold a reference
     // to the vnode and it should be release()'d
@@ -20,27 +20,36 @@
 
 #define MXDEBUG 0
 
-#define MAXBLOCKS 4096
-#define BLOCKSIZE 8192
+#define PAGE_SIZE 4096
+
+// largest file memfs will hold
+#define MAXFILESIZE (256 * 1024 * 1024)
 
 typedef struct mnode mnode_t;
 struct mnode {
     vnode_t vn;
     size_t datalen;
-    uint8_t* block[MAXBLOCKS];
+
+    // a file's contents live in a vmo, created on the first write and
+    // grown as needed; everything past datalen in it is zero. Only pages
+    // that were written are committed, reading holes doesn't commit them.
+    mx_handle_t vmo;
+    size_t vmosize;
 };
 
 mx_status_t mem_get_node(vnode_t** out, mx_device_t* dev);
 mx_status_t mem_can_unlink(dnode_t* dn);
 
+// serializes renames, so the parents of directories don't change while
+// one is in progress, see vfs.h for the lock order
+static mtx_t mem_rename_lock = MTX_INIT;
+
 static void mem_release(vnode_t* vn) {
     xprintf("memfs: vn %p destroyed\n", vn);
 
     mnode_t* mem = vn->pdata;
-    for (int i = 0; i < MAXBLOCKS; i++) {
-        if (mem->block[i]) {
-            free(mem->block[i]);
-        }
+    if (mem->vmo) {
+        mx_handle_close(mem->vmo);
     }
     free(mem);
 }
@@ -59,117 +68,154 @@ mx_status_t memfs_close(vnode_t* vn) {
     return NO_ERROR;
 }
 
-static ssize_t mem_read(vnode_t* vn, void* _data, size_t len, size_t off) {
+// Makes the vmo at least len bytes long, called with the vnode's lock
+// held exclusively. It grows geometrically so that appending doesn't
+// resize it on every write; pages are only committed once written.
+static mx_status_t mem_grow(mnode_t* mem, size_t len) {
+    if (len <= mem->vmosize) {
+        return NO_ERROR;
+    }
+    if (len > MAXFILESIZE) {
+        return ERR_NO_MEMORY;
+    }
+    size_t size = mem->vmosize * 2;
+    if (size < len) {
+        size = len;
+    }
+    size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (size > MAXFILESIZE) {
+        size = MAXFILESIZE;
+    }
+
+    mx_status_t r;
+    if (mem->vmo == 0) {
+        r = mx_vmo_create(size, 0, &mem->vmo);
+    } else {
+        r = mx_vmo_set_size(mem->vmo, size);
+    }
+    if (r < 0) {
+        return r;
+    }
+    mem->vmosize = size;
+    return NO_ERROR;
+}
+
+static ssize_t _mem_read(vnode_t* vn, void* data, size_t len, size_t off) {
     mnode_t* mem = vn->pdata;
-    uint8_t* data = _data;
-    ssize_t count = 0;
     if (off >= mem->datalen)
         return 0;
     if (len > (mem->datalen - off))
         len = mem->datalen - off;
 
-    size_t bno = off / BLOCKSIZE;
-    off = off % BLOCKSIZE;
-    while (len > 0) {
-        size_t xfer = (BLOCKSIZE - off);
-        if (len < xfer)
-            xfer = len;
-        if (mem->block[bno] == NULL) {
-            xprintf("mem_read: hole at %zu\n", bno);
-            memset(data, 0, xfer);
-        } else {
-            memcpy(data, mem->block[bno] + off, xfer);
-        }
-        data += xfer;
-        len -= xfer;
-        count += xfer;
-        bno++;
-        off = 0;
+    mx_status_t r;
+    if ((r = mx_vmo_read(mem->vmo, data, off, len, &len)) < 0) {
+        return r;
     }
-    return count;
+    return len;
 }
 
-static ssize_t mem_write(vnode_t* vn, const void* _data, size_t len, size_t off) {
-    mnode_t* mem = vn->pdata;
-    const uint8_t* data = _data;
-    ssize_t count = 0;
-    size_t bno = off / BLOCKSIZE;
-    off = off % BLOCKSIZE;
-    while (len > 0) {
-        size_t xfer = (BLOCKSIZE - off);
-        if (len < xfer)
-            xfer = len;
-        if (bno >= MAXBLOCKS) {
-            return count ? count : ERR_NO_MEMORY;
-        }
-        if (mem->block[bno] == NULL) {
-            xprintf("mem_write: alloc at %zu\n", bno);
-            if ((mem->block[bno] = calloc(1, BLOCKSIZE)) == NULL) {
-                return count ? count : ERR_NO_MEMORY;
-            }
-        }
-        memcpy(mem->block[bno] + off, data, xfer);
+static ssize_t mem_read(vnode_t* vn, void* data, size_t len, size_t off) {
+    pthread_rwlock_rdlock(&vn->lock);
+    ssize_t r = _mem_read(vn, data, len, off);
+    pthread_rwlock_unlock(&vn->lock);
+    return r;
+}
 
-        size_t pos = bno * BLOCKSIZE + off + xfer;
-        if (pos > mem->datalen)
-            mem->datalen = pos;
+static ssize_t _mem_write(vnode_t* vn, const void* data, size_t len, size_t off) {
+    mnode_t* mem = vn->pdata;
+    if (len == 0)
+        return 0;
+    if (off >= MAXFILESIZE)
+        return ERR_NO_MEMORY;
+    if (len > (MAXFILESIZE - off))
+        len = MAXFILESIZE - off;
 
-        data += xfer;
-        len -= xfer;
-        count += xfer;
-        bno++;
-        off = 0;
+    mx_status_t r;
+    if ((r = mem_grow(mem, off + len)) < 0) {
+        return r;
     }
-    return count;
+    if ((r = mx_vmo_write(mem->vmo, data, off, len, &len)) < 0) {
+        return r;
+    }
+    if ((off + len) > mem->datalen)
+        mem->datalen = off + len;
+    return len;
 }
 
-mx_status_t memfs_truncate(vnode_t* vn, size_t len) {
+static ssize_t mem_write(vnode_t* vn, const void* data, size_t len, size_t off) {
+    pthread_rwlock_wrlock(&vn->lock);
+    ssize_t r = _mem_write(vn, data, len, off);
+    pthread_rwlock_unlock(&vn->lock);
+    return r;
+}
+
+static mx_status_t _mem_truncate(vnode_t* vn, size_t len) {
     mnode_t* mem = vn->pdata;
-    mx_status_t r = 0;
+    mx_status_t r;
 
-    while (len < mem->datalen) {
+    if (len < mem->datalen) {
         // Truncate should make the file shorter
-
-        // Observe the final blocks of the file first
-        size_t bno = mem->datalen / BLOCKSIZE;
-        size_t b_start = bno * BLOCKSIZE;
-
-        if (b_start == mem->datalen) {
-            // If the last block is empty, move to the one before
-            bno--;
-            b_start -= BLOCKSIZE;
+        //
+        // Shrinking the vmo frees the whole pages past the new end, but
+        // the tail of the last page has to be zeroed by hand, or growing
+        // the file again would bring the old data back.
+        static const uint8_t zero[PAGE_SIZE];
+        size_t size = (len + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        size_t tail = ((mem->datalen < size) ? mem->datalen : size) - len;
+        size_t actual;
+        if ((tail > 0) && ((r = mx_vmo_write(mem->vmo, zero, len, tail, &actual)) < 0)) {
+            return r;
         }
-        // "b_start" is now guaranteed to be less than "mem->datalen"
-
-        if (len <= b_start) {
-            // Wipe out this entire block
-            if (mem->block[bno] != NULL) {
-                free(mem->block[bno]);
-                mem->block[bno] = NULL;
-            }
-            mem->datalen = b_start;
-        } else {
-            // Wipe out a portion of a block
-            size_t sub_block_off = len - b_start;
-            memset(mem->block[bno] + sub_block_off, 0, BLOCKSIZE - sub_block_off);
-            mem->datalen = len;
+        if ((r = mx_vmo_set_size(mem->vmo, size)) < 0) {
+            return r;
         }
-    }
-    if (len > mem->datalen) {
+        mem->vmosize = size;
+    } else if (len > mem->datalen) {
         // Truncate should make the file longer
-        if (len > MAXBLOCKS * BLOCKSIZE) {
+        if (len > MAXFILESIZE) {
             return ERR_INVALID_ARGS;
         }
-        // Memfs supports sparse files, so we can simply extend the data length,
-        // and trust the rest of the filesystem to deal with this appropriately
-        mem->datalen = len;
+        // The vmo reads back zeroes where nothing was written, so
+        // making room for the new length is all that is needed
+        if ((r = mem_grow(mem, len)) < 0) {
+            return r;
+        }
     }
+    mem->datalen = len;
+    return NO_ERROR;
+}
+
+// Hands out the file's vmo itself, so that clients which only read it
+// don't need a round trip to devmgr for every chunk. The length is the
+// one at the time of the call, as for a bootfs file.
+static mx_handle_t mem_get_vmofile(vnode_t* vn, mx_off_t* off, mx_off_t* len) {
+    mnode_t* mem = vn->pdata;
+    mx_handle_t vmo;
+    mx_status_t r;
+
+    // an empty file may not have a vmo yet
+    pthread_rwlock_wrlock(&vn->lock);
+    if ((r = mem_grow(mem, 1)) == NO_ERROR) {
+        r = mx_handle_duplicate(mem->vmo, MX_RIGHT_READ | MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER,
+                                &vmo);
+    }
+    *off = 0;
+    *len = mem->datalen;
+    pthread_rwlock_unlock(&vn->lock);
+    return (r < 0) ? r : vmo;
+}
+
+mx_status_t memfs_truncate(vnode_t* vn, size_t len) {
+    pthread_rwlock_wrlock(&vn->lock);
+    mx_status_t r = _mem_truncate(vn, len);
+    pthread_rwlock_unlock(&vn->lock);
     return r;
 }
 
-mx_status_t memfs_rename(vnode_t* olddir, vnode_t* newdir,
-                         const char* oldname, size_t oldlen,
-                         const char* newname, size_t newlen) {
+// called with mem_rename_lock and the locks of both directories held
+static mx_status_t _memfs_rename(vnode_t* olddir, vnode_t* newdir,
+                                 const char* oldname, size_t oldlen,
+                                 const char* newname, size_t newlen) {
     if ((olddir->dnode == NULL) || (newdir->dnode == NULL))
         return ERR_BAD_STATE;
     if ((oldlen == 1) && (oldname[0] == '.'))
@@ -214,7 +260,10 @@ mx_status_t memfs_rename(vnode_t* olddir, vnode_t* newdir,
         if (srcIsFile != dstIsFile) {
             // Cannot rename files to directories (and vice versa)
             return ERR_INVALID_ARGS;
-        } else if ((r = mem_can_unlink(targetdn)) < 0) {
+        }
+        // the name cache may hold a reference, drop it before checking
+        vfs_dcache_remove(newdir, newname, newlen);
+        if ((r = mem_can_unlink(targetdn)) < 0) {
             return r;
         }
     } else if (r != ERR_NOT_FOUND) {
@@ -239,20 +288,50 @@ mx_status_t memfs_rename(vnode_t* olddir, vnode_t* newdir,
     vn_acquire(vn); // Acquire +1
     uint32_t oldtype = DN_TYPE(olddn->flags);
 
+    if (vn->dnode != NULL) {
+        // A directory's entries hang off its dnode, move them over to the
+        // new one. The directory is neither of the two locked ones (checked
+        // above), and only renames take a second lock, so this is safe.
+        pthread_rwlock_wrlock(&vn->lock);
+        dn_move_children(olddn, newdn);
+        vn->dnode = newdn;
+        pthread_rwlock_unlock(&vn->lock);
+    }
+
     // Delete source dnode
     dn_delete(olddn); // Acquire +0
 
     // Bind the newdn and vn, and attach it to the destination's parent
     dn_attach(newdn, vn); // Acquire +1
     vn_release(vn); // Acquire +0. No change in refcount, no chance of deletion.
-    if (vn->dnode != NULL)
-        vn->dnode = newdn;
     newdn->flags |= oldtype;
     dn_add_child(newdir->dnode, newdn);
 
     return NO_ERROR;
 }
 
+mx_status_t memfs_rename(vnode_t* olddir, vnode_t* newdir,
+                         const char* oldname, size_t oldlen,
+                         const char* newname, size_t newlen) {
+    mtx_lock(&mem_rename_lock);
+    // lock the directories in address order
+    vnode_t* first = (olddir < newdir) ? olddir : newdir;
+    vnode_t* second = (olddir < newdir) ? newdir : olddir;
+    pthread_rwlock_wrlock(&first->lock);
+    if (second != first) {
+        pthread_rwlock_wrlock(&second->lock);
+    }
+
+    mx_status_t r = _memfs_rename(olddir, newdir, oldname, oldlen, newname, newlen);
+
+    if (second != first) {
+        pthread_rwlock_unlock(&second->lock);
+    }
+    pthread_rwlock_unlock(&first->lock);
+    mtx_unlock(&mem_rename_lock);
+    return r;
+}
+
 mx_status_t memfs_rename_none(vnode_t* olddir, vnode_t* newdir,
                               const char* oldname, size_t oldlen,
                               const char* newname, size_t newlen) {
@@ -278,15 +357,16 @@ ssize_t memfs_write_none(vnode_t* vn, const void* data, size_t len, size_t off)
 }
 
 mx_status_t memfs_lookup(vnode_t* parent, vnode_t** out, const char* name, size_t len) {
-    if (parent->dnode == NULL) {
-        return ERR_NOT_FOUND;
-    }
     dnode_t* dn;
-    mx_status_t r = dn_lookup(parent->dnode, &dn, name, len);
-    if (r >= 0) {
+    mx_status_t r;
+    pthread_rwlock_rdlock(&parent->lock);
+    if (parent->dnode == NULL) {
+        r = ERR_NOT_FOUND;
+    } else if ((r = dn_lookup(parent->dnode, &dn, name, len)) >= 0) {
         vn_acquire(dn->vnode);
         *out = dn->vnode;
     }
+    pthread_rwlock_unlock(&parent->lock);
     return r;
 }
 
@@ -294,7 +374,9 @@ static mx_status_t mem_getattr(vnode_t* vn, vnattr_t* attr) {
     mnode_t* mem = vn->pdata;
     memset(attr, 0, sizeof(vnattr_t));
     if (vn->dnode == NULL) {
+        pthread_rwlock_rdlock(&vn->lock);
         attr->size = mem->datalen;
+        pthread_rwlock_unlock(&vn->lock);
         attr->mode = V_TYPE_FILE | V_IRUSR;
     } else {
         attr->mode = V_TYPE_DIR | V_IRUSR;
@@ -303,11 +385,16 @@ static mx_status_t mem_getattr(vnode_t* vn, vnattr_t* attr) {
 }
 
 mx_status_t memfs_readdir(vnode_t* parent, void* cookie, void* data, size_t len) {
+    mx_status_t r;
+    pthread_rwlock_rdlock(&parent->lock);
     if (parent->dnode == NULL) {
         // TODO: not directory error?
-        return ERR_NOT_FOUND;
+        r = ERR_NOT_FOUND;
+    } else {
+        r = dn_readdir(parent->dnode, cookie, data, len);
     }
-    return dn_readdir(parent->dnode, cookie, data, len);
+    pthread_rwlock_unlock(&parent->lock);
+    return r;
 }
 
 static mx_status_t _mem_create(vnode_t* parent, mnode_t** out,
@@ -316,11 +403,13 @@ static mx_status_t _mem_create(vnode_t* parent, mnode_t** out,
 
 static mx_status_t mem_create(vnode_t* vn, vnode_t** out, const char* name, size_t len, uint32_t mode) {
     mnode_t* mem;
+    pthread_rwlock_wrlock(&vn->lock);
     mx_status_t r = _mem_create(vn, &mem, name, len, S_ISDIR(mode));
     if (r >= 0) {
         vn_acquire(&mem->vn);
         *out = &mem->vn;
     }
+    pthread_rwlock_unlock(&vn->lock);
     return r;
 }
 
@@ -330,6 +419,11 @@ ssize_t memfs_ioctl(vnode_t* vn, uint32_t op,
     return ERR_NOT_SUPPORTED;
 }
 
+// Called with the lock of the directory holding dn held exclusively.
+//
+// A directory can only be unlinked while its dnode holds the only
+// reference, and new references are only handed out by lookups under
+// that lock, so nothing can be creating entries in it at the same time.
 mx_status_t mem_can_unlink(dnode_t* dn) {
     bool isDirectory = (dn->vnode->dnode != NULL);
     if (isDirectory && (dn->vnode->refcount > 1)) {
@@ -352,14 +446,16 @@ mx_status_t memfs_unlink(vnode_t* vn, const char* name, size_t len) {
     }
     dnode_t* dn;
     mx_status_t r;
-    if ((r = dn_lookup(vn->dnode, &dn, name, len)) < 0) {
-        return r;
-    }
-    if ((r = mem_can_unlink(dn)) < 0) {
-        return r;
+    pthread_rwlock_wrlock(&vn->lock);
+    if ((r = dn_lookup(vn->dnode, &dn, name, len)) == NO_ERROR) {
+        // the name cache may hold a reference, drop it before checking
+        vfs_dcache_remove(vn, name, len);
+        if ((r = mem_can_unlink(dn)) == NO_ERROR) {
+            dn_delete(dn);
+        }
     }
-    dn_delete(dn);
-    return NO_ERROR;
+    pthread_rwlock_unlock(&vn->lock);
+    return r;
 }
 
 static vnode_ops_t vn_mem_ops = {
@@ -378,6 +474,10 @@ static vnode_ops_t vn_mem_ops = {
     .sync = memfs_sync,
 };
 
+static vnode_pops_t vn_mem_pops = {
+    .get_vmofile = mem_get_vmofile,
+};
+
 static vnode_ops_t vn_mem_ops_dir = {
     .release = mem_release,
     .open = memfs_open,
@@ -411,6 +511,7 @@ static mnode_t mem_root = {
     },
 };
 
+// called with parent's lock held exclusively
 static mx_status_t _mem_create(vnode_t* parent, mnode_t** out,
                                const char* name, size_t namelen,
                                bool isdir) {
@@ -446,6 +547,9 @@ static mx_status_t _mem_create(vnode_t* parent, mnode_t** out,
 
     if (isdir) {
         mem->vn.dnode = dn;
+    } else {
+        mem->vn.flags |= V_FLAG_VMOFILE;
+        mem->vn.pops = &vn_mem_pops;
     }
 
     *out = mem;
@@ -504,31 +608,35 @@ typedef struct mount_node {
 
 static list_node_t remote_list = LIST_INITIAL_VALUE(remote_list);
 
+// protects remote_list, taken before any vnode lock
+static mtx_t remote_lock = MTX_INIT;
+
 mx_status_t vfs_install_remote(vnode_t* vn, mx_handle_t h) {
     if (vn == NULL) {
         return ERR_ACCESS_DENIED;
     }
 
-    mtx_lock(&vfs_lock);
+    mx_status_t r = NO_ERROR;
+    mtx_lock(&remote_lock);
+    pthread_rwlock_wrlock(&vn->lock);
     // We cannot mount if anything else is already installed remotely
-    if (vn->remote > 0) {
-        mtx_unlock(&vfs_lock);
-        return ERR_ALREADY_BOUND;
-    }
-    // Allocate a node to track the remote handle
     mount_node_t* mount_point;
-    if ((mount_point = calloc(1, sizeof(mount_node_t))) == NULL) {
-        mtx_unlock(&vfs_lock);
-        return ERR_NO_MEMORY;
+    if (vn->remote > 0) {
+        r = ERR_ALREADY_BOUND;
+    } else if ((mount_point = calloc(1, sizeof(mount_node_t))) == NULL) {
+        // Allocate a node to track the remote handle
+        r = ERR_NO_MEMORY;
+    } else {
+        // Save this node in the list of mounted vnodes
+        mount_point->vn = vn;
+        list_add_tail(&remote_list, &mount_point->node);
+        vn->remote = h;
+        vn->flags |= V_FLAG_REMOTE;
     }
-    // Save this node in the list of mounted vnodes
-    mount_point->vn = vn;
-    list_add_tail(&remote_list, &mount_point->node);
-    vn->remote = h;
-    vn->flags |= V_FLAG_REMOTE;
-    mtx_unlock(&vfs_lock);
+    pthread_rwlock_unlock(&vn->lock);
+    mtx_unlock(&remote_lock);
 
-    return NO_ERROR;
+    return r;
 }
 
 static mx_status_t txn_unmount(mx_handle_t srv) {
@@ -554,16 +662,21 @@ static mx_status_t txn_unmount(mx_handle_t srv) {
 mx_status_t vfs_uninstall_all(void) {
     mount_node_t* mount_point;
     mount_node_t* tmp;
-    mtx_lock(&vfs_lock);
+    mtx_lock(&remote_lock);
     list_for_every_entry_safe (&remote_list, mount_point, tmp, mount_node_t, node) {
+        vnode_t* vn = mount_point->vn;
         mx_status_t status;
-        if ((status = txn_unmount(mount_point->vn->remote)) < 0) {
+        // the handle only changes under remote_lock, no need to hold
+        // the vnode lock while waiting for the remote filesystem
+        if ((status = txn_unmount(vn->remote)) < 0) {
             printf("Unexpected error unmounting filesystem: %d\n", status);
         }
-        mx_handle_close(mount_point->vn->remote);
-        mount_point->vn->remote = 0;
+        pthread_rwlock_wrlock(&vn->lock);
+        mx_handle_close(vn->remote);
+        vn->remote = 0;
+        pthread_rwlock_unlock(&vn->lock);
         list_delete(&mount_point->node);
     }
-    mtx_unlock(&vfs_lock);
+    mtx_unlock(&remote_lock);
     return NO_ERROR;
 }
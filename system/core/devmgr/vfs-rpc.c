@@ -19,6 +19,7 @@
 #include <magenta/syscalls.h>
 
 #include <fcntl.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,6 +27,9 @@
 
 #define MXDEBUG 0
 
+// upper bound on the threads serving vfs requests
+#define VFS_MAX_WORKERS 4
+
 static mxio_dispatcher_t* vfs_dispatcher;
 
 static mx_status_t vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie);
@@ -103,12 +107,20 @@ static mx_status_t vfs_get_handles(vnode_t* vn, uint32_t flags,
                                    void* extra, uint32_t* esize,
                                    const char* trackfn) {
     if ((vn->flags & V_FLAG_DEVICE) && !(flags & O_DIRECTORY)) {
-        *type = 0;
+        // devfs_remove() may be detaching the device right now
+        pthread_rwlock_rdlock(&vn->lock);
         hnds[0] = vn->remote;
+        pthread_rwlock_unlock(&vn->lock);
+        if (hnds[0] == 0) {
+            return ERR_NOT_FOUND;
+        }
+        *type = 0;
         return 1;
-    } else if (vn->flags & V_FLAG_VMOFILE) {
+    } else if ((vn->flags & V_FLAG_VMOFILE) && ((flags & O_ACCMODE) == O_RDONLY)) {
         mx_off_t* args = extra;
-        hnds[0] = vfs_get_vmofile(vn, args + 0, args + 1);
+        if ((hnds[0] = vfs_get_vmofile(vn, args + 0, args + 1)) < 0) {
+            return hnds[0];
+        }
         *type = MXIO_PROTOCOL_VMOFILE;
         *esize = sizeof(mx_off_t) * 2;
         return 1;
@@ -143,9 +155,7 @@ static mx_status_t txn_handoff_open(mx_handle_t srv, mx_handle_t rh,
 static mx_status_t _vfs_open(mxrio_msg_t* msg, mx_handle_t rh, vnode_t* vn,
                              const char* path, uint32_t flags, uint32_t mode) {
     mx_status_t r;
-    mtx_lock(&vfs_lock);
     r = vfs_open(vn, &vn, path, &path, flags, mode);
-    mtx_unlock(&vfs_lock);
     if (r < 0) {
         xprintf("vfs: open: r=%d\n", r);
         return r;
@@ -187,10 +197,23 @@ static mx_status_t _vfs_open(mxrio_msg_t* msg, mx_handle_t rh, vnode_t* vn,
     return NO_ERROR;
 }
 
-static vnode_t* volatile vfs_txn_vn;
-static volatile int vfs_txn_op;
-static volatile int vfs_txn = -1;
-static int vfs_txn_no = 0;
+// What each dispatcher worker is serving, for the watchdog. A worker owns
+// its slot and stores |txn| last, after the rest is filled in; zero means
+// idle. The watchdog copies the slot and rereads |txn| to make sure it did
+// not change in the meantime. |vn| is only printed, never dereferenced:
+// the worker may drop the last reference to it at any time, so the device
+// name is copied while the transaction still holds one.
+typedef struct {
+    atomic_int txn;
+    atomic_int op;
+    atomic_uintptr_t vn;
+    char name[MX_DEVICE_NAME_MAX + 1];
+} vfs_txn_slot_t;
+
+static vfs_txn_slot_t vfs_txn_slots[VFS_MAX_WORKERS];
+static atomic_int vfs_txn_slot_count;
+static atomic_int vfs_txn_no;
+static thread_local vfs_txn_slot_t* vfs_txn_slot;
 
 static mx_status_t _vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie) {
     vfs_iostate_t* ios = cookie;
@@ -199,9 +222,6 @@ static mx_status_t _vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
     int32_t arg = msg->arg;
     msg->datalen = 0;
 
-    vfs_txn_vn = vn;
-    vfs_txn_op = MXRIO_OP(msg->op);
-
     for (unsigned i = 0; i < msg->hcount; i++) {
         mx_handle_close(msg->handle[i]);
     }
@@ -339,9 +359,7 @@ static mx_status_t _vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
             return ERR_INVALID_ARGS;
         }
         mx_status_t r;
-        mtx_lock(&vfs_lock);
         r = vn->ops->readdir(vn, &ios->dircookie, msg->data, arg);
-        mtx_unlock(&vfs_lock);
         if (r >= 0) {
             msg->datalen = r;
         }
@@ -395,28 +413,67 @@ static mx_status_t _vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
     }
 }
 
+// Publishes the transaction this worker is starting in its slot. The
+// vnode is still referenced by |ios| here.
+static void vfs_txn_begin(vnode_t* vn, uint32_t op) {
+    vfs_txn_slot_t* slot = vfs_txn_slot;
+    if (slot == NULL) {
+        int n = atomic_fetch_add(&vfs_txn_slot_count, 1);
+        if (n >= VFS_MAX_WORKERS) {
+            return;
+        }
+        slot = vfs_txn_slot = &vfs_txn_slots[n];
+    }
+    atomic_store(&slot->vn, (uintptr_t)vn);
+    atomic_store(&slot->op, MXRIO_OP(op));
+    if (vn->flags & V_FLAG_DEVICE) {
+        memcpy(slot->name, ((mx_device_t*)vn->pdata)->name, sizeof(slot->name));
+    } else {
+        slot->name[0] = 0;
+    }
+    atomic_store(&slot->txn, (atomic_fetch_add(&vfs_txn_no, 1) & 0x0FFFFFFF) + 1);
+}
+
+static void vfs_txn_end(void) {
+    if (vfs_txn_slot != NULL) {
+        atomic_store(&vfs_txn_slot->txn, 0);
+    }
+}
+
+// The dispatcher runs this from several worker threads, the vnode
+// operations do their own locking (see vfs.h)
 static mx_status_t vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie) {
-    vfs_txn_no = (vfs_txn_no + 1) & 0x0FFFFFFF;
-    vfs_txn = vfs_txn_no;
+    vfs_iostate_t* ios = cookie;
+    vfs_txn_begin(ios->vn, msg->op);
     mx_status_t r = _vfs_handler(msg, rh, cookie);
-    vfs_txn = -1;
+    vfs_txn_end();
     return r;
 }
 
 static int vfs_watchdog(void* arg) {
-    int txn = vfs_txn;
+    int last[VFS_MAX_WORKERS] = { 0 };
     for (;;) {
         mx_nanosleep(1000000000ULL);
-        int now = vfs_txn;
-        if ((now == txn) && (now != -1)) {
-            vnode_t* vn = vfs_txn_vn;
-            printf("devmgr: watchdog: txn %d did not complete: vn=%p op=%d\n", txn, vn, vfs_txn_op);
-            if (vn->flags & V_FLAG_DEVICE) {
-                printf("devmgr: watchdog: vn=%p is device '%s'\n", vn,
-                       ((mx_device_t*)vn->pdata)->name);
+        for (int i = 0; i < VFS_MAX_WORKERS; i++) {
+            vfs_txn_slot_t* slot = &vfs_txn_slots[i];
+            int txn = atomic_load(&slot->txn);
+            if ((txn != 0) && (txn == last[i])) {
+                void* vn = (void*)atomic_load(&slot->vn);
+                int op = atomic_load(&slot->op);
+                char name[sizeof(slot->name)];
+                memcpy(name, slot->name, sizeof(name));
+                name[sizeof(name) - 1] = 0;
+                atomic_thread_fence(memory_order_acquire);
+                if (atomic_load(&slot->txn) == txn) {
+                    printf("devmgr: watchdog: txn %d did not complete: vn=%p op=%d\n",
+                           txn, vn, op);
+                    if (name[0]) {
+                        printf("devmgr: watchdog: vn=%p is device '%s'\n", vn, name);
+                    }
+                }
             }
+            last[i] = txn;
         }
-        txn = now;
     }
     return 0;
 }
@@ -435,7 +492,11 @@ static vnode_t* global_vfs_root;
 // Initialize the global root VFS node and dispatcher
 void vfs_global_init(vnode_t* root) {
     global_vfs_root = root;
-    if (mxio_dispatcher_create(&vfs_dispatcher, mxrio_handler) == NO_ERROR) {
+    uint32_t workers = mx_num_cpus();
+    if (workers > VFS_MAX_WORKERS) {
+        workers = VFS_MAX_WORKERS;
+    }
+    if (mxio_dispatcher_create_pool(&vfs_dispatcher, mxrio_handler, workers) == NO_ERROR) {
         mxio_dispatcher_start(vfs_dispatcher, "vfs-rio-dispatcher");
     }
     thrd_t t;
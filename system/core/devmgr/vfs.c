@@ -30,8 +30,6 @@
 
 #define DEBUG_TRACK_NAMES 1
 
-mtx_t vfs_lock = MTX_INIT;
-
 static list_node_t vfs_iostate_list = LIST_INITIAL_VALUE(vfs_iostate_list);
 static mtx_t vfs_iostate_lock = MTX_INIT;
 
@@ -56,6 +54,200 @@ void untrack_vfs_iostate(vfs_iostate_t* ios) {
 #endif
 }
 
+// Returns 0 if vn is not a mount point, otherwise the handle of the
+// filesystem mounted there, or ERR_NOT_FOUND if nothing is mounted now
+static mx_handle_t vfs_get_remote(vnode_t* vn) {
+    mx_handle_t h = 0;
+    pthread_rwlock_rdlock(&vn->lock);
+    if (vn->flags & V_FLAG_REMOTE) {
+        h = (vn->remote > 0) ? vn->remote : ERR_NOT_FOUND;
+    }
+    pthread_rwlock_unlock(&vn->lock);
+    return h;
+}
+
+// Name cache
+//
+// Remembers the results of recent lookups, found or not, keyed by
+// directory vnode and name, so that repeated walks through stable
+// directories like /boot/lib or /dev/class don't have to go through the
+// filesystem and each directory's lock again.
+//
+// An entry is only used while its directory still has the generation it
+// was filled under. Generations come from one global counter and are
+// bumped (under the directory's lock) before any child is added or
+// removed, so a lookup that raced with a change never leaves a stale
+// entry behind, and a new vnode at a reused address never matches old
+// entries. Entries that found something hold a reference on that vnode,
+// which vfs_dcache_remove() drops right away for the entries it forgets,
+// a single name or all of a directory's.
+//
+// The entry locks are leaves: nothing else is locked while holding one,
+// and vnodes are only released after dropping them.
+
+#define DCACHE_SIZE 1024 // entries, direct mapped
+#define DCACHE_LOCKS 16
+#define DCACHE_NAME_MAX 40 // longer names are not cached
+
+typedef struct dcache_entry {
+    vnode_t* vndir;
+    vnode_t* vn; // NULL if the name was not found
+    uint64_t gen;
+    uint32_t hash;
+    uint32_t len;
+    char name[DCACHE_NAME_MAX];
+} dcache_entry_t;
+
+static dcache_entry_t dcache[DCACHE_SIZE];
+static mtx_t dcache_lock[DCACHE_LOCKS] = {
+    [0 ... DCACHE_LOCKS - 1] = MTX_INIT,
+};
+static atomic_uint_fast64_t dcache_gen = 0;
+
+static bool dcache_cacheable(const char* name, size_t len) {
+    if ((len == 0) || (len > DCACHE_NAME_MAX))
+        return false;
+    if ((len == 1) && (name[0] == '.'))
+        return false;
+    if ((len == 2) && (name[0] == '.') && (name[1] == '.'))
+        return false;
+    return true;
+}
+
+// FNV-1a over the directory pointer and the name
+static uint32_t dcache_hash(vnode_t* vndir, const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    uintptr_t p = (uintptr_t)vndir;
+    for (size_t i = 0; i < sizeof(p); i++) {
+        hash = (hash ^ (uint8_t)(p >> (i * 8))) * 16777619u;
+    }
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static dcache_entry_t* dcache_entry(uint32_t hash) {
+    return &dcache[hash % DCACHE_SIZE];
+}
+
+static mtx_t* dcache_entry_lock(uint32_t hash) {
+    return &dcache_lock[hash % DCACHE_LOCKS];
+}
+
+// called with the entry's lock held
+static bool dcache_match(dcache_entry_t* e, vnode_t* vndir, uint32_t hash,
+                         const char* name, size_t len) {
+    return (e->vndir == vndir) && (e->hash == hash) && (e->len == len) &&
+           (memcmp(e->name, name, len) == 0);
+}
+
+// drops every entry under vndir, called with vndir's lock held exclusively
+static void dcache_remove_all(vnode_t* vndir) {
+    vnode_t* vns[DCACHE_SIZE / DCACHE_LOCKS];
+    for (size_t l = 0; l < DCACHE_LOCKS; l++) {
+        size_t count = 0;
+        mtx_lock(&dcache_lock[l]);
+        for (size_t i = l; i < DCACHE_SIZE; i += DCACHE_LOCKS) {
+            dcache_entry_t* e = &dcache[i];
+            if (e->vndir == vndir) {
+                if (e->vn) {
+                    vns[count++] = e->vn;
+                }
+                e->vndir = NULL;
+                e->vn = NULL;
+            }
+        }
+        mtx_unlock(&dcache_lock[l]);
+        for (size_t i = 0; i < count; i++) {
+            vn_release(vns[i]);
+        }
+    }
+}
+
+void vfs_dcache_remove(vnode_t* vndir, const char* name, size_t len) {
+    atomic_store(&vndir->dcache_gen, atomic_fetch_add(&dcache_gen, 1) + 1);
+    if (name == NULL) {
+        dcache_remove_all(vndir);
+        return;
+    }
+    if (!dcache_cacheable(name, len)) {
+        return;
+    }
+
+    // drop the entry now rather than leave it holding a reference; the
+    // child is still linked in, so this is never the last one
+    uint32_t hash = dcache_hash(vndir, name, len);
+    dcache_entry_t* e = dcache_entry(hash);
+    vnode_t* vn = NULL;
+    mtx_lock(dcache_entry_lock(hash));
+    if (dcache_match(e, vndir, hash, name, len)) {
+        vn = e->vn;
+        e->vndir = NULL;
+        e->vn = NULL;
+    }
+    mtx_unlock(dcache_entry_lock(hash));
+    if (vn) {
+        vn_release(vn);
+    }
+}
+
+// Looks up name in vndir like vndir->ops->lookup(), going through the
+// name cache
+static mx_status_t vfs_lookup(vnode_t* vndir, vnode_t** out,
+                              const char* name, size_t len) {
+    if (!dcache_cacheable(name, len)) {
+        return vndir->ops->lookup(vndir, out, name, len);
+    }
+
+    uint32_t hash = dcache_hash(vndir, name, len);
+    dcache_entry_t* e = dcache_entry(hash);
+    mtx_t* lock = dcache_entry_lock(hash);
+    mx_status_t r;
+
+    mtx_lock(lock);
+    if (dcache_match(e, vndir, hash, name, len) &&
+        (e->gen == atomic_load(&vndir->dcache_gen))) {
+        if (e->vn) {
+            vn_acquire(e->vn);
+            *out = e->vn;
+            r = NO_ERROR;
+        } else {
+            r = ERR_NOT_FOUND;
+        }
+        mtx_unlock(lock);
+        return r;
+    }
+    mtx_unlock(lock);
+
+    uint64_t gen = atomic_load(&vndir->dcache_gen);
+    r = vndir->ops->lookup(vndir, out, name, len);
+    if ((r != NO_ERROR) && (r != ERR_NOT_FOUND)) {
+        return r;
+    }
+
+    // only fill the entry if vndir hasn't changed since the lookup began
+    vnode_t* old = NULL;
+    mtx_lock(lock);
+    if (gen == atomic_load(&vndir->dcache_gen)) {
+        old = e->vn;
+        e->vndir = vndir;
+        e->vn = (r == NO_ERROR) ? *out : NULL;
+        e->gen = gen;
+        e->hash = hash;
+        e->len = len;
+        memcpy(e->name, name, len);
+        if (e->vn) {
+            vn_acquire(e->vn);
+        }
+    }
+    mtx_unlock(lock);
+    if (old) {
+        vn_release(old);
+    }
+    return r;
+}
+
 // Starting at vnode vn, walk the tree described by the path string,
 // until either there is only one path segment remaining in the string
 // or we encounter a vnode that represents a remote filesystem
@@ -66,6 +258,7 @@ static mx_status_t vfs_walk(vnode_t* vn, vnode_t** out,
                             const char* path, const char** pathout) {
     vnode_t* oldvn = NULL;
     const char* nextpath;
+    mx_handle_t remote;
     mx_status_t r;
     size_t len;
 
@@ -78,7 +271,7 @@ static mx_status_t vfs_walk(vnode_t* vn, vnode_t** out,
             // convert empty initial path of final path segment to "."
             path = ".";
         }
-        if (vn->flags & V_FLAG_REMOTE) {
+        if ((remote = vfs_get_remote(vn)) != 0) {
             // remote filesystem mount, caller must resolve
             xprintf("vfs_walk: vn=%p name='%s' (remote)\n", vn, path);
             *out = vn;
@@ -87,17 +280,14 @@ static mx_status_t vfs_walk(vnode_t* vn, vnode_t** out,
                 // returning our original vnode, need to upref it
                 vn_acquire(vn);
             }
-            if (vn->remote > 0) {
-                return vn->remote;
-            }
-            return ERR_NOT_FOUND;
+            return remote;
         } else if ((nextpath = strchr(path, '/')) != NULL) {
             // path has at least one additional segment
             // traverse to the next segment
             len = nextpath - path;
             nextpath++;
             xprintf("vfs_walk: vn=%p name='%.*s' nextpath='%s'\n", vn, (int)len, path, nextpath);
-            r = vn->ops->lookup(vn, &vn, path, len);
+            r = vfs_lookup(vn, &vn, path, len);
             if (oldvn) {
                 // release the old vnode, even if there was an error
                 vn_release(oldvn);
@@ -150,14 +340,13 @@ mx_status_t vfs_open(vnode_t* vndir, vnode_t** out, const char* path,
         }
     } else {
     try_open:
-        r = vndir->ops->lookup(vndir, &vn, path, len);
+        r = vfs_lookup(vndir, &vn, path, len);
         vn_release(vndir);
         if (r < 0) {
             return r;
         }
-        if ((vn->flags & V_FLAG_REMOTE) && (vn->remote > 0)) {
+        if ((r = vfs_get_remote(vn)) > 0) {
             *pathout = ".";
-            r = vn->remote;
             vn_release(vn);
             return r;
         }
@@ -266,9 +455,9 @@ ssize_t vfs_do_ioctl(vnode_t* vn, uint32_t op, const void* in_buf,
             return ERR_NO_RESOURCES;
         }
         memcpy(out_buf, &h, sizeof(mx_handle_t));
-        mtx_lock(&vfs_lock);
+        pthread_rwlock_wrlock(&vn->lock);
         list_add_tail(&vn->watch_list, &watcher->node);
-        mtx_unlock(&vfs_lock);
+        pthread_rwlock_unlock(&vn->lock);
         xprintf("new watcher vn=%p w=%p\n", vn, watcher);
         return sizeof(mx_handle_t);
     }
@@ -294,17 +483,22 @@ ssize_t vfs_do_ioctl(vnode_t* vn, uint32_t op, const void* in_buf,
     }
 }
 
+mx_handle_t vfs_get_vmofile(vnode_t* vn, mx_off_t* off, mx_off_t* len) {
+    vnode_pops_t* pops = vn->pops;
+    return pops->get_vmofile(vn, off, len);
+}
+
 void vn_acquire(vnode_t* vn) {
-    vn->refcount++;
+    atomic_fetch_add(&vn->refcount, 1);
 }
 
 void vn_release(vnode_t* vn) {
-    if (vn->refcount == 0) {
+    unsigned int refcount = atomic_fetch_sub(&vn->refcount, 1);
+    if (refcount == 0) {
         printf("vn %p: ref underflow\n", vn);
         panic();
     }
-    vn->refcount--;
-    if (vn->refcount == 0) {
+    if (refcount == 1) {
         vn->ops->release(vn);
     }
 }
@@ -9,14 +9,36 @@
 #include <mxio/remoteio.h>
 #include <mxio/vfs.h>
 #include <magenta/listnode.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <threads.h>
 
 typedef struct dnode dnode_t;
 
+// Locking:
+//
+// Each vnode has a reader/writer lock. For a directory it protects the
+// children of its dnode, its watch list and its remote mount; for a memfs
+// file it protects the file contents. Lookups and readdir take it shared,
+// anything that adds or removes a child takes it exclusive.
+//
+// Only rename holds more than one vnode lock at a time. It first takes
+// the global rename lock, which keeps the shape of the tree stable, then
+// locks the two directories in address order. Nothing may wait on another
+// vnode lock while holding one otherwise.
+//
+// References are atomic and need no lock. A directory's dnode holds a
+// reference on each child vnode, so a child found under its parent's
+// lock stays alive once vn_acquire()'d.
+//
+// Recent lookups are remembered in a name cache (see vfs.c). Anything
+// that adds or removes a child must call vfs_dcache_remove() with the
+// directory's lock held exclusively, before making the change; the dnode
+// helpers do this for their callers.
 struct vnode {
     vnode_ops_t* ops;
     uint32_t flags;
-    uint32_t refcount;
+    atomic_uint refcount;
     uint32_t seqcount;
     mx_handle_t remote;
     dnode_t* dnode;
@@ -30,6 +52,11 @@ struct vnode {
 
     // all directory watchers
     list_node_t watch_list;
+
+    pthread_rwlock_t lock;
+
+    // name cache generation, changes whenever a child is added or removed
+    atomic_uint_fast64_t dcache_gen;
 };
 
 typedef struct vnode_watcher {
@@ -41,6 +68,13 @@ typedef struct vnode_watcher {
 #define V_FLAG_REMOTE 2
 #define V_FLAG_VMOFILE 4
 
+// devmgr-specific vnode operations, found through vn->pops
+typedef struct vnode_pops {
+    // Returns a read-only handle to a vmo holding the file's contents
+    // at [*off, *off + *len), for V_FLAG_VMOFILE vnodes
+    mx_handle_t (*get_vmofile)(vnode_t* vn, mx_off_t* off, mx_off_t* len);
+} vnode_pops_t;
+
 mx_status_t vfs_open(vnode_t* vndir, vnode_t** out, const char* path,
                      const char** pathout, uint32_t flags, uint32_t mode);
 
@@ -50,6 +84,8 @@ mx_status_t vfs_rename(vnode_t* vn, const char* oldpath, const char* newpath,
 ssize_t vfs_do_ioctl(vnode_t* vn, uint32_t op, const void* in_buf,
                      size_t in_len, void* out_buf, size_t out_len);
 
+// Read-only opens of V_FLAG_VMOFILE vnodes are served as vmofiles,
+// which clients read directly, without going through devmgr
 mx_handle_t vfs_get_vmofile(vnode_t* vn, mx_off_t* off, mx_off_t* len);
 
 // helper for filling out dents
@@ -58,6 +94,12 @@ mx_status_t vfs_fill_dirent(vdirent_t* de, size_t delen,
                             const char* name, size_t len, uint32_t type);
 
 
+// called with vndir's lock held exclusively, before a child named
+// name is added to or removed from vndir; a NULL name forgets all of
+// vndir's cached children
+void vfs_dcache_remove(vnode_t* vndir, const char* name, size_t len);
+
+// called with vndir's lock held exclusively
 void vfs_notify_add(vnode_t* vndir, const char* name, size_t namelen);
 void vfs_global_init(vnode_t* root);
 
@@ -108,10 +150,6 @@ ssize_t memfs_ioctl(vnode_t* vn, uint32_t op, const void* in_data, size_t in_len
 mx_status_t vfs_install_remote(vnode_t* vn, mx_handle_t h);
 mx_status_t vfs_uninstall_all(void);
 
-// big vfs lock protects lookup and walk operations
-//TODO: finer grained locking
-extern mtx_t vfs_lock;
-
 typedef struct vfs_iostate {
     union {
         mx_device_t* dev;
@@ -94,6 +94,13 @@
 // and has a closed remote end will return ERR_REMOTE_CLOSED.
 #define ERR_SHOULD_WAIT (-27)
 
+// ERR_CALL_FAILED: A two-part operation failed after its first part
+// took effect, so the caller should not retry or undo the first part.
+// Example: mx_channel_call() wrote the request (consuming its handles)
+// but waiting for or reading the reply failed; the reason is reported
+// separately.
+#define ERR_CALL_FAILED (-28)
+
 // ======= Permission check errors =======
 // ERR_ACCESS_DENIED: The caller did not have permission to perform
 // the specified operation.
@@ -12,3 +12,12 @@
 
 // Mask for all the valid MX_CHANNEL_READ_... flags:
 #define MX_CHANNEL_READ_MASK                1u
+
+// Deliver the last buffer of the message as a read-only VMO handle, appended
+// after the message's other handles, instead of copying it into the message.
+// Page aligned buffers in writable mappings are moved rather than copied,
+// leaving zero pages behind in the writer.
+#define MX_CHANNEL_WRITE_PAYLOAD_VMO        1u
+
+// Mask for all the valid MX_CHANNEL_WRITE_... flags:
+#define MX_CHANNEL_WRITE_MASK               1u
@@ -21,6 +21,8 @@ typedef enum {
     MX_INFO_PROCESS_THREADS,
     MX_INFO_RESOURCE_CHILDREN,
     MX_INFO_RESOURCE_RECORDS,
+    MX_INFO_MESSAGE_PACKETS,
+    MX_INFO_PORT,
 } mx_object_info_topic_t;
 
 typedef enum {
@@ -42,6 +44,7 @@ typedef enum {
     MX_OBJ_TYPE_RESOURCE            = 15,
     MX_OBJ_TYPE_EVENT_PAIR          = 16,
     MX_OBJ_TYPE_JOB                 = 17,
+    MX_OBJ_TYPE_TIMER               = 18,
     MX_OBJ_TYPE_LAST
 } mx_obj_type_t;
 
@@ -94,6 +97,44 @@ typedef struct mx_info_process_threads {
     mx_record_process_thread_t rec[];
 } mx_info_process_threads_t;
 
+// System wide channel message allocation counts. |pool_allocs| were carved
+// out of the kernel's packet pool, |cache_allocs| of them served from a
+// per-cpu cache without taking a lock. |refills| and |drains| count the
+// batches moved between those caches and the pool, which holds |cached|
+// free packets in the caches right now. |heap_allocs| were too large for
+// the pool, or made while it was exhausted.
+typedef struct mx_record_message_packets {
+    uint64_t cached;
+    uint64_t pool_allocs;
+    uint64_t cache_allocs;
+    uint64_t refills;
+    uint64_t drains;
+    uint64_t heap_allocs;
+} mx_record_message_packets_t;
+
+// Returned for topic MX_INFO_MESSAGE_PACKETS (on a channel handle)
+typedef struct mx_info_message_packets {
+    mx_info_header_t hdr;
+    mx_record_message_packets_t rec;
+} mx_info_message_packets_t;
+
+// |queued| packets are waiting on the port. |pool_used| packets queued with
+// mx_port_queue() are waiting or being read; once that reaches |max_queued|
+// mx_port_queue() returns ERR_SHOULD_WAIT. The port keeps |pool_cached| free
+// packets for reuse.
+typedef struct mx_record_port {
+    uint32_t queued;
+    uint32_t max_queued;
+    uint32_t pool_used;
+    uint32_t pool_cached;
+} mx_record_port_t;
+
+// Returned for topic MX_INFO_PORT (on a port handle)
+typedef struct mx_info_port {
+    mx_info_header_t hdr;
+    mx_record_port_t rec;
+} mx_info_port_t;
+
 // Object properties.
 
 // Argument is MX_POLICY_BAD_HANDLE_... (below, uint32_t).
@@ -13,6 +13,9 @@ __BEGIN_CDECLS
 
 #define MX_PORT_MAX_PKT_SIZE   128u
 
+// Options for mx_port_create()
+#define MX_PORT_OPT_NO_YIELD   1u
+
 #define MX_PORT_PKT_TYPE_KERN      0u
 #define MX_PORT_PKT_TYPE_IOSN      1u
 #define MX_PORT_PKT_TYPE_USER      2u
@@ -24,6 +24,9 @@ typedef uint64_t mx_koid_t;
 #define MX_VMO_OP_LOOKUP                5u
 #define MX_VMO_OP_CACHE_SYNC            6u
 
+// VM Object clone flags
+#define MX_VMO_CLONE_COPY_ON_WRITE      1u
+
 // Buffer size limits on the cprng syscalls
 #define MX_CPRNG_DRAW_MAX_LEN        256
 #define MX_CPRNG_ADD_ENTROPY_MAX_LEN 256
@@ -31,6 +34,9 @@ typedef uint64_t mx_koid_t;
 // Socket flags and limits.
 #define MX_SOCKET_HALF_CLOSE                1u
 
+// Wait set entry options.
+#define MX_WAITSET_EDGE_TRIGGERED           1u
+
 // Structure for mx_waitset_*():
 typedef struct mx_waitset_result {
     uint64_t cookie;
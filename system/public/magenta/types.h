@@ -89,6 +89,10 @@ typedef uint32_t mx_signals_t;
 #define MX_EPAIR_CLOSED             MX_OBJECT_SIGNAL_2
 #define MX_EPAIR_SIGNAL_MASK        (MX_USER_SIGNAL_ALL | MX_OBJECT_SIGNAL_2 | MX_OBJECT_SIGNAL_3)
 
+// Timer
+#define MX_TIMER_SIGNALED           MX_OBJECT_SIGNAL_3
+#define MX_TIMER_SIGNAL_MASK        (MX_USER_SIGNAL_ALL | MX_OBJECT_SIGNAL_3)
+
 // Task signals (process, thread, job)
 #define MX_TASK_TERMINATED          MX_OBJECT_SIGNAL_3
 #define MX_TASK_SIGNAL_MASK         MX_OBJECT_SIGNAL_3
@@ -146,6 +150,42 @@ typedef uint32_t mx_rights_t;
 #define MX_FLAG_REPLY_CHANNEL            (1u << 0)
 #define MX_CHANNEL_CREATE_REPLY_CHANNEL  (1u << 0)
 
+// transaction id carried in the first four bytes of messages
+// written and read by mx_channel_call()
+typedef uint32_t mx_txid_t;
+
+typedef struct {
+    const void* wr_bytes;
+    const mx_handle_t* wr_handles;
+    void *rd_bytes;
+    mx_handle_t* rd_handles;
+    uint32_t wr_num_bytes;
+    uint32_t wr_num_handles;
+    uint32_t rd_num_bytes;
+    uint32_t rd_num_handles;
+} mx_channel_call_args_t;
+
+// one segment of a message passed to mx_channel_writev() or
+// mx_channel_readv(); |reserved| must be zero
+typedef struct {
+    void* buffer;
+    uint32_t num_bytes;
+    uint32_t reserved;
+} mx_channel_iovec_t;
+
+// like mx_channel_call_args_t, but with the request gathered from and the
+// reply scattered across arrays of segments; used by mx_channel_callv()
+typedef struct {
+    const mx_channel_iovec_t* wr_iovs;
+    const mx_handle_t* wr_handles;
+    const mx_channel_iovec_t* rd_iovs;
+    mx_handle_t* rd_handles;
+    uint32_t wr_num_iovs;
+    uint32_t wr_num_handles;
+    uint32_t rd_num_iovs;
+    uint32_t rd_num_handles;
+} mx_channel_callv_args_t;
+
 // clock ids
 #define MX_CLOCK_MONOTONIC        (0u)
 
@@ -9,9 +9,13 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <threads.h>
 
 #include <magenta/compiler.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/channel.h>
+#include <magenta/syscalls/object.h>
 #include <mxtl/unique_ptr.h>
 
 namespace {
@@ -27,6 +31,29 @@ void duplicate_handles(uint32_t n, mx_handle_t src, mx_handle_t* dest) {
     }
 }
 
+// Reads the kernel's system wide message packet allocation counters.
+mx_record_message_packets_t get_packet_stats(mx_handle_t channel) {
+    mx_info_message_packets_t info = {};
+    mx_size_t actual;
+    __UNUSED mx_status_t status =
+        mx_object_get_info(channel, MX_INFO_MESSAGE_PACKETS, sizeof(info.rec),
+                           &info, sizeof(info), &actual);
+    assert(status == NO_ERROR);
+    return info.rec;
+}
+
+// Prints the per message allocation counts between |before| and |after|.
+void print_packet_stats(const mx_record_message_packets_t& before,
+                        const mx_record_message_packets_t& after, double messages) {
+    printf("  allocations/message: %.2f pooled (%.2f cached), %.2f heap\n",
+           static_cast<double>(after.pool_allocs - before.pool_allocs) / messages,
+           static_cast<double>(after.cache_allocs - before.cache_allocs) / messages,
+           static_cast<double>(after.heap_allocs - before.heap_allocs) / messages);
+    printf("  magazine batches/message: %.4f refills, %.4f drains\n",
+           static_cast<double>(after.refills - before.refills) / messages,
+           static_cast<double>(after.drains - before.drains) / messages);
+}
+
 struct TestArgs {
     uint32_t size;
     uint32_t handles;
@@ -68,6 +95,8 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
 
     duplicate_handles(test_args.handles, event, handles.get());
 
+    mx_record_message_packets_t stats_before = get_packet_stats(mp[0]);
+
     static constexpr uint32_t big_it_size = 10000;
     uint64_t big_its = 0;
     uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
@@ -93,6 +122,8 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
             break;
     }
 
+    mx_record_message_packets_t stats_after = get_packet_stats(mp[0]);
+
     for (uint32_t i = 0; i < test_args.handles; i++) {
         status = mx_handle_close(handles[i]);
         assert(status == NO_ERROR);
@@ -109,6 +140,200 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
                "%.0f iterations/second\n",
            test_args.size, test_args.handles, test_args.queue, its_per_second);
+    print_packet_stats(stats_before, stats_after, static_cast<double>(big_its) * big_it_size);
+}
+
+// Echoes every message it reads on |arg| back to the sender until the peer goes away.
+int echo_server(void* arg) {
+    mx_handle_t h = static_cast<mx_handle_t>(reinterpret_cast<uintptr_t>(arg));
+    uint8_t buf[65536];
+
+    for (;;) {
+        mx_signals_t pending;
+        if (mx_handle_wait_one(h, MX_SIGNAL_READABLE | MX_SIGNAL_PEER_CLOSED,
+                               MX_TIME_INFINITE, &pending) != NO_ERROR)
+            break;
+        if (!(pending & MX_SIGNAL_READABLE))
+            break;
+
+        uint32_t size = sizeof(buf);
+        if (mx_channel_read(h, 0u, buf, size, &size, nullptr, 0u, nullptr) != NO_ERROR)
+            break;
+        if (mx_channel_write(h, 0u, buf, size, nullptr, 0u) != NO_ERROR)
+            break;
+    }
+
+    mx_handle_close(h);
+    return 0;
+}
+
+// Measures request/reply round trips against an echo server thread, first as
+// a write + wait + read sequence and then as a single mx_channel_call().
+void do_call_test(uint32_t duration, uint32_t size) {
+    __UNUSED mx_status_t status;
+
+    uint64_t duration_ns = duration * 1000000000ull;
+
+    // The first bytes of each message hold the transaction id.
+    if (size < sizeof(mx_txid_t))
+        size = sizeof(mx_txid_t);
+
+    mx_handle_t mp[2] = {MX_HANDLE_INVALID, MX_HANDLE_INVALID};
+    status = mx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == NO_ERROR);
+
+    thrd_t server;
+    int ret = thrd_create(&server, echo_server, reinterpret_cast<void*>(static_cast<uintptr_t>(mp[1])));
+    assert(ret == thrd_success);
+
+    mxtl::unique_ptr<uint8_t[]> data(new uint8_t[size]);
+    memset(data.get(), 0, size);
+
+    for (int use_call = 0; use_call < 2; use_call++) {
+        static constexpr uint32_t big_it_size = 1000;
+        uint64_t big_its = 0;
+        uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        uint64_t end_ns;
+        for (;;) {
+            big_its++;
+            for (uint32_t i = 0; i < big_it_size; i++) {
+                uint32_t r_size = size;
+                if (use_call) {
+                    mx_channel_call_args_t args = {
+                        data.get(), nullptr, data.get(), nullptr, size, 0u, size, 0u,
+                    };
+                    mx_status_t read_status;
+                    status = mx_channel_call(mp[0], 0u, MX_TIME_INFINITE, &args,
+                                             &r_size, nullptr, &read_status);
+                    assert(status == NO_ERROR);
+                } else {
+                    status = mx_channel_write(mp[0], 0u, data.get(), size, nullptr, 0u);
+                    assert(status == NO_ERROR);
+                    status = mx_handle_wait_one(mp[0], MX_SIGNAL_READABLE, MX_TIME_INFINITE,
+                                                nullptr);
+                    assert(status == NO_ERROR);
+                    status = mx_channel_read(mp[0], 0u, data.get(), r_size, &r_size,
+                                             nullptr, 0u, nullptr);
+                    assert(status == NO_ERROR);
+                }
+                assert(r_size == size);
+            }
+
+            end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+            if ((end_ns - start_ns) >= duration_ns)
+                break;
+        }
+
+        double round_trips = static_cast<double>(big_its) * big_it_size;
+        double latency_us = static_cast<double>(end_ns - start_ns) / 1000.0 / round_trips;
+        printf("%s %" PRIu32 " bytes: %.2f us/round trip\n",
+               use_call ? "channel_call     " : "write/wait/read  ", size, latency_us);
+    }
+
+    // Closing our end makes the server see PEER_CLOSED and exit.
+    status = mx_handle_close(mp[0]);
+    assert(status == NO_ERROR);
+    thrd_join(server, nullptr);
+}
+
+// Moves |size| bytes from a writer's buffer to a reader per iteration, first copied
+// through messages of at most 64K and then as a payload VMO. The writer's buffer is a
+// mapped VMO, so the payload pages are moved rather than copied.
+void do_payload_test(uint32_t duration, uint32_t size) {
+    __UNUSED mx_status_t status;
+
+    static constexpr uint32_t kMaxChunk = 65536u;
+    static constexpr uint32_t kPageSize = 4096u;
+    uint64_t duration_ns = duration * 1000000000ull;
+
+    mx_handle_t mp[2] = {MX_HANDLE_INVALID, MX_HANDLE_INVALID};
+    status = mx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == NO_ERROR);
+
+    uint32_t map_size = (size + kPageSize - 1) & ~(kPageSize - 1);
+    mx_handle_t vmo;
+    status = mx_vmo_create(map_size, 0u, &vmo);
+    assert(status == NO_ERROR);
+    uintptr_t src_addr;
+    status = mx_process_map_vm(mx_process_self(), vmo, 0u, map_size, &src_addr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    assert(status == NO_ERROR);
+    uint8_t* src = reinterpret_cast<uint8_t*>(src_addr);
+
+    mxtl::unique_ptr<uint8_t[]> dst(new uint8_t[size]);
+    uint64_t sum = 0;
+
+    for (int use_vmo = 0; use_vmo < 2; use_vmo++) {
+        uint64_t its = 0;
+        uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        uint64_t end_ns;
+        for (;;) {
+            // Both modes produce the data and touch every page of it on the reading side.
+            its++;
+            memset(src, static_cast<int>(its), size);
+
+            if (use_vmo) {
+                status = mx_channel_write(mp[0], MX_CHANNEL_WRITE_PAYLOAD_VMO, src, size,
+                                          nullptr, 0u);
+                assert(status == NO_ERROR);
+
+                uint32_t r_size = 0u;
+                uint32_t r_handles = 1u;
+                mx_handle_t payload;
+                status = mx_channel_read(mp[1], 0u, nullptr, 0u, &r_size,
+                                         &payload, r_handles, &r_handles);
+                assert(status == NO_ERROR);
+                assert(r_handles == 1u);
+
+                uintptr_t addr;
+                status = mx_process_map_vm(mx_process_self(), payload, 0u, map_size, &addr,
+                                           MX_VM_FLAG_PERM_READ);
+                assert(status == NO_ERROR);
+                const uint8_t* p = reinterpret_cast<const uint8_t*>(addr);
+                for (uint32_t off = 0; off < size; off += kPageSize)
+                    sum += p[off];
+                mx_process_unmap_vm(mx_process_self(), addr, 0u);
+                mx_handle_close(payload);
+            } else {
+                for (uint32_t off = 0; off < size; off += kMaxChunk) {
+                    uint32_t chunk = size - off < kMaxChunk ? size - off : kMaxChunk;
+                    status = mx_channel_write(mp[0], 0u, src + off, chunk, nullptr, 0u);
+                    assert(status == NO_ERROR);
+
+                    uint32_t r_size = chunk;
+                    status = mx_channel_read(mp[1], 0u, dst.get() + off, r_size, &r_size,
+                                             nullptr, 0u, nullptr);
+                    assert(status == NO_ERROR);
+                    assert(r_size == chunk);
+                }
+                for (uint32_t off = 0; off < size; off += kPageSize)
+                    sum += dst[off];
+            }
+
+            end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+            if ((end_ns - start_ns) >= duration_ns)
+                break;
+        }
+
+        double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+        double mb_per_second = static_cast<double>(its) * size / (1024.0 * 1024.0) / real_duration;
+        printf("%s %7" PRIu32 " bytes: %.2f us/transfer, %.1f MB/s\n",
+               use_vmo ? "payload vmo  " : "copy, 64K max", size,
+               real_duration * 1000000.0 / static_cast<double>(its), mb_per_second);
+    }
+
+    // Keeps the reads from being optimized out.
+    if (sum == 1u)
+        printf("\n");
+
+    status = mx_process_unmap_vm(mx_process_self(), src_addr, 0u);
+    assert(status == NO_ERROR);
+    status = mx_handle_close(vmo);
+    assert(status == NO_ERROR);
+    status = mx_handle_close(mp[0]);
+    assert(status == NO_ERROR);
+    status = mx_handle_close(mp[1]);
+    assert(status == NO_ERROR);
 }
 
 }  // namespace
@@ -121,6 +346,8 @@ int main(int argc, char** argv) {
         "  -h    show help (this)\n"
         "  -o    run single test (default)\n"
         "  -s    run suite (ignores -S/-H/-Q)\n"
+        "  -c    run request/reply latency test (uses -S)\n"
+        "  -p    run bulk payload test, copied vs. payload VMO (uses -S)\n"
         "  -n N  set test repetition count to N (default: 1)\n"
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
@@ -128,6 +355,8 @@ int main(int argc, char** argv) {
         "  -Q N  set message pre-queue count to N messages (default: 0)\n";
 
     bool run_suite = false;  // -o/-s
+    bool run_call = false;   // -c
+    bool run_payload = false; // -p
     uint32_t duration = 5;   // -d
     uint32_t repeats = 1;    // -n
     // Ignored when running a suite:
@@ -138,7 +367,7 @@ int main(int argc, char** argv) {
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hoscpn:d:S:H:Q:")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -160,6 +389,12 @@ int main(int argc, char** argv) {
             case 's':
                 run_suite = true;
                 break;
+            case 'c':
+                run_call = true;
+                break;
+            case 'p':
+                run_payload = true;
+                break;
             case 'n':
                 assert(optarg);
                 repeats = value;
@@ -216,6 +451,18 @@ int main(int argc, char** argv) {
             };
             for (size_t i = 0; i < countof(suite); i++)
                 do_test(duration, suite[i]);
+
+            static constexpr uint32_t call_suite[] = {16, 100, 1000};
+            for (size_t i = 0; i < countof(call_suite); i++)
+                do_call_test(duration, call_suite[i]);
+
+            static constexpr uint32_t payload_suite[] = {8192, 65536, 1048576};
+            for (size_t i = 0; i < countof(payload_suite); i++)
+                do_payload_test(duration, payload_suite[i]);
+        } else if (run_payload) {
+            do_payload_test(duration, test_args.size);
+        } else if (run_call) {
+            do_call_test(duration, test_args.size);
         } else {
             do_test(duration, test_args);
         }
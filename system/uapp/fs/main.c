@@ -105,6 +105,8 @@ int test_rename(void);
 int test_sync(void);
 int test_append(void);
 int test_truncate(void);
+int test_parallel(void);
+int test_lookup(void);
 
 struct {
     const char* name;
@@ -117,6 +119,8 @@ struct {
     {"rename", test_rename},
     {"sync", test_sync},
     {"truncate", test_truncate},
+    {"parallel", test_parallel},
+    {"lookup", test_lookup},
 };
 
 int run_fs_tests(int (*mount)(void), int (*unmount)(void), int argc, char** argv) {
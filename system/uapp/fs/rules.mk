@@ -20,6 +20,8 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/test_rename.c \
     $(LOCAL_DIR)/test_sync.c \
     $(LOCAL_DIR)/test_truncate.c \
+    $(LOCAL_DIR)/test_parallel.c \
+    $(LOCAL_DIR)/test_lookup.c \
 
 MODULE_LDFLAGS := --wrap open --wrap unlink --wrap stat --wrap mkdir
 MODULE_LDFLAGS += --wrap rename --wrap truncate
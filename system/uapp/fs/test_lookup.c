@@ -0,0 +1,74 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "misc.h"
+
+// Looks names up over and over while they come and go, so that any
+// cached lookup result that outlives a change shows up as an error.
+int test_lookup(void) {
+    struct stat s;
+    TRY(mkdir("::lookup", 0755));
+    for (int i = 0; i < 3; i++) {
+        EXPECT_FAIL(open("::lookup/file", O_RDWR, 0644));
+        EXPECT_FAIL(stat("::lookup/dir/file", &s));
+    }
+
+    // names that were not found appear once created
+    int fd = TRY(open("::lookup/file", O_RDWR | O_CREAT | O_EXCL, 0644));
+    TRY(write(fd, "first", 5));
+    close(fd);
+    TRY(mkdir("::lookup/dir", 0755));
+    fd = TRY(open("::lookup/dir/file", O_RDWR | O_CREAT, 0644));
+    close(fd);
+    for (int i = 0; i < 3; i++) {
+        close(TRY(open("::lookup/file", O_RDWR, 0644)));
+        TRY(stat("::lookup/dir/file", &s));
+    }
+
+    // and disappear once unlinked
+    TRY(unlink("::lookup/dir/file"));
+    TRY(unlink("::lookup/file"));
+    for (int i = 0; i < 3; i++) {
+        EXPECT_FAIL(open("::lookup/file", O_RDWR, 0644));
+        EXPECT_FAIL(stat("::lookup/dir/file", &s));
+    }
+
+    // a recreated file is the new one
+    fd = TRY(open("::lookup/file", O_RDWR | O_CREAT | O_EXCL, 0644));
+    TRY(write(fd, "second", 6));
+    close(fd);
+    TRY(stat("::lookup/file", &s));
+    if (s.st_size != 6) {
+        printf("lookup found a stale file, size %lld\n", (long long)s.st_size);
+        return -1;
+    }
+
+    // renames move names both ways
+    TRY(rename("::lookup/file", "::lookup/dir/moved"));
+    EXPECT_FAIL(stat("::lookup/file", &s));
+    TRY(stat("::lookup/dir/moved", &s));
+    TRY(rename("::lookup/dir", "::lookup/dir2"));
+    EXPECT_FAIL(stat("::lookup/dir/moved", &s));
+    TRY(stat("::lookup/dir2/moved", &s));
+
+    // looking up a directory must not keep it from being removed, but an
+    // open one still can't be
+    TRY(unlink("::lookup/dir2/moved"));
+    fd = TRY(open("::lookup/dir2", O_RDONLY, 0644));
+    EXPECT_FAIL(unlink("::lookup/dir2"));
+    close(fd);
+    TRY(stat("::lookup/dir2", &s));
+    TRY(unlink("::lookup/dir2"));
+    EXPECT_FAIL(stat("::lookup/dir2", &s));
+
+    TRY(unlink("::lookup"));
+    return 0;
+}
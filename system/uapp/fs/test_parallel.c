@@ -0,0 +1,154 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <magenta/syscalls.h>
+
+#include "misc.h"
+
+// Several threads churn through creates, writes, reads, renames and
+// unlinks at once. Each thread works in its own directory, but also
+// renames files and directories through one shared directory, so that
+// renames touching two directories race with everything else.
+
+#define MAX_THREADS 8
+#define ITERATIONS 128
+#define FILE_SIZE 1024
+
+typedef struct {
+    uint32_t id;
+    uint64_t ops;
+    int result;
+} churn_t;
+
+static int churn_verify(const char* path, uint32_t id, uint32_t i) {
+    uint8_t buf[FILE_SIZE];
+    int fd = TRY(open(path, O_RDONLY, 0644));
+    int r = TRY(read(fd, buf, sizeof(buf)));
+    close(fd);
+    if (r != FILE_SIZE) {
+        fprintf(stderr, "parallel: '%s' short read %d\n", path, r);
+        return -1;
+    }
+    for (int n = 0; n < FILE_SIZE; n++) {
+        if (buf[n] != (uint8_t)(id * 31 + i + n)) {
+            fprintf(stderr, "parallel: '%s' bad data @%d\n", path, n);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int churn_thread(void* arg) {
+    churn_t* c = arg;
+    char dir[32], file[96], renamed[64], shared[64], subdir[64];
+    uint8_t buf[FILE_SIZE];
+
+    snprintf(dir, sizeof(dir), "::par%u", c->id);
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+        snprintf(file, sizeof(file), "%s/file%u", dir, i % 8);
+        snprintf(renamed, sizeof(renamed), "%s/renamed%u", dir, i % 8);
+        snprintf(shared, sizeof(shared), "::shared/t%u-%u", c->id, i % 8);
+        snprintf(subdir, sizeof(subdir), "%s/sub%u", dir, i % 8);
+
+        for (int n = 0; n < FILE_SIZE; n++) {
+            buf[n] = (uint8_t)(c->id * 31 + i + n);
+        }
+        int fd = TRY(open(file, O_RDWR | O_CREAT | O_EXCL, 0644));
+        int r = TRY(write(fd, buf, sizeof(buf)));
+        close(fd);
+        if (r != FILE_SIZE) {
+            fprintf(stderr, "parallel: '%s' short write %d\n", file, r);
+            c->result = -1;
+            return 0;
+        }
+
+        // within one directory, then out through the shared one and back
+        TRY(rename(file, renamed));
+        TRY(rename(renamed, shared));
+        TRY(rename(shared, renamed));
+        if (churn_verify(renamed, c->id, i) < 0) {
+            c->result = -1;
+            return 0;
+        }
+
+        // the same for a directory with something in it
+        TRY(mkdir(subdir, 0755));
+        snprintf(file, sizeof(file), "%s/inner", subdir);
+        TRY(rename(renamed, file));
+        TRY(rename(subdir, shared));
+        TRY(rename(shared, subdir));
+        if (churn_verify(file, c->id, i) < 0) {
+            c->result = -1;
+            return 0;
+        }
+        struct stat st;
+        TRY(stat(file, &st));
+        TRY(unlink(file));
+        TRY(unlink(subdir));
+        c->ops += 14;
+    }
+    c->result = 0;
+    return 0;
+}
+
+static int run_churn(uint32_t num_threads) {
+    churn_t churns[MAX_THREADS];
+    thrd_t threads[MAX_THREADS];
+    char dir[32];
+
+    for (uint32_t n = 0; n < num_threads; n++) {
+        snprintf(dir, sizeof(dir), "::par%u", n);
+        TRY(mkdir(dir, 0755));
+        churns[n].id = n;
+        churns[n].ops = 0;
+        churns[n].result = -1;
+    }
+
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (uint32_t n = 0; n < num_threads; n++) {
+        if (thrd_create(&threads[n], churn_thread, &churns[n]) != thrd_success) {
+            fprintf(stderr, "parallel: cannot create thread\n");
+            exit(1);
+        }
+    }
+    uint64_t ops = 0;
+    int result = 0;
+    for (uint32_t n = 0; n < num_threads; n++) {
+        thrd_join(threads[n], NULL);
+        ops += churns[n].ops;
+        result |= churns[n].result;
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    for (uint32_t n = 0; n < num_threads; n++) {
+        snprintf(dir, sizeof(dir), "::par%u", n);
+        TRY(unlink(dir));
+    }
+    if (result == 0) {
+        fprintf(stderr, "parallel: %u threads: %" PRIu64 " ops in %" PRIu64 " ms, %" PRIu64
+                " ops/sec\n", num_threads, ops, elapsed / 1000000,
+                ops * 1000000000 / (elapsed ? elapsed : 1));
+    }
+    return result;
+}
+
+int test_parallel(void) {
+    TRY(mkdir("::shared", 0755));
+    for (uint32_t n = 1; n <= MAX_THREADS; n *= 2) {
+        if (run_churn(n) < 0) {
+            return -1;
+        }
+    }
+    TRY(unlink("::shared"));
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+
+// Measures how futex operations on unrelated futexes scale with the number
+// of threads in a process. Each thread hammers its own futex with wakes that
+// find no waiters and waits whose value check fails, so the only shared state
+// in the kernel is the process's futex table.
+
+namespace {
+
+constexpr uint32_t kMaxThreads = 32u;
+
+struct alignas(64) ThreadState {
+    volatile int futex;
+    uint64_t ops;
+};
+
+ThreadState states[kMaxThreads];
+volatile bool start;
+volatile bool stop;
+
+int worker(void* arg) {
+    auto state = static_cast<ThreadState*>(arg);
+
+    while (!start)
+        thrd_yield();
+
+    uint64_t ops = 0;
+    while (!stop) {
+        __UNUSED mx_status_t status = mx_futex_wake(const_cast<int*>(&state->futex), 1u);
+        assert(status == NO_ERROR);
+        status = mx_futex_wait(const_cast<int*>(&state->futex), state->futex + 1, 0u);
+        assert(status == ERR_BAD_STATE);
+        ops += 2;
+    }
+    state->ops = ops;
+    return 0;
+}
+
+void do_test(uint32_t num_threads, uint32_t duration_ms) {
+    thrd_t threads[kMaxThreads];
+
+    start = false;
+    stop = false;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        states[i].futex = 0;
+        states[i].ops = 0;
+        __UNUSED int ret = thrd_create(&threads[i], worker, &states[i]);
+        assert(ret == thrd_success);
+    }
+
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    start = true;
+    mx_nanosleep(static_cast<mx_time_t>(duration_ms) * 1000000u);
+    stop = true;
+
+    uint64_t ops = 0;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        thrd_join(threads[i], nullptr);
+        ops += states[i].ops;
+    }
+    uint64_t end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    double seconds = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    double rate = static_cast<double>(ops) / seconds;
+    printf("%2" PRIu32 " threads: %10.0f futex ops/second, %10.0f per thread\n",
+           num_threads, rate, rate / num_threads);
+}
+
+void argument_error(const char* argv0, const char* message) {
+    fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
+    exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...]\n"
+        "\n"
+        "Options:\n"
+        "  -h    show help (this)\n"
+        "  -t N  run with up to N threads (default: 16, max: 32)\n"
+        "  -d N  run each step for N milliseconds (default: 1000)\n";
+
+    uint32_t max_threads = 16;   // -t
+    uint32_t duration_ms = 1000; // -d
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+ht:d:")) != -1) {
+        switch (opt) {
+            case 'h':
+                printf(help, argv[0]);
+                return EXIT_SUCCESS;
+            case 't':
+            case 'd': {
+                errno = 0;
+                char* endptr = nullptr;
+                unsigned long long v = strtoull(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || v == 0 || v > UINT32_MAX)
+                    argument_error(argv[0], "invalid number");
+                if (opt == 't') {
+                    if (v > kMaxThreads)
+                        argument_error(argv[0], "too many threads");
+                    max_threads = static_cast<uint32_t>(v);
+                } else {
+                    duration_ms = static_cast<uint32_t>(v);
+                }
+                break;
+            }
+            default:  // '?'
+                argument_error(argv[0], "invalid option");
+                break;
+        }
+    }
+    if (optind < argc)
+        argument_error(argv[0], "unexpected positional argument");
+
+    for (uint32_t n = 1; n <= max_threads; n *= 2)
+        do_test(n, duration_ms);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+
+namespace {
+
+struct Packet {
+    mx_packet_header_t hdr;
+    uint64_t seq;
+};
+
+// Key of the packet that tells the consumer the producer is done.
+constexpr uint64_t kLastKey = 1u;
+
+constexpr uint32_t kMaxBatch = 64u;
+
+struct ProducerArgs {
+    mx_handle_t port;
+    uint32_t packets;
+    // Times the port was full when the producer tried to queue.
+    uint64_t full;
+};
+
+int producer(void* arg) {
+    auto args = static_cast<ProducerArgs*>(arg);
+
+    Packet pkt = {};
+    for (uint32_t i = 0; i < args->packets; i++) {
+        pkt.hdr.key = (i + 1 == args->packets) ? kLastKey : 0u;
+        pkt.seq = i;
+        mx_status_t status;
+        // A full port pushes back; give the consumer a chance to drain it.
+        while ((status = mx_port_queue(args->port, &pkt, sizeof(pkt))) == ERR_SHOULD_WAIT) {
+            args->full++;
+            thrd_yield();
+        }
+        assert(status == NO_ERROR);
+    }
+    return 0;
+}
+
+// One thread queues |packets| packets while this thread drains them with
+// port_wait (|batch| == 0) or port_wait_many in batches of up to |batch|.
+void do_test(uint32_t packets, uint32_t options, uint32_t batch) {
+    __UNUSED mx_status_t status;
+
+    ProducerArgs args = {MX_HANDLE_INVALID, packets, 0u};
+    status = mx_port_create(options, &args.port);
+    assert(status == NO_ERROR);
+
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    thrd_t thread;
+    __UNUSED int ret = thrd_create(&thread, producer, &args);
+    assert(ret == thrd_success);
+
+    Packet pkts[kMaxBatch];
+    uint64_t waits = 0;
+    uint32_t received = 0;
+    bool done = false;
+    while (!done) {
+        uint32_t count = 1;
+        if (batch == 0) {
+            status = mx_port_wait(args.port, MX_TIME_INFINITE, &pkts[0], sizeof(pkts[0]));
+        } else {
+            status = mx_port_wait_many(args.port, MX_TIME_INFINITE, pkts, sizeof(pkts[0]),
+                                       batch, &count);
+        }
+        assert(status == NO_ERROR);
+        waits++;
+
+        for (uint32_t i = 0; i < count; i++) {
+            assert(pkts[i].seq == received);
+            received++;
+            if (pkts[i].hdr.key == kLastKey)
+                done = true;
+        }
+    }
+
+    uint64_t end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    thrd_join(thread, nullptr);
+    status = mx_handle_close(args.port);
+    assert(status == NO_ERROR);
+
+    double seconds = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    char mode[32];
+    if (batch == 0)
+        snprintf(mode, sizeof(mode), "port_wait");
+    else
+        snprintf(mode, sizeof(mode), "port_wait_many(%" PRIu32 ")", batch);
+    printf("%-20s %-8s: %10.0f packets/second, %.2f packets/wait, port full %" PRIu64 " times\n",
+           mode, (options & MX_PORT_OPT_NO_YIELD) ? "no-yield" : "yield",
+           static_cast<double>(received) / seconds,
+           static_cast<double>(received) / static_cast<double>(waits), args.full);
+}
+
+void argument_error(const char* argv0, const char* message) {
+    fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
+    exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...]\n"
+        "\n"
+        "Options:\n"
+        "  -h    show help (this)\n"
+        "  -p N  set packets per run to N (default: 200000)\n";
+
+    uint32_t packets = 200000;  // -p
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+hp:")) != -1) {
+        switch (opt) {
+            case 'h':
+                printf(help, argv[0]);
+                return EXIT_SUCCESS;
+            case 'p': {
+                errno = 0;
+                char* endptr = nullptr;
+                unsigned long long v = strtoull(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || v == 0 || v > UINT32_MAX)
+                    argument_error(argv[0], "invalid packet count");
+                packets = static_cast<uint32_t>(v);
+                break;
+            }
+            default:  // '?'
+                argument_error(argv[0], "invalid option");
+                break;
+        }
+    }
+    if (optind < argc)
+        argument_error(argv[0], "unexpected positional argument");
+
+    static constexpr uint32_t options[] = {0u, MX_PORT_OPT_NO_YIELD};
+    static constexpr uint32_t batches[] = {0u, 1u, 8u, kMaxBatch};
+    for (size_t i = 0; i < countof(options); i++) {
+        for (size_t j = 0; j < countof(batches); j++)
+            do_test(packets, options[i], batches[j]);
+    }
+
+    return EXIT_SUCCESS;
+}
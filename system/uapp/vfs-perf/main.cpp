@@ -0,0 +1,350 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+
+// Measures how open and read requests from concurrent clients scale on a
+// filesystem server, by default devmgr's memfs under /tmp. Each thread opens
+// its own small file, reads it and closes it again, so the clients share
+// nothing but the server.
+//
+// Then measures name lookups in a large directory, by opening every entry
+// of a directory with many files in it.
+//
+// Last, measures read and write throughput on a 1 MB and a larger file. The
+// file is read back twice: opened read-only, which lets memfs hand out the
+// file's vmo to read directly, and opened read-write, which reads through
+// devmgr one message at a time.
+
+namespace {
+
+constexpr uint32_t kMaxThreads = 32u;
+constexpr size_t kFileSize = 4096u;
+constexpr size_t kMB = 1024u * 1024u;
+constexpr size_t kIoSize = 64u * 1024u;
+// memfs files can't grow past 256 MB
+constexpr uint32_t kMaxFileSizeMB = 256u;
+
+struct alignas(64) ThreadState {
+    char path[64];
+    uint64_t ops;
+    bool failed;
+};
+
+ThreadState states[kMaxThreads];
+volatile bool start;
+volatile bool stop;
+
+int worker(void* arg) {
+    auto state = static_cast<ThreadState*>(arg);
+    char buf[kFileSize];
+
+    while (!start)
+        thrd_yield();
+
+    uint64_t ops = 0;
+    while (!stop) {
+        int fd = open(state->path, O_RDONLY);
+        if (fd < 0) {
+            state->failed = true;
+            break;
+        }
+        ssize_t r = read(fd, buf, sizeof(buf));
+        close(fd);
+        if (r != static_cast<ssize_t>(sizeof(buf))) {
+            state->failed = true;
+            break;
+        }
+        ops += 2;
+    }
+    state->ops = ops;
+    return 0;
+}
+
+bool create_files(const char* dir, uint32_t num_files) {
+    char buf[kFileSize];
+    memset(buf, 0xa5, sizeof(buf));
+    for (uint32_t i = 0; i < num_files; i++) {
+        snprintf(states[i].path, sizeof(states[i].path), "%s/vfs-perf.%" PRIu32, dir, i);
+        int fd = open(states[i].path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "cannot create '%s': %d\n", states[i].path, errno);
+            return false;
+        }
+        ssize_t r = write(fd, buf, sizeof(buf));
+        close(fd);
+        if (r != static_cast<ssize_t>(sizeof(buf))) {
+            fprintf(stderr, "cannot write '%s': %d\n", states[i].path, errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+void remove_files(uint32_t num_files) {
+    for (uint32_t i = 0; i < num_files; i++)
+        unlink(states[i].path);
+}
+
+bool do_test(uint32_t num_threads, uint32_t duration_ms) {
+    thrd_t threads[kMaxThreads];
+
+    start = false;
+    stop = false;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        states[i].ops = 0;
+        states[i].failed = false;
+        __UNUSED int ret = thrd_create(&threads[i], worker, &states[i]);
+        assert(ret == thrd_success);
+    }
+
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    start = true;
+    mx_nanosleep(static_cast<mx_time_t>(duration_ms) * 1000000u);
+    stop = true;
+
+    uint64_t ops = 0;
+    bool failed = false;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        thrd_join(threads[i], nullptr);
+        ops += states[i].ops;
+        failed |= states[i].failed;
+    }
+    uint64_t end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    if (failed) {
+        fprintf(stderr, "%2" PRIu32 " threads: open or read failed\n", num_threads);
+        return false;
+    }
+
+    double seconds = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    double rate = static_cast<double>(ops) / seconds;
+    printf("%2" PRIu32 " threads: %10.0f opens+reads/second, %10.0f per thread\n",
+           num_threads, rate, rate / num_threads);
+    return true;
+}
+
+bool do_dir_test(const char* dir, uint32_t num_entries) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/vfs-perf-dir", dir);
+    if (mkdir(path, 0755) < 0) {
+        fprintf(stderr, "cannot create '%s': %d\n", path, errno);
+        return false;
+    }
+
+    bool ok = true;
+    uint32_t created = 0;
+    char name[96];
+    for (; created < num_entries; created++) {
+        snprintf(name, sizeof(name), "%s/entry%05" PRIu32, path, created);
+        int fd = open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "cannot create '%s': %d\n", name, errno);
+            ok = false;
+            break;
+        }
+        close(fd);
+    }
+
+    if (ok) {
+        uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        for (uint32_t i = 0; i < num_entries; i++) {
+            snprintf(name, sizeof(name), "%s/entry%05" PRIu32, path, i);
+            int fd = open(name, O_RDONLY);
+            if (fd < 0) {
+                fprintf(stderr, "cannot open '%s': %d\n", name, errno);
+                ok = false;
+                break;
+            }
+            close(fd);
+        }
+        uint64_t end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        if (ok) {
+            uint64_t per_open = (end_ns - start_ns) / num_entries;
+            printf("%" PRIu32 " entries: opened each in %" PRIu64 " ns on average\n",
+                   num_entries, per_open);
+        }
+    }
+
+    for (uint32_t i = 0; i < created; i++) {
+        snprintf(name, sizeof(name), "%s/entry%05" PRIu32, path, i);
+        unlink(name);
+    }
+    unlink(path);
+    return ok;
+}
+
+double mb_per_second(size_t bytes, uint64_t ns) {
+    return (static_cast<double>(bytes) / kMB) / (static_cast<double>(ns) / 1000000000.0);
+}
+
+// Reads the whole file at path, returns the time it took or 0 on failure
+uint64_t time_read(const char* path, int flags, size_t size, uint8_t* buf) {
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    int fd = open(path, flags);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open '%s': %d\n", path, errno);
+        return 0;
+    }
+    size_t total = 0;
+    ssize_t r;
+    while ((r = read(fd, buf, kIoSize)) > 0)
+        total += r;
+    close(fd);
+    uint64_t end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    if (r < 0 || total != size) {
+        fprintf(stderr, "cannot read '%s': read %zu of %zu bytes\n", path, total, size);
+        return 0;
+    }
+    return end_ns - start_ns;
+}
+
+bool do_throughput_test(const char* dir, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/vfs-perf-big", dir);
+    auto buf = static_cast<uint8_t*>(malloc(kIoSize));
+    if (buf == nullptr)
+        return false;
+    memset(buf, 0x5a, kIoSize);
+
+    bool ok = true;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "cannot create '%s': %d\n", path, errno);
+        free(buf);
+        return false;
+    }
+    for (size_t done = 0; done < size; done += kIoSize) {
+        size_t len = (size - done < kIoSize) ? size - done : kIoSize;
+        if (write(fd, buf, len) != static_cast<ssize_t>(len)) {
+            fprintf(stderr, "cannot write '%s': %d\n", path, errno);
+            ok = false;
+            break;
+        }
+    }
+    close(fd);
+    uint64_t write_ns = mx_time_get(MX_CLOCK_MONOTONIC) - start_ns;
+
+    uint64_t read_ro_ns = 0;
+    uint64_t read_rw_ns = 0;
+    if (ok) {
+        read_ro_ns = time_read(path, O_RDONLY, size, buf);
+        read_rw_ns = time_read(path, O_RDWR, size, buf);
+        ok = (read_ro_ns != 0) && (read_rw_ns != 0);
+    }
+    if (ok) {
+        printf("%4zu MB file: write %8.1f MB/s, read %8.1f MB/s read-only, "
+               "%8.1f MB/s read-write\n", size / kMB, mb_per_second(size, write_ns),
+               mb_per_second(size, read_ro_ns), mb_per_second(size, read_rw_ns));
+    }
+
+    unlink(path);
+    free(buf);
+    return ok;
+}
+
+void argument_error(const char* argv0, const char* message) {
+    fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
+    exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...]\n"
+        "\n"
+        "Options:\n"
+        "  -h    show help (this)\n"
+        "  -t N  run with up to N threads (default: 8, max: 32)\n"
+        "  -d N  run each step for N milliseconds (default: 1000)\n"
+        "  -p P  create the test files in directory P (default: /tmp)\n"
+        "  -e N  open each of N entries of one directory (default: 10000, 0 to skip)\n"
+        "  -s N  measure throughput on a 1 MB and an N MB file (default: 100, max: 256, 0 to skip)\n";
+
+    uint32_t max_threads = 8;    // -t
+    uint32_t duration_ms = 1000; // -d
+    const char* dir = "/tmp";    // -p
+    uint32_t num_entries = 10000; // -e
+    uint32_t size_mb = 100;       // -s
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+ht:d:p:e:s:")) != -1) {
+        switch (opt) {
+            case 'h':
+                printf(help, argv[0]);
+                return EXIT_SUCCESS;
+            case 't':
+            case 'd': {
+                errno = 0;
+                char* endptr = nullptr;
+                unsigned long long v = strtoull(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || v == 0 || v > UINT32_MAX)
+                    argument_error(argv[0], "invalid number");
+                if (opt == 't') {
+                    if (v > kMaxThreads)
+                        argument_error(argv[0], "too many threads");
+                    max_threads = static_cast<uint32_t>(v);
+                } else {
+                    duration_ms = static_cast<uint32_t>(v);
+                }
+                break;
+            }
+            case 'p':
+                dir = optarg;
+                break;
+            case 'e': {
+                errno = 0;
+                char* endptr = nullptr;
+                unsigned long long v = strtoull(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || v > 99999)
+                    argument_error(argv[0], "invalid number of entries");
+                num_entries = static_cast<uint32_t>(v);
+                break;
+            }
+            case 's': {
+                errno = 0;
+                char* endptr = nullptr;
+                unsigned long long v = strtoull(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || v > kMaxFileSizeMB)
+                    argument_error(argv[0], "invalid file size");
+                size_mb = static_cast<uint32_t>(v);
+                break;
+            }
+            default:  // '?'
+                argument_error(argv[0], "invalid option");
+                break;
+        }
+    }
+    if (optind < argc)
+        argument_error(argv[0], "unexpected positional argument");
+
+    bool ok = create_files(dir, max_threads);
+    for (uint32_t n = 1; ok && n <= max_threads; n *= 2)
+        ok = do_test(n, duration_ms);
+    remove_files(max_threads);
+    if (ok && num_entries > 0)
+        ok = do_dir_test(dir, num_entries);
+    if (ok && size_mb > 0)
+        ok = do_throughput_test(dir, kMB);
+    if (ok && size_mb > 1)
+        ok = do_throughput_test(dir, size_mb * kMB);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
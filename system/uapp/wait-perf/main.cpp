@@ -0,0 +1,174 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+
+// Compares the cost of finding the one ready handle among many with
+// handle_wait_many, which has to look at every handle on every call, and with
+// a wait set, which only looks at the entries that are ready.
+
+namespace {
+
+// handle_wait_many refuses more handles than this.
+constexpr uint32_t kMaxWaitManyHandles = 256u;
+
+constexpr uint32_t kMaxResults = 16u;
+
+enum class Mode {
+    WAIT_MANY,
+    WAITSET_LEVEL,
+    WAITSET_EDGE,
+};
+
+const char* mode_name(Mode mode) {
+    switch (mode) {
+        case Mode::WAIT_MANY:
+            return "handle_wait_many";
+        case Mode::WAITSET_LEVEL:
+            return "waitset level";
+        case Mode::WAITSET_EDGE:
+            return "waitset edge";
+    }
+    return "?";
+}
+
+// Signals one of |num_handles| events per iteration (striding through all of
+// them) and waits for it to be reported, |iterations| times.
+void do_test(Mode mode, uint32_t num_handles, uint32_t iterations) {
+    __UNUSED mx_status_t status;
+
+    if (mode == Mode::WAIT_MANY && num_handles > kMaxWaitManyHandles) {
+        printf("%-16s %5" PRIu32 " handles: not supported (limit is %" PRIu32 " handles)\n",
+               mode_name(mode), num_handles, kMaxWaitManyHandles);
+        return;
+    }
+
+    mx_handle_t* events = new mx_handle_t[num_handles];
+    mx_wait_item_t* items = new mx_wait_item_t[num_handles];
+    for (uint32_t i = 0; i < num_handles; i++) {
+        status = mx_event_create(0u, &events[i]);
+        assert(status == NO_ERROR);
+    }
+
+    mx_handle_t ws = MX_HANDLE_INVALID;
+    if (mode != Mode::WAIT_MANY) {
+        status = mx_waitset_create(0u, &ws);
+        assert(status == NO_ERROR);
+        uint32_t options = (mode == Mode::WAITSET_EDGE) ? MX_WAITSET_EDGE_TRIGGERED : 0u;
+        for (uint32_t i = 0; i < num_handles; i++) {
+            status = mx_waitset_add(ws, i, events[i], MX_USER_SIGNAL_0, options);
+            assert(status == NO_ERROR);
+        }
+    }
+
+    mx_waitset_result_t results[kMaxResults];
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    for (uint32_t n = 0; n < iterations; n++) {
+        // An odd stride visits every handle without always picking the first
+        // or last one.
+        uint32_t ready = static_cast<uint32_t>((n * 7u + num_handles / 2u) % num_handles);
+        status = mx_object_signal(events[ready], 0u, MX_USER_SIGNAL_0);
+        assert(status == NO_ERROR);
+
+        uint32_t found = num_handles;
+        if (mode == Mode::WAIT_MANY) {
+            for (uint32_t i = 0; i < num_handles; i++) {
+                items[i].handle = events[i];
+                items[i].waitfor = MX_USER_SIGNAL_0;
+                items[i].pending = 0u;
+            }
+            status = mx_handle_wait_many(items, num_handles, MX_TIME_INFINITE);
+            assert(status == NO_ERROR);
+            for (uint32_t i = 0; i < num_handles; i++) {
+                if (items[i].pending & MX_USER_SIGNAL_0) {
+                    found = i;
+                    break;
+                }
+            }
+        } else {
+            uint32_t num_results = kMaxResults;
+            status = mx_waitset_wait(ws, MX_TIME_INFINITE, results, &num_results);
+            assert(status == NO_ERROR);
+            assert(num_results == 1u);
+            found = static_cast<uint32_t>(results[0].cookie);
+        }
+        assert(found == ready);
+
+        status = mx_object_signal(events[found], MX_USER_SIGNAL_0, 0u);
+        assert(status == NO_ERROR);
+    }
+
+    uint64_t end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    if (ws != MX_HANDLE_INVALID)
+        mx_handle_close(ws);
+    for (uint32_t i = 0; i < num_handles; i++)
+        mx_handle_close(events[i]);
+    delete[] items;
+    delete[] events;
+
+    uint64_t ns_per_wait = (end_ns - start_ns) / iterations;
+    printf("%-16s %5" PRIu32 " handles: %8" PRIu64 " ns/wakeup\n",
+           mode_name(mode), num_handles, ns_per_wait);
+}
+
+void argument_error(const char* argv0, const char* message) {
+    fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
+    exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...]\n"
+        "\n"
+        "Options:\n"
+        "  -h    show help (this)\n"
+        "  -i N  set wakeups per run to N (default: 20000)\n";
+
+    uint32_t iterations = 20000;  // -i
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+hi:")) != -1) {
+        switch (opt) {
+            case 'h':
+                printf(help, argv[0]);
+                return EXIT_SUCCESS;
+            case 'i': {
+                errno = 0;
+                char* endptr = nullptr;
+                unsigned long long v = strtoull(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || v == 0 || v > UINT32_MAX)
+                    argument_error(argv[0], "invalid iteration count");
+                iterations = static_cast<uint32_t>(v);
+                break;
+            }
+            default:  // '?'
+                argument_error(argv[0], "invalid option");
+                break;
+        }
+    }
+    if (optind < argc)
+        argument_error(argv[0], "unexpected positional argument");
+
+    static constexpr uint32_t sizes[] = {10u, 100u, 1000u};
+    static constexpr Mode modes[] = {Mode::WAIT_MANY, Mode::WAITSET_LEVEL, Mode::WAITSET_EDGE};
+    for (size_t i = 0; i < countof(sizes); i++) {
+        for (size_t j = 0; j < countof(modes); j++)
+            do_test(modes[j], sizes[i], iterations);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -144,14 +144,25 @@ static mx_status_t choose_load_bias(mx_handle_t proc,
     return NO_ERROR;
 }
 
-// TODO(mcgrathr): Temporary hack to avoid modifying the file VMO.
-// This will go away when we have copy-on-write.
+// Returns a VMO holding the data part of a writable segment that can be
+// mapped writable without modifying the file VMO.
 static mx_handle_t get_writable_vmo(mx_handle_t proc_self,
                                     mx_handle_t vmo, size_t data_size,
                                     uintptr_t* file_start,
                                     uintptr_t* file_end) {
+    // A copy-on-write clone is a snapshot of the file that only costs a
+    // page copy for the pages that get written, in it or in the file.
     mx_handle_t copy_vmo;
-    mx_status_t status = mx_vmo_create(data_size, 0, &copy_vmo);
+    mx_status_t status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE,
+                                      *file_start, data_size, &copy_vmo);
+    if (status == NO_ERROR) {
+        *file_end -= *file_start;
+        *file_start = 0;
+        return copy_vmo;
+    }
+
+    // Not every VMO can be cloned, fall back to copying the data.
+    status = mx_vmo_create(data_size, 0, &copy_vmo);
     if (status < 0)
         return status;
     uintptr_t window = 0;
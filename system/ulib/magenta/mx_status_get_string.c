@@ -26,6 +26,7 @@ const char* _mx_status_get_string(mx_status_t status) {
     case ERR_REMOTE_CLOSED: return "ERR_REMOTE_CLOSED";
     case ERR_UNAVAILABLE: return "ERR_UNAVAILABLE";
     case ERR_SHOULD_WAIT: return "ERR_SHOULD_WAIT";
+    case ERR_CALL_FAILED: return "ERR_CALL_FAILED";
     case ERR_ACCESS_DENIED: return "ERR_ACCESS_DENIED";
     case ERR_IO: return "ERR_IO";
     case ERR_IO_REFUSED: return "ERR_IO_REFUSED";
@@ -20,6 +20,7 @@ class waitset;
 // - thread
 // - process
 // - job
+// - timer
 template <typename T> struct handle_traits {
     static const bool supports_duplication = true;
     static const bool supports_user_signal = true;
@@ -33,6 +33,11 @@ public:
         return mx_port_wait(get(), timeout, packet, size);
     }
 
+    mx_status_t wait_many(mx_time_t timeout, void* packets, mx_size_t size,
+                          uint32_t count, uint32_t* actual) const {
+        return mx_port_wait_many(get(), timeout, packets, size, count, actual);
+    }
+
     mx_status_t bind(uint64_t key, mx_handle_t source,
                      mx_signals_t signals) const {
         return mx_port_bind(get(), key, source, signals);
@@ -0,0 +1,37 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <mx/handle.h>
+
+namespace mx {
+
+class timer : public handle<timer> {
+public:
+    timer() = default;
+
+    explicit timer(mx_handle_t value) : handle(value) {}
+
+    explicit timer(handle<void>&& h) : handle(h.release()) {}
+
+    timer(timer&& other) : handle(other.release()) {}
+
+    timer& operator=(timer&& other) {
+        reset(other.release());
+        return *this;
+    }
+
+    static mx_status_t create(uint32_t options, timer* result);
+
+    mx_status_t set(mx_time_t deadline, mx_time_t slack) const {
+        return mx_timer_set(get(), deadline, slack);
+    }
+
+    mx_status_t cancel() const {
+        return mx_timer_cancel(get());
+    }
+};
+
+} // namespace mx
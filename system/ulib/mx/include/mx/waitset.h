@@ -26,8 +26,8 @@ public:
     static mx_status_t create(uint32_t options, waitset* result);
 
     mx_status_t add(uint64_t cookie, const handle& handle,
-                    mx_signals_t signals) const {
-        return mx_waitset_add(get(), cookie, handle.get(), signals);
+                    mx_signals_t signals, uint32_t options = 0u) const {
+        return mx_waitset_add(get(), cookie, handle.get(), signals, options);
     }
 
     mx_status_t remove(uint64_t cookie) const {
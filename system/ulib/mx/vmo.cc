@@ -15,4 +15,12 @@ mx_status_t vmo::create(uint64_t size, uint32_t options, vmo* result) {
     return status;
 }
 
+mx_status_t vmo::clone(uint32_t options, uint64_t offset, uint64_t size,
+                       vmo* result) const {
+    mx_handle_t h = MX_HANDLE_INVALID;
+    mx_status_t status = mx_vmo_clone(get(), options, offset, size, &h);
+    result->reset(h);
+    return status;
+}
+
 } // namespace mx
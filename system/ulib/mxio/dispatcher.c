@@ -17,20 +17,34 @@
 
 typedef struct {
     list_node_t node;
+    // port key for this handler, never reused, so packets that are
+    // still queued when the handler goes away can be recognized
+    uint64_t id;
     mx_handle_t h;
-    uint32_t flags;
     void* cb;
     void* cookie;
+
+    // events that arrived while a worker was busy with this handler
+    uint32_t pending_reads;
+    bool pending_close;
+    // a worker owns this handler, only that worker calls into it
+    bool busy;
 } handler_t;
 
-#define FLAG_DISCONNECTED 1
+// number of port packets pulled in per wait
+#define DISPATCHER_BATCH 16
+
+#define HANDLER_BUCKETS 64
 
 struct mxio_dispatcher {
     mtx_t lock;
-    list_node_t list;
+    list_node_t handlers[HANDLER_BUCKETS];
+    uint64_t next_id;
     mx_handle_t ioport;
     mxio_dispatcher_cb_t cb;
-    thrd_t t;
+    uint32_t workers;
+    uint32_t running;
+    bool started;
 };
 
 static void mxio_dispatcher_destroy(mxio_dispatcher_t* md) {
@@ -38,78 +52,126 @@ static void mxio_dispatcher_destroy(mxio_dispatcher_t* md) {
     free(md);
 }
 
+// called with md->lock held
+static handler_t* find_handler(mxio_dispatcher_t* md, uint64_t id) {
+    handler_t* handler;
+    list_for_every_entry (&md->handlers[id % HANDLER_BUCKETS], handler, handler_t, node) {
+        if (handler->id == id) {
+            return handler;
+        }
+    }
+    return NULL;
+}
+
+// called with md->lock held, by the worker that owns the handler
 static void destroy_handler(mxio_dispatcher_t* md, handler_t* handler, bool need_close_cb) {
+    // once unlisted, events still in the port for it are dropped
+    list_delete(&handler->node);
+    mtx_unlock(&md->lock);
+
+    mx_handle_close(handler->h);
     if (need_close_cb) {
         md->cb(0, handler->cb, handler->cookie);
     }
-    mtx_lock(&md->lock);
-    list_delete(&handler->node);
-    mtx_unlock(&md->lock);
     free(handler);
-}
 
-static void disconnect_handler(mxio_dispatcher_t* md, handler_t* handler, bool need_close_cb) {
-    // close handle, so we get no further messages
-    mx_handle_close(handler->h);
+    mtx_lock(&md->lock);
+}
 
-    // send a synthetic message so we know when it's safe to destroy
-    mx_io_packet_t packet;
-    packet.hdr.key = (uint64_t)(uintptr_t)handler;
-    packet.signals = need_close_cb ? MX_SIGNAL_SIGNALED : 0;
-    mx_port_queue(md->ioport, &packet, sizeof(packet));
+// called with md->lock held, by the worker that just marked the handler busy
+// runs the handler until it has no events left, or is destroyed
+static void run_handler(mxio_dispatcher_t* md, handler_t* handler) {
+    mx_status_t r;
+    for (;;) {
+        if (handler->pending_reads > 0) {
+            handler->pending_reads--;
+            mtx_unlock(&md->lock);
+            r = md->cb(handler->h, handler->cb, handler->cookie);
+            mtx_lock(&md->lock);
+            if (r != 0) {
+                if (r == ERR_DISPATCHER_NO_WORK) {
+                    printf("mxio: dispatcher found no work to do!\n");
+                } else {
+                    destroy_handler(md, handler, r < 0);
+                    return;
+                }
+            }
+            continue;
+        }
+        if (handler->pending_close) {
+            // synthesize a close
+            destroy_handler(md, handler, true);
+            return;
+        }
+        handler->busy = false;
+        return;
+    }
+}
 
-    // flag so we know to ignore further events
-    handler->flags |= FLAG_DISCONNECTED;
+static void handle_packet(mxio_dispatcher_t* md, mx_io_packet_t* packet) {
+    mtx_lock(&md->lock);
+    handler_t* handler = find_handler(md, packet->hdr.key);
+    if (handler != NULL) {
+        if (packet->signals & MX_SIGNAL_READABLE) {
+            handler->pending_reads++;
+        }
+        if (packet->signals & MX_SIGNAL_PEER_CLOSED) {
+            handler->pending_close = true;
+        }
+        // if another worker is in this handler it picks up the new
+        // events before letting go of it, so calls never overlap
+        if (!handler->busy) {
+            handler->busy = true;
+            run_handler(md, handler);
+        }
+    }
+    mtx_unlock(&md->lock);
 }
 
 static int mxio_dispatcher_thread(void* _md) {
     mxio_dispatcher_t* md = _md;
     mx_status_t r;
 
-again:
+    // with several workers, take one packet at a time so a slow
+    // handler never sits on events that another worker could serve
+    uint32_t batch = (md->workers > 1) ? 1 : DISPATCHER_BATCH;
+
     for (;;) {
-        mx_io_packet_t packet;
-        if ((r = mx_port_wait(md->ioport, MX_TIME_INFINITE, &packet, sizeof(packet))) < 0) {
+        mx_io_packet_t packets[DISPATCHER_BATCH];
+        uint32_t count;
+        if ((r = mx_port_wait_many(md->ioport, MX_TIME_INFINITE, packets, sizeof(packets[0]),
+                                   batch, &count)) < 0) {
             printf("dispatcher: ioport wait failed %d\n", r);
             break;
         }
-        handler_t* handler = (void*)(uintptr_t)packet.hdr.key;
-        if (handler->flags & FLAG_DISCONNECTED) {
-            // handler is awaiting gc
-            // ignore events for it until we get the synthetic "destroy" event
-            if (packet.hdr.type == MX_PORT_PKT_TYPE_USER) {
-                destroy_handler(md, handler, packet.signals & MX_SIGNAL_SIGNALED);
-            }
-            continue;
-        }
-        if (packet.signals & MX_SIGNAL_READABLE) {
-            if ((r = md->cb(handler->h, handler->cb, handler->cookie)) != 0) {
-                if (r == ERR_DISPATCHER_NO_WORK) {
-                    printf("mxio: dispatcher found no work to do!\n");
-                } else {
-                    disconnect_handler(md, handler, r < 0);
-                    continue;
-                }
-            }
-        }
-        if (packet.signals & MX_SIGNAL_PEER_CLOSED) {
-            // synthesize a close
-            disconnect_handler(md, handler, true);
+        for (uint32_t i = 0; i < count; i++) {
+            handle_packet(md, &packets[i]);
         }
     }
 
     printf("dispatcher: FATAL ERROR, EXITING\n");
-    mxio_dispatcher_destroy(md);
+    mtx_lock(&md->lock);
+    bool last = (--md->running == 0);
+    mtx_unlock(&md->lock);
+    if (last) {
+        mxio_dispatcher_destroy(md);
+    }
     return NO_ERROR;
 }
 
-mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t cb) {
+mx_status_t mxio_dispatcher_create_pool(mxio_dispatcher_t** out, mxio_dispatcher_cb_t cb,
+                                        uint32_t workers) {
+    if (workers == 0) {
+        return ERR_INVALID_ARGS;
+    }
     mxio_dispatcher_t* md;
     if ((md = calloc(1, sizeof(*md))) == NULL) {
         return ERR_NO_MEMORY;
     }
-    xprintf("mxio_dispatcher_create: %p\n", md);
-    list_initialize(&md->list);
+    xprintf("mxio_dispatcher_create: %p workers=%u\n", md, workers);
+    for (unsigned n = 0; n < HANDLER_BUCKETS; n++) {
+        list_initialize(&md->handlers[n]);
+    }
     mtx_init(&md->lock, mtx_plain);
     mx_status_t status;
     if ((status = mx_port_create(0u, &md->ioport)) < 0) {
@@ -117,29 +179,55 @@ mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t
         return status;
     }
     md->cb = cb;
+    md->workers = workers;
     *out = md;
     return NO_ERROR;
 }
 
+mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t cb) {
+    return mxio_dispatcher_create_pool(out, cb, 1);
+}
+
+// called with md->lock held
+// returns the number of worker threads actually started
+static uint32_t start_workers(mxio_dispatcher_t* md, uint32_t count, const char* name) {
+    uint32_t started = 0;
+    while (started < count) {
+        thrd_t t;
+        if (thrd_create_with_name(&t, mxio_dispatcher_thread, md, name) != thrd_success) {
+            printf("dispatcher: could only start %u of %u workers\n", started, count);
+            break;
+        }
+        thrd_detach(t);
+        md->running++;
+        started++;
+    }
+    return started;
+}
+
 mx_status_t mxio_dispatcher_start(mxio_dispatcher_t* md, const char* name) {
     mx_status_t r;
     mtx_lock(&md->lock);
-    if (md->t == NULL) {
-        if (thrd_create_with_name(&md->t, mxio_dispatcher_thread, md, name) != thrd_success) {
-            mxio_dispatcher_destroy(md);
-            r = ERR_NO_RESOURCES;
-        } else {
-            thrd_detach(md->t);
-            r = NO_ERROR;
-        }
-    } else {
+    if (md->started) {
         r = ERR_BAD_STATE;
+    } else if (start_workers(md, md->workers, name) == 0) {
+        mtx_unlock(&md->lock);
+        mxio_dispatcher_destroy(md);
+        return ERR_NO_RESOURCES;
+    } else {
+        md->started = true;
+        r = NO_ERROR;
     }
     mtx_unlock(&md->lock);
     return r;
 }
 
 void mxio_dispatcher_run(mxio_dispatcher_t* md) {
+    mtx_lock(&md->lock);
+    md->started = true;
+    md->running++;
+    start_workers(md, md->workers - 1, "mxio-dispatcher");
+    mtx_unlock(&md->lock);
     mxio_dispatcher_thread(md);
 }
 
@@ -147,17 +235,17 @@ mx_status_t mxio_dispatcher_add(mxio_dispatcher_t* md, mx_handle_t h, void* cb,
     handler_t* handler;
     mx_status_t r;
 
-    if ((handler = malloc(sizeof(handler_t))) == NULL) {
+    if ((handler = calloc(1, sizeof(handler_t))) == NULL) {
         return ERR_NO_MEMORY;
     }
     handler->h = h;
-    handler->flags = 0;
     handler->cb = cb;
     handler->cookie = cookie;
 
     mtx_lock(&md->lock);
-    list_add_tail(&md->list, &handler->node);
-    if ((r = mx_port_bind(md->ioport, (uint64_t)(uintptr_t)handler, h,
+    handler->id = ++md->next_id;
+    list_add_tail(&md->handlers[handler->id % HANDLER_BUCKETS], &handler->node);
+    if ((r = mx_port_bind(md->ioport, handler->id, h,
                              MX_SIGNAL_READABLE | MX_SIGNAL_PEER_CLOSED)) < 0) {
         list_delete(&handler->node);
     }
@@ -223,7 +223,8 @@ int epoll_ctl(int epfd, int op, int fd, struct epoll_event* ep_event) {
         }
 
         cookie->ep_event = *ep_event;
-        if ((r = mx_waitset_add(epio->h, (uint64_t)(uintptr_t)cookie, h, signals)) < 0) {
+        uint32_t options = (ep_event->events & EPOLLET) ? MX_WAITSET_EDGE_TRIGGERED : 0u;
+        if ((r = mx_waitset_add(epio->h, (uint64_t)(uintptr_t)cookie, h, signals, options)) < 0) {
             mxio_release(cookie->io);
             free(cookie);
             goto end;
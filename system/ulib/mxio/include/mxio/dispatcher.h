@@ -26,10 +26,21 @@ typedef mx_status_t (*mxio_dispatcher_cb_t)(mx_handle_t h, void* cb, void* cooki
 // the message pipe had been closed remotely (zero handle).
 mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t cb);
 
-// create a thread for a dispatcher and start it running
+// Create a dispatcher that is served by a pool of |workers| threads
+// sharing one port.
+//
+// The handler is never called concurrently for the same handle, and
+// calls for one handle happen in the order its messages arrived, but
+// calls for different handles may run in parallel on different workers,
+// so the handler must be safe to use that way.
+mx_status_t mxio_dispatcher_create_pool(mxio_dispatcher_t** out, mxio_dispatcher_cb_t cb,
+                                        uint32_t workers);
+
+// create the worker thread(s) for a dispatcher and start them running
 mx_status_t mxio_dispatcher_start(mxio_dispatcher_t* md, const char* name);
 
 // run the dispatcher loop on the current thread, never to return
+// for a pool, the remaining workers are started as new threads
 void mxio_dispatcher_run(mxio_dispatcher_t* md);
 
 // add a pipe and handler to a dispatcher
@@ -15,7 +15,7 @@ __BEGIN_CDECLS
 
 #define MXRIO_HDR_SZ       (__builtin_offsetof(mxrio_msg_t, data))
 
-#define MXRIO_MAGIC        0x024F4952 // RIO 0x02
+#define MXRIO_MAGIC        0x034F4952 // RIO 0x03
 
 #define MXRIO_STATUS       0x00000000
 #define MXRIO_CLOSE        0x00000001
@@ -84,6 +84,7 @@ mx_status_t mxrio_handler(mx_handle_t h, void* cb, void* cookie);
 mx_status_t mxrio_txn_handoff(mx_handle_t srv, mx_handle_t rh, mxrio_msg_t* msg);
 
 struct mxrio_msg {
+    mx_txid_t txid;                    // transaction id, see mx_channel_call()
     uint32_t magic;                    // MXRIO_MAGIC
     uint32_t op;                       // opcode
     uint32_t datalen;                  // size of data[]
@@ -140,6 +140,8 @@ mx_status_t mxrio_handler(mx_handle_t h, void* _cb, void* cookie) {
         msg.handle[msg.hcount++] = rh;
     }
 
+    // the reply reuses the request header, so msg.txid is
+    // echoed back as mx_channel_call() requires
     msg.op = MXRIO_STATUS;
     if ((r = mx_channel_write(rh, 0, &msg, MXRIO_HDR_SZ + msg.datalen, msg.handle, msg.hcount)) < 0) {
         discard_handles(msg.handle, msg.hcount);
@@ -170,15 +172,9 @@ mx_status_t mxrio_txn_handoff(mx_handle_t srv, mx_handle_t rh, mxrio_msg_t* msg)
     return 0;
 }
 
-// on success, msg->hcount indicates number of valid handles in msg->handle
-// on error there are never any handles
-static mx_status_t mxrio_txn(mxrio_t* rio, mxrio_msg_t* msg) {
-    msg->magic = MXRIO_MAGIC;
-    if (!is_message_valid(msg)) {
-        return ERR_INVALID_ARGS;
-    }
-
-    xprintf("txn h=%x op=%d len=%u\n", rio->h, msg->op, msg->datalen);
+// Transaction over a thread-local reply channel, for requests that the
+// server may hand off to another server (see mxrio_txn_handoff()).
+static mx_status_t mxrio_txn_reply_channel(mxrio_t* rio, mxrio_msg_t* msg) {
     uint32_t dsize = MXRIO_HDR_SZ + msg->datalen;
 
     mx_status_t r;
@@ -257,6 +253,99 @@ fail_close_reply_channel:
     return r;
 }
 
+static bool may_be_handed_off(uint32_t op) {
+    switch (MXRIO_OP(op)) {
+    case MXRIO_OPEN:
+    case MXRIO_CLONE:
+    case MXRIO_RENAME:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Like mxrio_txn(), but the request data is gathered from |wr_data| and the
+// reply data is scattered into |rd_data|, which has room for |rd_len| bytes,
+// so neither is copied through msg->data. Only the header of |msg| is used.
+// Not for requests that may be handed off.
+static mx_status_t mxrio_txnv(mxrio_t* rio, mxrio_msg_t* msg,
+                              const void* wr_data, void* rd_data, uint32_t rd_len) {
+    msg->magic = MXRIO_MAGIC;
+    if (!is_message_valid(msg) || (rd_len > MXIO_CHUNK_SIZE)) {
+        return ERR_INVALID_ARGS;
+    }
+
+    xprintf("txnv h=%x op=%d len=%u\n", rio->h, msg->op, msg->datalen);
+
+    mx_channel_iovec_t wr_iovs[2] = {
+        { .buffer = msg, .num_bytes = MXRIO_HDR_SZ },
+        { .buffer = (void*)wr_data, .num_bytes = msg->datalen },
+    };
+    mx_channel_iovec_t rd_iovs[2] = {
+        { .buffer = msg, .num_bytes = MXRIO_HDR_SZ },
+        { .buffer = rd_data, .num_bytes = rd_len },
+    };
+    mx_channel_callv_args_t args = {
+        .wr_iovs = wr_iovs,
+        .wr_handles = msg->handle,
+        .rd_iovs = rd_iovs,
+        .rd_handles = msg->handle,
+        .wr_num_iovs = 2,
+        .wr_num_handles = msg->hcount,
+        .rd_num_iovs = 2,
+        .rd_num_handles = MXIO_MAX_HANDLES,
+    };
+
+    uint32_t dsize;
+    mx_status_t rs;
+    mx_status_t r = mx_channel_callv(rio->h, 0, MX_TIME_INFINITE, &args,
+                                     &dsize, &msg->hcount, &rs);
+    if (r < 0) {
+        if (r == ERR_CALL_FAILED) {
+            // the request went out (taking its handles with it)
+            // but the reply could not be received
+            msg->hcount = 0;
+            return rs;
+        }
+        // the request was never sent, we still own the handles
+        goto fail_discard_handles;
+    }
+
+    // check for protocol errors
+    if (!is_message_reply_valid(msg, dsize) ||
+        (MXRIO_OP(msg->op) != MXRIO_STATUS)) {
+        r = ERR_IO;
+        goto fail_discard_handles;
+    }
+    // check for remote error
+    if ((r = msg->arg) < 0) {
+        goto fail_discard_handles;
+    }
+    return r;
+
+fail_discard_handles:
+    discard_handles(msg->handle, msg->hcount);
+    msg->hcount = 0;
+    return r;
+}
+
+// on success, msg->hcount indicates number of valid handles in msg->handle
+// on error there are never any handles
+static mx_status_t mxrio_txn(mxrio_t* rio, mxrio_msg_t* msg) {
+    if (may_be_handed_off(msg->op)) {
+        msg->magic = MXRIO_MAGIC;
+        if (!is_message_valid(msg)) {
+            return ERR_INVALID_ARGS;
+        }
+        xprintf("txn h=%x op=%d len=%u\n", rio->h, msg->op, msg->datalen);
+        return mxrio_txn_reply_channel(rio, msg);
+    }
+
+    // The reply is read back into the same buffer as the request.
+    const void* wr_data = (msg->datalen > 0) ? msg->data : NULL;
+    return mxrio_txnv(rio, msg, wr_data, msg->data, MXIO_CHUNK_SIZE);
+}
+
 static ssize_t mxrio_ioctl(mxio_t* io, uint32_t op, const void* in_buf,
                            size_t in_len, void* out_buf, size_t out_len) {
     mxrio_t* rio = (mxrio_t*)io;
@@ -319,9 +408,9 @@ static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t l
         msg.datalen = xfer;
         if (op == MXRIO_WRITE_AT)
             msg.arg2.off = offset;
-        memcpy(msg.data, data, xfer);
 
-        if ((r = mxrio_txn(rio, &msg)) < 0) {
+        // the data goes out straight from the caller's buffer
+        if ((r = mxrio_txnv(rio, &msg, data, msg.data, MXIO_CHUNK_SIZE)) < 0) {
             break;
         }
         discard_handles(msg.handle, msg.hcount);
@@ -368,7 +457,8 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
         if (op == MXRIO_READ_AT)
             msg.arg2.off = offset;
 
-        if ((r = mxrio_txn(rio, &msg)) < 0) {
+        // the reply data lands straight in the caller's buffer
+        if ((r = mxrio_txnv(rio, &msg, NULL, data, xfer)) < 0) {
             break;
         }
         discard_handles(msg.handle, msg.hcount);
@@ -377,7 +467,6 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
             r = ERR_IO;
             break;
         }
-        memcpy(data, msg.data, r);
         count += r;
         data += r;
         len -= r;
@@ -27,6 +27,9 @@
 class Mutex {
 public:
     constexpr Mutex() : mutex_(MUTEX_INITIAL_VALUE(mutex_)) { }
+    // Accounts contention on this mutex to |cls|, see kernel/mutex.h.
+    constexpr explicit Mutex(mutex_class_t* cls)
+        : mutex_(MUTEX_INITIAL_VALUE_CLASS(mutex_, cls)) { }
     ~Mutex() { mutex_destroy(&mutex_); }
     void Acquire() { mutex_acquire(&mutex_); }
     void Release() { mutex_release(&mutex_); }
@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <threads.h>
 #include <unistd.h>
 
@@ -437,6 +438,389 @@ static bool channel_may_discard(void) {
     END_TEST;
 }
 
+// Answers one request on |arg|: an ordinary message whose first bytes are the txid with
+// the kernel bit cleared and a stale reply with a bogus txid first, then the real one with
+// the txid echoed and the payload incremented.
+static int call_server(void* arg) {
+    mx_handle_t h = *(mx_handle_t*)arg;
+    uint32_t msg[2];
+    uint32_t size = sizeof(msg);
+
+    if (mx_handle_wait_one(h, MX_SIGNAL_READABLE, MX_TIME_INFINITE, NULL) != NO_ERROR)
+        return -1;
+    if (mx_channel_read(h, 0u, msg, size, &size, NULL, 0, NULL) != NO_ERROR)
+        return -1;
+    if (size != sizeof(msg))
+        return -1;
+
+    uint32_t ordinary[2] = {msg[0] & ~0x80000000u, 1u};
+    if (mx_channel_write(h, 0u, ordinary, sizeof(ordinary), NULL, 0u) != NO_ERROR)
+        return -1;
+
+    uint32_t stale[2] = {msg[0] + 1u, 0u};
+    if (mx_channel_write(h, 0u, stale, sizeof(stale), NULL, 0u) != NO_ERROR)
+        return -1;
+
+    msg[1]++;
+    if (mx_channel_write(h, 0u, msg, sizeof(msg), NULL, 0u) != NO_ERROR)
+        return -1;
+    return 0;
+}
+
+static bool channel_call_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    thrd_t server;
+    ASSERT_EQ(thrd_create(&server, call_server, &channel[1]), thrd_success, "thrd_create failed");
+
+    uint32_t request[2] = {0u, 41u};
+    uint32_t reply[2] = {};
+    mx_channel_call_args_t args = {
+        .wr_bytes = request,
+        .wr_num_bytes = sizeof(request),
+        .rd_bytes = reply,
+        .rd_num_bytes = sizeof(reply),
+    };
+    uint32_t actual_bytes = 0u, actual_handles = 0u;
+    mx_status_t read_status = NO_ERROR;
+    EXPECT_EQ(mx_channel_call(channel[0], 0u, MX_TIME_INFINITE, &args,
+                              &actual_bytes, &actual_handles, &read_status), NO_ERROR, "");
+    EXPECT_EQ(actual_bytes, sizeof(reply), "wrong size");
+    EXPECT_EQ(actual_handles, 0u, "wrong number of handles");
+    EXPECT_EQ(reply[1], 42u, "wrong reply");
+    EXPECT_TRUE(reply[0] & 0x80000000u, "txid not kernel generated");
+
+    EXPECT_EQ(thrd_join(server, NULL), thrd_success, "");
+
+    // Neither the ordinary message nor the stale reply matched the call, both were queued.
+    uint32_t size = sizeof(reply);
+    EXPECT_EQ(mx_channel_read(channel[0], 0u, reply, size, &size, NULL, 0, NULL), NO_ERROR, "");
+    EXPECT_EQ(reply[1], 1u, "wrong ordinary message");
+    size = sizeof(reply);
+    EXPECT_EQ(mx_channel_read(channel[0], 0u, reply, size, &size, NULL, 0, NULL), NO_ERROR, "");
+    EXPECT_EQ(reply[1], 0u, "wrong stale reply");
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool channel_callv_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    thrd_t server;
+    ASSERT_EQ(thrd_create(&server, call_server, &channel[1]), thrd_success, "thrd_create failed");
+
+    // The txid and the payload travel in separate buffers each way.
+    mx_txid_t txid = 0u;
+    uint32_t request = 41u;
+    mx_channel_iovec_t wr_iovs[2] = {
+        {&txid, sizeof(txid), 0u},
+        {&request, sizeof(request), 0u},
+    };
+    mx_txid_t reply_txid = 0u;
+    uint32_t reply = 0u;
+    mx_channel_iovec_t rd_iovs[2] = {
+        {&reply_txid, sizeof(reply_txid), 0u},
+        {&reply, sizeof(reply), 0u},
+    };
+    mx_channel_callv_args_t args = {
+        .wr_iovs = wr_iovs,
+        .wr_num_iovs = 2u,
+        .rd_iovs = rd_iovs,
+        .rd_num_iovs = 2u,
+    };
+    uint32_t actual_bytes = 0u;
+    mx_status_t read_status = NO_ERROR;
+    EXPECT_EQ(mx_channel_callv(channel[0], 0u, MX_TIME_INFINITE, &args,
+                               &actual_bytes, NULL, &read_status), NO_ERROR, "");
+    EXPECT_EQ(actual_bytes, sizeof(reply_txid) + sizeof(reply), "wrong size");
+    EXPECT_EQ(reply, 42u, "wrong reply");
+    EXPECT_TRUE(reply_txid & 0x80000000u, "txid not kernel generated");
+
+    EXPECT_EQ(thrd_join(server, NULL), thrd_success, "");
+
+    // Drop the ordinary message and the stale reply the server queued.
+    uint32_t drain[2];
+    for (int i = 0; i < 2; i++) {
+        uint32_t size = sizeof(drain);
+        EXPECT_EQ(mx_channel_read(channel[0], 0u, drain, size, &size, NULL, 0, NULL), NO_ERROR, "");
+    }
+
+    // Too many segments are refused before anything is written.
+    mx_channel_iovec_t many_iovs[64] = {};
+    args.wr_iovs = many_iovs;
+    args.wr_num_iovs = 64u;
+    EXPECT_EQ(mx_channel_callv(channel[0], 0u, MX_TIME_INFINITE, &args, NULL, NULL, &read_status),
+              ERR_OUT_OF_RANGE, "too many iovecs accepted");
+    EXPECT_EQ(mx_handle_wait_one(channel[1], MX_SIGNAL_READABLE, 0u, NULL), ERR_TIMED_OUT,
+              "bad call queued a message");
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool channel_call_error_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    uint32_t request[2] = {};
+    uint32_t reply[2] = {};
+    mx_channel_call_args_t args = {
+        .wr_bytes = request,
+        .wr_num_bytes = sizeof(request),
+        .rd_bytes = reply,
+        .rd_num_bytes = sizeof(reply),
+    };
+    mx_status_t read_status = NO_ERROR;
+
+    // No room for the transaction id.
+    args.wr_num_bytes = 2u;
+    EXPECT_EQ(mx_channel_call(channel[0], 0u, MX_TIME_INFINITE, &args, NULL, NULL, &read_status),
+              ERR_INVALID_ARGS, "");
+    args.wr_num_bytes = sizeof(request);
+
+    // Nobody answers: the request is sent, then the wait times out.
+    EXPECT_EQ(mx_channel_call(channel[0], 0u, 1000000u, &args, NULL, NULL, &read_status),
+              ERR_CALL_FAILED, "");
+    EXPECT_EQ(read_status, ERR_TIMED_OUT, "");
+
+    // The peer is gone: the request can't be written at all.
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+    EXPECT_EQ(mx_channel_call(channel[0], 0u, MX_TIME_INFINITE, &args, NULL, NULL, &read_status),
+              ERR_BAD_STATE, "");
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool channel_iovec_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    // A header and a payload from separate buffers arrive as one message.
+    uint32_t header[2] = {1u, 2u};
+    char payload[] = "payload";
+    mx_channel_iovec_t wr_iovs[3] = {
+        {header, sizeof(header), 0u},
+        {NULL, 0u, 0u},
+        {payload, sizeof(payload), 0u},
+    };
+    ASSERT_EQ(mx_channel_writev(channel[0], 0u, wr_iovs, 3u, NULL, 0u), NO_ERROR, "");
+
+    char flat[sizeof(header) + sizeof(payload)];
+    uint32_t size = sizeof(flat);
+    ASSERT_EQ(mx_channel_read(channel[1], 0u, flat, size, &size, NULL, 0u, NULL), NO_ERROR, "");
+    EXPECT_EQ(size, sizeof(flat), "wrong size");
+    EXPECT_EQ(memcmp(flat, header, sizeof(header)), 0, "header mismatch");
+    EXPECT_EQ(memcmp(flat + sizeof(header), payload, sizeof(payload)), 0, "payload mismatch");
+
+    // Reading scatters the message back, filling each buffer in turn.
+    ASSERT_EQ(mx_channel_write(channel[1], 0u, flat, sizeof(flat), NULL, 0u), NO_ERROR, "");
+    uint32_t rd_header[2] = {};
+    char rd_payload[64] = {};
+    mx_channel_iovec_t rd_iovs[2] = {
+        {rd_header, sizeof(rd_header), 0u},
+        {rd_payload, sizeof(rd_payload), 0u},
+    };
+    size = 0u;
+    ASSERT_EQ(mx_channel_readv(channel[0], 0u, rd_iovs, 2u, &size, NULL, 0u, NULL), NO_ERROR, "");
+    EXPECT_EQ(size, sizeof(flat), "wrong size");
+    EXPECT_EQ(memcmp(rd_header, header, sizeof(header)), 0, "header mismatch");
+    EXPECT_EQ(memcmp(rd_payload, payload, sizeof(payload)), 0, "payload mismatch");
+
+    // Too little room in total leaves the message queued and reports its size.
+    ASSERT_EQ(mx_channel_writev(channel[0], 0u, wr_iovs, 3u, NULL, 0u), NO_ERROR, "");
+    rd_iovs[1].num_bytes = 2u;
+    size = 0u;
+    EXPECT_EQ(mx_channel_readv(channel[1], 0u, rd_iovs, 2u, &size, NULL, 0u, NULL),
+              ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(size, sizeof(flat), "wrong size");
+    rd_iovs[1].num_bytes = sizeof(rd_payload);
+    EXPECT_EQ(mx_channel_readv(channel[1], 0u, rd_iovs, 2u, &size, NULL, 0u, NULL), NO_ERROR, "");
+
+    // Malformed iovecs are rejected without writing anything.
+    wr_iovs[1].num_bytes = 4u;
+    EXPECT_EQ(mx_channel_writev(channel[0], 0u, wr_iovs, 3u, NULL, 0u), ERR_INVALID_ARGS,
+              "null buffer accepted");
+    wr_iovs[1].num_bytes = 0u;
+    wr_iovs[1].reserved = 1u;
+    EXPECT_EQ(mx_channel_writev(channel[0], 0u, wr_iovs, 3u, NULL, 0u), ERR_INVALID_ARGS,
+              "reserved field accepted");
+    wr_iovs[1].reserved = 0u;
+    mx_channel_iovec_t many_iovs[64] = {};
+    EXPECT_EQ(mx_channel_writev(channel[0], 0u, many_iovs, 64u, NULL, 0u), ERR_OUT_OF_RANGE,
+              "too many iovecs accepted");
+    EXPECT_EQ(mx_handle_wait_one(channel[1], MX_SIGNAL_READABLE, 0u, NULL), ERR_TIMED_OUT,
+              "bad write queued a message");
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+// Reads back the payload VMO of a message written with MX_CHANNEL_WRITE_PAYLOAD_VMO.
+static bool read_payload(mx_handle_t channel, void* buf, mx_size_t len, mx_rights_t* rights) {
+    uint32_t num_bytes = 0u;
+    uint32_t num_handles = 1u;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_channel_read(channel, 0u, NULL, 0u, &num_bytes, &vmo, num_handles, &num_handles),
+              NO_ERROR, "");
+    ASSERT_EQ(num_bytes, 0u, "payload copied into the message");
+    ASSERT_EQ(num_handles, 1u, "no payload handle");
+
+    mx_info_handle_basic_t info;
+    mx_size_t sz;
+    ASSERT_EQ(mx_object_get_info(vmo, MX_INFO_HANDLE_BASIC, sizeof(info.rec), &info,
+                                 sizeof(info), &sz), NO_ERROR, "");
+    EXPECT_EQ(info.rec.type, (uint32_t)MX_OBJ_TYPE_VMEM, "payload is not a vmo");
+    *rights = info.rec.rights;
+
+    uint64_t size;
+    ASSERT_EQ(mx_vmo_get_size(vmo, &size), NO_ERROR, "");
+    EXPECT_EQ(size, len, "wrong payload size");
+    mx_size_t actual;
+    ASSERT_EQ(mx_vmo_read(vmo, buf, 0u, len, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, len, "short read");
+
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    return true;
+}
+
+static bool channel_payload_vmo_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    // An arbitrary buffer is copied into a read-only vmo.
+    char small[100];
+    for (size_t i = 0; i < sizeof(small); i++)
+        small[i] = (char)i;
+    ASSERT_EQ(mx_channel_write(channel[0], MX_CHANNEL_WRITE_PAYLOAD_VMO, small, sizeof(small),
+                               NULL, 0u), NO_ERROR, "");
+    char check[sizeof(small)] = {};
+    mx_rights_t rights;
+    ASSERT_TRUE(read_payload(channel[1], check, sizeof(check), &rights), "");
+    EXPECT_EQ(memcmp(small, check, sizeof(small)), 0, "payload mismatch");
+    EXPECT_EQ(rights & MX_RIGHT_WRITE, 0u, "payload is writable");
+    EXPECT_EQ(rights & MX_RIGHT_READ, MX_RIGHT_READ, "payload is not readable");
+
+    // Whole pages of a writable mapping are moved, leaving zeros behind.
+    const mx_size_t len = 4u * 4096u;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(len, 0u, &vmo), NO_ERROR, "");
+    uintptr_t addr;
+    ASSERT_EQ(mx_process_map_vm(mx_process_self(), vmo, 0u, len, &addr,
+                                MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE), NO_ERROR, "");
+    uint8_t* pages = (uint8_t*)addr;
+    memset(pages, 0x5a, len);
+
+    // Header bytes go in the message, the last buffer becomes the vmo.
+    uint32_t header = 7u;
+    mx_channel_iovec_t iovs[2] = {
+        {&header, sizeof(header), 0u},
+        {pages, len, 0u},
+    };
+    ASSERT_EQ(mx_channel_writev(channel[0], MX_CHANNEL_WRITE_PAYLOAD_VMO, iovs, 2u, NULL, 0u),
+              NO_ERROR, "");
+    EXPECT_EQ(pages[0], 0u, "pages were not moved");
+    EXPECT_EQ(pages[len - 1], 0u, "pages were not moved");
+
+    uint32_t rd_header = 0u;
+    uint32_t num_bytes = sizeof(rd_header);
+    uint32_t num_handles = 1u;
+    mx_handle_t payload;
+    ASSERT_EQ(mx_channel_read(channel[1], 0u, &rd_header, num_bytes, &num_bytes,
+                              &payload, num_handles, &num_handles), NO_ERROR, "");
+    EXPECT_EQ(rd_header, header, "header mismatch");
+    ASSERT_EQ(num_handles, 1u, "no payload handle");
+    uint8_t byte = 0u;
+    mx_size_t actual;
+    EXPECT_EQ(mx_vmo_read(payload, &byte, len - 1, 1u, &actual), NO_ERROR, "");
+    EXPECT_EQ(byte, 0x5a, "payload mismatch");
+    EXPECT_EQ(mx_handle_close(payload), NO_ERROR, "");
+
+    // With the vmo mapped a second time, the pages are copied instead.
+    uintptr_t addr2;
+    ASSERT_EQ(mx_process_map_vm(mx_process_self(), vmo, 0u, len, &addr2,
+                                MX_VM_FLAG_PERM_READ), NO_ERROR, "");
+    memset(pages, 0x33, len);
+    ASSERT_EQ(mx_channel_write(channel[0], MX_CHANNEL_WRITE_PAYLOAD_VMO, pages, len, NULL, 0u),
+              NO_ERROR, "");
+    EXPECT_EQ(pages[0], 0x33, "pages of a shared vmo were moved");
+    EXPECT_EQ(((uint8_t*)addr2)[len - 1], 0x33, "pages of a shared vmo were moved");
+    num_bytes = 0u;
+    num_handles = 1u;
+    ASSERT_EQ(mx_channel_read(channel[1], 0u, NULL, 0u, &num_bytes,
+                              &payload, num_handles, &num_handles), NO_ERROR, "");
+    ASSERT_EQ(num_handles, 1u, "no payload handle");
+    byte = 0u;
+    EXPECT_EQ(mx_vmo_read(payload, &byte, len - 1, 1u, &actual), NO_ERROR, "");
+    EXPECT_EQ(byte, 0x33, "payload mismatch");
+    EXPECT_EQ(mx_handle_close(payload), NO_ERROR, "");
+    EXPECT_EQ(mx_process_unmap_vm(mx_process_self(), addr2, 0u), NO_ERROR, "");
+
+    EXPECT_EQ(mx_process_unmap_vm(mx_process_self(), addr, 0u), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+
+    // There has to be a buffer to turn into the payload.
+    EXPECT_EQ(mx_channel_writev(channel[0], MX_CHANNEL_WRITE_PAYLOAD_VMO, NULL, 0u, NULL, 0u),
+              ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_channel_write(channel[0], 0x80000000u, small, sizeof(small), NULL, 0u),
+              ERR_NOT_SUPPORTED, "unknown flag accepted");
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+// The kernel has room for 1 << 20 handles in total.
+#define KERNEL_MAX_HANDLES (1u << 20)
+#define PAYLOADS_PER_CHANNEL 256u
+
+// A message carrying only a payload still owns its vmo handle. Closing the
+// channel with such messages unread must free them, or writing more of them
+// than the kernel has handles would eventually fail.
+static bool channel_payload_vmo_unread_test(void) {
+    BEGIN_TEST;
+
+    mx_status_t status = NO_ERROR;
+    uint32_t rounds = KERNEL_MAX_HANDLES / PAYLOADS_PER_CHANNEL + 16u;
+    for (uint32_t round = 0; round < rounds && status == NO_ERROR; round++) {
+        mx_handle_t channel[2];
+        status = mx_channel_create(0, &channel[0], &channel[1]);
+        if (status != NO_ERROR)
+            break;
+        char byte = 0;
+        for (uint32_t i = 0; i < PAYLOADS_PER_CHANNEL && status == NO_ERROR; i++) {
+            status = mx_channel_write(channel[0], MX_CHANNEL_WRITE_PAYLOAD_VMO, &byte, 0u,
+                                      NULL, 0u);
+        }
+        mx_handle_close(channel[0]);
+        mx_handle_close(channel[1]);
+    }
+    EXPECT_EQ(status, NO_ERROR, "unread payload vmos were not freed");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(channel_tests)
 RUN_TEST(channel_test)
 RUN_TEST(channel_read_error_test)
@@ -445,6 +829,12 @@ RUN_TEST(channel_non_transferable)
 RUN_TEST(channel_duplicate_handles)
 RUN_TEST(channel_multithread_read)
 RUN_TEST(channel_may_discard)
+RUN_TEST(channel_call_test)
+RUN_TEST(channel_call_error_test)
+RUN_TEST(channel_callv_test)
+RUN_TEST(channel_iovec_test)
+RUN_TEST(channel_payload_vmo_test)
+RUN_TEST(channel_payload_vmo_unread_test)
 END_TEST_CASE(channel_tests)
 
 #ifndef BUILD_COMBINED_TESTS
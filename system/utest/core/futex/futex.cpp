@@ -331,6 +331,30 @@ bool test_futex_requeue() {
     END_TEST;
 }
 
+// Test requeueing a waiter along a chain of adjacent futexes.  The futex
+// table is split into buckets by address, so this moves the waiter between
+// buckets as well as within one.
+bool test_futex_requeue_chain() {
+    BEGIN_TEST;
+    volatile int futex_values[32] = {};
+    TestThread thread(&futex_values[0]);
+
+    for (size_t i = 0; i + 1 < countof(futex_values); i++) {
+        mx_status_t rc = mx_futex_requeue(
+            const_cast<int*>(&futex_values[i]), 0, futex_values[i],
+            const_cast<int*>(&futex_values[i + 1]), 1);
+        ASSERT_EQ(rc, NO_ERROR, "Error in requeue");
+        // Nothing is left waiting on the old futex.
+        rc = mx_futex_wake(const_cast<int*>(&futex_values[i]), INT_MAX);
+        ASSERT_EQ(rc, NO_ERROR, "Error in wake");
+        thread.assert_thread_not_woken();
+    }
+
+    check_futex_wake(&futex_values[countof(futex_values) - 1], 1);
+    thread.assert_thread_woken();
+    END_TEST;
+}
+
 // Test the case where futex_wait() times out after having been moved to a
 // different queue by futex_requeue().  Check that futex_wait() removes
 // itself from the correct queue in that case.
@@ -465,6 +489,7 @@ RUN_TEST(test_futex_unqueued_on_timeout_3);
 RUN_TEST(test_futex_requeue_value_mismatch);
 RUN_TEST(test_futex_requeue_same_addr);
 RUN_TEST(test_futex_requeue);
+RUN_TEST(test_futex_requeue_chain);
 RUN_TEST(test_futex_requeue_unqueued_on_timeout);
 RUN_TEST(test_futex_thread_killed);
 RUN_TEST(test_event_signaling);
@@ -6,6 +6,7 @@
 #include <threads.h>
 
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
 #include <magenta/syscalls/port.h>
 #include <unittest/unittest.h>
 
@@ -466,6 +467,117 @@ static bool port_timeout(void) {
     END_TEST;
 }
 
+static bool wait_many_test(void) {
+    BEGIN_TEST;
+    mx_status_t status;
+    mx_handle_t port;
+
+    status = mx_port_create(0xffu, &port);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "bad options");
+
+    status = mx_port_create(MX_PORT_OPT_NO_YIELD, &port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_user_packet_t out[3];
+    uint32_t count;
+    status = mx_port_wait_many(port, 0ull, out, sizeof(out[0]), 3u, &count);
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    mx_user_packet_t in = {};
+    for (uint64_t ix = 0; ix != 5u; ++ix) {
+        in.hdr.key = ix;
+        in.param[0] = ix * 10u;
+        status = mx_port_queue(port, &in, sizeof(in));
+        EXPECT_EQ(status, NO_ERROR, "");
+    }
+
+    // the first call takes as many as fit, the second gets the rest
+    status = mx_port_wait_many(port, MX_TIME_INFINITE, out, sizeof(out[0]), 3u, &count);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, 3u, "");
+    for (uint32_t ix = 0; ix != count; ++ix) {
+        EXPECT_EQ(out[ix].hdr.key, ix, "packets out of order");
+        EXPECT_EQ(out[ix].hdr.type, MX_PORT_PKT_TYPE_USER, "");
+        EXPECT_EQ(out[ix].param[0], ix * 10u, "");
+    }
+
+    status = mx_port_wait_many(port, 0ull, out, sizeof(out[0]), 3u, &count);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, 2u, "");
+    EXPECT_EQ(out[0].hdr.key, 3u, "");
+    EXPECT_EQ(out[1].hdr.key, 4u, "");
+
+    // a packet that does not fit the slot size stays queued
+    status = mx_port_queue(port, &in, sizeof(in));
+    EXPECT_EQ(status, NO_ERROR, "");
+    mx_packet_header_t small[2];
+    status = mx_port_wait_many(port, 0ull, small, sizeof(small[0]), 2u, &count);
+    EXPECT_EQ(status, ERR_BUFFER_TOO_SMALL, "");
+    status = mx_port_wait(port, 0ull, &out[0], sizeof(out[0]));
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_port_wait_many(port, 0ull, out, sizeof(out[0]), 0u, &count);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "zero count");
+
+    status = mx_handle_close(port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool get_port_info(mx_handle_t port, mx_record_port_t* rec) {
+    mx_info_port_t info;
+    mx_size_t actual;
+    mx_status_t status = mx_object_get_info(port, MX_INFO_PORT, sizeof(info.rec),
+                                            &info, sizeof(info), &actual);
+    *rec = info.rec;
+    return status == NO_ERROR && actual == sizeof(info);
+}
+
+static bool queue_full_test(void) {
+    BEGIN_TEST;
+    mx_status_t status;
+    mx_handle_t port;
+
+    status = mx_port_create(0u, &port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_record_port_t rec;
+    ASSERT_TRUE(get_port_info(port, &rec), "get_info failed");
+    EXPECT_EQ(rec.queued, 0u, "");
+    EXPECT_GT(rec.max_queued, 0u, "");
+    EXPECT_EQ(rec.pool_used, 0u, "");
+
+    // queue until the port pushes back
+    mx_user_packet_t pkt = {};
+    uint32_t queued = 0;
+    for (;;) {
+        pkt.hdr.key = queued;
+        status = mx_port_queue(port, &pkt, sizeof(pkt));
+        if (status != NO_ERROR)
+            break;
+        ++queued;
+    }
+    EXPECT_EQ(status, ERR_SHOULD_WAIT, "expected backpressure");
+    EXPECT_EQ(queued, rec.max_queued, "");
+
+    ASSERT_TRUE(get_port_info(port, &rec), "get_info failed");
+    EXPECT_EQ(rec.queued, queued, "");
+    EXPECT_EQ(rec.pool_used, queued, "");
+
+    // draining a packet makes room for another
+    status = mx_port_wait(port, 0ull, &pkt, sizeof(pkt));
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(pkt.hdr.key, 0u, "");
+    status = mx_port_queue(port, &pkt, sizeof(pkt));
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_handle_close(port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
 RUN_TEST(queue_and_close_test)
@@ -475,6 +587,8 @@ RUN_TEST(bind_channels_test)
 RUN_TEST(bind_sockets_test)
 RUN_TEST(bind_channels_playback)
 RUN_TEST(port_timeout)
+RUN_TEST(wait_many_test)
+RUN_TEST(queue_full_test)
 END_TEST_CASE(port_tests)
 
 #ifndef BUILD_COMBINED_TESTS
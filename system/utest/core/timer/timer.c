@@ -0,0 +1,163 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <magenta/syscalls/port.h>
+#include <unittest/unittest.h>
+
+static mx_time_t now(void) {
+    return mx_time_get(MX_CLOCK_MONOTONIC);
+}
+
+static mx_signals_t signals_state(mx_handle_t h) {
+    mx_signals_t pending = 0;
+    mx_handle_wait_one(h, 0u, 0u, &pending);
+    return pending;
+}
+
+static bool basic_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t timer;
+    ASSERT_EQ(mx_timer_create(0u, &timer), NO_ERROR, "");
+
+    mx_info_handle_basic_t info;
+    mx_size_t sz;
+    ASSERT_EQ(mx_object_get_info(timer, MX_INFO_HANDLE_BASIC, sizeof(info.rec), &info,
+                                 sizeof(info), &sz), NO_ERROR, "");
+    EXPECT_EQ(info.rec.type, (uint32_t)MX_OBJ_TYPE_TIMER, "wrong type");
+
+    EXPECT_EQ(signals_state(timer), 0u, "new timer is signaled");
+
+    mx_time_t deadline = now() + MX_MSEC(10);
+    ASSERT_EQ(mx_timer_set(timer, deadline, 0u), NO_ERROR, "");
+    EXPECT_EQ(signals_state(timer), 0u, "timer signaled before its deadline");
+
+    mx_signals_t pending = 0;
+    ASSERT_EQ(mx_handle_wait_one(timer, MX_TIMER_SIGNALED, MX_SEC(5), &pending), NO_ERROR, "");
+    EXPECT_EQ(pending, MX_TIMER_SIGNALED, "");
+    EXPECT_GE(now(), deadline, "timer signaled early");
+
+    // Setting the timer again clears the signal until the new deadline.
+    ASSERT_EQ(mx_timer_set(timer, now() + MX_SEC(1000), 0u), NO_ERROR, "");
+    EXPECT_EQ(signals_state(timer), 0u, "set did not clear the signal");
+
+    // A deadline in the past signals right away.
+    ASSERT_EQ(mx_timer_set(timer, 1u, 0u), NO_ERROR, "");
+    EXPECT_EQ(signals_state(timer), MX_TIMER_SIGNALED, "past deadline did not signal");
+
+    mx_handle_t bad_timer;
+    EXPECT_EQ(mx_timer_create(1u, &bad_timer), ERR_INVALID_ARGS, "bad options accepted");
+
+    EXPECT_EQ(mx_handle_close(timer), NO_ERROR, "");
+    END_TEST;
+}
+
+static bool cancel_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t timer;
+    ASSERT_EQ(mx_timer_create(0u, &timer), NO_ERROR, "");
+
+    ASSERT_EQ(mx_timer_set(timer, now() + MX_MSEC(20), 0u), NO_ERROR, "");
+    ASSERT_EQ(mx_timer_cancel(timer), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_wait_one(timer, MX_TIMER_SIGNALED, MX_MSEC(100), NULL), ERR_TIMED_OUT,
+              "canceled timer fired");
+
+    // Canceling also clears a signal that was already asserted.
+    ASSERT_EQ(mx_timer_set(timer, 1u, 0u), NO_ERROR, "");
+    EXPECT_EQ(signals_state(timer), MX_TIMER_SIGNALED, "");
+    ASSERT_EQ(mx_timer_cancel(timer), NO_ERROR, "");
+    EXPECT_EQ(signals_state(timer), 0u, "cancel did not clear the signal");
+
+    // Closing an armed timer must not leave anything behind to fire.
+    ASSERT_EQ(mx_timer_set(timer, now() + MX_MSEC(5), 0u), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(timer), NO_ERROR, "");
+    mx_nanosleep(MX_MSEC(20));
+
+    END_TEST;
+}
+
+#define NUM_TIMERS 64
+
+static bool wait_set_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t ws;
+    ASSERT_EQ(mx_waitset_create(0u, &ws), NO_ERROR, "");
+
+    // One thread multiplexing many timers, with enough slack that several share a wakeup.
+    mx_handle_t timers[NUM_TIMERS];
+    mx_time_t deadlines[NUM_TIMERS];
+    mx_time_t start = now();
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        ASSERT_EQ(mx_timer_create(0u, &timers[i]), NO_ERROR, "");
+        ASSERT_EQ(mx_waitset_add(ws, i, timers[i], MX_TIMER_SIGNALED, MX_WAITSET_EDGE_TRIGGERED),
+                  NO_ERROR, "");
+        deadlines[i] = start + MX_MSEC(5 + (i * 7) % 50);
+        ASSERT_EQ(mx_timer_set(timers[i], deadlines[i], MX_MSEC(5)), NO_ERROR, "");
+    }
+
+    bool fired[NUM_TIMERS] = {};
+    int remaining = NUM_TIMERS;
+    while (remaining > 0) {
+        mx_waitset_result_t results[NUM_TIMERS];
+        uint32_t count = NUM_TIMERS;
+        ASSERT_EQ(mx_waitset_wait(ws, MX_SEC(5), results, &count), NO_ERROR, "wait timed out");
+        mx_time_t t = now();
+        for (uint32_t j = 0; j < count; j++) {
+            uint64_t i = results[j].cookie;
+            ASSERT_LT(i, (uint64_t)NUM_TIMERS, "bad cookie");
+            EXPECT_EQ(results[j].observed & MX_TIMER_SIGNALED, MX_TIMER_SIGNALED, "");
+            EXPECT_GE(t, deadlines[i], "timer signaled early");
+            EXPECT_FALSE(fired[i], "timer reported twice");
+            fired[i] = true;
+            remaining--;
+        }
+    }
+
+    for (int i = 0; i < NUM_TIMERS; i++)
+        EXPECT_EQ(mx_handle_close(timers[i]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(ws), NO_ERROR, "");
+    END_TEST;
+}
+
+static bool port_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t port;
+    ASSERT_EQ(mx_port_create(0u, &port), NO_ERROR, "");
+
+    mx_handle_t timer;
+    ASSERT_EQ(mx_timer_create(0u, &timer), NO_ERROR, "");
+    ASSERT_EQ(mx_port_bind(port, 7u, timer, MX_TIMER_SIGNALED), NO_ERROR, "");
+
+    mx_time_t deadline = now() + MX_MSEC(10);
+    ASSERT_EQ(mx_timer_set(timer, deadline, 0u), NO_ERROR, "");
+
+    mx_io_packet_t packet;
+    ASSERT_EQ(mx_port_wait(port, MX_SEC(5), &packet, sizeof(packet)), NO_ERROR, "");
+    EXPECT_GE(now(), deadline, "timer signaled early");
+    EXPECT_EQ(packet.hdr.key, 7u, "key mismatch");
+    EXPECT_EQ(packet.hdr.type, MX_PORT_PKT_TYPE_IOSN, "type mismatch");
+    EXPECT_EQ(packet.signals, MX_TIMER_SIGNALED, "");
+
+    EXPECT_EQ(mx_handle_close(timer), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(port), NO_ERROR, "");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(timer_tests)
+RUN_TEST(basic_test)
+RUN_TEST(cancel_test)
+RUN_TEST(wait_set_test)
+RUN_TEST(port_test)
+END_TEST_CASE(timer_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
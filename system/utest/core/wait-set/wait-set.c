@@ -44,21 +44,21 @@ bool wait_set_add_remove_test(void) {
     ASSERT_GT(ws, 0, "mx_waitset_create() failed");
 
     const uint64_t cookie1 = 0u;
-    ASSERT_EQ(mx_waitset_add(ws, cookie1, ev[0], MX_USER_SIGNAL_0), NO_ERROR, "");
+    ASSERT_EQ(mx_waitset_add(ws, cookie1, ev[0], MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
 
     const uint64_t cookie2 = (uint64_t)-1;
-    ASSERT_EQ(mx_waitset_add(ws, cookie2, ev[1], MX_USER_SIGNAL_1), NO_ERROR, "");
+    ASSERT_EQ(mx_waitset_add(ws, cookie2, ev[1], MX_USER_SIGNAL_1, 0u), NO_ERROR, "");
 
     // Can add a handle that's already in there.
     const uint64_t cookie3 = 12345678901234567890ull;
-    ASSERT_EQ(mx_waitset_add(ws, cookie3, ev[0], MX_USER_SIGNAL_0 | MX_USER_SIGNAL_1), NO_ERROR,
+    ASSERT_EQ(mx_waitset_add(ws, cookie3, ev[0], MX_USER_SIGNAL_0 | MX_USER_SIGNAL_1, 0u), NO_ERROR,
               "");
 
     // Remove |cookie1|.
     ASSERT_EQ(mx_waitset_remove(ws, cookie1), NO_ERROR, "");
 
     // Now can reuse |cookie1|.
-    ASSERT_EQ(mx_waitset_add(ws, cookie1, ev[2], MX_USER_SIGNAL_0), NO_ERROR, "");
+    ASSERT_EQ(mx_waitset_add(ws, cookie1, ev[2], MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
 
     // Can close a handle (|ev[1]|) that's in a wait set.
     EXPECT_EQ(mx_handle_close(ev[1]), NO_ERROR, "");
@@ -89,16 +89,16 @@ bool wait_set_bad_add_remove_test(void) {
     ASSERT_GT(ws, 0, "mx_waitset_create() failed");
 
     const uint64_t cookie1 = 123u;
-    EXPECT_EQ(mx_waitset_add(MX_HANDLE_INVALID, cookie1, ev, MX_USER_SIGNAL_0), ERR_BAD_HANDLE,
+    EXPECT_EQ(mx_waitset_add(MX_HANDLE_INVALID, cookie1, ev, MX_USER_SIGNAL_0, 0u), ERR_BAD_HANDLE,
               "");
-    EXPECT_EQ(mx_waitset_add(ws, cookie1, MX_HANDLE_INVALID, MX_USER_SIGNAL_0), ERR_BAD_HANDLE,
+    EXPECT_EQ(mx_waitset_add(ws, cookie1, MX_HANDLE_INVALID, MX_USER_SIGNAL_0, 0u), ERR_BAD_HANDLE,
               "");
 
     EXPECT_EQ(mx_waitset_remove(MX_HANDLE_INVALID, cookie1), ERR_BAD_HANDLE, "");
     EXPECT_EQ(mx_waitset_remove(ws, cookie1), ERR_NOT_FOUND, "");
 
-    EXPECT_EQ(mx_waitset_add(ws, cookie1, ev, MX_USER_SIGNAL_0), NO_ERROR, "");
-    EXPECT_EQ(mx_waitset_add(ws, cookie1, ev, MX_USER_SIGNAL_0), ERR_ALREADY_EXISTS, "");
+    EXPECT_EQ(mx_waitset_add(ws, cookie1, ev, MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
+    EXPECT_EQ(mx_waitset_add(ws, cookie1, ev, MX_USER_SIGNAL_0, 0u), ERR_ALREADY_EXISTS, "");
 
     const uint64_t cookie2 = 456u;
     EXPECT_EQ(mx_waitset_remove(ws, cookie2), ERR_NOT_FOUND, "");
@@ -168,13 +168,13 @@ bool wait_set_wait_single_thread_1_test(void) {
     EXPECT_EQ(num_results, 5u, "mx_waitset_wait() modified num_results");
 
     const uint64_t cookie0 = 1u;
-    EXPECT_EQ(mx_waitset_add(ws, cookie0, ev[0], MX_USER_SIGNAL_0), NO_ERROR, "");
+    EXPECT_EQ(mx_waitset_add(ws, cookie0, ev[0], MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
     const uint64_t cookie1a = 2u;
-    EXPECT_EQ(mx_waitset_add(ws, cookie1a, ev[1], MX_USER_SIGNAL_0), NO_ERROR, "");
+    EXPECT_EQ(mx_waitset_add(ws, cookie1a, ev[1], MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
     const uint64_t cookie2 = 3u;
-    EXPECT_EQ(mx_waitset_add(ws, cookie2, ev[2], MX_USER_SIGNAL_0), NO_ERROR, "");
+    EXPECT_EQ(mx_waitset_add(ws, cookie2, ev[2], MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
     const uint64_t cookie1b = 4u;
-    EXPECT_EQ(mx_waitset_add(ws, cookie1b, ev[1], MX_USER_SIGNAL_0), NO_ERROR, "");
+    EXPECT_EQ(mx_waitset_add(ws, cookie1b, ev[1], MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
 
     num_results = 5u;
     // Nothing signaled; should still time out.
@@ -258,9 +258,9 @@ bool wait_set_wait_single_thread_2_test(void) {
     ASSERT_GT(ws, 0, "mx_waitset_create() failed");
 
     const uint64_t cookie1 = 987654321098765ull;
-    EXPECT_EQ(mx_waitset_add(ws, cookie1, mp[0], MX_SIGNAL_READABLE), NO_ERROR, "");
+    EXPECT_EQ(mx_waitset_add(ws, cookie1, mp[0], MX_SIGNAL_READABLE, 0u), NO_ERROR, "");
     const uint64_t cookie2 = 789023457890412ull;
-    EXPECT_EQ(mx_waitset_add(ws, cookie2, mp[0], MX_SIGNAL_PEER_CLOSED), NO_ERROR, "");
+    EXPECT_EQ(mx_waitset_add(ws, cookie2, mp[0], MX_SIGNAL_PEER_CLOSED, 0u), NO_ERROR, "");
 
     mx_waitset_result_t results[5] = {};
     uint32_t num_results = 5u;
@@ -316,7 +316,7 @@ bool wait_set_wait_threaded_test(void) {
     ASSERT_GT(ws, 0, "mx_waitset_create() failed");
 
     const uint64_t cookie = 123u;
-    EXPECT_EQ(mx_waitset_add(ws, cookie, ev, MX_USER_SIGNAL_0), NO_ERROR, "");
+    EXPECT_EQ(mx_waitset_add(ws, cookie, ev, MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
 
     thrd_t thread;
     ASSERT_EQ(thrd_create(&thread, signaler_thread_fn, &ev), thrd_success, "thrd_create() failed");
@@ -358,7 +358,7 @@ bool wait_set_wait_cancelled_test(void) {
     ASSERT_GT(ws, 0, "mx_waitset_create() failed");
 
     const uint64_t cookie = 123u;
-    EXPECT_EQ(mx_waitset_add(ws, cookie, ev, MX_USER_SIGNAL_0), NO_ERROR, "");
+    EXPECT_EQ(mx_waitset_add(ws, cookie, ev, MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
 
     // We close the wait set handle!
     thrd_t thread;
@@ -380,6 +380,101 @@ bool wait_set_wait_cancelled_test(void) {
     END_TEST;
 }
 
+bool wait_set_edge_triggered_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t ev[2];
+    ASSERT_EQ(mx_event_create(0u, &ev[0]), 0, "mx_event_create() failed");
+    ASSERT_EQ(mx_event_create(0u, &ev[1]), 0, "mx_event_create() failed");
+
+    mx_handle_t ws;
+    ASSERT_EQ(mx_waitset_create(0, &ws), NO_ERROR, "");
+
+    EXPECT_EQ(mx_waitset_add(ws, 1u, ev[0], MX_USER_SIGNAL_0, 0x80000000u), ERR_INVALID_ARGS, "");
+
+    // |ev[1]| is already signaled when added, which counts as an edge.
+    ASSERT_EQ(mx_object_signal(ev[1], 0u, MX_USER_SIGNAL_0), NO_ERROR, "");
+
+    const uint64_t cookie0 = 1u;
+    ASSERT_EQ(mx_waitset_add(ws, cookie0, ev[0], MX_USER_SIGNAL_0, MX_WAITSET_EDGE_TRIGGERED),
+              NO_ERROR, "");
+    const uint64_t cookie1 = 2u;
+    ASSERT_EQ(mx_waitset_add(ws, cookie1, ev[1], MX_USER_SIGNAL_0, MX_WAITSET_EDGE_TRIGGERED),
+              NO_ERROR, "");
+
+    mx_waitset_result_t results[4] = {};
+    uint32_t num_results = 4u;
+    ASSERT_EQ(mx_waitset_wait(ws, 0u, results, &num_results), NO_ERROR, "");
+    ASSERT_EQ(num_results, 1u, "wrong num_results from mx_waitset_wait()");
+    EXPECT_TRUE(check_results(num_results, results, cookie1, NO_ERROR, MX_USER_SIGNAL_0), "");
+
+    // Reported once; still signaled but no new edge, so nothing more to report.
+    num_results = 4u;
+    EXPECT_EQ(mx_waitset_wait(ws, 0u, results, &num_results), ERR_TIMED_OUT, "");
+
+    ASSERT_EQ(mx_object_signal(ev[0], 0u, MX_USER_SIGNAL_0), NO_ERROR, "");
+    num_results = 4u;
+    ASSERT_EQ(mx_waitset_wait(ws, 0u, results, &num_results), NO_ERROR, "");
+    ASSERT_EQ(num_results, 1u, "wrong num_results from mx_waitset_wait()");
+    EXPECT_TRUE(check_results(num_results, results, cookie0, NO_ERROR, MX_USER_SIGNAL_0), "");
+
+    // A triggered edge entry stays triggered even if the signal goes away before the wait.
+    ASSERT_EQ(mx_object_signal(ev[1], MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
+    ASSERT_EQ(mx_object_signal(ev[1], 0u, MX_USER_SIGNAL_0), NO_ERROR, "");
+    ASSERT_EQ(mx_object_signal(ev[1], MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
+    num_results = 4u;
+    ASSERT_EQ(mx_waitset_wait(ws, 0u, results, &num_results), NO_ERROR, "");
+    ASSERT_EQ(num_results, 1u, "wrong num_results from mx_waitset_wait()");
+    EXPECT_TRUE(check_results(num_results, results, cookie1, NO_ERROR, 0u), "");
+
+    // Closing the handle is reported until the entry is removed.
+    EXPECT_EQ(mx_handle_close(ev[0]), NO_ERROR, "");
+    for (int i = 0; i < 2; i++) {
+        num_results = 4u;
+        ASSERT_EQ(mx_waitset_wait(ws, 0u, results, &num_results), NO_ERROR, "");
+        ASSERT_EQ(num_results, 1u, "wrong num_results from mx_waitset_wait()");
+        EXPECT_TRUE(check_results(num_results, results, cookie0, ERR_HANDLE_CLOSED, 0u), "");
+    }
+    EXPECT_EQ(mx_waitset_remove(ws, cookie0), NO_ERROR, "");
+
+    EXPECT_EQ(mx_handle_close(ws), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(ev[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+bool wait_set_wait_fairness_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t ev[4];
+    mx_handle_t ws;
+    ASSERT_EQ(mx_waitset_create(0, &ws), NO_ERROR, "");
+    for (uint64_t i = 0; i < 4u; i++) {
+        ASSERT_EQ(mx_event_create(0u, &ev[i]), 0, "mx_event_create() failed");
+        ASSERT_EQ(mx_object_signal(ev[i], 0u, MX_USER_SIGNAL_0), NO_ERROR, "");
+        ASSERT_EQ(mx_waitset_add(ws, i, ev[i], MX_USER_SIGNAL_0, 0u), NO_ERROR, "");
+    }
+
+    // With room for one result at a time, every entry must come up once in four waits even
+    // though they all stay signaled.
+    unsigned seen = 0u;
+    for (int i = 0; i < 4; i++) {
+        mx_waitset_result_t result = {};
+        uint32_t num_results = 1u;
+        ASSERT_EQ(mx_waitset_wait(ws, 0u, &result, &num_results), NO_ERROR, "");
+        ASSERT_EQ(num_results, 1u, "wrong num_results from mx_waitset_wait()");
+        ASSERT_LT(result.cookie, 4u, "unexpected cookie");
+        seen |= 1u << result.cookie;
+    }
+    EXPECT_EQ(seen, 0xfu, "an entry was starved");
+
+    EXPECT_EQ(mx_handle_close(ws), NO_ERROR, "");
+    for (int i = 0; i < 4; i++)
+        EXPECT_EQ(mx_handle_close(ev[i]), NO_ERROR, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(wait_set_tests)
 RUN_TEST(wait_set_create_test)
 RUN_TEST(wait_set_add_remove_test)
@@ -388,6 +483,8 @@ RUN_TEST(wait_set_wait_single_thread_1_test)
 RUN_TEST(wait_set_wait_single_thread_2_test)
 RUN_TEST(wait_set_wait_threaded_test)
 RUN_TEST(wait_set_wait_cancelled_test)
+RUN_TEST(wait_set_edge_triggered_test)
+RUN_TEST(wait_set_wait_fairness_test)
 END_TEST_CASE(wait_set_tests)
 
 #ifndef BUILD_COMBINED_TESTS
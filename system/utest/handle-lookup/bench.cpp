@@ -0,0 +1,81 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+
+#include "bench.h"
+
+namespace {
+
+constexpr uint64_t kSecond = 1000000000u;
+constexpr uint64_t kRunTime = kSecond; // Per thread count.
+constexpr uint32_t kMaxThreads = 16u;
+
+struct LookupThreadArgs {
+    mx_handle_t handle;
+    mx_time_t deadline;
+    uint64_t calls;
+};
+
+int lookup_thread(void* arg) {
+    auto args = static_cast<LookupThreadArgs*>(arg);
+    mx_info_handle_basic_t info;
+    uint64_t calls = 0;
+    do {
+        // Check the time every so often so it does not dominate the loop.
+        for (int i = 0; i < 1000; i++) {
+            __UNUSED mx_status_t status = mx_object_get_info(
+                args->handle, MX_INFO_HANDLE_BASIC, sizeof(info.rec), &info, sizeof(info), nullptr);
+        }
+        calls += 1000;
+    } while (mx_time_get(MX_CLOCK_MONOTONIC) < args->deadline);
+    args->calls = calls;
+    return 0;
+}
+
+} // namespace
+
+int handle_lookup_run_benchmark() {
+    printf("starting handle lookup benchmark\n");
+
+    // All threads look up the same handle, which is the worst case for a
+    // per-process handle table lock.
+    mx_handle_t event;
+    if (mx_event_create(0u, &event) != NO_ERROR) {
+        printf("failed to create event\n");
+        return -1;
+    }
+
+    for (uint32_t num_threads = 1; num_threads <= kMaxThreads; num_threads *= 2) {
+        thrd_t threads[kMaxThreads];
+        LookupThreadArgs args[kMaxThreads];
+
+        mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + kRunTime;
+        for (uint32_t i = 0; i < num_threads; i++) {
+            args[i] = {event, deadline, 0u};
+            thrd_create_with_name(&threads[i], lookup_thread, &args[i], "lookup");
+        }
+
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < num_threads; i++) {
+            thrd_join(threads[i], nullptr);
+            total += args[i].calls;
+        }
+
+        uint64_t per_sec = total * kSecond / kRunTime;
+        printf("\t%2u threads: %10" PRIu64 " lookups/sec total, %10" PRIu64 " per thread\n",
+               num_threads, per_sec, per_sec / num_threads);
+    }
+
+    mx_handle_close(event);
+
+    printf("done with benchmark\n");
+    return 0;
+}
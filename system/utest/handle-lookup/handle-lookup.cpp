@@ -0,0 +1,133 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <unittest/unittest.h>
+
+#include "bench.h"
+
+static bool is_valid(mx_handle_t handle) {
+    return mx_object_get_info(handle, MX_INFO_HANDLE_VALID, 0, NULL, 0u, NULL) == NO_ERROR;
+}
+
+static bool stale_handle_test(void) {
+    BEGIN_TEST;
+
+    // A closed handle value must not alias a new handle, even when the
+    // kernel reuses the same slot for it.
+    for (int i = 0; i < 1000; i++) {
+        mx_handle_t old_event;
+        ASSERT_EQ(mx_event_create(0u, &old_event), NO_ERROR, "");
+        ASSERT_EQ(mx_handle_close(old_event), NO_ERROR, "");
+
+        mx_handle_t new_event;
+        ASSERT_EQ(mx_event_create(0u, &new_event), NO_ERROR, "");
+        EXPECT_TRUE(old_event != new_event, "stale handle value reused");
+        EXPECT_FALSE(is_valid(old_event), "stale handle value is valid");
+        EXPECT_TRUE(is_valid(new_event), "");
+        ASSERT_EQ(mx_handle_close(new_event), NO_ERROR, "");
+    }
+
+    END_TEST;
+}
+
+static bool transferred_handle_test(void) {
+    BEGIN_TEST;
+
+    // A handle that leaves the process and comes back gets a new value;
+    // the value it had before must stop working.
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0u, &channel[0], &channel[1]), NO_ERROR, "");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+    ASSERT_EQ(mx_channel_write(channel[0], 0u, NULL, 0u, &event, 1u), NO_ERROR, "");
+    EXPECT_FALSE(is_valid(event), "sent handle value is valid");
+
+    mx_handle_t received;
+    uint32_t num_bytes = 0u;
+    uint32_t num_handles = 1u;
+    ASSERT_EQ(mx_channel_read(channel[1], 0u, NULL, 0u, &num_bytes, &received, 1u,
+                              &num_handles), NO_ERROR, "");
+    ASSERT_EQ(num_handles, 1u, "");
+    EXPECT_TRUE(received != event, "handle value reused after transfer");
+    EXPECT_FALSE(is_valid(event), "old handle value is valid after transfer");
+    EXPECT_TRUE(is_valid(received), "");
+
+    ASSERT_EQ(mx_handle_close(received), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+struct LookupArgs {
+    mx_handle_t handle;
+    volatile bool done;
+    int failures;
+};
+
+static int lookup_thread(void* arg) {
+    LookupArgs* args = static_cast<LookupArgs*>(arg);
+    mx_info_handle_basic_t info;
+    while (!args->done) {
+        if (mx_object_get_info(args->handle, MX_INFO_HANDLE_BASIC, sizeof(info.rec),
+                               &info, sizeof(info), NULL) != NO_ERROR)
+            args->failures++;
+    }
+    return 0;
+}
+
+static bool concurrent_lookup_test(void) {
+    BEGIN_TEST;
+
+    constexpr int kNumThreads = 4;
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+
+    thrd_t threads[kNumThreads];
+    LookupArgs args[kNumThreads];
+    for (int i = 0; i < kNumThreads; i++) {
+        args[i] = {event, false, 0};
+        ASSERT_EQ(thrd_create_with_name(&threads[i], lookup_thread, &args[i], "lookup"),
+                  thrd_success, "");
+    }
+
+    // Churn the handle table while the lookups run.
+    for (int i = 0; i < 10000; i++) {
+        mx_handle_t dup;
+        ASSERT_EQ(mx_handle_duplicate(event, MX_RIGHT_SAME_RIGHTS, &dup), NO_ERROR, "");
+        ASSERT_EQ(mx_handle_close(dup), NO_ERROR, "");
+    }
+
+    for (int i = 0; i < kNumThreads; i++) {
+        args[i].done = true;
+        thrd_join(threads[i], NULL);
+        EXPECT_EQ(args[i].failures, 0, "lookup of a live handle failed");
+    }
+
+    ASSERT_EQ(mx_handle_close(event), NO_ERROR, "");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(handle_lookup_tests)
+RUN_TEST(stale_handle_test)
+RUN_TEST(transferred_handle_test)
+RUN_TEST(concurrent_lookup_test)
+END_TEST_CASE(handle_lookup_tests)
+
+int main(int argc, char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+        return handle_lookup_run_benchmark();
+
+    bool success = unittest_run_all_tests(argc, argv);
+    return success ? 0 : -1;
+}
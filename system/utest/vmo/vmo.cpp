@@ -525,6 +525,167 @@ bool vmo_commit_test() {
     END_TEST;
 }
 
+bool vmo_clone_test() {
+    BEGIN_TEST;
+
+    mx_handle_t vmo;
+    mx_handle_t clone;
+    mx_status_t status;
+    mx_size_t n;
+    const size_t size = PAGE_SIZE * 4;
+
+    status = mx_vmo_create(size, 0, &vmo);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_create");
+
+    // fill each page with its index
+    char buf[PAGE_SIZE];
+    for (size_t i = 0; i < size / PAGE_SIZE; i++) {
+        memset(buf, (int)i + 1, sizeof(buf));
+        status = mx_vmo_write(vmo, buf, i * PAGE_SIZE, sizeof(buf), &n);
+        EXPECT_EQ(NO_ERROR, status, "vm_object_write");
+    }
+
+    // offset must be page aligned
+    status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 1, size, &clone);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_clone unaligned");
+
+    status = mx_vmo_clone(vmo, 0, 0, size, &clone);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_clone bad options");
+
+    // clone the last three pages, plus one past the end of the parent
+    status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, PAGE_SIZE, size, &clone);
+    EXPECT_EQ(NO_ERROR, status, "vm_clone");
+
+    uintptr_t ptr;
+    status = mx_process_map_vm(mx_process_self(), clone, 0, size, &ptr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    EXPECT_EQ(NO_ERROR, status, "vm_map");
+
+    // the clone starts out with the parent's contents, and zeros past its end
+    volatile uint8_t* p = (volatile uint8_t*)ptr;
+    EXPECT_EQ(2, p[0], "clone page 0");
+    EXPECT_EQ(3, p[PAGE_SIZE], "clone page 1");
+    EXPECT_EQ(4, p[PAGE_SIZE * 2], "clone page 2");
+    EXPECT_EQ(0, p[PAGE_SIZE * 3], "clone page past parent");
+
+    // writing to the clone does not change the parent
+    p[0] = 0x99;
+    EXPECT_EQ(0x99, p[0], "clone write");
+    status = mx_vmo_read(vmo, buf, PAGE_SIZE, 1, &n);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_read");
+    EXPECT_EQ(2, buf[0], "parent after clone write");
+
+    // writing to the clone through vmo_write replaces the shared mapping
+    buf[0] = 0x77;
+    status = mx_vmo_write(clone, buf, PAGE_SIZE, 1, &n);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_write clone");
+    EXPECT_EQ(0x77, p[PAGE_SIZE], "clone mapping after vmo_write");
+
+    // the clone keeps the pages it shares when the parent lets go of them
+    status = mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, PAGE_SIZE * 3, PAGE_SIZE, NULL, 0);
+    EXPECT_EQ(NO_ERROR, status, "decommit with clone");
+    EXPECT_EQ(4, p[PAGE_SIZE * 2], "clone page 2 after parent decommit");
+    status = mx_vmo_set_size(vmo, 0);
+    EXPECT_EQ(NO_ERROR, status, "shrink with clone");
+    EXPECT_EQ(0x99, p[0], "clone page 0 after parent shrink");
+    EXPECT_EQ(0x77, p[PAGE_SIZE], "clone page 1 after parent shrink");
+    EXPECT_EQ(4, p[PAGE_SIZE * 2], "clone page 2 after parent shrink");
+
+    status = mx_process_unmap_vm(mx_process_self(), ptr, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_unmap");
+    status = mx_handle_close(clone);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+
+    status = mx_handle_close(vmo);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+
+    END_TEST;
+}
+
+bool vmo_clone_snapshot_test() {
+    BEGIN_TEST;
+
+    mx_handle_t vmo;
+    mx_handle_t clone;
+    mx_handle_t clone2;
+    mx_status_t status;
+    mx_size_t n;
+    const size_t size = PAGE_SIZE * 2;
+
+    // only the first page is committed in the parent
+    status = mx_vmo_create(size, 0, &vmo);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_create");
+    char buf[PAGE_SIZE];
+    memset(buf, 0x11, sizeof(buf));
+    status = mx_vmo_write(vmo, buf, 0, PAGE_SIZE, &n);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_write");
+
+    status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, size, &clone);
+    EXPECT_EQ(NO_ERROR, status, "vm_clone");
+
+    uintptr_t ptr;
+    status = mx_process_map_vm(mx_process_self(), clone, 0, size, &ptr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    EXPECT_EQ(NO_ERROR, status, "vm_map");
+    volatile uint8_t* p = (volatile uint8_t*)ptr;
+
+    uintptr_t parent_ptr;
+    status = mx_process_map_vm(mx_process_self(), vmo, 0, size, &parent_ptr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    EXPECT_EQ(NO_ERROR, status, "vm_map parent");
+    volatile uint8_t* pp = (volatile uint8_t*)parent_ptr;
+
+    EXPECT_EQ(0x11, p[0], "clone page 0 before parent write");
+    EXPECT_EQ(0, p[PAGE_SIZE], "clone page 1 before parent write");
+
+    // the parent's writes, through a mapping it first read through and with
+    // vmo_write, are not visible in the clone
+    EXPECT_EQ(0x11, pp[0], "parent page 0 before parent write");
+    pp[0] = 0x42;
+    memset(buf, 0x42, sizeof(buf));
+    status = mx_vmo_write(vmo, buf, PAGE_SIZE, PAGE_SIZE, &n);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_write");
+    EXPECT_EQ(0x11, p[0], "clone page 0 after parent write");
+    status = mx_vmo_read(clone, buf, PAGE_SIZE, 1, &n);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_read clone");
+    EXPECT_EQ(0, buf[0], "clone page 1 after parent write");
+
+    // a clone of the clone is a snapshot of the clone in turn
+    status = mx_vmo_clone(clone, MX_VMO_CLONE_COPY_ON_WRITE, 0, size, &clone2);
+    EXPECT_EQ(NO_ERROR, status, "vm_clone of clone");
+    uintptr_t ptr2;
+    status = mx_process_map_vm(mx_process_self(), clone2, 0, size, &ptr2, MX_VM_FLAG_PERM_READ);
+    EXPECT_EQ(NO_ERROR, status, "vm_map");
+    volatile uint8_t* p2 = (volatile uint8_t*)ptr2;
+    EXPECT_EQ(0x11, p2[0], "clone of clone before clone write");
+
+    p[0] = 0x55;
+    EXPECT_EQ(0x55, p[0], "clone after clone write");
+    EXPECT_EQ(0x11, p2[0], "clone of clone after clone write");
+    EXPECT_EQ(0x42, pp[0], "parent after clone write");
+
+    // truncating the parent leaves both clones alone
+    status = mx_process_unmap_vm(mx_process_self(), parent_ptr, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_unmap parent");
+    status = mx_vmo_set_size(vmo, 0);
+    EXPECT_EQ(NO_ERROR, status, "shrink with clones");
+    EXPECT_EQ(0x55, p[0], "clone after parent shrink");
+    EXPECT_EQ(0x11, p2[0], "clone of clone after parent shrink");
+
+    status = mx_process_unmap_vm(mx_process_self(), ptr2, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_unmap");
+    status = mx_handle_close(clone2);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+    status = mx_process_unmap_vm(mx_process_self(), ptr, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_unmap");
+    status = mx_handle_close(clone);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+    status = mx_handle_close(vmo);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(vmo_tests)
 RUN_TEST(vmo_create_test);
 RUN_TEST(vmo_read_write_test);
@@ -534,6 +695,8 @@ RUN_TEST(vmo_resize_test);
 RUN_TEST(vmo_rights_test);
 RUN_TEST(vmo_lookup_test);
 RUN_TEST(vmo_commit_test);
+RUN_TEST(vmo_clone_test);
+RUN_TEST(vmo_clone_snapshot_test);
 END_TEST_CASE(vmo_tests)
 
 int main(int argc, char** argv) {